@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define CLOCK_PLL_FRAC_BITS 8 // fixed point fraction of the time estimates
+
+// loop gains as right shifts of the phase error: phase correction 1/8, period correction 1/64
+#define CLOCK_PLL_PHASE_SHIFT 3
+#define CLOCK_PLL_PERIOD_SHIFT 6
+
+// a pulse that is this many periods late means the clock was stopped, the loop relocks
+#define CLOCK_PLL_TIMEOUT_PERIODS 4
+
+#define CLOCK_PLL_NO_TICK INT64_MAX
+
+
+// second order pll following an external clock. It smooths the pulse intervals
+// and schedules `ratio` ticks per pulse, interpolated between pulses
+typedef struct {
+    uint8_t ratio;
+
+    // timing estimates (µs << CLOCK_PLL_FRAC_BITS)
+    int64_t period;
+    int64_t phase; // ideal time of the last pulse
+    int64_t last_timestamp;
+    uint8_t timing_pulses; // pulses since the loop (re)locked, saturates at 2
+
+    // tick accounting while running
+    bool running;
+    uint32_t pulses; // pulses since start
+    uint32_t ticks; // ticks emitted since start
+} clock_pll_t;
+
+
+void clock_pll_init(clock_pll_t *pll, uint8_t ratio);
+
+void clock_pll_pulse(clock_pll_t *pll, int64_t timestamp);
+
+void clock_pll_start(clock_pll_t *pll);
+void clock_pll_stop(clock_pll_t *pll);
+
+uint32_t clock_pll_poll(clock_pll_t *pll, int64_t now, int64_t *next_tick);
+
+bool clock_pll_is_locked(clock_pll_t *pll);
+int64_t clock_pll_get_period_us(clock_pll_t *pll);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include "midi_message.h"
+#include "sequencer.h"
+#include "sequencer_config.h"
+#include "clock_pll.h"
+#include "callback.h"
+
+
+// sequencer ticks per midi clock pulse
+#define MIDI_CLOCK_TICKS_PER_PULSE (SEQ_PPQN / MIDI_CLOCK_PPQN)
+
+// song position pointer unit (one midi beat = one 16th note)
+#define MIDI_CLOCK_TICKS_PER_BEAT SEQ_TICKS_PER_SIXTEENTH_NOTE
+
+
+typedef enum {
+    MIDI_CLOCK_OFF,
+    MIDI_CLOCK_MASTER, // send clock and transport from the sequencer
+    MIDI_CLOCK_SLAVE // drive the sequencer from received clock and transport
+} midi_clock_mode_t;
+
+typedef struct midi_clock_t midi_clock_t;
+CALLBACK_DECLARE(midi_clock_send, esp_err_t,
+    const midi_message_t *message);
+
+typedef struct {
+    struct {
+        void *context;
+        CALLBACK_TYPE(midi_clock_send) send;
+    } callbacks;
+    sequencer_t *sequencer;
+    midi_clock_mode_t mode;
+} midi_clock_config_t;
+
+struct midi_clock_t {
+    midi_clock_config_t config;
+
+    // slave mode: the pll is fed from the midi task and polled from the tick timer
+    clock_pll_t pll;
+    portMUX_TYPE lock;
+    esp_timer_handle_t timer;
+};
+
+
+esp_err_t midi_clock_init(midi_clock_t *clock, const midi_clock_config_t *config);
+esp_err_t midi_clock_set_mode(midi_clock_t *clock, midi_clock_mode_t mode);
+
+esp_err_t midi_clock_sequencer_event(midi_clock_t *clock, sequencer_event_t event, sequencer_t *sequencer, void *data);
+esp_err_t midi_clock_recv(midi_clock_t *clock, const midi_message_t *message, int64_t timestamp);
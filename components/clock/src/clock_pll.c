@@ -0,0 +1,108 @@
+#include "clock_pll.h"
+
+
+#define TO_FIXED(t) ((int64_t) (t) << CLOCK_PLL_FRAC_BITS)
+#define FROM_FIXED(t) ((t) >> CLOCK_PLL_FRAC_BITS)
+
+
+void clock_pll_init(clock_pll_t *pll, uint8_t ratio) {
+    pll->ratio = ratio;
+    pll->period = 0;
+    pll->phase = 0;
+    pll->last_timestamp = 0;
+    pll->timing_pulses = 0;
+
+    pll->running = false;
+    pll->pulses = 0;
+    pll->ticks = 0;
+}
+
+void clock_pll_pulse(clock_pll_t *pll, int64_t timestamp) {
+    int64_t t = TO_FIXED(timestamp);
+
+    // relock if the clock stopped for a while
+    if (pll->timing_pulses >= 2 && t - pll->last_timestamp > pll->period * CLOCK_PLL_TIMEOUT_PERIODS) {
+        pll->timing_pulses = 0;
+    }
+
+    switch (pll->timing_pulses) {
+        case 0:
+            // first pulse only gives the phase
+            pll->phase = t;
+            pll->timing_pulses = 1;
+            break;
+        case 1:
+            // second pulse gives the initial period. Pulses of one usb transfer share their
+            // timestamp, they give no period yet
+            if (t - pll->last_timestamp <= 0) break;
+            pll->period = t - pll->last_timestamp;
+            pll->phase = t;
+            pll->timing_pulses = 2;
+            break;
+        default:;
+            // correct phase and period by a fraction of the prediction error
+            int64_t predicted = pll->phase + pll->period;
+            int64_t error = t - predicted;
+            pll->phase = predicted + (error >> CLOCK_PLL_PHASE_SHIFT);
+            pll->period += error >> CLOCK_PLL_PERIOD_SHIFT;
+            if (pll->period < 1) pll->period = 1; // clock_pll_poll divides by it
+            break;
+    }
+
+    pll->last_timestamp = t;
+    if (pll->running) pll->pulses++;
+}
+
+void clock_pll_start(clock_pll_t *pll) {
+    // the next pulse is tick 0
+    pll->running = true;
+    pll->pulses = 0;
+    pll->ticks = 0;
+}
+
+void clock_pll_stop(clock_pll_t *pll) {
+    pll->running = false;
+}
+
+uint32_t clock_pll_poll(clock_pll_t *pll, int64_t now, int64_t *next_tick) {
+    uint32_t base, due, n;
+    int64_t k;
+
+    *next_tick = CLOCK_PLL_NO_TICK;
+    if (!pll->running || pll->pulses == 0) return 0;
+
+    // the last pulse is tick `base`, its interval holds the ticks up to base + ratio - 1
+    base = (pll->pulses - 1) * pll->ratio;
+
+    if (pll->timing_pulses < 2) {
+        // no period estimate yet, only tick on the pulses
+        due = base + 1;
+    } else {
+        // interpolate between pulses. The tick of the next pulse may run ahead of it
+        // by the phase error, but never further than that
+        k = (TO_FIXED(now) - pll->phase) * pll->ratio;
+        k = k >= 0 ? k / pll->period : -((-k + pll->period - 1) / pll->period);
+        if (k > pll->ratio) k = pll->ratio;
+        due = base + 1 + (k < -1 ? -1 : k);
+    }
+
+    n = due > pll->ticks ? due - pll->ticks : 0;
+    pll->ticks += n;
+
+    // schedule the next interpolated tick, unless we have to wait for a pulse.
+    // Rounded up, so the tick is due when the timer fires
+    if (pll->timing_pulses >= 2 && pll->ticks <= base + pll->ratio) {
+        int64_t t = pll->phase + (pll->period * (int64_t) (pll->ticks - base) + pll->ratio - 1) / pll->ratio;
+        *next_tick = FROM_FIXED(t + TO_FIXED(1) - 1);
+    }
+
+    return n;
+}
+
+bool clock_pll_is_locked(clock_pll_t *pll) {
+    return pll->timing_pulses >= 2;
+}
+
+int64_t clock_pll_get_period_us(clock_pll_t *pll) {
+    return FROM_FIXED(pll->period);
+}
@@ -0,0 +1,196 @@
+#include "midi_clock.h"
+#include <freertos/task.h>
+#include <esp_check.h>
+
+
+static const char *TAG = "midi_clock";
+
+
+static esp_err_t midi_clock_send_command(midi_clock_t *clock, uint8_t command) {
+    const midi_message_t message = { .command = command, .channel = 0 };
+    return CALLBACK_INVOKE(&clock->config.callbacks, send, &message);
+}
+
+static esp_err_t midi_clock_send_song_position(midi_clock_t *clock, uint32_t playhead) {
+    uint16_t beats = playhead / MIDI_CLOCK_TICKS_PER_BEAT;
+
+    // the body carries the raw 7 bit lsb and msb data bytes
+    const midi_message_t message = {
+        .command = MIDI_COMMAND_SONG_POSITION,
+        .channel = 0,
+        .body = { beats & 0x7F, (beats >> 7) & 0x7F }
+    };
+    return CALLBACK_INVOKE(&clock->config.callbacks, send, &message);
+}
+
+static void midi_clock_timer_callback(void *arg) {
+    midi_clock_t *clock = (midi_clock_t *) arg;
+    int64_t now = esp_timer_get_time(), next_tick;
+    uint32_t n;
+    esp_err_t err;
+
+    taskENTER_CRITICAL(&clock->lock);
+    n = clock_pll_poll(&clock->pll, now, &next_tick);
+    taskEXIT_CRITICAL(&clock->lock);
+
+    // run the ticks that are due, late ones are caught up right away
+    while (n-- > 0) {
+        err = sequencer_tick_external(clock->config.sequencer);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "failed to tick sequencer: %s", esp_err_to_name(err));
+        }
+    }
+
+    // wait for the next interpolated tick (or for the next pulse to restart the timer)
+    if (next_tick != CLOCK_PLL_NO_TICK) {
+        now = esp_timer_get_time();
+        esp_timer_start_once(clock->timer, next_tick > now ? next_tick - now : 0);
+    }
+}
+
+static esp_err_t midi_clock_slave_pulse(midi_clock_t *clock, int64_t timestamp) {
+    taskENTER_CRITICAL(&clock->lock);
+    clock_pll_pulse(&clock->pll, timestamp);
+    taskEXIT_CRITICAL(&clock->lock);
+
+    // let the timer poll the pll right away, the pulse may make ticks due
+    esp_timer_stop(clock->timer);
+    ESP_RETURN_ON_ERROR(esp_timer_start_once(clock->timer, 0),
+        TAG, "failed to start tick timer");
+
+    return ESP_OK;
+}
+
+static esp_err_t midi_clock_slave_transport(midi_clock_t *clock, const midi_message_t *message) {
+    sequencer_t *sequencer = clock->config.sequencer;
+
+    switch (message->command) {
+        case MIDI_COMMAND_START:
+            ESP_RETURN_ON_ERROR(sequencer_seek(sequencer, 0),
+                TAG, "failed to seek sequencer");
+            // fall through
+        case MIDI_COMMAND_CONTINUE:
+            // the next pulse plays the current playhead
+            taskENTER_CRITICAL(&clock->lock);
+            clock_pll_start(&clock->pll);
+            taskEXIT_CRITICAL(&clock->lock);
+
+            ESP_RETURN_ON_ERROR(sequencer_play(sequencer),
+                TAG, "failed to start sequencer");
+            break;
+        case MIDI_COMMAND_STOP:
+            taskENTER_CRITICAL(&clock->lock);
+            clock_pll_stop(&clock->pll);
+            taskEXIT_CRITICAL(&clock->lock);
+
+            ESP_RETURN_ON_ERROR(sequencer_pause(sequencer),
+                TAG, "failed to stop sequencer");
+            break;
+        case MIDI_COMMAND_SONG_POSITION:;
+            // position changes are only allowed while stopped
+            if (sequencer->playing) break;
+
+            uint32_t beats = message->body[0] | (message->body[1] << 7);
+            ESP_RETURN_ON_ERROR(sequencer_seek(sequencer, beats * MIDI_CLOCK_TICKS_PER_BEAT),
+                TAG, "failed to seek sequencer");
+            break;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t midi_clock_init(midi_clock_t *clock, const midi_clock_config_t *config) {
+    clock->config = *config;
+    clock->config.mode = MIDI_CLOCK_OFF;
+    clock->lock = (portMUX_TYPE) portMUX_INITIALIZER_UNLOCKED;
+    clock_pll_init(&clock->pll, MIDI_CLOCK_TICKS_PER_PULSE);
+
+    // create the slave tick timer
+    const esp_timer_create_args_t timer_config = {
+        .name = "midi_clock_tick",
+        .callback = midi_clock_timer_callback,
+        .arg = clock
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&timer_config, &clock->timer),
+        TAG, "failed to create timer");
+
+    return midi_clock_set_mode(clock, config->mode);
+}
+
+esp_err_t midi_clock_set_mode(midi_clock_t *clock, midi_clock_mode_t mode) {
+    sequencer_t *sequencer = clock->config.sequencer;
+
+    if (clock->config.mode == mode) return ESP_OK;
+    clock->config.mode = mode;
+
+    // leaving slave mode stops the interpolated ticks
+    esp_timer_stop(clock->timer);
+    clock_pll_init(&clock->pll, MIDI_CLOCK_TICKS_PER_PULSE);
+
+    ESP_RETURN_ON_ERROR(sequencer_set_clock_source(sequencer,
+            mode == MIDI_CLOCK_SLAVE ? SEQUENCER_CLOCK_EXTERNAL : SEQUENCER_CLOCK_INTERNAL),
+        TAG, "failed to set sequencer clock source");
+
+    // a slave joining a running sequencer continues on the next pulse
+    if (mode == MIDI_CLOCK_SLAVE && sequencer->playing) {
+        clock_pll_start(&clock->pll);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t midi_clock_sequencer_event(midi_clock_t *clock, sequencer_event_t event, sequencer_t *sequencer, void *data) {
+    if (clock->config.mode != MIDI_CLOCK_MASTER) return ESP_OK;
+
+    switch (event) {
+        case SEQUENCER_CLOCK:
+            // every MIDI_CLOCK_TICKS_PER_PULSE-th tick is a clock pulse
+            if (*(uint32_t *) data % MIDI_CLOCK_TICKS_PER_PULSE == 0) {
+                ESP_RETURN_ON_ERROR(midi_clock_send_command(clock, MIDI_COMMAND_CLOCK),
+                    TAG, "failed to send clock");
+            }
+            break;
+        case SEQUENCER_PLAY:
+            // start from the top, otherwise tell the slaves where to continue
+            if (sequencer->playhead == 0) {
+                ESP_RETURN_ON_ERROR(midi_clock_send_command(clock, MIDI_COMMAND_START),
+                    TAG, "failed to send start");
+            } else {
+                ESP_RETURN_ON_ERROR(midi_clock_send_song_position(clock, sequencer->playhead),
+                    TAG, "failed to send song position");
+                ESP_RETURN_ON_ERROR(midi_clock_send_command(clock, MIDI_COMMAND_CONTINUE),
+                    TAG, "failed to send continue");
+            }
+            break;
+        case SEQUENCER_PAUSE:
+            ESP_RETURN_ON_ERROR(midi_clock_send_command(clock, MIDI_COMMAND_STOP),
+                TAG, "failed to send stop");
+            break;
+        case SEQUENCER_SEEK:
+            if (!sequencer->playing) {
+                ESP_RETURN_ON_ERROR(midi_clock_send_song_position(clock, *(uint32_t *) data),
+                    TAG, "failed to send song position");
+            }
+            break;
+        default:
+            break;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t midi_clock_recv(midi_clock_t *clock, const midi_message_t *message, int64_t timestamp) {
+    if (clock->config.mode != MIDI_CLOCK_SLAVE) return ESP_OK;
+
+    switch (message->command) {
+        case MIDI_COMMAND_CLOCK:
+            return midi_clock_slave_pulse(clock, timestamp);
+        case MIDI_COMMAND_START:
+        case MIDI_COMMAND_CONTINUE:
+        case MIDI_COMMAND_STOP:
+        case MIDI_COMMAND_SONG_POSITION:
+            return midi_clock_slave_transport(clock, message);
+        default:
+            return ESP_OK;
+    }
+}
@@ -0,0 +1,122 @@
+#include "bdd-for-c.h"
+#include "clock_pll.h"
+#include "clock_sim.h"
+
+
+spec("clock pll") {
+    static clock_pll_t pll;
+    int64_t next_tick;
+
+    before_each() {
+        clock_pll_init(&pll, 2);
+    }
+
+    it("should only tick while running") {
+        clock_pll_pulse(&pll, 1000);
+        expect(clock_pll_poll(&pll, 1000, &next_tick)) to_be(0);
+        expect(next_tick) to_be(CLOCK_PLL_NO_TICK);
+    }
+
+    it("should tick on pulses until the period is known") {
+        clock_pll_start(&pll);
+        clock_pll_pulse(&pll, 1000);
+
+        expect(clock_pll_poll(&pll, 1000, &next_tick)) to_be(1);
+        expect(clock_pll_poll(&pll, 5000, &next_tick)) to_be(0);
+        expect(next_tick) to_be(CLOCK_PLL_NO_TICK);
+        expect(clock_pll_is_locked(&pll)) to_be_false();
+    }
+
+    it("should not take a period from pulses with the same timestamp") {
+        // two clock bytes of one usb transfer
+        clock_pll_start(&pll);
+        clock_pll_pulse(&pll, 1000);
+        clock_pll_pulse(&pll, 1000);
+
+        expect(clock_pll_is_locked(&pll)) to_be_false();
+        expect(clock_pll_poll(&pll, 1000, &next_tick)) to_be(3);
+        expect(next_tick) to_be(CLOCK_PLL_NO_TICK);
+
+        clock_pll_pulse(&pll, 21000);
+        expect(clock_pll_is_locked(&pll)) to_be_true();
+        expect(clock_pll_get_period_us(&pll)) to_be(20000);
+
+        // a locked clock keeps a usable period through a burst of them
+        for (int i = 0; i < 64; i++) clock_pll_pulse(&pll, 21000);
+        check(pll.period >= 1);
+        clock_pll_poll(&pll, 21000, &next_tick);
+    }
+
+    it("should interpolate between pulses of a steady clock") {
+        clock_pll_start(&pll);
+        clock_pll_pulse(&pll, 0);
+        clock_pll_poll(&pll, 0, &next_tick);
+        clock_pll_pulse(&pll, 20000);
+
+        expect(clock_pll_is_locked(&pll)) to_be_true();
+        expect(clock_pll_get_period_us(&pll)) to_be(20000);
+
+        // tick 1 could not be interpolated before the lock, it is caught up with tick 2
+        expect(clock_pll_poll(&pll, 20000, &next_tick)) to_be(2);
+        expect(next_tick) to_be(30000);
+        expect(clock_pll_poll(&pll, 30000, &next_tick)) to_be(1);
+        expect(next_tick) to_be(40000);
+    }
+
+    it("should run at most one tick ahead of a missing pulse") {
+        clock_pll_start(&pll);
+        clock_pll_pulse(&pll, 0);
+        clock_pll_poll(&pll, 0, &next_tick);
+        clock_pll_pulse(&pll, 20000);
+
+        expect(clock_pll_poll(&pll, 100000, &next_tick)) to_be(4);
+        expect(next_tick) to_be(CLOCK_PLL_NO_TICK);
+        expect(pll.ticks) to_be(5);
+    }
+
+    it("should catch up when pulses come in early") {
+        clock_pll_start(&pll);
+        clock_pll_pulse(&pll, 0);
+        clock_pll_poll(&pll, 0, &next_tick);
+        clock_pll_pulse(&pll, 20000);
+        clock_pll_poll(&pll, 20000, &next_tick);
+
+        // the tick at 30000 was not run yet
+        clock_pll_pulse(&pll, 32000);
+        clock_pll_pulse(&pll, 44000);
+        expect(clock_pll_poll(&pll, 44000, &next_tick)) to_be_greater_than(1);
+        expect(pll.ticks) to_be_greater_than(5);
+    }
+
+    it("should relock after the clock stopped") {
+        clock_pll_pulse(&pll, 0);
+        clock_pll_pulse(&pll, 20000);
+        clock_pll_pulse(&pll, 1000000);
+
+        expect(clock_pll_is_locked(&pll)) to_be_false();
+        clock_pll_pulse(&pll, 1010000);
+        expect(clock_pll_get_period_us(&pll)) to_be(10000);
+    }
+
+    it("should keep the phase error below the input jitter") {
+        const clock_sim_config_t config = {
+            .bpm_start = 120, .bpm_end = 120, .jitter_us = 2000, .num_pulses = 2400, .ratio = 2
+        };
+        clock_sim_result_t result;
+
+        clock_sim_run(&config, &result);
+        expect(result.ticks) to_be_greater_than(4700);
+        expect(result.phase_error_us < result.input_jitter_us) to_be_true();
+        expect(result.tick_jitter_us < result.input_jitter_us) to_be_true();
+    }
+
+    it("should follow tempo changes") {
+        const clock_sim_config_t config = {
+            .bpm_start = 90, .bpm_end = 150, .jitter_us = 1000, .num_pulses = 2400, .ratio = 2
+        };
+        clock_sim_result_t result;
+
+        clock_sim_run(&config, &result);
+        expect(result.max_phase_error_us < 3000) to_be_true();
+    }
+}
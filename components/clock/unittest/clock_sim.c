@@ -0,0 +1,85 @@
+#include "clock_sim.h"
+#include <math.h>
+#include <stdlib.h>
+
+
+#define CLOCK_SIM_SETTLE_PULSES 96
+#define CLOCK_SIM_MAX_TICKS 65536
+
+
+static uint32_t sim_state = 0x12345678;
+
+static int64_t clock_sim_jitter(int64_t jitter_us) {
+    // xorshift32, deterministic so the reports can be compared
+    sim_state ^= sim_state << 13;
+    sim_state ^= sim_state >> 17;
+    sim_state ^= sim_state << 5;
+    return jitter_us ? (int64_t) (sim_state % (2 * jitter_us + 1)) - jitter_us : 0;
+}
+
+void clock_sim_run(const clock_sim_config_t *config, clock_sim_result_t *result) {
+    static double ideal_pulses[CLOCK_SIM_MAX_TICKS];
+    static int64_t arrivals[CLOCK_SIM_MAX_TICKS];
+    static int64_t tick_times[CLOCK_SIM_MAX_TICKS];
+    clock_pll_t pll;
+    double ideal = 1000000, input_sum = 0;
+    uint32_t ticks = 0, n;
+    int64_t next_tick;
+
+    clock_pll_init(&pll, config->ratio);
+    clock_pll_start(&pll);
+
+    // ideal pulse times of the ramping tempo
+    for (uint32_t p = 0; p <= config->num_pulses && p < CLOCK_SIM_MAX_TICKS; p++) {
+        double bpm = config->bpm_start + (config->bpm_end - config->bpm_start) * p / config->num_pulses;
+        ideal_pulses[p] = ideal;
+        ideal += 60000000.0 / (bpm * 24);
+    }
+
+    // jittery arrival times of the pulses
+    for (uint32_t p = 0; p < config->num_pulses; p++) {
+        arrivals[p] = (int64_t) ideal_pulses[p] + clock_sim_jitter(config->jitter_us);
+        if (p >= CLOCK_SIM_SETTLE_PULSES) {
+            input_sum += pow(arrivals[p] - ideal_pulses[p], 2);
+        }
+    }
+    arrivals[config->num_pulses] = INT64_MAX;
+
+    for (uint32_t p = 0; p < config->num_pulses; p++) {
+        // the pulse arrives, then the timer polls until the next pulse
+        clock_pll_pulse(&pll, arrivals[p]);
+        int64_t now = arrivals[p];
+
+        while (1) {
+            n = clock_pll_poll(&pll, now, &next_tick);
+            while (n-- > 0 && ticks < CLOCK_SIM_MAX_TICKS) tick_times[ticks++] = now;
+
+            if (next_tick == CLOCK_PLL_NO_TICK || next_tick >= arrivals[p + 1]) break;
+            now = next_tick > now ? next_tick : now;
+        }
+    }
+
+    // compare against the ideal tick times, interpolated between ideal pulses
+    double phase_sum = 0, jitter_sum = 0, max_phase = 0;
+    uint32_t num = 0;
+    for (uint32_t t = CLOCK_SIM_SETTLE_PULSES * config->ratio; t < ticks; t++) {
+        uint32_t p = t / config->ratio, k = t % config->ratio;
+        double expected = ideal_pulses[p] + (ideal_pulses[p + 1] - ideal_pulses[p]) * k / config->ratio;
+        double prev_expected = ideal_pulses[(t - 1) / config->ratio]
+            + (ideal_pulses[(t - 1) / config->ratio + 1] - ideal_pulses[(t - 1) / config->ratio]) * ((t - 1) % config->ratio) / config->ratio;
+
+        double phase_error = tick_times[t] - expected;
+        double interval_error = (tick_times[t] - tick_times[t - 1]) - (expected - prev_expected);
+
+        phase_sum += phase_error * phase_error;
+        jitter_sum += interval_error * interval_error;
+        if (fabs(phase_error) > max_phase) max_phase = fabs(phase_error);
+        num++;
+    }
+
+    result->ticks = ticks;
+    result->input_jitter_us = sqrt(input_sum / (config->num_pulses - CLOCK_SIM_SETTLE_PULSES));
+    result->tick_jitter_us = num ? sqrt(jitter_sum / num) : 0;
+    result->phase_error_us = num ? sqrt(phase_sum / num) : 0;
+    result->max_phase_error_us = max_phase;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include "clock_pll.h"
+
+
+typedef struct {
+    double bpm_start;
+    double bpm_end; // tempo ramps linearly over the simulation
+    int64_t jitter_us; // uniform input jitter, +/- jitter_us
+    uint32_t num_pulses;
+    uint8_t ratio;
+} clock_sim_config_t;
+
+typedef struct {
+    uint32_t ticks;
+    double input_jitter_us; // rms deviation of the pulse arrival from the ideal clock
+    double tick_jitter_us; // rms deviation of the tick intervals from the ideal intervals
+    double phase_error_us; // rms deviation of the ticks from their ideal times
+    double max_phase_error_us;
+} clock_sim_result_t;
+
+
+// feed a jittery clock into a pll and compare the emitted ticks with the ideal clock.
+// Statistics skip the first pulses while the loop settles
+void clock_sim_run(const clock_sim_config_t *config, clock_sim_result_t *result);
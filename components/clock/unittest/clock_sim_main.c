@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include "clock_sim.h"
+
+
+int main() {
+    const clock_sim_config_t configs[] = {
+        { .bpm_start = 120, .bpm_end = 120, .jitter_us = 0, .num_pulses = 2400, .ratio = 2 },
+        { .bpm_start = 120, .bpm_end = 120, .jitter_us = 1000, .num_pulses = 2400, .ratio = 2 },
+        { .bpm_start = 120, .bpm_end = 120, .jitter_us = 3000, .num_pulses = 2400, .ratio = 2 },
+        { .bpm_start = 90, .bpm_end = 150, .jitter_us = 1000, .num_pulses = 2400, .ratio = 2 },
+        { .bpm_start = 180, .bpm_end = 180, .jitter_us = 1000, .num_pulses = 2400, .ratio = 2 },
+    };
+
+    printf("bpm        jitter  ticks  input rms  tick jitter rms  phase rms  phase max  (µs)\n");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        clock_sim_result_t result;
+        clock_sim_run(&configs[i], &result);
+
+        printf("%3.0f - %3.0f  %6lld  %5u  %9.1f  %15.1f  %9.1f  %9.1f\n",
+            configs[i].bpm_start, configs[i].bpm_end, (long long) configs[i].jitter_us, (unsigned) result.ticks,
+            result.input_jitter_us, result.tick_jitter_us, result.phase_error_us, result.max_phase_error_us);
+    }
+
+    return 0;
+}
@@ -6,6 +6,7 @@
 #include "output.h"
 #include "usb.h"
 #include "callback.h"
+#include "latency.h"
 
 
 typedef struct controller_t controller_t;
@@ -51,6 +52,10 @@ struct controller_t {
     const controller_class_t *class;
     controller_class_functions_t functions;
     controller_config_t config;
+
+    // receive time of the message that is currently being handled
+    int64_t recv_timestamp;
+    uint8_t recv_latency_recorded;
 };
 
 
@@ -63,5 +68,7 @@ esp_err_t controller_free(controller_t *controller);
 esp_err_t controller_midi_send(controller_t *controller, const midi_message_t *message);
 esp_err_t controller_midi_send_sysex(controller_t *controller, const uint8_t *data, size_t length);
 
-esp_err_t controller_midi_recv(controller_t *controller, const midi_message_t *message);
+esp_err_t controller_midi_recv(controller_t *controller, const midi_message_t *message, int64_t timestamp);
 esp_err_t controller_sequencer_event(controller_t *controller, sequencer_event_t event, sequencer_t *sequencer, void *data);
+
+void controller_latency_record(controller_t *controller, latency_path_t path);
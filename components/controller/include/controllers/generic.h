@@ -2,6 +2,7 @@
 
 #include "controller.h"
 #include "midi_message.h"
+#include "controllers/generic_voices.h"
 
 
 #define GENERIC_CC_BPM 1
@@ -14,7 +15,7 @@ extern const controller_class_t controller_class_generic;
 
 typedef struct {
     controller_t super;
-    uint8_t current_note;
+    generic_voices_t voices;
 } controller_generic_t;
 
 
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define GENERIC_MAX_VOICES 8
+#define GENERIC_NUM_NOTES 128
+#define GENERIC_NO_NOTE 0xFF
+#define GENERIC_NO_VOICE 0xFF
+
+
+// which note gets a voice when there are more notes held than voices
+typedef enum {
+    GENERIC_VOICE_LAST, // the newest notes, the oldest one is stolen
+    GENERIC_VOICE_LOW, // the lowest notes
+    GENERIC_VOICE_HIGH, // the highest notes
+    GENERIC_VOICE_ROUND_ROBIN // voices in turn, a new note steals the next voice
+} generic_voice_policy_t;
+
+typedef struct {
+    uint8_t note; // GENERIC_NO_NOTE while released
+    uint8_t velocity;
+} generic_voice_t;
+
+// polyphonic voice allocation over held notes. A released voice takes over a held
+// note without a voice (legato), so the gate stays open when notes are stolen back
+typedef struct {
+    generic_voice_policy_t policy;
+    uint8_t num_voices;
+    generic_voice_t voices[GENERIC_MAX_VOICES];
+    uint8_t next_voice; // round robin
+
+    // voice and velocity of each note, held notes have a velocity above 0
+    uint8_t note_voices[GENERIC_NUM_NOTES];
+    uint8_t note_velocities[GENERIC_NUM_NOTES];
+
+    // note stack of the held notes, oldest first, linked through the note numbers
+    uint8_t note_prev[GENERIC_NUM_NOTES], note_next[GENERIC_NUM_NOTES];
+    uint8_t oldest_note, newest_note;
+} generic_voices_t;
+
+
+void generic_voices_init(generic_voices_t *voices, uint8_t num_voices, generic_voice_policy_t policy);
+
+// each returns the voice that changed or GENERIC_NO_VOICE, a note of GENERIC_NO_NOTE releases it
+uint8_t generic_voices_note_on(generic_voices_t *voices, uint8_t note, uint8_t velocity);
+uint8_t generic_voices_note_off(generic_voices_t *voices, uint8_t note);
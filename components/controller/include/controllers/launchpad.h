@@ -1,5 +1,10 @@
 #pragma once
 
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
 #include "controller.h"
 #include "midi_message.h"
 #include "launchpad_types.h"
@@ -12,6 +17,16 @@
 #define LP_VENDOR_ID 0x1235
 #define LP_PRODUCT_ID 0x51
 
+#define LP_FRAME_RATE_HZ 60
+#define LP_PAGE_FLIP_LEAD_US (1000000 / LP_FRAME_RATE_HZ)
+#define LP_RENDER_TASK_PRIORITY 1
+#define LP_RENDER_TASK_STACK_SIZE 4096
+
+// piano keys play a note column of the outputs, see output_transaction_set_column_note. The column is
+// shared with the first sequencer track: a key overrides it until the next note event of the track
+#define LP_LIVE_CV_COLUMN 0
+#define LP_LIVE_NOTE_NONE 0xFF
+
 #define LP_SYSEX_BUFFER_SIZE 256
 #define LP_SYSEX_HEADER 0xF0, 0x00, 0x20, 0x29, 0x02, 0x10
 #define LP_SYSEX_COMMAND_SET_LEDS 0x0A
@@ -39,9 +54,19 @@ typedef struct {
     piano_editor_t piano_editor;
     button_t play_button;
     button_t record_button;
+    button_t view_buttons[PATTERN_EDITOR_NUM_VIEWS];
 
     int selected_track_id;
+    uint8_t live_note; // piano key sounding on the cv outputs
+    pattern_editor_view_t selected_view;
     pattern_step_t *selected_step;
+
+    // the ui is drawn by input events and rendered by the frame task
+    SemaphoreHandle_t ui_lock;
+    TaskHandle_t render_task;
+    esp_timer_handle_t frame_timer;
+    int64_t input_timestamp; // oldest input that is not rendered yet
+    atomic_uint changed_tracks; // tracks whose active pattern was replaced or resized
 } controller_launchpad_t;
 
 
@@ -54,4 +79,5 @@ esp_err_t controller_launchpad_midi_recv(void *context, const midi_message_t *me
 esp_err_t controller_launchpad_sequencer_event(void *context, sequencer_event_t event, sequencer_t *sequencer, void *data);
 
 esp_err_t controller_launchpad_select_track(controller_launchpad_t *controller, int track_id);
+esp_err_t controller_launchpad_select_view(controller_launchpad_t *controller, pattern_editor_view_t view);
 esp_err_t controller_launchpad_select_step(controller_launchpad_t *controller, pattern_step_t *step);
@@ -35,6 +35,8 @@ controller_t *controller_create(const controller_class_t *class,
 
     controller->class = class;
     controller->config = *config;
+    controller->recv_timestamp = 0;
+    controller->recv_latency_recorded = 0;
 
     // setup the function callback context
     controller->functions = class->functions;
@@ -75,15 +77,26 @@ esp_err_t controller_midi_send_sysex(controller_t *controller, const uint8_t *da
     //printf("esp --> controller: ");
     //midi_message_print(&message);
 
+    // sysex messages are led updates, sent by the render task. It records the
+    // press to led latency itself, the receive timestamp belongs to the midi task
     return controller_midi_send(controller, &message);
 }
 
-esp_err_t controller_midi_recv(controller_t *controller, const midi_message_t *message) {
+esp_err_t controller_midi_recv(controller_t *controller, const midi_message_t *message, int64_t timestamp) {
+    esp_err_t ret;
+
     //printf("controller --> esp: ");
     //midi_message_print(message);
 
-    return CALLBACK_INVOKE(&controller->functions, midi_recv,
+    // store the timestamp so that outgoing updates can be matched to this message
+    controller->recv_timestamp = timestamp;
+    controller->recv_latency_recorded = 0;
+
+    ret = CALLBACK_INVOKE(&controller->functions, midi_recv,
         message);
+
+    controller->recv_timestamp = 0;
+    return ret;
 }
 
 esp_err_t controller_sequencer_event(controller_t *controller, sequencer_event_t event, sequencer_t *sequencer, void *data) {
@@ -92,3 +105,12 @@ esp_err_t controller_sequencer_event(controller_t *controller, sequencer_event_t
         sequencer,
         data);
 }
+
+void controller_latency_record(controller_t *controller, latency_path_t path) {
+    // only the first update caused by a received message is recorded
+    if (controller->recv_timestamp == 0) return;
+    if (controller->recv_latency_recorded & (1 << path)) return;
+
+    latency_record(path, controller->recv_timestamp);
+    controller->recv_latency_recorded |= 1 << path;
+}
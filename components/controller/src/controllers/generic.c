@@ -4,6 +4,18 @@
 
 static const char *TAG = "generic controller";
 
+// each voice plays a note column of the output, see output_transaction_set_column_note. The sequencer
+// is paused meanwhile, so the tracks do not drive the columns
+#if defined(CONFIG_CONTROLLER_GENERIC_VOICE_LOW)
+    #define GENERIC_VOICE_POLICY GENERIC_VOICE_LOW
+#elif defined(CONFIG_CONTROLLER_GENERIC_VOICE_HIGH)
+    #define GENERIC_VOICE_POLICY GENERIC_VOICE_HIGH
+#elif defined(CONFIG_CONTROLLER_GENERIC_VOICE_ROUND_ROBIN)
+    #define GENERIC_VOICE_POLICY GENERIC_VOICE_ROUND_ROBIN
+#else
+    #define GENERIC_VOICE_POLICY GENERIC_VOICE_LAST
+#endif
+
 const controller_class_t controller_class_generic = {
     .size = sizeof(controller_generic_t),
     .functions = {
@@ -25,8 +37,9 @@ bool controller_generic_supported(void *context, const usb_device_desc_t *desc)
 esp_err_t controller_generic_init(void *context) {
     controller_generic_t *controller = context;
 
-    // reset the current note
-    controller->current_note = -1;
+    // one voice per output column
+    output_t *output = controller->super.config.output;
+    generic_voices_init(&controller->voices, output->config.num_columns, GENERIC_VOICE_POLICY);
 
     // halt the sequencer
     sequencer_pause(controller->super.config.sequencer);
@@ -43,29 +56,30 @@ esp_err_t controller_generic_free(void *context) {
     return ESP_OK;
 }
 
+static void controller_generic_voice_update(controller_generic_t *controller, uint8_t voice) {
+    if (voice == GENERIC_NO_VOICE) return;
+    const generic_voice_t *state = &controller->voices.voices[voice];
+
+    // the rows of the voice change together, a released voice keeps its pitch
+    output_transaction_t tx;
+    output_transaction_begin(controller->super.config.output, &tx);
+    output_transaction_set_column_note(&tx, voice, state->note, state->note != GENERIC_NO_NOTE ? state->velocity : 0);
+    output_transaction_commit(&tx);
+    controller_latency_record(&controller->super, LATENCY_NOTE_TO_CV);
+}
+
 static void controller_generic_note_off(void *context, uint8_t note) {
     controller_generic_t *controller = context;
 
-    // release the note only if it is the current one
-    if (controller->current_note == note) {
-        output_set_voltage(controller->super.config.output, 0, 1, OUTPUT_VELOCITY_TO_VOLTAGE(0));
-        controller->current_note = -1;
-    }
+    // the voice is released, or plays a held note that had no voice
+    controller_generic_voice_update(controller, generic_voices_note_off(&controller->voices, note));
 }
 
 static void controller_generic_note_on(void *context, uint8_t note, uint8_t velocity) {
     controller_generic_t *controller = context;
 
-    // same as note off
-    if (velocity == 0) {
-        controller_generic_note_off(controller, note);
-        return;
-    }
-
-    // set the current note
-    output_set_voltage(controller->super.config.output, 0, 0, OUTPUT_NOTE_TO_VOLTAGE(note));
-    output_set_voltage(controller->super.config.output, 0, 1, OUTPUT_VELOCITY_TO_VOLTAGE(velocity));
-    controller->current_note = note;
+    // same as note off for zero velocity
+    controller_generic_voice_update(controller, generic_voices_note_on(&controller->voices, note, velocity));
 }
 
 esp_err_t controller_generic_midi_recv(void *context, const midi_message_t *message) {
@@ -0,0 +1,151 @@
+#include "controllers/generic_voices.h"
+
+#include <string.h>
+
+
+void generic_voices_init(generic_voices_t *voices, uint8_t num_voices, generic_voice_policy_t policy) {
+    voices->policy = policy;
+    voices->num_voices = num_voices < GENERIC_MAX_VOICES ? num_voices : GENERIC_MAX_VOICES;
+    voices->next_voice = 0;
+
+    for (uint8_t i = 0; i < GENERIC_MAX_VOICES; i++) {
+        voices->voices[i] = (generic_voice_t) { .note = GENERIC_NO_NOTE, .velocity = 0 };
+    }
+    memset(voices->note_voices, GENERIC_NO_VOICE, sizeof(voices->note_voices));
+    memset(voices->note_velocities, 0, sizeof(voices->note_velocities));
+    voices->oldest_note = voices->newest_note = GENERIC_NO_NOTE;
+}
+
+static void generic_voices_push(generic_voices_t *voices, uint8_t note) {
+    voices->note_prev[note] = voices->newest_note;
+    voices->note_next[note] = GENERIC_NO_NOTE;
+
+    if (voices->newest_note == GENERIC_NO_NOTE) {
+        voices->oldest_note = note;
+    } else {
+        voices->note_next[voices->newest_note] = note;
+    }
+    voices->newest_note = note;
+}
+
+static void generic_voices_remove(generic_voices_t *voices, uint8_t note) {
+    uint8_t prev = voices->note_prev[note], next = voices->note_next[note];
+
+    if (prev == GENERIC_NO_NOTE) {
+        voices->oldest_note = next;
+    } else {
+        voices->note_next[prev] = next;
+    }
+
+    if (next == GENERIC_NO_NOTE) {
+        voices->newest_note = prev;
+    } else {
+        voices->note_prev[next] = prev;
+    }
+}
+
+static uint8_t generic_voices_assign(generic_voices_t *voices, uint8_t voice, uint8_t note) {
+    // the previous note of the voice stays held, without a voice
+    uint8_t previous = voices->voices[voice].note;
+    if (previous != GENERIC_NO_NOTE) voices->note_voices[previous] = GENERIC_NO_VOICE;
+
+    voices->voices[voice] = (generic_voice_t) { .note = note, .velocity = voices->note_velocities[note] };
+    voices->note_voices[note] = voice;
+
+    return voice;
+}
+
+static uint8_t generic_voices_find_free(generic_voices_t *voices) {
+    // round robin continues after the last voice, all others fill up from the first
+    uint8_t start = voices->policy == GENERIC_VOICE_ROUND_ROBIN ? voices->next_voice : 0;
+
+    for (uint8_t i = 0; i < voices->num_voices; i++) {
+        uint8_t voice = (start + i) % voices->num_voices;
+        if (voices->voices[voice].note == GENERIC_NO_NOTE) return voice;
+    }
+
+    return GENERIC_NO_VOICE;
+}
+
+// voice that a new note takes from the sounding ones, GENERIC_NO_VOICE if it stays silent
+static uint8_t generic_voices_find_stolen(generic_voices_t *voices, uint8_t note) {
+    uint8_t stolen = GENERIC_NO_VOICE;
+
+    switch (voices->policy) {
+        case GENERIC_VOICE_LAST:
+            // the oldest sounding note
+            for (uint8_t n = voices->oldest_note; n != GENERIC_NO_NOTE; n = voices->note_next[n]) {
+                if (voices->note_voices[n] != GENERIC_NO_VOICE) return voices->note_voices[n];
+            }
+            break;
+        case GENERIC_VOICE_LOW:
+        case GENERIC_VOICE_HIGH:
+            // the highest (lowest) sounding note, if the new one is below (above) it
+            for (uint8_t i = 0; i < voices->num_voices; i++) {
+                uint8_t sounding = voices->voices[i].note;
+                bool beats = voices->policy == GENERIC_VOICE_LOW ? note < sounding : note > sounding;
+                bool further = stolen == GENERIC_NO_VOICE || (voices->policy == GENERIC_VOICE_LOW
+                    ? sounding > voices->voices[stolen].note
+                    : sounding < voices->voices[stolen].note);
+                if (beats && further) stolen = i;
+            }
+            break;
+        case GENERIC_VOICE_ROUND_ROBIN:
+            stolen = voices->next_voice;
+            break;
+    }
+
+    return stolen;
+}
+
+// held note without a voice that takes over a released voice, GENERIC_NO_NOTE if none
+static uint8_t generic_voices_find_waiting(generic_voices_t *voices) {
+    uint8_t waiting = GENERIC_NO_NOTE;
+
+    for (uint8_t n = voices->newest_note; n != GENERIC_NO_NOTE; n = voices->note_prev[n]) {
+        if (voices->note_voices[n] != GENERIC_NO_VOICE) continue;
+
+        // the newest waiting note, or the lowest (highest) one
+        if (voices->policy == GENERIC_VOICE_LAST || voices->policy == GENERIC_VOICE_ROUND_ROBIN) return n;
+        if (waiting == GENERIC_NO_NOTE
+                || (voices->policy == GENERIC_VOICE_LOW ? n < waiting : n > waiting)) waiting = n;
+    }
+
+    return waiting;
+}
+
+uint8_t generic_voices_note_on(generic_voices_t *voices, uint8_t note, uint8_t velocity) {
+    if (note >= GENERIC_NUM_NOTES || voices->num_voices == 0) return GENERIC_NO_VOICE;
+    if (velocity == 0) return generic_voices_note_off(voices, note);
+
+    // a note played again moves to the top of the stack and keeps its voice
+    if (voices->note_velocities[note] > 0) generic_voices_remove(voices, note);
+    generic_voices_push(voices, note);
+    voices->note_velocities[note] = velocity;
+
+    uint8_t voice = voices->note_voices[note];
+    if (voice == GENERIC_NO_VOICE) voice = generic_voices_find_free(voices);
+    if (voice == GENERIC_NO_VOICE) voice = generic_voices_find_stolen(voices, note);
+    if (voice == GENERIC_NO_VOICE) return GENERIC_NO_VOICE;
+
+    voices->next_voice = (voice + 1) % voices->num_voices;
+    return generic_voices_assign(voices, voice, note);
+}
+
+uint8_t generic_voices_note_off(generic_voices_t *voices, uint8_t note) {
+    if (note >= GENERIC_NUM_NOTES || voices->note_velocities[note] == 0) return GENERIC_NO_VOICE;
+
+    generic_voices_remove(voices, note);
+    voices->note_velocities[note] = 0;
+
+    uint8_t voice = voices->note_voices[note];
+    if (voice == GENERIC_NO_VOICE) return GENERIC_NO_VOICE;
+    voices->note_voices[note] = GENERIC_NO_VOICE;
+
+    // legato to a held note that lost its voice, or release
+    uint8_t waiting = generic_voices_find_waiting(voices);
+    if (waiting != GENERIC_NO_NOTE) return generic_voices_assign(voices, voice, waiting);
+
+    voices->voices[voice] = (generic_voice_t) { .note = GENERIC_NO_NOTE, .velocity = 0 };
+    return voice;
+}
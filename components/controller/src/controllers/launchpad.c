@@ -64,6 +64,68 @@ static esp_err_t _lpui_sysex_ready(void *context, lpui_t *ui, uint8_t *buffer, s
     return controller_midi_send_sysex(&controller->super, buffer, length);
 }
 
+static void _frame_timer_callback(void *arg) {
+    controller_launchpad_t *controller = arg;
+
+    // wake up the render task once per frame
+    xTaskNotifyGive(controller->render_task);
+}
+
+static void _apply_track_changes(controller_launchpad_t *controller) {
+    sequencer_t *sequencer = controller->super.config.sequencer;
+    uint32_t changed_tracks = atomic_exchange(&controller->changed_tracks, 0);
+
+    // show the current active pattern of the tracks, the selected step may have
+    // pointed into the steps of the previous one
+    for (int i = 0; changed_tracks != 0; i++, changed_tracks >>= 1) {
+        if (!(changed_tracks & 1)) continue;
+
+        if (i == controller->selected_track_id) {
+            controller->selected_step = NULL;
+        }
+        esp_err_t ret = pattern_editor_set_track_pattern(&controller->pattern_editor, i, sequencer_get_active_pattern(sequencer, i));
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to update pattern of track %d: %s", i, esp_err_to_name(ret));
+        }
+    }
+}
+
+static void _render_task(void *arg) {
+    controller_launchpad_t *controller = arg;
+    lpui_t *ui = &controller->ui;
+    esp_err_t ret;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        xSemaphoreTake(controller->ui_lock, portMAX_DELAY);
+        _apply_track_changes(controller);
+
+        // follow the playhead, the step position is read once per frame. With the
+        // internal clock the tempo is known and pages are flipped a frame early
+        sequencer_t *sequencer = controller->super.config.sequencer;
+        bool lookahead = sequencer->playing && sequencer->clock_source == SEQUENCER_CLOCK_INTERNAL;
+        uint32_t frames = ui->stats.frames;
+        pattern_editor_update_playhead(&controller->pattern_editor,
+            sequencer_get_tick_period_us(sequencer), lookahead ? LP_PAGE_FLIP_LEAD_US : 0);
+        lpui_animate(ui, esp_timer_get_time());
+
+        // send everything that changed since the last frame
+        ret = lpui_commit(ui);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to render frame: %s", esp_err_to_name(ret));
+        }
+
+        // the input became visible with this frame
+        if (controller->input_timestamp != 0 && ui->stats.frames != frames) {
+            latency_record(LATENCY_PRESS_TO_LED, controller->input_timestamp);
+        }
+        controller->input_timestamp = 0;
+
+        xSemaphoreGive(controller->ui_lock);
+    }
+}
+
 static esp_err_t _play_button_pressed(void *context, button_t *button) {
     controller_launchpad_t *controller = context;
 
@@ -78,6 +140,101 @@ static esp_err_t _play_button_released(void *context, button_t *button) {
     return sequencer_pause(controller->super.config.sequencer);
 }
 
+static esp_err_t _live_note_on(controller_launchpad_t *controller, uint8_t note, uint8_t velocity) {
+    output_t *output = controller->super.config.output;
+
+    // the last pressed key sounds, like the generic controller. Pitch, velocity, gate and trigger change together
+    output_transaction_t tx;
+    output_transaction_begin(output, &tx);
+    ESP_RETURN_ON_ERROR(output_transaction_set_column_note(&tx, LP_LIVE_CV_COLUMN, note, velocity),
+        TAG, "Failed to stage live note");
+    ESP_RETURN_ON_ERROR(output_transaction_commit(&tx),
+        TAG, "Failed to set live note voltages");
+    controller_latency_record(&controller->super, LATENCY_NOTE_TO_CV);
+    controller->live_note = note;
+
+    return ESP_OK;
+}
+
+static esp_err_t _live_note_off(controller_launchpad_t *controller, uint8_t note) {
+    output_t *output = controller->super.config.output;
+
+    // only releasing the sounding key closes the gate
+    if (controller->live_note != note) return ESP_OK;
+
+    output_transaction_t tx;
+    output_transaction_begin(output, &tx);
+    ESP_RETURN_ON_ERROR(output_transaction_set_column_note(&tx, LP_LIVE_CV_COLUMN, note, 0),
+        TAG, "Failed to stage live note release");
+    ESP_RETURN_ON_ERROR(output_transaction_commit(&tx),
+        TAG, "Failed to release live note");
+    controller_latency_record(&controller->super, LATENCY_NOTE_TO_CV);
+    controller->live_note = LP_LIVE_NOTE_NONE;
+
+    return ESP_OK;
+}
+
+static esp_err_t _live_input(controller_launchpad_t *controller, const midi_message_t *message) {
+    lpui_position_t pos;
+    uint8_t velocity, note;
+
+    // only pads of the piano editor play notes. The key mapping is fixed after init,
+    // so this does not need the ui lock
+    if (lpui_decode_key(message, &pos, &velocity) != ESP_OK) return ESP_OK;
+    if (message->command == MIDI_COMMAND_CONTROL_CHANGE) return ESP_OK;
+    if (piano_editor_get_note(&controller->piano_editor, pos, &note) != ESP_OK) return ESP_OK;
+
+    return velocity > 0 ? _live_note_on(controller, note, velocity) : _live_note_off(controller, note);
+}
+
+static esp_err_t _piano_editor_pressed(void *context, piano_editor_t *editor, uint8_t note, uint8_t velocity) {
+    controller_launchpad_t *controller = context;
+    pattern_editor_t *pattern_editor = &controller->pattern_editor;
+    pattern_t *pattern = pattern_editor->pattern;
+
+    // the note is already playing, only record it
+    if (!controller->record_button.pressed || pattern == NULL || pattern->config.type != PATTERN_TYPE_MELODIC) {
+        return ESP_OK;
+    }
+
+    // write into the selected step, or the step closest to the playhead. The
+    // selection is only kept while it belongs to the edited pattern
+    uint16_t step_position = pattern_get_nearest_step(pattern);
+    if (controller->selected_step != NULL) {
+        uintptr_t offset = (uintptr_t) controller->selected_step - (uintptr_t) pattern->steps;
+        ESP_RETURN_ON_FALSE(offset % sizeof(pattern_step_t) == 0 && offset / sizeof(pattern_step_t) < pattern->config.step_length, ESP_ERR_INVALID_STATE,
+            TAG, "Selected step is outside of the edited pattern");
+        step_position = offset / sizeof(pattern_step_t);
+    }
+    ESP_RETURN_ON_FALSE(step_position < pattern->config.step_length, ESP_ERR_INVALID_STATE,
+        TAG, "No step to record into");
+
+    // note and velocity are stored together, so the sequencer never reads half of a step
+    pattern->steps[step_position].atomic = (pattern_atomic_step_t) { .note = note, .velocity = velocity };
+    ESP_RETURN_ON_ERROR(pattern_editor_draw_steps(pattern_editor, &step_position, 1),
+        TAG, "Failed to draw recorded step");
+
+    return ESP_OK;
+}
+
+static esp_err_t _view_button_pressed(void *context, button_t *button) {
+    controller_launchpad_t *controller = context;
+
+    // show the view of the button
+    return controller_launchpad_select_view(controller, button - controller->view_buttons);
+}
+
+static esp_err_t _view_button_released(void *context, button_t *button) {
+    controller_launchpad_t *controller = context;
+
+    // the selected view stays lit until another one is selected
+    if (button - controller->view_buttons == controller->selected_view) {
+        return button_set_pressed(button, true);
+    }
+
+    return ESP_OK;
+}
+
 static esp_err_t _pattern_editor_pressed(void *context, pattern_editor_t *editor, uint16_t step_position) {
     controller_launchpad_t *controller = context;
     sequencer_t *sequencer = controller->super.config.sequencer;
@@ -111,19 +268,35 @@ static esp_err_t _pattern_editor_released(void *context, pattern_editor_t *edito
     return ESP_OK;
 }
 
+static esp_err_t _pattern_editor_track_pressed(void *context, pattern_editor_t *editor, int track_id) {
+    controller_launchpad_t *controller = context;
+
+    // edit the steps of the pressed track
+    ESP_RETURN_ON_ERROR(controller_launchpad_select_track(controller, track_id),
+        TAG, "Failed to select track");
+    ESP_RETURN_ON_ERROR(controller_launchpad_select_view(controller, PATTERN_EDITOR_VIEW_VELOCITY),
+        TAG, "Failed to select view");
+
+    return ESP_OK;
+}
+
 esp_err_t controller_launchpad_init(void *context) {
     esp_err_t ret;
     controller_launchpad_t *controller = context;
 
     controller->selected_track_id = -1;
+    controller->live_note = LP_LIVE_NOTE_NONE;
+    controller->selected_view = PATTERN_EDITOR_VIEW_VELOCITY;
     controller->selected_step = NULL;
+    atomic_init(&controller->changed_tracks, 0);
 
     // setup launchpad ui
     const lpui_config_t ui_config = {
         .callbacks = {
             .context = controller,
             .sysex_ready = _lpui_sysex_ready
-        }
+        },
+        .native_effects = true
     };
     ret = lpui_init(&controller->ui, &ui_config);
     ESP_RETURN_ON_ERROR(ret, TAG, "Failed to initialize launchpad ui");
@@ -156,12 +329,24 @@ esp_err_t controller_launchpad_init(void *context) {
     lpui_add_component(&controller->ui, &controller->play_button.cmp);
     button_draw(&controller->play_button);
 
+    const button_config_t record_button_config = {
+        .cmp_config = {
+            .pos = { x: 0, y: 1 }
+        },
+        .color = LPUI_COLOR_RECORD,
+        .mode = BUTTON_MODE_TOGGLE
+    };
+    button_init(&controller->record_button, &record_button_config);
+    lpui_add_component(&controller->ui, &controller->record_button.cmp);
+    button_draw(&controller->record_button);
+
     // initialize pattern editor
     const pattern_editor_config_t pattern_editor_config = (pattern_editor_config_t) {
         .callbacks = {
             .context = controller,
             .pressed = _pattern_editor_pressed,
-            .released = _pattern_editor_released
+            .released = _pattern_editor_released,
+            .track_pressed = _pattern_editor_track_pressed
         },
         .cmp_config = {
             .pos = { x: 1, y: 5 },
@@ -171,12 +356,43 @@ esp_err_t controller_launchpad_init(void *context) {
     pattern_editor_init(&controller->pattern_editor, &pattern_editor_config);
     lpui_add_component(&controller->ui, &controller->pattern_editor.cmp);
 
+    // the overview shows the patterns of all tracks
+    for (int i = 0; i < SEQUENCER_NUM_TRACKS; i++) {
+        pattern_t *pattern = sequencer_get_active_pattern(controller->super.config.sequencer, i);
+        pattern_editor_set_track_pattern(&controller->pattern_editor, i, pattern);
+    }
+
+    // initialize the view buttons on the right side, next to the pattern editor
+    for (int i = 0; i < PATTERN_EDITOR_NUM_VIEWS; i++) {
+        const button_config_t view_button_config = {
+            .cmp_config = {
+                .pos = { x: 9, y: 8 - i }
+            },
+            .callbacks = {
+                .context = controller,
+                .pressed = _view_button_pressed,
+                .released = _view_button_released
+            },
+            .color = LPUI_COLOR_VIEW,
+            .mode = BUTTON_MODE_TOGGLE
+        };
+        button_init(&controller->view_buttons[i], &view_button_config);
+        lpui_add_component(&controller->ui, &controller->view_buttons[i].cmp);
+        button_draw(&controller->view_buttons[i]);
+    }
+    button_set_pressed(&controller->view_buttons[controller->selected_view], true);
+
     // initialize piano editor
     const piano_editor_config_t piano_editor_config = {
+        .callbacks = {
+            .context = controller,
+            .pressed = _piano_editor_pressed
+        },
         .cmp_config = {
             .pos = { x: 1, y: 1 },
             .size = { width: 8, height: 4 }
-        }
+        },
+        .base_note = PIANO_EDITOR_DEFAULT_BASE_NOTE
     };
     piano_editor_init(&controller->piano_editor, &piano_editor_config);
     lpui_add_component(&controller->ui, &controller->piano_editor.cmp);
@@ -185,41 +401,93 @@ esp_err_t controller_launchpad_init(void *context) {
     // select the first track.
     controller_launchpad_select_track(controller, 0);
 
+    // send the first frame
+    ret = lpui_commit(&controller->ui);
+    ESP_RETURN_ON_ERROR(ret, TAG, "Failed to commit launchpad ui");
+
+    // render all further frames at a fixed rate, independent of the sequencer ticks
+    controller->input_timestamp = 0;
+    controller->ui_lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(controller->ui_lock != NULL, ESP_ERR_NO_MEM,
+        TAG, "Failed to create ui lock");
+
+    ESP_RETURN_ON_FALSE(xTaskCreate(_render_task, "lp_render", LP_RENDER_TASK_STACK_SIZE, controller,
+            LP_RENDER_TASK_PRIORITY, &controller->render_task) == pdPASS, ESP_ERR_NO_MEM,
+        TAG, "Failed to create render task");
+
+    const esp_timer_create_args_t frame_timer_config = {
+        .name = "lp_frame",
+        .callback = _frame_timer_callback,
+        .arg = controller
+    };
+    ret = esp_timer_create(&frame_timer_config, &controller->frame_timer);
+    ESP_RETURN_ON_ERROR(ret, TAG, "Failed to create frame timer");
+
+    ret = esp_timer_start_periodic(controller->frame_timer, 1000000 / LP_FRAME_RATE_HZ);
+    ESP_RETURN_ON_ERROR(ret, TAG, "Failed to start frame timer");
+
     return ESP_OK;
 }
 
 esp_err_t controller_launchpad_free(void *context) {
-    return ESP_OK;
+    controller_launchpad_t *controller = context;
+
+    // stop rendering, the lock makes sure no frame is in progress
+    esp_timer_stop(controller->frame_timer);
+    esp_timer_delete(controller->frame_timer);
+
+    xSemaphoreTake(controller->ui_lock, portMAX_DELAY);
+    vTaskDelete(controller->render_task);
+    vSemaphoreDelete(controller->ui_lock);
+
+    return lpui_free(&controller->ui);
 }
 
 esp_err_t controller_launchpad_midi_recv(void *context, const midi_message_t *message) {
     controller_launchpad_t *controller = context;
     lpui_t *ui = &controller->ui;
 
-    // let the launchpad ui handle the event
+    // play piano keys before waiting for the ui, which is locked while a frame is sent
+    esp_err_t ret = _live_input(controller, message);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to play live input: %s", esp_err_to_name(ret));
+    }
+
+    // let the launchpad ui handle the event, the next frame sends the changes
+    xSemaphoreTake(controller->ui_lock, portMAX_DELAY);
+    _apply_track_changes(controller);
     lpui_midi_recv(ui, message);
-    
+    if (controller->input_timestamp == 0) {
+        controller->input_timestamp = controller->super.recv_timestamp;
+    }
+    xSemaphoreGive(controller->ui_lock);
+
     return ESP_OK;
 }
 
 esp_err_t controller_launchpad_sequencer_event(void *context, sequencer_event_t event, sequencer_t *sequencer, void *data) {
     controller_launchpad_t *controller = context;
 
-    switch (event) {
-        case SEQUENCER_TICK:
-            // if playing, update the pattern editor position
-            pattern_editor_update_step_position(&controller->pattern_editor);
-            break;
-        default:
-            break;
+    // the sequencer runs in a timing critical context. The playhead is picked
+    // up by the render task instead, so ticks do no ui work at all. Replaced and
+    // resized patterns are only marked, the ui follows them under its lock
+    if (event == SEQUENCER_TRACK_EVENT) {
+        sequencer_track_event_t *track_event = data;
+        if (track_event->event == TRACK_PATTERN_CHANGE || track_event->event == TRACK_PATTERN_RESIZE) {
+            atomic_fetch_or(&controller->changed_tracks, 1U << (track_event->track - sequencer->tracks));
+        }
     }
-    
+
     return ESP_OK;
 }
 
 esp_err_t controller_launchpad_select_track(controller_launchpad_t *controller, int track_id) {
     // set the new selected track id
     if (controller->selected_track_id == track_id) return ESP_OK;
+
+    // the selected step belongs to the pattern of the previous track
+    ESP_RETURN_ON_ERROR(controller_launchpad_select_step(controller, NULL),
+        TAG, "Failed to clear the selected step");
     controller->selected_track_id = track_id;
 
     // select the active pattern on that track (or NULL if no track is selected)
@@ -230,12 +498,47 @@ esp_err_t controller_launchpad_select_track(controller_launchpad_t *controller,
     return ESP_OK;
 }
 
+esp_err_t controller_launchpad_select_view(controller_launchpad_t *controller, pattern_editor_view_t view) {
+    if (controller->selected_view == view) return ESP_OK;
+
+    // light the button of the new view only
+    pattern_editor_view_t prev_view = controller->selected_view;
+    controller->selected_view = view;
+    button_set_pressed(&controller->view_buttons[prev_view], false);
+    button_set_pressed(&controller->view_buttons[view], true);
+
+    // the pattern editor redraws from its color cache, the next frame sends the difference
+    ESP_RETURN_ON_ERROR(pattern_editor_set_view(&controller->pattern_editor, view),
+        TAG, "Failed to set pattern editor view");
+
+    return ESP_OK;
+}
+
 esp_err_t controller_launchpad_select_step(controller_launchpad_t *controller, pattern_step_t *step) {
-    // set the new step
+    pattern_editor_t *editor = &controller->pattern_editor;
+    pattern_t *pattern = editor->pattern;
+    int step_position = -1;
+
     if (controller->selected_step == step) return ESP_OK;
-    controller->selected_step = step;
 
+    // only steps of the edited pattern can be selected
+    if (step != NULL) {
+        ESP_RETURN_ON_FALSE(pattern != NULL, ESP_ERR_INVALID_ARG,
+            TAG, "No pattern to select a step in");
+
+        uintptr_t offset = (uintptr_t) step - (uintptr_t) pattern->steps;
+        ESP_RETURN_ON_FALSE(offset % sizeof(pattern_step_t) == 0 && offset / sizeof(pattern_step_t) < pattern->config.step_length, ESP_ERR_INVALID_ARG,
+            TAG, "Step %p is not part of the edited pattern", step);
+        step_position = offset / sizeof(pattern_step_t);
+    }
+
+    // set the new step
+    controller->selected_step = step;
     ESP_LOGI(TAG, "Selected step %p", step);
 
+    // flash the selected step in the pattern editor
+    ESP_RETURN_ON_ERROR(pattern_editor_select_step(editor, step_position),
+        TAG, "Failed to select pattern editor step");
+
     return ESP_OK;
 }
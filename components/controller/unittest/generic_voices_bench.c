@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <time.h>
+#include "controllers/generic_voices.h"
+
+
+#define BENCH_CHORDS 200000
+#define BENCH_MAX_CHORD 12
+
+
+static uint32_t bench_state = 0x2545F491;
+
+static uint32_t bench_rand() {
+    bench_state ^= bench_state << 13;
+    bench_state ^= bench_state >> 17;
+    bench_state ^= bench_state << 5;
+    return bench_state;
+}
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_run(const char *name, generic_voice_policy_t policy, uint8_t num_voices, uint8_t chord_size) {
+    static generic_voices_t voices;
+    static uint8_t chords[BENCH_CHORDS][BENCH_MAX_CHORD];
+    generic_voices_init(&voices, num_voices, policy);
+
+    // overlapping chords: each chord is pressed before the previous one is released
+    for (uint32_t c = 0; c < BENCH_CHORDS; c++) {
+        uint8_t root = 36 + bench_rand() % 48;
+        for (uint8_t i = 0; i < chord_size; i++) chords[c][i] = root + (bench_rand() % 24);
+    }
+
+    uint32_t changes = 0;
+    uint64_t start = bench_now_ns();
+    for (uint32_t c = 0; c < BENCH_CHORDS; c++) {
+        for (uint8_t i = 0; i < chord_size; i++) {
+            changes += generic_voices_note_on(&voices, chords[c][i], 100) != GENERIC_NO_VOICE;
+        }
+        if (c > 0) {
+            for (uint8_t i = 0; i < chord_size; i++) {
+                changes += generic_voices_note_off(&voices, chords[c - 1][i]) != GENERIC_NO_VOICE;
+            }
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    uint64_t events = (uint64_t) BENCH_CHORDS * chord_size * 2;
+    printf("  %-11s %u voices, %2u note chords: %5.1f ns/event, %5.2f us per chord change, %4.2f voice changes/event\n",
+        name, num_voices, chord_size, (double) elapsed / events, (double) elapsed / BENCH_CHORDS / 1000.0,
+        (double) changes / events);
+}
+
+int main() {
+    const struct {
+        const char *name;
+        generic_voice_policy_t policy;
+    } policies[] = {
+        { "last", GENERIC_VOICE_LAST },
+        { "low", GENERIC_VOICE_LOW },
+        { "high", GENERIC_VOICE_HIGH },
+        { "round robin", GENERIC_VOICE_ROUND_ROBIN }
+    };
+
+    printf("voice allocation, %d overlapping chords\n", BENCH_CHORDS);
+    for (int p = 0; p < 4; p++) {
+        bench_run(policies[p].name, policies[p].policy, 4, 4);
+        bench_run(policies[p].name, policies[p].policy, 4, 8);
+        bench_run(policies[p].name, policies[p].policy, 8, 12);
+    }
+
+    return 0;
+}
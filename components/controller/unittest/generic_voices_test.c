@@ -0,0 +1,151 @@
+#include "bdd-for-c.h"
+#include "controllers/generic_voices.h"
+
+
+#define FUZZ_EVENTS 100000
+
+
+static uint32_t fuzz_state = 0x9E3779B9;
+
+static uint32_t fuzz_rand() {
+    fuzz_state ^= fuzz_state << 13;
+    fuzz_state ^= fuzz_state >> 17;
+    fuzz_state ^= fuzz_state << 5;
+    return fuzz_state;
+}
+
+static uint8_t voice_note(generic_voices_t *voices, uint8_t voice) {
+    return voices->voices[voice].note;
+}
+
+// the held notes that should sound: the newest, lowest or highest ones
+static bool should_sound(generic_voices_t *voices, uint8_t note) {
+    uint8_t better = 0;
+    if (voices->policy == GENERIC_VOICE_LAST) {
+        for (uint8_t n = voices->note_next[note]; n != GENERIC_NO_NOTE; n = voices->note_next[n]) better++;
+    } else {
+        for (uint8_t n = 0; n < GENERIC_NUM_NOTES; n++) {
+            if (voices->note_velocities[n] == 0) continue;
+            if (voices->policy == GENERIC_VOICE_LOW ? n < note : n > note) better++;
+        }
+    }
+    return better < voices->num_voices;
+}
+
+static bool voices_consistent(generic_voices_t *voices) {
+    uint8_t held = 0, sounding = 0;
+
+    for (uint8_t n = voices->oldest_note; n != GENERIC_NO_NOTE; n = voices->note_next[n]) {
+        if (voices->note_velocities[n] == 0) return false;
+        held++;
+    }
+
+    // every voice plays a held note that maps back to it
+    for (uint8_t v = 0; v < voices->num_voices; v++) {
+        uint8_t note = voice_note(voices, v);
+        if (note == GENERIC_NO_NOTE) continue;
+        if (voices->note_velocities[note] == 0 || voices->note_voices[note] != v) return false;
+        sounding++;
+    }
+
+    // released voices always take over waiting notes
+    if (sounding != (held < voices->num_voices ? held : voices->num_voices)) return false;
+
+    if (voices->policy == GENERIC_VOICE_ROUND_ROBIN) return true;
+    for (uint8_t n = voices->oldest_note; n != GENERIC_NO_NOTE; n = voices->note_next[n]) {
+        bool sounds = voices->note_voices[n] != GENERIC_NO_VOICE;
+        if (sounds != should_sound(voices, n)) return false;
+    }
+
+    return true;
+}
+
+
+spec("generic voices") {
+    static generic_voices_t voices;
+
+    it("should steal the oldest note for the last note") {
+        generic_voices_init(&voices, 2, GENERIC_VOICE_LAST);
+        expect(generic_voices_note_on(&voices, 60, 100)) to_be(0);
+        expect(generic_voices_note_on(&voices, 62, 100)) to_be(1);
+        expect(generic_voices_note_on(&voices, 64, 100)) to_be(0);
+        expect(voice_note(&voices, 0)) to_be(64);
+
+        // legato back to the stolen note, then release
+        expect(generic_voices_note_off(&voices, 64)) to_be(0);
+        expect(voice_note(&voices, 0)) to_be(60);
+        expect(generic_voices_note_off(&voices, 60)) to_be(0);
+        expect(voice_note(&voices, 0)) to_be(GENERIC_NO_NOTE);
+        expect(voice_note(&voices, 1)) to_be(62);
+    }
+
+    it("should keep the lowest notes for the low note") {
+        generic_voices_init(&voices, 2, GENERIC_VOICE_LOW);
+        generic_voices_note_on(&voices, 60, 100);
+        generic_voices_note_on(&voices, 64, 100);
+        expect(generic_voices_note_on(&voices, 67, 100)) to_be(GENERIC_NO_VOICE);
+        expect(generic_voices_note_on(&voices, 55, 100)) to_be(1);
+        expect(voice_note(&voices, 1)) to_be(55);
+
+        // the lowest waiting note comes back
+        expect(generic_voices_note_off(&voices, 55)) to_be(1);
+        expect(voice_note(&voices, 1)) to_be(64);
+        expect(generic_voices_note_off(&voices, 67)) to_be(GENERIC_NO_VOICE);
+    }
+
+    it("should keep the highest notes for the high note") {
+        generic_voices_init(&voices, 2, GENERIC_VOICE_HIGH);
+        generic_voices_note_on(&voices, 60, 100);
+        generic_voices_note_on(&voices, 64, 100);
+        expect(generic_voices_note_on(&voices, 55, 100)) to_be(GENERIC_NO_VOICE);
+        expect(generic_voices_note_on(&voices, 67, 100)) to_be(0);
+
+        expect(generic_voices_note_off(&voices, 67)) to_be(0);
+        expect(voice_note(&voices, 0)) to_be(60);
+    }
+
+    it("should take the voices in turn for round robin") {
+        generic_voices_init(&voices, 3, GENERIC_VOICE_ROUND_ROBIN);
+        expect(generic_voices_note_on(&voices, 60, 100)) to_be(0);
+        expect(generic_voices_note_off(&voices, 60)) to_be(0);
+        expect(generic_voices_note_on(&voices, 60, 100)) to_be(1);
+        expect(generic_voices_note_on(&voices, 62, 100)) to_be(2);
+        expect(generic_voices_note_on(&voices, 64, 100)) to_be(0);
+        expect(generic_voices_note_on(&voices, 65, 100)) to_be(1);
+        expect(voice_note(&voices, 1)) to_be(65);
+    }
+
+    it("should keep the voice of a retriggered note") {
+        generic_voices_init(&voices, 4, GENERIC_VOICE_LAST);
+        generic_voices_note_on(&voices, 60, 100);
+        generic_voices_note_on(&voices, 62, 100);
+        expect(generic_voices_note_on(&voices, 60, 50)) to_be(0);
+        expect(voices.voices[0].velocity) to_be(50);
+
+        // zero velocity is a note off, unknown notes are ignored
+        expect(generic_voices_note_on(&voices, 60, 0)) to_be(0);
+        expect(voice_note(&voices, 0)) to_be(GENERIC_NO_NOTE);
+        expect(generic_voices_note_off(&voices, 70)) to_be(GENERIC_NO_VOICE);
+        expect(generic_voices_note_on(&voices, 200, 100)) to_be(GENERIC_NO_VOICE);
+    }
+
+    it("should stay consistent under random notes") {
+        const generic_voice_policy_t policies[] = {
+            GENERIC_VOICE_LAST, GENERIC_VOICE_LOW, GENERIC_VOICE_HIGH, GENERIC_VOICE_ROUND_ROBIN
+        };
+
+        for (int p = 0; p < 4; p++) {
+            generic_voices_init(&voices, 4, policies[p]);
+            for (int i = 0; i < FUZZ_EVENTS; i++) {
+                // a small range of notes, so notes are retriggered and held often
+                uint8_t note = 48 + fuzz_rand() % 16;
+                if (fuzz_rand() % 2) {
+                    generic_voices_note_on(&voices, note, 1 + fuzz_rand() % 127);
+                } else {
+                    generic_voices_note_off(&voices, note);
+                }
+                if (i % 97 == 0) check(voices_consistent(&voices), "policy %d, event %d", policies[p], i);
+            }
+        }
+    }
+}
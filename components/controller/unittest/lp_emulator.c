@@ -0,0 +1,282 @@
+#include "lp_emulator.h"
+
+#include <string.h>
+#include <esp_check.h>
+
+
+static const char *TAG = "lp_emulator";
+
+static const uint8_t lp_emulator_sysex_header[] = { LP_SYSEX_HEADER };
+
+// the first palette entries, every other index is reported as an error
+static const lp_emulator_color_t lp_emulator_palette[] = {
+    { 0x00, 0x00, 0x00 },
+    { 0x07, 0x07, 0x07 },
+    { 0x1f, 0x1f, 0x1f },
+    { 0x3f, 0x3f, 0x3f }
+};
+
+#define LP_EMULATOR_PALETTE_SIZE (sizeof(lp_emulator_palette) / sizeof(lp_emulator_palette[0]))
+
+#define LP_EMULATOR_COMMAND_FLASH_LEDS 0x23
+#define LP_EMULATOR_COMMAND_PULSE_LEDS 0x28
+#define LP_EMULATOR_COMMAND_STANDALONE_MODE 0x21
+#define LP_EMULATOR_COMMAND_LAYOUT 0x2C
+
+
+esp_err_t lp_emulator_init(lp_emulator_t *emu, const lp_emulator_config_t *config) {
+    emu->config = *config;
+
+    // the device starts out dark in the default layout
+    memset(emu->leds, 0, sizeof(emu->leds));
+    memset(emu->effects, 0, sizeof(emu->effects));
+    emu->standalone = false;
+    emu->layout = 0;
+
+    memset(&emu->stats, 0, sizeof(emu->stats));
+    emu->frame_messages = 0;
+
+    return ESP_OK;
+}
+
+
+static void lp_emulator_set_led(lp_emulator_t *emu, uint8_t index, lp_emulator_color_t color) {
+    if (index >= LP_EMULATOR_GRID_SIZE * LP_EMULATOR_GRID_SIZE) {
+        emu->stats.errors++;
+        return;
+    }
+
+    // a static color also stops any effect
+    emu->leds[index % LP_EMULATOR_GRID_SIZE][index / LP_EMULATOR_GRID_SIZE] = color;
+    emu->effects[index % LP_EMULATOR_GRID_SIZE][index / LP_EMULATOR_GRID_SIZE].type = LP_EMULATOR_EFFECT_NONE;
+    emu->stats.leds_set++;
+}
+
+static void lp_emulator_set_effect(lp_emulator_t *emu, uint8_t index, lp_emulator_effect_t effect) {
+    if (index >= LP_EMULATOR_GRID_SIZE * LP_EMULATOR_GRID_SIZE) {
+        emu->stats.errors++;
+        return;
+    }
+
+    emu->effects[index % LP_EMULATOR_GRID_SIZE][index / LP_EMULATOR_GRID_SIZE] = effect;
+    emu->stats.leds_set++;
+}
+
+static bool lp_emulator_palette_color(lp_emulator_t *emu, uint8_t index, lp_emulator_color_t *color) {
+    if (index >= LP_EMULATOR_PALETTE_SIZE) {
+        emu->stats.errors++;
+        return false;
+    }
+
+    *color = lp_emulator_palette[index];
+    return true;
+}
+
+static esp_err_t lp_emulator_decode(lp_emulator_t *emu, uint8_t command, const uint8_t *data, size_t length) {
+    lp_emulator_color_t color;
+
+    switch (command) {
+        case LP_SET_LEDS:
+            ESP_RETURN_ON_FALSE(length % 2 == 0, ESP_ERR_INVALID_SIZE, TAG, "invalid palette led message");
+            for (size_t i = 0; i < length; i += 2) {
+                if (lp_emulator_palette_color(emu, data[i + 1], &color)) lp_emulator_set_led(emu, data[i], color);
+            }
+            return ESP_OK;
+
+        case LP_SET_LEDS_RGB:
+            ESP_RETURN_ON_FALSE(length % 4 == 0, ESP_ERR_INVALID_SIZE, TAG, "invalid rgb led message");
+            for (size_t i = 0; i < length; i += 4) {
+                lp_emulator_set_led(emu, data[i], (lp_emulator_color_t) { data[i + 1], data[i + 2], data[i + 3] });
+            }
+            return ESP_OK;
+
+        case LP_SET_LEDS_COLUMN:
+        case LP_SET_LEDS_ROW:
+            ESP_RETURN_ON_FALSE(length % 2 == 0, ESP_ERR_INVALID_SIZE, TAG, "invalid line message");
+            for (size_t i = 0; i < length; i += 2) {
+                ESP_RETURN_ON_FALSE(data[i] < LP_EMULATOR_GRID_SIZE, ESP_ERR_INVALID_ARG, TAG, "invalid line %d", data[i]);
+                if (!lp_emulator_palette_color(emu, data[i + 1], &color)) continue;
+
+                for (uint8_t j = 0; j < LP_EMULATOR_GRID_SIZE; j++) {
+                    lp_emulator_set_led(emu, command == LP_SET_LEDS_ROW
+                        ? data[i] * LP_EMULATOR_GRID_SIZE + j
+                        : j * LP_EMULATOR_GRID_SIZE + data[i], color);
+                }
+            }
+            return ESP_OK;
+
+        case LP_SET_LEDS_ALL:
+            ESP_RETURN_ON_FALSE(length == 1, ESP_ERR_INVALID_SIZE, TAG, "invalid fill message");
+            if (!lp_emulator_palette_color(emu, data[0], &color)) return ESP_OK;
+
+            for (uint8_t i = 0; i < LP_EMULATOR_GRID_SIZE * LP_EMULATOR_GRID_SIZE; i++) {
+                lp_emulator_set_led(emu, i, color);
+            }
+            return ESP_OK;
+
+        case LP_SET_LEDS_GRID_RGB: {
+            ESP_RETURN_ON_FALSE(length >= 1, ESP_ERR_INVALID_SIZE, TAG, "invalid grid message");
+
+            // the 10x10 grid covers all leds, the 8x8 one only the inner pads. Both bottom row first
+            uint8_t size = data[0] == LP_GRID_10X10 ? 10 : 8;
+            uint8_t offset = data[0] == LP_GRID_10X10 ? 0 : 1;
+            ESP_RETURN_ON_FALSE(data[0] <= LP_GRID_8X8 && length == 1 + size * size * 3, ESP_ERR_INVALID_SIZE,
+                TAG, "invalid grid message");
+
+            data++;
+            for (uint8_t y = 0; y < size; y++) {
+                for (uint8_t x = 0; x < size; x++, data += 3) {
+                    lp_emulator_set_led(emu, (y + offset) * LP_EMULATOR_GRID_SIZE + x + offset,
+                        (lp_emulator_color_t) { data[0], data[1], data[2] });
+                }
+            }
+            return ESP_OK;
+        }
+
+        case LP_EMULATOR_COMMAND_FLASH_LEDS:
+        case LP_EMULATOR_COMMAND_PULSE_LEDS:
+            ESP_RETURN_ON_FALSE(length % 2 == 0, ESP_ERR_INVALID_SIZE, TAG, "invalid effect message");
+            for (size_t i = 0; i < length; i += 2) {
+                if (!lp_emulator_palette_color(emu, data[i + 1], &color)) continue;
+
+                lp_emulator_set_effect(emu, data[i], (lp_emulator_effect_t) {
+                    .type = command == LP_EMULATOR_COMMAND_FLASH_LEDS ? LP_EMULATOR_EFFECT_FLASH : LP_EMULATOR_EFFECT_PULSE,
+                    .color = color
+                });
+            }
+            return ESP_OK;
+
+        case LP_EMULATOR_COMMAND_STANDALONE_MODE:
+            ESP_RETURN_ON_FALSE(length == 1, ESP_ERR_INVALID_SIZE, TAG, "invalid mode message");
+            emu->standalone = data[0] == 0x01;
+            return ESP_OK;
+
+        case LP_EMULATOR_COMMAND_LAYOUT:
+            ESP_RETURN_ON_FALSE(length == 1, ESP_ERR_INVALID_SIZE, TAG, "invalid layout message");
+            emu->layout = data[0];
+            return ESP_OK;
+
+        default:
+            ESP_LOGE(TAG, "unknown command %02x", command);
+            return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+esp_err_t lp_emulator_recv_sysex(lp_emulator_t *emu, const uint8_t *data, size_t length) {
+    emu->stats.bytes += length;
+    emu->stats.messages++;
+    emu->frame_messages++;
+
+    // header, command and terminator
+    size_t header_length = sizeof(lp_emulator_sysex_header);
+    if (length < header_length + 2 ||
+            memcmp(data, lp_emulator_sysex_header, header_length) != 0 ||
+            data[length - 1] != MIDI_COMMAND_SYSEX_END) {
+        emu->stats.errors++;
+        ESP_LOGE(TAG, "invalid sysex message");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = lp_emulator_decode(emu, data[header_length], &data[header_length + 1], length - header_length - 2);
+    if (ret != ESP_OK) emu->stats.errors++;
+    return ret;
+}
+
+esp_err_t lp_emulator_midi_send(lp_emulator_t *emu, const midi_message_t *message) {
+    // only sysex messages change the state of the device
+    if (message->command != MIDI_COMMAND_SYSEX) {
+        emu->stats.messages++;
+        return ESP_OK;
+    }
+
+    return lp_emulator_recv_sysex(emu, message->sysex.data, message->sysex.length);
+}
+
+void lp_emulator_sync(lp_emulator_t *emu) {
+    // everything received since the last sync belongs to one frame
+    if (emu->frame_messages > 0) emu->stats.frames++;
+    emu->frame_messages = 0;
+}
+
+
+esp_err_t lp_emulator_press(lp_emulator_t *emu, uint8_t x, uint8_t y, uint8_t velocity) {
+    ESP_RETURN_ON_FALSE(x < LP_EMULATOR_GRID_SIZE && y < LP_EMULATOR_GRID_SIZE, ESP_ERR_INVALID_ARG,
+        TAG, "invalid pad %d, %d", x, y);
+
+    // in the programmer layout the pads send notes, the buttons around them control changes
+    uint8_t index = x + y * LP_EMULATOR_GRID_SIZE;
+    bool button = x == 0 || y == 0 || x == LP_EMULATOR_GRID_SIZE - 1 || y == LP_EMULATOR_GRID_SIZE - 1;
+
+    midi_message_t message;
+    if (button) {
+        message = (midi_message_t) {
+            .command = MIDI_COMMAND_CONTROL_CHANGE,
+            .control_change = { .control = index, .value = velocity }
+        };
+    } else {
+        message = (midi_message_t) {
+            .command = MIDI_COMMAND_NOTE_ON,
+            .note_on = { .note = index, .velocity = velocity }
+        };
+    }
+
+    return CALLBACK_INVOKE(&emu->config.callbacks, pad_event, &message);
+}
+
+esp_err_t lp_emulator_release(lp_emulator_t *emu, uint8_t x, uint8_t y) {
+    // the launchpad releases pads with a zero velocity
+    return lp_emulator_press(emu, x, y, 0);
+}
+
+
+lp_emulator_color_t lp_emulator_get_led(lp_emulator_t *emu, uint8_t x, uint8_t y) {
+    return emu->leds[x][y];
+}
+
+lp_emulator_effect_t lp_emulator_get_effect(lp_emulator_t *emu, uint8_t x, uint8_t y) {
+    return emu->effects[x][y];
+}
+
+static uint8_t lp_emulator_to_8bit(uint8_t value) {
+    // the launchpad uses 6 bit colors, brighter values are clamped
+    if (value > 0x3f) value = 0x3f;
+    return value * 255 / 0x3f;
+}
+
+void lp_emulator_print(lp_emulator_t *emu, FILE *file) {
+    // top row first, every led as a 24 bit colored block
+    for (int y = LP_EMULATOR_GRID_SIZE - 1; y >= 0; y--) {
+        for (int x = 0; x < LP_EMULATOR_GRID_SIZE; x++) {
+            lp_emulator_color_t color = emu->leds[x][y];
+            fprintf(file, "\x1b[38;2;%d;%d;%dm██",
+                lp_emulator_to_8bit(color.red),
+                lp_emulator_to_8bit(color.green),
+                lp_emulator_to_8bit(color.blue));
+        }
+        fprintf(file, "\x1b[0m\n");
+    }
+}
+
+esp_err_t lp_emulator_write_ppm(lp_emulator_t *emu, const char *path, int scale) {
+    FILE *file = fopen(path, "wb");
+    ESP_RETURN_ON_FALSE(file != NULL, ESP_FAIL, TAG, "failed to open %s", path);
+
+    int size = LP_EMULATOR_GRID_SIZE * scale;
+    fprintf(file, "P6\n%d %d\n255\n", size, size);
+
+    // top row first, every led as a scale x scale square
+    for (int py = size - 1; py >= 0; py--) {
+        for (int px = 0; px < size; px++) {
+            lp_emulator_color_t color = emu->leds[px / scale][py / scale];
+            const uint8_t pixel[] = {
+                lp_emulator_to_8bit(color.red),
+                lp_emulator_to_8bit(color.green),
+                lp_emulator_to_8bit(color.blue)
+            };
+            fwrite(pixel, 1, sizeof(pixel), file);
+        }
+    }
+
+    fclose(file);
+    return ESP_OK;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include "midi_message.h"
+#include "callback.h"
+#include "controllers/launchpad_types.h"
+
+
+#define LP_EMULATOR_GRID_SIZE 10
+
+
+// pad events of the virtual launchpad, e.g. forwarded to controller_midi_recv
+CALLBACK_DECLARE(lp_emulator_pad_event, esp_err_t,
+    const midi_message_t *message);
+
+typedef struct {
+    struct {
+        void *context;
+        CALLBACK_TYPE(lp_emulator_pad_event) pad_event;
+    } callbacks;
+} lp_emulator_config_t;
+
+typedef struct {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+} lp_emulator_color_t;
+
+typedef enum {
+    LP_EMULATOR_EFFECT_NONE,
+    LP_EMULATOR_EFFECT_FLASH,
+    LP_EMULATOR_EFFECT_PULSE
+} lp_emulator_effect_type_t;
+
+typedef struct {
+    lp_emulator_effect_type_t type;
+    lp_emulator_color_t color;
+} lp_emulator_effect_t;
+
+typedef struct {
+    uint32_t bytes;
+    uint32_t messages;
+    uint32_t frames; // syncs that received at least one message
+    uint32_t leds_set;
+    uint32_t errors; // malformed messages and unknown palette colors
+} lp_emulator_stats_t;
+
+typedef struct {
+    lp_emulator_config_t config;
+
+    // indexed by [x][y] like the lpui framebuffer, led 99 is the side led
+    lp_emulator_color_t leds[LP_EMULATOR_GRID_SIZE][LP_EMULATOR_GRID_SIZE];
+    lp_emulator_effect_t effects[LP_EMULATOR_GRID_SIZE][LP_EMULATOR_GRID_SIZE]; // stopped by static colors
+    bool standalone;
+    uint8_t layout;
+
+    lp_emulator_stats_t stats;
+    uint32_t frame_messages;
+} lp_emulator_t;
+
+
+esp_err_t lp_emulator_init(lp_emulator_t *emu, const lp_emulator_config_t *config);
+
+// messages sent to the device
+esp_err_t lp_emulator_midi_send(lp_emulator_t *emu, const midi_message_t *message);
+esp_err_t lp_emulator_recv_sysex(lp_emulator_t *emu, const uint8_t *data, size_t length);
+void lp_emulator_sync(lp_emulator_t *emu);
+
+// messages sent by the device
+esp_err_t lp_emulator_press(lp_emulator_t *emu, uint8_t x, uint8_t y, uint8_t velocity);
+esp_err_t lp_emulator_release(lp_emulator_t *emu, uint8_t x, uint8_t y);
+
+lp_emulator_color_t lp_emulator_get_led(lp_emulator_t *emu, uint8_t x, uint8_t y);
+lp_emulator_effect_t lp_emulator_get_effect(lp_emulator_t *emu, uint8_t x, uint8_t y);
+void lp_emulator_print(lp_emulator_t *emu, FILE *file);
+esp_err_t lp_emulator_write_ppm(lp_emulator_t *emu, const char *path, int scale);
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <unistd.h>
+#include "lp_emulator.h"
+#include "lpui.h"
+#include "lpui_components/button.h"
+#include "lpui_components/pattern_editor.h"
+#include "lpui_components/piano_editor.h"
+
+
+#define BENCH_STEPS 64
+#define BENCH_FRAMES 1024
+
+
+static esp_err_t bench_sysex_ready(void *context, lpui_t *ui, uint8_t *buffer, size_t length) {
+    return lp_emulator_recv_sysex(context, buffer, length);
+}
+
+static esp_err_t bench_pad_event(void *context, const midi_message_t *message) {
+    return lpui_midi_recv(context, message);
+}
+
+int main(int argc, char *argv[]) {
+    static lp_emulator_t emu;
+    static lpui_t ui;
+    static button_t play_button;
+    static pattern_editor_t editor;
+    static piano_editor_t piano;
+    static pattern_t pattern;
+
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [snapshot.ppm]\n", argv[0]);
+        return 1;
+    }
+
+    lp_emulator_init(&emu, &(lp_emulator_config_t) {
+        .callbacks = { .context = &ui, .pad_event = bench_pad_event }
+    });
+    lpui_init(&ui, &(lpui_config_t) {
+        .callbacks = { .context = &emu, .sysex_ready = bench_sysex_ready }
+    });
+
+    // same layout as the launchpad controller
+    button_init(&play_button, &(button_config_t) {
+        .cmp_config = { .pos = { 0, 2 } },
+        .color = LPUI_COLOR_GREEN,
+        .mode = BUTTON_MODE_TOGGLE
+    });
+    lpui_add_component(&ui, &play_button.cmp);
+    button_draw(&play_button);
+
+    pattern_editor_init(&editor, &(pattern_editor_config_t) {
+        .cmp_config = { .pos = { 1, 5 }, .size = { 8, 4 } }
+    });
+    lpui_add_component(&ui, &editor.cmp);
+
+    piano_editor_init(&piano, &(piano_editor_config_t) {
+        .cmp_config = { .pos = { 1, 1 }, .size = { 8, 4 } }
+    });
+    lpui_add_component(&ui, &piano.cmp);
+    piano_editor_draw(&piano);
+
+    pattern_init(&pattern, &PATTERN_DEFAULT_CONFIG());
+    pattern_resize(&pattern, BENCH_STEPS);
+    for (int i = 0; i < BENCH_STEPS; i++) {
+        pattern.steps[i].atomic.velocity = (i % 3) ? 100 : 0;
+    }
+    pattern_editor_set_pattern(&editor, 0, &pattern);
+    lpui_commit(&ui);
+    lp_emulator_sync(&emu);
+
+    // press play, then follow the playhead at one step per frame while editing
+    // a step and switching tracks every now and then
+    lp_emulator_press(&emu, 0, 2, 127);
+    lp_emulator_release(&emu, 0, 2);
+    button_draw(&play_button);
+
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        pattern.step_position = i % BENCH_STEPS;
+        pattern_editor_update_step_position(&editor);
+
+        if (i % 16 == 0) {
+            lp_emulator_press(&emu, 1 + (i / 16) % 8, 5, 100);
+            lp_emulator_release(&emu, 1 + (i / 16) % 8, 5);
+
+            pattern_step_t *step = &pattern.steps[(i / 16) % BENCH_STEPS];
+            step->atomic.velocity = step->atomic.velocity ? 0 : 100;
+            pattern_editor_draw(&editor);
+        }
+        if (i % 256 == 255) {
+            pattern_editor_set_pattern(&editor, (i / 256) % 4, &pattern);
+        }
+
+        lpui_commit(&ui);
+        lp_emulator_sync(&emu);
+    }
+
+    printf("emulated session, %d frames\n", BENCH_FRAMES);
+    printf("  %u bytes, %u messages, %u frames with updates, %u leds set, %u errors\n",
+        (unsigned) emu.stats.bytes, (unsigned) emu.stats.messages, (unsigned) emu.stats.frames,
+        (unsigned) emu.stats.leds_set, (unsigned) emu.stats.errors);
+    printf("  %.1f bytes/frame, %.1f bytes/s at 60 Hz\n",
+        (double) emu.stats.bytes / BENCH_FRAMES, (double) emu.stats.bytes * 60 / BENCH_FRAMES);
+
+    if (isatty(STDOUT_FILENO)) lp_emulator_print(&emu, stdout);
+    if (argc == 2 && lp_emulator_write_ppm(&emu, argv[1], 16) != ESP_OK) return 1;
+
+    lpui_free(&ui);
+    return emu.stats.errors == 0 ? 0 : 1;
+}
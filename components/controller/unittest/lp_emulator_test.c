@@ -0,0 +1,235 @@
+#include "bdd-for-c.h"
+#include "lp_emulator.h"
+#include "lpui.h"
+#include "lpui_components/button.h"
+#include "lpui_components/pattern_editor.h"
+#include "lpui_components/piano_editor.h"
+
+
+#define MAX_EVENTS 8
+
+
+static midi_message_t events[MAX_EVENTS];
+static int num_events;
+
+static esp_err_t test_pad_event(void *context, const midi_message_t *msg) {
+    if (num_events < MAX_EVENTS) events[num_events++] = *msg;
+    return ESP_OK;
+}
+
+static esp_err_t test_pad_event_lpui(void *context, const midi_message_t *msg) {
+    return lpui_midi_recv(context, msg);
+}
+
+static esp_err_t test_sysex_ready(void *context, lpui_t *ui, uint8_t *buffer, size_t length) {
+    return lp_emulator_recv_sysex(context, buffer, length);
+}
+
+static bool test_leds_equal(lp_emulator_t *emu, lpui_t *ui) {
+    for (uint8_t x = 0; x < LP_EMULATOR_GRID_SIZE; x++) {
+        for (uint8_t y = 0; y < LP_EMULATOR_GRID_SIZE; y++) {
+            lp_emulator_color_t a = lp_emulator_get_led(emu, x, y);
+            lpui_color_t b = lpui_get_led(ui, (lpui_position_t) { x, y });
+            if (a.red != b.red || a.green != b.green || a.blue != b.blue) return false;
+        }
+    }
+    return true;
+}
+
+#define SEND(emu, bytes...) do { \
+        const uint8_t data[] = { LP_SYSEX_HEADER, bytes, 0xF7 }; \
+        expect(lp_emulator_recv_sysex(emu, data, sizeof(data))) to_be(ESP_OK); \
+    } while (0)
+
+
+spec("lp emulator") {
+    static lp_emulator_t emu;
+
+    before_each() {
+        const lp_emulator_config_t config = {
+            .callbacks = {
+                .pad_event = test_pad_event
+            }
+        };
+        lp_emulator_init(&emu, &config);
+        num_events = 0;
+    }
+
+    describe("led commands") {
+        it("should set rgb and palette leds") {
+            SEND(&emu, LP_SET_LEDS_RGB, 11, 1, 2, 3, 12, 4, 5, 6);
+            SEND(&emu, LP_SET_LEDS, 13, 3);
+
+            expect(lp_emulator_get_led(&emu, 1, 1).blue) to_be(3);
+            expect(lp_emulator_get_led(&emu, 2, 1).red) to_be(4);
+            expect(lp_emulator_get_led(&emu, 3, 1).green) to_be(0x3f);
+            expect(emu.stats.leds_set) to_be(3);
+            expect(emu.stats.messages) to_be(2);
+            expect(emu.stats.bytes) to_be(16 + 10);
+            expect(emu.stats.errors) to_be(0);
+        }
+
+        it("should fill rows, columns and all leds") {
+            SEND(&emu, LP_SET_LEDS_ALL, 3);
+            expect(lp_emulator_get_led(&emu, 9, 9).red) to_be(0x3f);
+
+            SEND(&emu, LP_SET_LEDS_ROW, 4, 0);
+            SEND(&emu, LP_SET_LEDS_COLUMN, 7, 0);
+            expect(lp_emulator_get_led(&emu, 0, 4).red) to_be(0);
+            expect(lp_emulator_get_led(&emu, 7, 0).red) to_be(0);
+            expect(lp_emulator_get_led(&emu, 6, 5).red) to_be(0x3f);
+        }
+
+        it("should set the inner pads from an 8x8 grid") {
+            uint8_t data[8 + 1 + 64 * 3] = { LP_SYSEX_HEADER, LP_SET_LEDS_GRID_RGB, LP_GRID_8X8 };
+            for (int i = 0; i < 64; i++) data[8 + i * 3] = i;
+            data[sizeof(data) - 1] = 0xF7;
+
+            expect(lp_emulator_recv_sysex(&emu, data, sizeof(data))) to_be(ESP_OK);
+            expect(lp_emulator_get_led(&emu, 1, 1).red) to_be(0);
+            expect(lp_emulator_get_led(&emu, 8, 1).red) to_be(7);
+            expect(lp_emulator_get_led(&emu, 1, 2).red) to_be(8);
+            expect(lp_emulator_get_led(&emu, 8, 8).red) to_be(63);
+            expect(emu.stats.leds_set) to_be(64);
+        }
+
+        it("should report malformed messages") {
+            const uint8_t no_header[] = { 0xF0, 0x00, 0x20, 0x29, 0x02, 0x18, LP_SET_LEDS_ALL, 0x00, 0xF7 };
+            expect(lp_emulator_recv_sysex(&emu, no_header, sizeof(no_header))) to_be(ESP_ERR_INVALID_ARG);
+
+            const uint8_t split_led[] = { LP_SYSEX_HEADER, LP_SET_LEDS_RGB, 11, 1, 2, 0xF7 };
+            expect(lp_emulator_recv_sysex(&emu, split_led, sizeof(split_led))) to_be(ESP_ERR_INVALID_SIZE);
+
+            SEND(&emu, LP_SET_LEDS, 11, 100);
+            expect(emu.stats.errors) to_be(3);
+        }
+
+        it("should count frames") {
+            SEND(&emu, LP_SET_LEDS, 11, 3);
+            SEND(&emu, LP_SET_LEDS, 12, 3);
+            lp_emulator_sync(&emu);
+            lp_emulator_sync(&emu);
+            SEND(&emu, LP_SET_LEDS, 13, 3);
+            lp_emulator_sync(&emu);
+
+            expect(emu.stats.frames) to_be(2);
+        }
+    }
+
+    describe("pad events") {
+        it("should send notes for pads and control changes for buttons") {
+            lp_emulator_press(&emu, 3, 4, 100);
+            lp_emulator_release(&emu, 3, 4);
+            lp_emulator_press(&emu, 0, 2, 127);
+
+            expect(num_events) to_be(3);
+            expect(events[0].command) to_be(MIDI_COMMAND_NOTE_ON);
+            expect(events[0].note_on.note) to_be(43);
+            expect(events[0].note_on.velocity) to_be(100);
+            expect(events[1].note_on.velocity) to_be(0);
+            expect(events[2].command) to_be(MIDI_COMMAND_CONTROL_CHANGE);
+            expect(events[2].control_change.control) to_be(20);
+        }
+    }
+
+    describe("lpui") {
+        static lpui_t ui;
+        static button_t play_button;
+        static pattern_editor_t editor;
+        static piano_editor_t piano;
+        static pattern_t pattern;
+
+        before_each() {
+            // same layout as the launchpad controller, wired through the emulator
+            lpui_init(&ui, &(lpui_config_t) {
+                .callbacks = { .context = &emu, .sysex_ready = test_sysex_ready }
+            });
+            emu.config.callbacks.context = &ui;
+            emu.config.callbacks.pad_event = test_pad_event_lpui;
+
+            button_init(&play_button, &(button_config_t) {
+                .cmp_config = { .pos = { 0, 2 } },
+                .color = LPUI_COLOR_GREEN,
+                .mode = BUTTON_MODE_TOGGLE
+            });
+            lpui_add_component(&ui, &play_button.cmp);
+            button_draw(&play_button);
+
+            pattern_editor_init(&editor, &(pattern_editor_config_t) {
+                .cmp_config = { .pos = { 1, 5 }, .size = { 8, 4 } }
+            });
+            lpui_add_component(&ui, &editor.cmp);
+
+            piano_editor_init(&piano, &(piano_editor_config_t) {
+                .cmp_config = { .pos = { 1, 1 }, .size = { 8, 4 } }
+            });
+            lpui_add_component(&ui, &piano.cmp);
+            piano_editor_draw(&piano);
+
+            pattern_init(&pattern, &PATTERN_DEFAULT_CONFIG());
+            pattern_resize(&pattern, 64);
+            for (int i = 0; i < 64; i++) {
+                pattern.steps[i].atomic.velocity = (i % 3) ? 100 : 0;
+            }
+            pattern_editor_set_pattern(&editor, 1, &pattern);
+        }
+
+        after_each() {
+            lpui_free(&ui);
+        }
+
+        it("should show the framebuffer after every frame") {
+            for (int i = 0; i < 128; i++) {
+                pattern.step_position = i % 64;
+                pattern_editor_update_step_position(&editor);
+                expect(lpui_commit(&ui)) to_be(ESP_OK);
+                lp_emulator_sync(&emu);
+
+                check(test_leds_equal(&emu, &ui), "frame %d differs", i);
+            }
+
+            expect(emu.stats.errors) to_be(0);
+            expect(emu.stats.bytes) to_be(ui.stats.bytes);
+            expect(emu.stats.messages) to_be(ui.stats.messages);
+            expect(emu.stats.frames) to_be(ui.stats.frames);
+        }
+
+        it("should light the play button when it is pressed") {
+            lpui_commit(&ui);
+            expect(lp_emulator_get_led(&emu, 0, 2).green) to_be(lpui_color_darken(LPUI_COLOR_GREEN).green);
+
+            lp_emulator_press(&emu, 0, 2, 127);
+            lp_emulator_release(&emu, 0, 2);
+            button_draw(&play_button);
+            lpui_commit(&ui);
+
+            expect(play_button.pressed) to_be(true);
+            expect(lp_emulator_get_led(&emu, 0, 2).green) to_be(LPUI_COLOR_GREEN.green);
+        }
+
+        it("should flash the selected step on the device") {
+            ui.config.native_effects = true;
+            lpui_commit(&ui);
+
+            // the first step is at the top left of the pattern editor
+            pattern_editor_select_step(&editor, 0);
+            lpui_commit(&ui);
+            expect(lp_emulator_get_effect(&emu, 1, 8).type) to_be(LP_EMULATOR_EFFECT_FLASH);
+            expect(lp_emulator_get_effect(&emu, 1, 8).color.red) to_be(0x3f);
+
+            // the playhead passing by restarts the effect after the static color
+            for (int i = 0; i < 2; i++) {
+                pattern.step_position = i;
+                pattern_editor_update_step_position(&editor);
+                lpui_commit(&ui);
+                expect(lp_emulator_get_effect(&emu, 1, 8).type) to_be(LP_EMULATOR_EFFECT_FLASH);
+            }
+
+            pattern_editor_select_step(&editor, -1);
+            lpui_commit(&ui);
+            expect(lp_emulator_get_effect(&emu, 1, 8).type) to_be(LP_EMULATOR_EFFECT_NONE);
+            expect(test_leds_equal(&emu, &ui)) to_be(true);
+            expect(emu.stats.errors) to_be(0);
+        }
+    }
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <time.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "lp_emulator.h"
+#include "output_sim.h"
+#include "controllers/launchpad.h"
+
+
+#define BENCH_LOOPS 64
+
+
+static lp_emulator_t emu;
+static output_t output;
+static sequencer_t sequencer;
+
+// host time of the first latched duty since the pad was pressed
+static uint64_t bench_cv_ns;
+static output_backend_t bench_backend;
+
+
+static const output_port_config_t bench_port_configs[] = {
+    { .type = OUTPUT_ANALOG, .pin = 2, .vmax_mv = 5000 },
+    { .type = OUTPUT_ANALOG, .pin = 3, .vmax_mv = 5000 }
+};
+
+
+// the render task and the frame timer are not started on the host, frames are
+// committed by the bench instead
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameters,
+        UBaseType_t priority, TaskHandle_t *created_task) {
+    *created_task = NULL;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait) {
+    return 0;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    return ESP_OK;
+}
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static esp_err_t bench_update_duty(void *context, output_port_t *port) {
+    if (bench_cv_ns == 0) bench_cv_ns = bench_now_ns();
+    return output_sim_backend.update_duty(context, port);
+}
+
+static esp_err_t bench_midi_send(void *context, controller_t *controller, const midi_message_t *message) {
+    return lp_emulator_midi_send(&emu, message);
+}
+
+int main() {
+    uint64_t cv_ns = 0, cv_max_ns = 0, recv_ns = 0, recv_max_ns = 0, frame_ns = 0, frame_max_ns = 0;
+    uint32_t presses = 0;
+
+    // the simulated outputs, with the time of the first duty change recorded
+    bench_backend = output_sim_backend;
+    bench_backend.update_duty = bench_update_duty;
+    output_sim_reset();
+    output_init(&output, &(output_config_t) {
+        .num_columns = 1, .num_rows = 2, .port_configs = bench_port_configs,
+        .backend = &bench_backend
+    });
+    sequencer_init(&sequencer, &(sequencer_config_t) { .bpm = 120 });
+    lp_emulator_init(&emu, &(lp_emulator_config_t) { 0 });
+
+    // the controller as created by main for a connected launchpad
+    controller_t *controller = controller_create(&controller_class_launchpad, &(controller_config_t) {
+        .callbacks = { .midi_send = bench_midi_send },
+        .sequencer = &sequencer,
+        .output = &output
+    });
+    if (controller == NULL) {
+        fprintf(stderr, "failed to create the launchpad controller\n");
+        return 1;
+    }
+    controller_launchpad_t *launchpad = (controller_launchpad_t *) controller;
+    lp_emulator_sync(&emu);
+
+    // every pad of the piano, pressed and released
+    for (int i = 0; i < BENCH_LOOPS * 32; i++) {
+        for (uint8_t velocity = 100; ; velocity = 0) {
+            const midi_message_t message = {
+                .command = MIDI_COMMAND_NOTE_ON,
+                .note_on = { .note = (1 + i % 8) + (1 + i / 8 % 4) * 10, .velocity = velocity }
+            };
+
+            // the controller sets the cv outputs before it takes the ui lock
+            bench_cv_ns = 0;
+            uint64_t start = bench_now_ns();
+            controller_midi_recv(controller, &message, esp_timer_get_time());
+            uint64_t recv = bench_now_ns();
+
+            // highlighting the key is left to the next frame
+            lpui_commit(&launchpad->ui);
+            lp_emulator_sync(&emu);
+            uint64_t end = bench_now_ns();
+
+            if (bench_cv_ns != 0) {
+                cv_ns += bench_cv_ns - start;
+                if (bench_cv_ns - start > cv_max_ns) cv_max_ns = bench_cv_ns - start;
+                presses++;
+            }
+            recv_ns += recv - start;
+            frame_ns += end - recv;
+            if (recv - start > recv_max_ns) recv_max_ns = recv - start;
+            if (end - recv > frame_max_ns) frame_max_ns = end - recv;
+
+            if (velocity == 0) break;
+        }
+    }
+
+    uint32_t events = BENCH_LOOPS * 32 * 2;
+    printf("live input, %u piano key events through controller_midi_recv\n", (unsigned) events);
+    printf("  key to cv:    %6.1f ns avg, %6.1f ns max (%u events changed a duty)\n",
+        (double) cv_ns / presses, (double) cv_max_ns, (unsigned) presses);
+    printf("  midi recv:    %6.1f ns avg, %6.1f ns max\n", (double) recv_ns / events, (double) recv_max_ns);
+    printf("  frame:        %6.1f ns avg, %6.1f ns max, plus up to one frame (%d us) of waiting\n",
+        (double) frame_ns / events, (double) frame_max_ns, 1000000 / LP_FRAME_RATE_HZ);
+    printf("  %u emulator errors\n", (unsigned) emu.stats.errors);
+
+    controller_free(controller);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <time.h>
+#include "lp_emulator.h"
+#include "lpui.h"
+#include "lpui_components/pattern_editor.h"
+
+
+#define BENCH_STEPS 64
+#define BENCH_SECONDS 60
+#define BENCH_FRAME_PERIOD_US (1000000 / 60)
+#define BENCH_FRAME_OFFSET_US 7000 // frames are not aligned to the sequencer ticks
+#define BENCH_MAX_FLIPS 64
+
+
+typedef struct {
+    const char *name;
+    bool prefetch;
+    bool lookahead;
+} bench_mode_t;
+
+typedef struct {
+    uint32_t notes, flips;
+    int64_t note_time[BENCH_MAX_FLIPS]; // first note of each new page
+    int64_t flip_time[BENCH_MAX_FLIPS]; // frame that shows the new page
+    uint64_t flip_ns_max, frame_ns_total;
+    uint32_t frames;
+} bench_result_t;
+
+
+static esp_err_t bench_sysex_ready(void *context, lpui_t *ui, uint8_t *buffer, size_t length) {
+    return lp_emulator_recv_sysex(context, buffer, length);
+}
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_run(uint16_t bpm, const bench_mode_t *mode) {
+    static lp_emulator_t emu;
+    static lpui_t ui;
+    static pattern_editor_t editor;
+    static pattern_t pattern;
+
+    lp_emulator_init(&emu, &(lp_emulator_config_t) { 0 });
+    lpui_init(&ui, &(lpui_config_t) {
+        .callbacks = { .context = &emu, .sysex_ready = bench_sysex_ready }
+    });
+
+    // the pattern editor of the launchpad controller
+    pattern_editor_init(&editor, &(pattern_editor_config_t) {
+        .cmp_config = { .pos = { 1, 5 }, .size = { 8, 4 } }
+    });
+    lpui_add_component(&ui, &editor.cmp);
+
+    pattern_init(&pattern, &PATTERN_DEFAULT_CONFIG());
+    pattern_resize(&pattern, BENCH_STEPS);
+    for (int i = 0; i < BENCH_STEPS; i++) {
+        pattern.steps[i].atomic.velocity = (i % 3) ? 100 : 0;
+        pattern.steps[i].probability = 127;
+    }
+    pattern_editor_set_pattern(&editor, 0, &pattern);
+    lpui_commit(&ui);
+
+    uint64_t tick_period = 60000000ULL / (SEQ_PPQN * bpm);
+    uint64_t next_tick = 0, next_frame = BENCH_FRAME_OFFSET_US;
+    uint16_t page_steps = 8 * 4;
+
+    static bench_result_t result;
+    result = (bench_result_t) { 0 };
+
+    // merge the tick and frame events of the simulated time
+    while (next_tick < BENCH_SECONDS * 1000000ULL) {
+        if (next_tick <= next_frame) {
+            // the note of a step is played when its first substep is ticked, the first page is shown already
+            bool page_start = pattern.substep_position == 0 && pattern.step_position % page_steps == 0;
+            if (page_start && next_tick > 0 && result.notes < BENCH_MAX_FLIPS) {
+                result.note_time[result.notes++] = next_tick;
+            }
+
+            pattern_tick(&pattern);
+            next_tick += tick_period;
+            continue;
+        }
+
+        // a frame of the render task
+        uint8_t page = editor.page;
+        if (!mode->prefetch) editor.back_buffer_page = -1;
+
+        uint64_t start = bench_now_ns();
+        pattern_editor_update_playhead(&editor, tick_period, mode->lookahead ? BENCH_FRAME_PERIOD_US : 0);
+        lpui_commit(&ui);
+        uint64_t elapsed = bench_now_ns() - start;
+
+        result.frames++;
+        result.frame_ns_total += elapsed;
+        if (editor.page != page) {
+            if (elapsed > result.flip_ns_max) result.flip_ns_max = elapsed;
+            if (result.flips < BENCH_MAX_FLIPS) result.flip_time[result.flips++] = next_frame;
+        }
+
+        next_frame += BENCH_FRAME_PERIOD_US;
+    }
+
+    // pair the page flips with the notes they belong to, positive offsets show the page after its note
+    uint32_t count = result.flips < result.notes ? result.flips : result.notes;
+    int64_t offset_min = INT64_MAX, offset_max = INT64_MIN;
+    uint32_t late = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        int64_t offset = result.flip_time[i] - result.note_time[i];
+        if (offset < offset_min) offset_min = offset;
+        if (offset > offset_max) offset_max = offset;
+        if (offset > 0) late++;
+    }
+
+    printf("  %3u bpm, %-22s %2u flips, page shown %+6.1f .. %+6.1f ms from its note (jitter %4.1f ms), "
+        "%2u late, flip frame %5.1f us, frames %4.1f us avg\n",
+        bpm, mode->name, (unsigned) count, offset_min / 1000.0, offset_max / 1000.0,
+        (offset_max - offset_min) / 1000.0, (unsigned) late,
+        result.flip_ns_max / 1000.0, (double) result.frame_ns_total / result.frames / 1000.0);
+
+    lpui_free(&ui);
+}
+
+int main() {
+    const bench_mode_t modes[] = {
+        { "redraw on crossing:", false, false },
+        { "prefetch:", true, false },
+        { "prefetch + lookahead:", true, true }
+    };
+
+    printf("page flips, %d s, %d steps\n", BENCH_SECONDS, BENCH_STEPS);
+    for (uint16_t bpm = 90; bpm <= 180; bpm += 45) {
+        for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+            bench_run(bpm, &modes[i]);
+        }
+    }
+
+    return 0;
+}
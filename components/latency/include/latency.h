@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+
+
+#define LATENCY_HISTOGRAM_BUCKETS 20 // power of two buckets, the last one covers >= 2^18 us
+
+
+typedef enum {
+    LATENCY_PRESS_TO_LED,
+    LATENCY_NOTE_TO_CV,
+    LATENCY_USB_IN_RESUBMIT,
+    LATENCY_NUM_PATHS
+} latency_path_t;
+
+typedef struct {
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    int64_t total_us;
+    int64_t min_us;
+    int64_t max_us;
+} latency_histogram_t;
+
+
+void latency_reset();
+
+void latency_record(latency_path_t path, int64_t timestamp_us);
+void latency_record_duration(latency_path_t path, int64_t duration_us);
+
+// a consistent copy, recording goes on meanwhile
+void latency_get_histogram(latency_path_t path, latency_histogram_t *histogram);
+void latency_dump();
@@ -0,0 +1,97 @@
+#include "latency.h"
+#include <stdio.h>
+#include <string.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+
+static const char *latency_path_names[LATENCY_NUM_PATHS] = {
+    [LATENCY_PRESS_TO_LED] = "press -> led",
+    [LATENCY_NOTE_TO_CV] = "note in -> cv",
+    [LATENCY_USB_IN_RESUBMIT] = "usb in -> resubmit"
+};
+
+static latency_histogram_t latency_histograms[LATENCY_NUM_PATHS];
+
+// paths are recorded from several tasks, the dump reads them from another one
+static portMUX_TYPE latency_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+static uint8_t latency_bucket(int64_t duration_us) {
+    uint8_t bucket = 0;
+
+    // find the position of the highest bit
+    while (duration_us > 0 && bucket < LATENCY_HISTOGRAM_BUCKETS - 1) {
+        duration_us >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+void latency_reset() {
+    taskENTER_CRITICAL(&latency_lock);
+    memset(latency_histograms, 0, sizeof(latency_histograms));
+    taskEXIT_CRITICAL(&latency_lock);
+}
+
+void latency_record(latency_path_t path, int64_t timestamp_us) {
+    // timestamps of 0 mark events that did not originate from an input
+    if (timestamp_us == 0) return;
+
+    latency_record_duration(path, esp_timer_get_time() - timestamp_us);
+}
+
+void latency_record_duration(latency_path_t path, int64_t duration_us) {
+    latency_histogram_t *histogram = &latency_histograms[path];
+
+    if (duration_us < 0) duration_us = 0;
+    uint8_t bucket = latency_bucket(duration_us);
+
+    taskENTER_CRITICAL(&latency_lock);
+    histogram->buckets[bucket]++;
+    histogram->total_us += duration_us;
+    if (histogram->count == 0 || duration_us < histogram->min_us) histogram->min_us = duration_us;
+    if (duration_us > histogram->max_us) histogram->max_us = duration_us;
+    histogram->count++;
+    taskEXIT_CRITICAL(&latency_lock);
+}
+
+void latency_get_histogram(latency_path_t path, latency_histogram_t *histogram) {
+    taskENTER_CRITICAL(&latency_lock);
+    *histogram = latency_histograms[path];
+    taskEXIT_CRITICAL(&latency_lock);
+}
+
+void latency_dump() {
+    for (int path = 0; path < LATENCY_NUM_PATHS; path++) {
+        // printed from a copy, outside of the critical section
+        latency_histogram_t copy;
+        const latency_histogram_t *histogram = &copy;
+        latency_get_histogram(path, &copy);
+
+        printf("LATENCY %s: n=%u", latency_path_names[path], (unsigned) histogram->count);
+        if (histogram->count == 0) {
+            printf("\n");
+            continue;
+        }
+
+        printf(" min=%lldus avg=%lldus max=%lldus\n",
+            (long long) histogram->min_us,
+            (long long) (histogram->total_us / histogram->count),
+            (long long) histogram->max_us);
+
+        // print all non-empty buckets
+        for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+            if (histogram->buckets[i] == 0) continue;
+
+            uint32_t lower = i == 0 ? 0 : 1U << (i - 1);
+            if (i == LATENCY_HISTOGRAM_BUCKETS - 1) {
+                printf("    >= %uus: %u\n", (unsigned) lower, (unsigned) histogram->buckets[i]);
+            } else {
+                printf("    %u - %uus: %u\n", (unsigned) lower, (unsigned) ((1U << i) - 1), (unsigned) histogram->buckets[i]);
+            }
+        }
+    }
+}
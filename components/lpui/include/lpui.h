@@ -1,15 +1,33 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <esp_err.h>
 #include "midi_message.h"
 #include "callback.h"
 #include "lpui_types.h"
 
 
+#define LPUI_GRID_SIZE 10
+#define LPUI_HIT_DEPTH 4 // maximum number of overlapping components per pad
+
 #define LPUI_SYSEX_BUFFER_SIZE 256
 #define LPUI_SYSEX_HEADER 0xF0, 0x00, 0x20, 0x29, 0x02, 0x10
+#define LPUI_SYSEX_OVERHEAD 8 // header, command and terminator
+#define LPUI_SYSEX_PAYLOAD_SIZE (LPUI_SYSEX_BUFFER_SIZE - LPUI_SYSEX_OVERHEAD)
+#define LPUI_SYSEX_COMMAND_SET_LEDS_PALETTE 0x0A
 #define LPUI_SYSEX_COMMAND_SET_LEDS 0x0B
+#define LPUI_SYSEX_COMMAND_SET_LEDS_COLUMN 0x0C
+#define LPUI_SYSEX_COMMAND_SET_LEDS_ROW 0x0D
+#define LPUI_SYSEX_COMMAND_SET_LEDS_ALL 0x0E
+#define LPUI_SYSEX_COMMAND_SET_LEDS_GRID 0x0F
+#define LPUI_SYSEX_GRID_8X8 0x01
+#define LPUI_SYSEX_COMMAND_FLASH_LEDS 0x23
+#define LPUI_SYSEX_COMMAND_PULSE_LEDS 0x28
+
+// software effects follow the device's default clock of 120 bpm
+#define LPUI_EFFECT_PERIOD_US 500000
+#define LPUI_EFFECT_PULSE_LEVELS 8
 
 #define LPUI_COLOR(r, g, b) ((lpui_color_t) { .red = r, .green = g, .blue = b })
 #define LPUI_COLOR_BLACK LPUI_COLOR(0x00, 0x00, 0x00)
@@ -20,6 +38,9 @@
     LPUI_COLOR(0x20, 0x00, 0x30), \
     LPUI_COLOR(0x20, 0x20, 0x20)
 #define LPUI_COLOR_PLAYHEAD LPUI_COLOR(0x3f, 0x3f, 0x3f)
+#define LPUI_COLOR_SELECTED LPUI_COLOR(0x3f, 0x3f, 0x3f)
+#define LPUI_COLOR_VIEW LPUI_COLOR(0x00, 0x20, 0x3f)
+#define LPUI_COLOR_RECORD LPUI_COLOR(0x3f, 0x00, 0x00)
 
 #define LPUI_COLOR_PIANO_RELEASED LPUI_COLOR(0x20, 0x20, 0x20)
 #define LPUI_COLOR_PIANO_PRESSED LPUI_COLOR(0x3f, 0x3f, 0x3f)
@@ -36,6 +57,9 @@ typedef struct {
 typedef struct {
     lpui_position_t pos;
     lpui_size_t size;
+
+    uint8_t z; // components on higher layers receive key events first
+    bool opaque; // hides the components below from key events
 } lpui_component_config_t;
 
 typedef struct lpui_t lpui_t;
@@ -57,15 +81,45 @@ typedef struct {
         void *context;
         CALLBACK_TYPE(lpui_sysex_ready) sysex_ready;
     } callbacks;
+
+    bool native_effects; // let the device animate effects with palette colors
 } lpui_config_t;
 
+typedef struct {
+    uint32_t frames; // commits that sent at least one led
+    uint32_t leds_drawn; // framebuffer writes
+    uint32_t leds_sent;
+    uint32_t messages;
+    uint32_t bytes;
+    uint32_t bytes_rgb; // bytes the same commits would have needed with per led rgb only
+} lpui_stats_t;
+
 struct lpui_t {
     lpui_config_t config;
 
     lpui_component_t *components;
 
+    // components covering each pad, ordered from the top layer down. Rebuilt
+    // whenever a component is added, moved or removed
+    lpui_component_t *hit_map[LPUI_GRID_SIZE][LPUI_GRID_SIZE][LPUI_HIT_DEPTH];
+
+    // components draw into the current image, a commit sends the leds that
+    // differ from the previous image
+    lpui_image_t image;
+    bool invalidated;
+    lpui_stats_t stats;
+
+    // effects on top of the image. Native effects are sent once and animated by
+    // the device, the others are rendered into the output image at commit
+    lpui_effect_t effects[LPUI_GRID_SIZE][LPUI_GRID_SIZE];
+    lpui_effect_t effects_sent[LPUI_GRID_SIZE][LPUI_GRID_SIZE];
+    bool stale[LPUI_GRID_SIZE][LPUI_GRID_SIZE]; // leds to resend even if unchanged
+    lpui_image_buffer_t output;
+    int64_t time;
+
     uint8_t *buffer;
     uint8_t *buffer_ptr;
+    uint8_t command; // command of the message being written, repeated when it is split
 };
 
 
@@ -77,12 +131,25 @@ esp_err_t lpui_component_init(lpui_component_t *cmp,
     const lpui_component_functions_t *functions);
 esp_err_t lpui_add_component(lpui_t *ui, lpui_component_t *cmp);
 esp_err_t lpui_remove_component(lpui_t *ui, lpui_component_t *cmp);
+esp_err_t lpui_move_component(lpui_t *ui, lpui_component_t *cmp, lpui_position_t pos, uint8_t z);
+
+
+void lpui_set_led(lpui_t *ui, lpui_position_t pos, lpui_color_t color);
+lpui_color_t lpui_get_led(lpui_t *ui, lpui_position_t pos);
+
+void lpui_set_led_effect(lpui_t *ui, lpui_position_t pos, lpui_effect_t effect);
+void lpui_animate(lpui_t *ui, int64_t time);
+
+void lpui_invalidate(lpui_t *ui);
+esp_err_t lpui_commit(lpui_t *ui);
 
 
 esp_err_t lpui_sysex_reset(lpui_t *ui, uint8_t command);
 esp_err_t lpui_sysex_add_color(lpui_t *ui, lpui_color_t color);
+esp_err_t lpui_sysex_add_entry(lpui_t *ui, const uint8_t *entry, size_t length);
 esp_err_t lpui_sysex_add_led_color(lpui_t *ui, lpui_position_t pos, lpui_color_t color);
 esp_err_t lpui_sysex_commit(lpui_t *ui);
 
 
 esp_err_t lpui_midi_recv(lpui_t *ui, const midi_message_t *message);
+esp_err_t lpui_decode_key(const midi_message_t *message, lpui_position_t *pos, uint8_t *velocity);
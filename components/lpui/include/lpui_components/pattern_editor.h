@@ -5,17 +5,44 @@
 #include "sequencer.h"
 
 
+#define PATTERN_EDITOR_MAX_STEPS (LPUI_GRID_SIZE * LPUI_GRID_SIZE)
+#define PATTERN_EDITOR_CACHE_STEPS 64 // longer patterns compute the colors of the remaining steps on each draw
+
+
+typedef enum {
+    PATTERN_EDITOR_VIEW_VELOCITY, // step on/off of the selected track
+    PATTERN_EDITOR_VIEW_GATE,
+    PATTERN_EDITOR_VIEW_PROBABILITY,
+    PATTERN_EDITOR_VIEW_NOTE,
+    PATTERN_EDITOR_VIEW_OVERVIEW, // one row per track, showing the steps around its playhead
+    PATTERN_EDITOR_NUM_VIEWS
+} pattern_editor_view_t;
+
+#define PATTERN_EDITOR_NUM_LANES PATTERN_EDITOR_VIEW_OVERVIEW
+
+
 typedef struct pattern_editor_t pattern_editor_t;
 CALLBACK_DECLARE(pattern_editor_pressed, esp_err_t,
     pattern_editor_t *editor, uint16_t step_position);
 CALLBACK_DECLARE(pattern_editor_released, esp_err_t,
-    pattern_editor_t *editor, uint16_t step_position)
+    pattern_editor_t *editor, uint16_t step_position);
+CALLBACK_DECLARE(pattern_editor_track_pressed, esp_err_t,
+    pattern_editor_t *editor, int track_id)
+
+// colors derived from the steps of a pattern, for each lane
+typedef struct {
+    pattern_t *pattern;
+    pattern_step_t *steps; // resizing the pattern reallocates the steps
+    bool valid[PATTERN_EDITOR_CACHE_STEPS];
+    lpui_color_t colors[PATTERN_EDITOR_CACHE_STEPS][PATTERN_EDITOR_NUM_LANES];
+} pattern_editor_cache_t;
 
 typedef struct {
     struct {
         void *context;
         CALLBACK_TYPE(pattern_editor_pressed) pressed;
         CALLBACK_TYPE(pattern_editor_released) released;
+        CALLBACK_TYPE(pattern_editor_track_pressed) track_pressed; // overview only
     } callbacks;
     lpui_component_config_t cmp_config;
 } pattern_editor_config_t;
@@ -26,11 +53,21 @@ struct pattern_editor_t {
 
     int track_id;
     pattern_t *pattern;
+    pattern_t *patterns[SEQUENCER_NUM_TRACKS];
+    pattern_editor_cache_t caches[SEQUENCER_NUM_TRACKS];
+
+    pattern_editor_view_t view;
+    uint16_t overview_positions[SEQUENCER_NUM_TRACKS]; // playheads shown in the overview
 
     uint8_t page;
     uint16_t step_offset;
 
     uint16_t step_position;
+    int selected_step; // flashes, -1 if no step is selected
+
+    // the next page, rendered before the playhead crosses into it
+    lpui_color_t back_buffer[PATTERN_EDITOR_MAX_STEPS];
+    int back_buffer_page; // -1 if outdated
 };
 
 
@@ -41,4 +78,8 @@ esp_err_t pattern_editor_draw(pattern_editor_t *editor);
 esp_err_t pattern_editor_draw_steps(pattern_editor_t *editor, uint16_t step_positions[], size_t n);
 
 esp_err_t pattern_editor_set_pattern(pattern_editor_t *editor, int track_id, pattern_t *pattern);
+esp_err_t pattern_editor_set_track_pattern(pattern_editor_t *editor, int track_id, pattern_t *pattern);
+esp_err_t pattern_editor_set_view(pattern_editor_t *editor, pattern_editor_view_t view);
 esp_err_t pattern_editor_update_step_position(pattern_editor_t *editor);
+esp_err_t pattern_editor_update_playhead(pattern_editor_t *editor, uint64_t tick_period_us, uint64_t lead_us);
+esp_err_t pattern_editor_select_step(pattern_editor_t *editor, int step_position);
@@ -1,20 +1,40 @@
 #pragma once
 
 #include "lpui.h"
+#include "callback.h"
 
 
+#define PIANO_EDITOR_DEFAULT_BASE_NOTE 48
+
+
+typedef struct piano_editor_t piano_editor_t;
+CALLBACK_DECLARE(piano_editor_pressed, esp_err_t,
+    piano_editor_t *editor, uint8_t note, uint8_t velocity);
+CALLBACK_DECLARE(piano_editor_released, esp_err_t,
+    piano_editor_t *editor, uint8_t note);
+
 typedef struct {
+    struct {
+        void *context;
+        CALLBACK_TYPE(piano_editor_pressed) pressed;
+        CALLBACK_TYPE(piano_editor_released) released;
+    } callbacks;
     lpui_component_config_t cmp_config;
+
+    uint8_t base_note; // note of the bottom left key, each pair of rows is one octave
 } piano_editor_config_t;
 
-typedef struct {
+struct piano_editor_t {
     piano_editor_config_t config;
     lpui_component_t cmp;
-} piano_editor_t;
+
+    uint32_t pressed_notes[4]; // one bit per midi note, pressed keys are highlighted
+};
 
 
 esp_err_t piano_editor_init(piano_editor_t *editor, const piano_editor_config_t *config);
 esp_err_t piano_editor_key_event(void *context, const lpui_position_t pos, uint8_t velocity);
+esp_err_t piano_editor_get_note(piano_editor_t *editor, lpui_position_t pos, uint8_t *note);
 
 esp_err_t piano_editor_draw(piano_editor_t *editor);
 esp_err_t piano_editor_draw_note(piano_editor_t *editor, uint8_t note);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include "lpui.h"
+
+
+typedef struct {
+    int8_t fill; // palette entry to fill all leds with first, -1 for none
+    bool lines; // fill rows and columns of a single palette color
+    bool grid; // send the inner 8x8 pads as one rgb block
+    bool palette; // send palette colors as indices instead of rgb
+} lpui_encoder_plan_t;
+
+#define LPUI_ENCODER_PLAN_RGB() { \
+    .fill = -1, \
+    .lines = false, \
+    .grid = false, \
+    .palette = false \
+}
+
+
+// costs of sending the output image rendered by the last commit
+esp_err_t lpui_encoder_cost(lpui_t *ui, const lpui_encoder_plan_t *plan, size_t *cost);
+esp_err_t lpui_encoder_choose(lpui_t *ui, lpui_encoder_plan_t *plan, size_t *cost);
+
+bool lpui_palette_find(lpui_color_t color, uint8_t *index);
+
+esp_err_t lpui_encode(lpui_t *ui, size_t *num_leds, bool touched[LPUI_GRID_SIZE][LPUI_GRID_SIZE]);
@@ -19,6 +19,17 @@ typedef struct {
     uint8_t height;
 } lpui_size_t;
 
+typedef enum {
+    LPUI_EFFECT_NONE,
+    LPUI_EFFECT_FLASH, // alternates between the led color and the effect color
+    LPUI_EFFECT_PULSE // pulses the effect color
+} lpui_effect_type_t;
+
+typedef struct {
+    lpui_effect_type_t type;
+    lpui_color_t color;
+} lpui_effect_t;
+
 typedef struct {
     lpui_color_t leds[10][10];
     lpui_color_t side_led;
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <esp_check.h>
 #include "utlist.h"
+#include "lpui_encoder.h"
 
 
 static const char *TAG = "lpui";
@@ -18,6 +19,19 @@ esp_err_t lpui_init(lpui_t *ui, const lpui_config_t *config) {
 
     // reset the components list
     ui->components = NULL;
+    memset(ui->hit_map, 0, sizeof(ui->hit_map));
+
+    // the device starts out cleared, just like the framebuffer
+    lpui_image_init(&ui->image);
+    ui->invalidated = false;
+    memset(&ui->stats, 0, sizeof(ui->stats));
+
+    // no effects are running
+    memset(ui->effects, 0, sizeof(ui->effects));
+    memset(ui->effects_sent, 0, sizeof(ui->effects_sent));
+    memset(ui->stale, 0, sizeof(ui->stale));
+    ui->output = ui->image.current;
+    ui->time = 0;
 
     // allocate the sysex buffer
     ui->buffer = calloc(LPUI_SYSEX_BUFFER_SIZE, sizeof(uint8_t));
@@ -29,6 +43,7 @@ esp_err_t lpui_init(lpui_t *ui, const lpui_config_t *config) {
     memcpy(ui->buffer, lpui_sysex_header, sizeof(lpui_sysex_header));
 
     ui->buffer_ptr = ui->buffer;
+    ui->command = LPUI_SYSEX_COMMAND_SET_LEDS;
     return ESP_OK;
 }
 
@@ -50,23 +65,227 @@ esp_err_t lpui_component_init(lpui_component_t *cmp,
     return ESP_OK;
 }
 
+static esp_err_t lpui_hit_map_insert(lpui_component_t **cell, lpui_component_t *cmp) {
+    // the cell is full, the component would be unreachable
+    if (cell[LPUI_HIT_DEPTH - 1] != NULL) return ESP_ERR_NO_MEM;
+
+    // keep the cell sorted from the top layer down, equal layers keep the list order
+    size_t i = 0;
+    while (cell[i] != NULL && cell[i]->config.z >= cmp->config.z) i++;
+
+    memmove(&cell[i + 1], &cell[i], (LPUI_HIT_DEPTH - i - 1) * sizeof(*cell));
+    cell[i] = cmp;
+
+    return ESP_OK;
+}
+
+static esp_err_t lpui_hit_map_rebuild(lpui_t *ui) {
+    memset(ui->hit_map, 0, sizeof(ui->hit_map));
+
+    for (lpui_component_t *cmp = ui->components; cmp != NULL; cmp = cmp->next) {
+        // clip the component to the grid
+        lpui_position_t pos;
+        for (pos.y = cmp->config.pos.y; pos.y < cmp->config.pos.y + cmp->config.size.height && pos.y < LPUI_GRID_SIZE; pos.y++) {
+            for (pos.x = cmp->config.pos.x; pos.x < cmp->config.pos.x + cmp->config.size.width && pos.x < LPUI_GRID_SIZE; pos.x++) {
+                ESP_RETURN_ON_ERROR(lpui_hit_map_insert(ui->hit_map[pos.x][pos.y], cmp),
+                    TAG, "too many components overlap at %d, %d", pos.x, pos.y);
+            }
+        }
+    }
+
+    return ESP_OK;
+}
+
 esp_err_t lpui_add_component(lpui_t *ui, lpui_component_t *cmp) {
     // link the ui and component
     cmp->ui = ui;
     LL_PREPEND(ui->components, cmp);
-    return ESP_OK;
+
+    // unlink it again if it does not fit into the hit map
+    esp_err_t ret = lpui_hit_map_rebuild(ui);
+    if (ret != ESP_OK) {
+        lpui_remove_component(ui, cmp);
+    }
+    return ret;
 }
 
 esp_err_t lpui_remove_component(lpui_t *ui, lpui_component_t *cmp) {
     // unlink the ui and component
     LL_DELETE(ui->components, cmp);
     cmp->ui = NULL;
+
+    // removing never overflows the hit map
+    return lpui_hit_map_rebuild(ui);
+}
+
+esp_err_t lpui_move_component(lpui_t *ui, lpui_component_t *cmp, lpui_position_t pos, uint8_t z) {
+    lpui_component_config_t previous = cmp->config;
+
+    cmp->config.pos = pos;
+    cmp->config.z = z;
+
+    // restore the previous placement if the new one does not fit into the hit map
+    esp_err_t ret = lpui_hit_map_rebuild(ui);
+    if (ret != ESP_OK) {
+        cmp->config = previous;
+        lpui_hit_map_rebuild(ui);
+    }
+    return ret;
+}
+
+
+static bool lpui_color_equals(lpui_color_t a, lpui_color_t b) {
+    return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+void lpui_set_led(lpui_t *ui, lpui_position_t pos, lpui_color_t color) {
+    lpui_image_set_pixel(&ui->image, pos, color);
+    ui->stats.leds_drawn++;
+}
+
+lpui_color_t lpui_get_led(lpui_t *ui, lpui_position_t pos) {
+    return lpui_image_get_pixel(&ui->image, pos);
+}
+
+void lpui_set_led_effect(lpui_t *ui, lpui_position_t pos, lpui_effect_t effect) {
+    ui->effects[pos.x][pos.y] = effect;
+}
+
+void lpui_animate(lpui_t *ui, int64_t time) {
+    // software effects are rendered for this time at the next commit
+    ui->time = time;
+}
+
+void lpui_invalidate(lpui_t *ui) {
+    // e.g. after the device was cleared behind our back
+    ui->invalidated = true;
+    memset(ui->effects_sent, 0, sizeof(ui->effects_sent));
+}
+
+static bool lpui_effect_equals(lpui_effect_t a, lpui_effect_t b) {
+    return a.type == b.type && (a.type == LPUI_EFFECT_NONE || lpui_color_equals(a.color, b.color));
+}
+
+static bool lpui_effect_is_native(lpui_t *ui, lpui_effect_t effect, uint8_t *index) {
+    // the device only animates palette colors
+    return ui->config.native_effects && effect.type != LPUI_EFFECT_NONE &&
+        lpui_palette_find(effect.color, index);
+}
+
+static lpui_color_t lpui_effect_render(lpui_t *ui, lpui_effect_t effect, lpui_color_t color) {
+    int64_t phase = ui->time % LPUI_EFFECT_PERIOD_US;
+
+    switch (effect.type) {
+        case LPUI_EFFECT_FLASH:
+            // the effect color for the first half of each period
+            return phase < LPUI_EFFECT_PERIOD_US / 2 ? effect.color : color;
+
+        case LPUI_EFFECT_PULSE: {
+            // a triangle in a few steps, so that most frames do not change the led
+            int level = phase * 2 * LPUI_EFFECT_PULSE_LEVELS / LPUI_EFFECT_PERIOD_US;
+            if (level > LPUI_EFFECT_PULSE_LEVELS) level = 2 * LPUI_EFFECT_PULSE_LEVELS - level;
+            return LPUI_COLOR(
+                effect.color.red * level / LPUI_EFFECT_PULSE_LEVELS,
+                effect.color.green * level / LPUI_EFFECT_PULSE_LEVELS,
+                effect.color.blue * level / LPUI_EFFECT_PULSE_LEVELS);
+        }
+
+        default:
+            return color;
+    }
+}
+
+static void lpui_render_output(lpui_t *ui) {
+    uint8_t index;
+
+    for (int x = 0; x < LPUI_GRID_SIZE; x++) {
+        for (int y = 0; y < LPUI_GRID_SIZE; y++) {
+            lpui_effect_t effect = ui->effects[x][y];
+            lpui_effect_t sent = ui->effects_sent[x][y];
+            lpui_color_t color = ui->image.current.leds[x][y];
+
+            // a static color stops a native effect on the device
+            if (!lpui_effect_equals(effect, sent) && lpui_effect_is_native(ui, sent, &index)) {
+                ui->stale[x][y] = true;
+            }
+
+            ui->output.leds[x][y] = lpui_effect_is_native(ui, effect, &index)
+                ? color
+                : lpui_effect_render(ui, effect, color);
+        }
+    }
+}
+
+static esp_err_t lpui_send_effects(lpui_t *ui, lpui_effect_type_t type, uint8_t command,
+        bool touched[LPUI_GRID_SIZE][LPUI_GRID_SIZE], size_t *num_effects) {
+    size_t num_sent = 0;
+    uint8_t index;
+
+    lpui_position_t pos;
+    for (pos.y = 0; pos.y < LPUI_GRID_SIZE; pos.y++) {
+        for (pos.x = 0; pos.x < LPUI_GRID_SIZE; pos.x++) {
+            lpui_effect_t effect = ui->effects[pos.x][pos.y];
+            if (effect.type != type || !lpui_effect_is_native(ui, effect, &index)) continue;
+
+            // resend if the effect changed or a static color just stopped it
+            if (lpui_effect_equals(effect, ui->effects_sent[pos.x][pos.y]) && !touched[pos.x][pos.y]) continue;
+
+            if (num_sent == 0) {
+                ESP_RETURN_ON_ERROR(lpui_sysex_reset(ui, command),
+                    TAG, "failed to reset sysex");
+            }
+            const uint8_t entry[] = { pos.x + pos.y * 10, index };
+            ESP_RETURN_ON_ERROR(lpui_sysex_add_entry(ui, entry, sizeof(entry)),
+                TAG, "failed to add effect");
+            num_sent++;
+        }
+    }
+
+    if (num_sent > 0) {
+        ESP_RETURN_ON_ERROR(lpui_sysex_commit(ui),
+            TAG, "failed to commit effects");
+    }
+
+    *num_effects += num_sent;
+    return ESP_OK;
+}
+
+esp_err_t lpui_commit(lpui_t *ui) {
+    lpui_image_t *img = &ui->image;
+    bool touched[LPUI_GRID_SIZE][LPUI_GRID_SIZE];
+    size_t num_leds = 0, num_effects = 0;
+
+    // the image with the software effects at the current time
+    lpui_render_output(ui);
+
+    // send the changed leds with the cheapest mix of commands
+    ESP_RETURN_ON_ERROR(lpui_encode(ui, &num_leds, touched),
+        TAG, "failed to encode frame");
+
+    // then start the native effects on top of them
+    ESP_RETURN_ON_ERROR(lpui_send_effects(ui, LPUI_EFFECT_FLASH, LPUI_SYSEX_COMMAND_FLASH_LEDS, touched, &num_effects),
+        TAG, "failed to send flashing leds");
+    ESP_RETURN_ON_ERROR(lpui_send_effects(ui, LPUI_EFFECT_PULSE, LPUI_SYSEX_COMMAND_PULSE_LEDS, touched, &num_effects),
+        TAG, "failed to send pulsing leds");
+
+    if (num_leds > 0 || num_effects > 0) {
+        ui->stats.frames++;
+        ui->stats.leds_sent += num_leds + num_effects;
+    }
+
+    // the device now shows the output image and effects
+    img->previous = ui->output;
+    memcpy(ui->effects_sent, ui->effects, sizeof(ui->effects_sent));
+    memset(ui->stale, 0, sizeof(ui->stale));
+    ui->invalidated = false;
+
     return ESP_OK;
 }
 
 
 static bool lpui_sysex_buffer_has_space(lpui_t *ui, size_t size) {
-    return ui->buffer_ptr + size < ui->buffer + LPUI_SYSEX_BUFFER_SIZE;
+    // always keep one byte for the terminator
+    return ui->buffer_ptr + size + 1 <= ui->buffer + LPUI_SYSEX_BUFFER_SIZE;
 }
 
 esp_err_t lpui_sysex_reset(lpui_t *ui, uint8_t command) {
@@ -75,6 +294,7 @@ esp_err_t lpui_sysex_reset(lpui_t *ui, uint8_t command) {
 
     // write the command
     *ui->buffer_ptr++ = command;
+    ui->command = command;
     return ESP_OK;
 }
 
@@ -91,76 +311,100 @@ esp_err_t lpui_sysex_add_color(lpui_t *ui, const lpui_color_t color) {
     return ESP_OK;
 }
 
-esp_err_t lpui_sysex_add_led_color(lpui_t *ui, const lpui_position_t pos, const lpui_color_t color) {
-    // validate the buffer size
-    ESP_RETURN_ON_FALSE(lpui_sysex_buffer_has_space(ui, 4), ESP_ERR_NO_MEM,
-        TAG, "not enough space in sysex buffer");
+esp_err_t lpui_sysex_add_entry(lpui_t *ui, const uint8_t *entry, size_t length) {
+    // if the buffer is full, send it and continue with the same command in a
+    // new message. Every entry is self contained, so any entry boundary is a valid split
+    if (!lpui_sysex_buffer_has_space(ui, length)) {
+        ESP_RETURN_ON_ERROR(lpui_sysex_commit(ui),
+            TAG, "failed to commit full sysex buffer");
+        ESP_RETURN_ON_ERROR(lpui_sysex_reset(ui, ui->command),
+            TAG, "failed to reset sysex buffer");
+    }
 
-    // write the position and rgb components
-    *ui->buffer_ptr++ = pos.x + pos.y * 10;
-    *ui->buffer_ptr++ = color.red;
-    *ui->buffer_ptr++ = color.green;
-    *ui->buffer_ptr++ = color.blue;
+    // the entry does not even fit into an empty message
+    ESP_RETURN_ON_FALSE(lpui_sysex_buffer_has_space(ui, length), ESP_ERR_NO_MEM,
+        TAG, "sysex entry too large");
+
+    memcpy(ui->buffer_ptr, entry, length);
+    ui->buffer_ptr += length;
 
     return ESP_OK;
 }
 
+esp_err_t lpui_sysex_add_led_color(lpui_t *ui, const lpui_position_t pos, const lpui_color_t color) {
+    // write the position and rgb components
+    const uint8_t entry[] = { pos.x + pos.y * 10, color.red, color.green, color.blue };
+    return lpui_sysex_add_entry(ui, entry, sizeof(entry));
+}
+
 esp_err_t lpui_sysex_commit(lpui_t *ui) {
     // validate the buffer size
-    ESP_RETURN_ON_FALSE(lpui_sysex_buffer_has_space(ui, 1), ESP_ERR_NO_MEM,
+    ESP_RETURN_ON_FALSE(lpui_sysex_buffer_has_space(ui, 0), ESP_ERR_NO_MEM,
         TAG, "not enough space in sysex buffer");
 
     // add the terminator byze and calculate the length
     *ui->buffer_ptr++ = 0xF7;
     size_t length = ui->buffer_ptr - ui->buffer;
 
+    ui->stats.messages++;
+    ui->stats.bytes += length;
+
     // invoke the sysex ready callback to render out the buffer
     return CALLBACK_INVOKE(&ui->config.callbacks, sysex_ready, ui, ui->buffer, length);
 }
 
 
-static bool lpui_component_contains_position(const lpui_component_t *cmp, const lpui_position_t pos) {
-    return pos.x >= cmp->config.pos.x &&
-        pos.x < cmp->config.pos.x + cmp->config.size.width &&
-        pos.y >= cmp->config.pos.y &&
-        pos.y < cmp->config.pos.y + cmp->config.size.height;
-}
-
-esp_err_t lpui_midi_recv(lpui_t *ui, const midi_message_t *message) {
-    uint8_t note, velocity;
+esp_err_t lpui_decode_key(const midi_message_t *message, lpui_position_t *pos, uint8_t *velocity) {
+    uint8_t note;
 
     // retrieve the note and velocity
     switch (message->command) {
         case MIDI_COMMAND_NOTE_ON:
             note = message->note_on.note;
-            velocity = message->note_on.velocity;
+            *velocity = message->note_on.velocity;
             break;
         case MIDI_COMMAND_NOTE_OFF:
             note = message->note_off.note;
-            velocity = 0;
+            *velocity = 0;
             break;
         case MIDI_COMMAND_CONTROL_CHANGE:
             note = message->control_change.control;
-            velocity = message->control_change.value;
+            *velocity = message->control_change.value;
             break;
         default:
-            return ESP_OK;
+            return ESP_ERR_NOT_FOUND;
     }
 
     // convert the note into a button
-    lpui_position_t pos = {
+    *pos = (lpui_position_t) {
         .x = note % 10,
         .y = note / 10
     };
 
-    // traverse the components list and find the first one to handle the event
-    for (lpui_component_t *cmp = ui->components; cmp != NULL; cmp = cmp->next) {
-        // skip components that do not contain the position
-        if (!lpui_component_contains_position(cmp, pos)) continue;
+    if (pos->x >= LPUI_GRID_SIZE || pos->y >= LPUI_GRID_SIZE) return ESP_ERR_NOT_FOUND;
+    return ESP_OK;
+}
+
+esp_err_t lpui_midi_recv(lpui_t *ui, const midi_message_t *message) {
+    lpui_position_t pos;
+    uint8_t velocity;
+
+    // ignore messages that are not key events
+    if (lpui_decode_key(message, &pos, &velocity) != ESP_OK) return ESP_OK;
+
+    // copy the owners, a key event may add or remove components
+    lpui_component_t *owners[LPUI_HIT_DEPTH];
+    memcpy(owners, ui->hit_map[pos.x][pos.y], sizeof(owners));
+
+    // dispatch from the top layer down until an opaque component is reached
+    for (size_t i = 0; i < LPUI_HIT_DEPTH && owners[i] != NULL; i++) {
+        lpui_component_t *cmp = owners[i];
 
         // invoke the key_event callback
         ESP_RETURN_ON_ERROR(CALLBACK_INVOKE_REQUIRED(&cmp->functions, key_event, pos, velocity),
             TAG, "component does not implement key_event callback");
+
+        if (cmp->config.opaque) break;
     }
 
     return ESP_OK;
@@ -52,13 +52,8 @@ esp_err_t button_draw(button_t *button) {
     if (!button->pressed) color = lpui_color_darken(color);
 
     // draw the single pixel
-    ESP_RETURN_ON_ERROR(lpui_sysex_reset(ui, LPUI_SYSEX_COMMAND_SET_LEDS),
-        TAG, "failed to reset sysex");
-    ESP_RETURN_ON_ERROR(lpui_sysex_add_led_color(ui, button->cmp.config.pos, color),
-        TAG, "failed to add color to sysex");
-    ESP_RETURN_ON_ERROR(lpui_sysex_commit(ui),
-        TAG, "failed to commit sysex");
-    
+    lpui_set_led(ui, button->cmp.config.pos, color);
+
     return ESP_OK;
 }
 
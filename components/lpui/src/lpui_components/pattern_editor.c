@@ -1,6 +1,7 @@
 #include "lpui_components/pattern_editor.h"
 
 #include <esp_check.h>
+#include <string.h>
 
 
 static const char *TAG = "pattern_editor";
@@ -20,96 +21,272 @@ esp_err_t pattern_editor_init(pattern_editor_t *editor, const pattern_editor_con
 
     editor->track_id = 0;
     editor->pattern = NULL;
+    memset(editor->patterns, 0, sizeof(editor->patterns));
+    memset(editor->caches, 0, sizeof(editor->caches));
+
+    editor->view = PATTERN_EDITOR_VIEW_VELOCITY;
+    memset(editor->overview_positions, 0, sizeof(editor->overview_positions));
 
     editor->page = 0;
     editor->step_offset = 0;
 
     editor->step_position = 0;
+    editor->selected_step = -1;
+    editor->back_buffer_page = -1;
 
     return ESP_OK;
 }
 
 
-static esp_err_t _pattern_editor_draw_step(pattern_editor_t *editor, uint16_t step_position) {
-    lpui_t *ui = editor->cmp.ui;
+static lpui_color_t _pattern_editor_scale(lpui_color_t color, uint8_t value) {
+    // fade from the color of a disabled step to the full color
+    lpui_color_t dark = lpui_color_darken(color);
+    return (lpui_color_t) {
+        .red = dark.red + (color.red - dark.red) * value / 127,
+        .green = dark.green + (color.green - dark.green) * value / 127,
+        .blue = dark.blue + (color.blue - dark.blue) * value / 127
+    };
+}
+
+static void _pattern_editor_derive_colors(int track_id, const pattern_step_t *step, lpui_color_t colors[]) {
+    // get the base color
+    uint8_t color_id = track_id % (sizeof(lpui_color_patterns) / sizeof(lpui_color_t));
+    lpui_color_t base_color = lpui_color_patterns[color_id];
+
+    // disabled steps are dark in every lane
+    if (step->atomic.velocity == 0) {
+        for (int lane = 0; lane < PATTERN_EDITOR_NUM_LANES; lane++) {
+            colors[lane] = lpui_color_darken(base_color);
+        }
+        return;
+    }
+
+    colors[PATTERN_EDITOR_VIEW_VELOCITY] = base_color;
+    colors[PATTERN_EDITOR_VIEW_GATE] = _pattern_editor_scale(base_color, step->gate < 127 ? step->gate : 127);
+    colors[PATTERN_EDITOR_VIEW_PROBABILITY] = _pattern_editor_scale(base_color, step->probability);
+    colors[PATTERN_EDITOR_VIEW_NOTE] = _pattern_editor_scale(base_color, (step->atomic.note % 12 + 1) * 127 / 12);
+}
+
+static pattern_editor_cache_t *_pattern_editor_get_cache(pattern_editor_t *editor, int track_id) {
+    pattern_editor_cache_t *cache = &editor->caches[track_id];
+    pattern_t *pattern = editor->patterns[track_id];
+
+    // drop the colors of a replaced or resized pattern
+    if (cache->pattern != pattern || cache->steps != pattern->steps) {
+        memset(cache->valid, 0, sizeof(cache->valid));
+        cache->pattern = pattern;
+        cache->steps = pattern->steps;
+    }
+
+    return cache;
+}
+
+static void _pattern_editor_invalidate_cache(pattern_editor_t *editor, int track_id) {
+    pattern_editor_cache_t *cache = &editor->caches[track_id];
+
+    // the next draw derives all colors from the steps again
+    memset(cache->valid, 0, sizeof(cache->valid));
+    cache->pattern = editor->patterns[track_id];
+    cache->steps = cache->pattern != NULL ? cache->pattern->steps : NULL;
+}
+
+static lpui_color_t _pattern_editor_get_lane_color(pattern_editor_t *editor, int track_id, uint16_t step_position,
+        pattern_editor_view_t lane) {
+    // check if the pattern and the step index are valid
+    pattern_t *pattern = editor->patterns[track_id];
+    if (pattern == NULL || step_position >= pattern->config.step_length) {
+        return LPUI_COLOR_BLACK;
+    }
+
+    // steps past the cache are derived on each draw
+    if (step_position >= PATTERN_EDITOR_CACHE_STEPS) {
+        lpui_color_t colors[PATTERN_EDITOR_NUM_LANES];
+        _pattern_editor_derive_colors(track_id, &pattern->steps[step_position], colors);
+        return colors[lane];
+    }
+
+    pattern_editor_cache_t *cache = _pattern_editor_get_cache(editor, track_id);
+    if (!cache->valid[step_position]) {
+        _pattern_editor_derive_colors(track_id, &pattern->steps[step_position], cache->colors[step_position]);
+        cache->valid[step_position] = true;
+    }
+    return cache->colors[step_position][lane];
+}
+
+static void _pattern_editor_invalidate_steps(pattern_editor_t *editor, uint16_t step_positions[], size_t n) {
+    if (editor->pattern == NULL) return;
+
+    pattern_editor_cache_t *cache = _pattern_editor_get_cache(editor, editor->track_id);
+    for (size_t i = 0; i < n; i++) {
+        if (step_positions[i] < PATTERN_EDITOR_CACHE_STEPS) cache->valid[step_positions[i]] = false;
+    }
+}
+
+static lpui_color_t _pattern_editor_get_step_color(pattern_editor_t *editor, uint16_t step_position, uint16_t playhead) {
+    // check if the pattern and the step index are valid
+    pattern_t *pattern = editor->pattern;
+    if (pattern == NULL || step_position >= pattern->config.step_length) {
+        return LPUI_COLOR_BLACK;
+    }
+
+    if (step_position == playhead) {
+        return LPUI_COLOR_PLAYHEAD;
+    }
+    return _pattern_editor_get_lane_color(editor, editor->track_id, step_position, editor->view);
+}
+
+static lpui_position_t _pattern_editor_get_display_pos(pattern_editor_t *editor, uint16_t display_position) {
     lpui_position_t *cmp_pos = &editor->cmp.config.pos;
     lpui_size_t *cmp_size = &editor->cmp.config.size;
 
-    // calculate the drawing position
-    uint16_t display_position = step_position - editor->step_offset;
+    // the first step is at the top left
     uint8_t x = display_position % cmp_size->width;
     uint8_t y = display_position / cmp_size->width;
-    lpui_position_t pos = {
+    return (lpui_position_t) {
         .x = cmp_pos->x + x,
         .y = cmp_pos->y + cmp_size->height - 1 - y
     };
+}
 
-    // check if the pattern is valid
-    pattern_t *pattern = editor->pattern;
-    if (pattern == NULL) {
-        return lpui_sysex_add_led_color(ui, pos, LPUI_COLOR_BLACK);
+static void _pattern_editor_draw_effect(pattern_editor_t *editor, lpui_position_t pos, uint16_t step_position) {
+    // the selected step flashes on top of its color
+    lpui_effect_t effect = { .type = LPUI_EFFECT_NONE };
+    if (step_position == editor->selected_step && editor->view != PATTERN_EDITOR_VIEW_OVERVIEW) {
+        effect = (lpui_effect_t) { .type = LPUI_EFFECT_FLASH, .color = LPUI_COLOR_SELECTED };
     }
+    lpui_set_led_effect(editor->cmp.ui, pos, effect);
+}
 
-    // check if the step index is valid
-    if (step_position >= pattern->config.step_length) {
-        return lpui_sysex_add_led_color(ui, pos, LPUI_COLOR_BLACK);
+static void _pattern_editor_draw_step(pattern_editor_t *editor, uint16_t step_position) {
+    lpui_position_t pos = _pattern_editor_get_display_pos(editor, step_position - editor->step_offset);
+
+    lpui_set_led(editor->cmp.ui, pos, _pattern_editor_get_step_color(editor, step_position, editor->step_position));
+    _pattern_editor_draw_effect(editor, pos, step_position);
+}
+
+static uint16_t _pattern_editor_overview_offset(pattern_editor_t *editor, int track_id) {
+    // each row scrolls with the playhead of its track
+    uint8_t width = editor->cmp.config.size.width;
+    return editor->overview_positions[track_id] / width * width;
+}
+
+static void _pattern_editor_draw_overview_step(pattern_editor_t *editor, int track_id, uint16_t step_position) {
+    lpui_size_t *size = &editor->cmp.config.size;
+    uint16_t step_offset = _pattern_editor_overview_offset(editor, track_id);
+    if (track_id >= size->height || step_position < step_offset || step_position >= step_offset + size->width) return;
+
+    // the first track is at the top
+    lpui_position_t pos = _pattern_editor_get_display_pos(editor, track_id * size->width + step_position - step_offset);
+
+    pattern_t *pattern = editor->patterns[track_id];
+    lpui_color_t color = _pattern_editor_get_lane_color(editor, track_id, step_position, PATTERN_EDITOR_VIEW_VELOCITY);
+    if (pattern != NULL && step_position == editor->overview_positions[track_id]) {
+        color = LPUI_COLOR_PLAYHEAD;
     }
 
-    // get the base color
-    uint8_t color_id = editor->track_id % (sizeof(lpui_color_patterns) / sizeof(lpui_color_t));
-    lpui_color_t base_color = lpui_color_patterns[color_id];
+    lpui_set_led(editor->cmp.ui, pos, color);
+    lpui_set_led_effect(editor->cmp.ui, pos, (lpui_effect_t) { .type = LPUI_EFFECT_NONE });
+}
 
-    pattern_step_t *step = &pattern->steps[step_position];
-    if (step_position == pattern->step_position) {
-        return lpui_sysex_add_led_color(ui, pos, LPUI_COLOR_PLAYHEAD);
-    } else if (step->atomic.velocity > 0) {
-        return lpui_sysex_add_led_color(ui, pos, base_color);
-    } else {
-        return lpui_sysex_add_led_color(ui, pos, lpui_color_darken(base_color));
+static void _pattern_editor_draw_overview_row(pattern_editor_t *editor, int row) {
+    lpui_size_t *size = &editor->cmp.config.size;
+
+    // rows without a track stay dark
+    if (row >= SEQUENCER_NUM_TRACKS) {
+        for (uint8_t x = 0; x < size->width; x++) {
+            lpui_position_t pos = _pattern_editor_get_display_pos(editor, row * size->width + x);
+            lpui_set_led(editor->cmp.ui, pos, LPUI_COLOR_BLACK);
+            lpui_set_led_effect(editor->cmp.ui, pos, (lpui_effect_t) { .type = LPUI_EFFECT_NONE });
+        }
+        return;
+    }
+
+    uint16_t step_offset = _pattern_editor_overview_offset(editor, row);
+    for (uint8_t x = 0; x < size->width; x++) {
+        _pattern_editor_draw_overview_step(editor, row, step_offset + x);
     }
 }
 
-esp_err_t pattern_editor_draw_steps(pattern_editor_t *editor, uint16_t step_positions[], size_t n) {
-    lpui_t *ui = editor->cmp.ui;
+static void _pattern_editor_draw_page(pattern_editor_t *editor) {
+    lpui_size_t *size = &editor->cmp.config.size;
 
-    // restart the sysex data stream
-    ESP_RETURN_ON_ERROR(lpui_sysex_reset(ui, LPUI_SYSEX_COMMAND_SET_LEDS),
-        TAG, "Failed to reset sysex buffer");
+    // draw all tracks
+    if (editor->view == PATTERN_EDITOR_VIEW_OVERVIEW) {
+        for (uint8_t row = 0; row < size->height; row++) {
+            _pattern_editor_draw_overview_row(editor, row);
+        }
+        return;
+    }
 
     // draw all visible steps
-    for (uint16_t i = 0; i < n; i++) {
-        uint16_t step_position = step_positions[i];
-        ESP_RETURN_ON_ERROR(_pattern_editor_draw_step(editor, step_position),
-            TAG, "Failed to draw step");
+    for (uint16_t i = 0; i < size->width * size->height; i++) {
+        _pattern_editor_draw_step(editor, editor->step_offset + i);
     }
+}
 
-    // finish and send the sysex data
-    ESP_RETURN_ON_ERROR(lpui_sysex_commit(ui),
-        TAG, "Failed to commit sysex buffer");
+esp_err_t pattern_editor_draw_steps(pattern_editor_t *editor, uint16_t step_positions[], size_t n) {
+    // the steps might have been edited
+    editor->back_buffer_page = -1;
+    _pattern_editor_invalidate_steps(editor, step_positions, n);
+
+    // draw the given steps
+    for (uint16_t i = 0; i < n; i++) {
+        if (editor->view == PATTERN_EDITOR_VIEW_OVERVIEW) {
+            _pattern_editor_draw_overview_step(editor, editor->track_id, step_positions[i]);
+        } else {
+            _pattern_editor_draw_step(editor, step_positions[i]);
+        }
+    }
 
     return ESP_OK;
 }
 
 esp_err_t pattern_editor_draw(pattern_editor_t *editor) {
-    lpui_t *ui = editor->cmp.ui;
-    lpui_size_t *size = &editor->cmp.config.size;
+    // the pattern might have been edited
+    editor->back_buffer_page = -1;
+    if (editor->pattern != NULL) {
+        _pattern_editor_invalidate_cache(editor, editor->track_id);
+    }
 
-    // restart the sysex data stream
-    ESP_RETURN_ON_ERROR(lpui_sysex_reset(ui, LPUI_SYSEX_COMMAND_SET_LEDS),
-        TAG, "Failed to reset sysex buffer");
+    _pattern_editor_draw_page(editor);
+    return ESP_OK;
+}
 
-    // draw all visible steps
-    for (uint16_t i = 0; i < size->width * size->height; i++) {
-        uint16_t step_position = editor->step_offset + i;
-        ESP_RETURN_ON_ERROR(_pattern_editor_draw_step(editor, step_position),
-            TAG, "Failed to draw step");
+static uint16_t _pattern_editor_page_steps(pattern_editor_t *editor) {
+    return editor->cmp.config.size.width * editor->cmp.config.size.height;
+}
+
+static uint8_t _pattern_editor_next_page(pattern_editor_t *editor) {
+    uint16_t page_steps = _pattern_editor_page_steps(editor);
+    uint16_t num_pages = (editor->pattern->config.step_length + page_steps - 1) / page_steps;
+    if (num_pages == 0) return editor->page;
+
+    return (editor->page + 1) % num_pages;
+}
+
+static void _pattern_editor_prefetch(pattern_editor_t *editor) {
+    uint16_t page_steps = _pattern_editor_page_steps(editor);
+    uint8_t page = _pattern_editor_next_page(editor);
+    if (page == editor->page || editor->back_buffer_page == page) return;
+
+    // the playhead enters the next page at its first step
+    uint16_t step_offset = page * page_steps;
+    for (uint16_t i = 0; i < page_steps; i++) {
+        editor->back_buffer[i] = _pattern_editor_get_step_color(editor, step_offset + i, step_offset);
     }
+    editor->back_buffer_page = page;
+}
 
-    // finish and send the sysex data
-    ESP_RETURN_ON_ERROR(lpui_sysex_commit(ui),
-        TAG, "Failed to commit sysex buffer");
+static void _pattern_editor_flip(pattern_editor_t *editor) {
+    uint16_t page_steps = _pattern_editor_page_steps(editor);
 
-    return ESP_OK;
+    // only the framebuffer writes are left, the diff sends the leds that differ
+    for (uint16_t i = 0; i < page_steps; i++) {
+        lpui_position_t pos = _pattern_editor_get_display_pos(editor, i);
+        lpui_set_led(editor->cmp.ui, pos, editor->back_buffer[i]);
+        _pattern_editor_draw_effect(editor, pos, editor->step_offset + i);
+    }
+    editor->back_buffer_page = -1;
 }
 
 /* esp_err_t pattern_editor_update(pattern_editor_t *editor) {
@@ -159,14 +336,24 @@ esp_err_t pattern_editor_draw(pattern_editor_t *editor) {
 esp_err_t pattern_editor_key_event(void *context, const lpui_position_t pos, uint8_t velocity) {
     pattern_editor_t *editor = (pattern_editor_t *) context;
 
+    lpui_position_t *cmp_pos = &editor->cmp.config.pos;
+    lpui_size_t *cmp_size = &editor->cmp.config.size;
+
+    // the overview selects the track of the pressed row
+    if (editor->view == PATTERN_EDITOR_VIEW_OVERVIEW) {
+        int track_id = cmp_size->height - (pos.y - cmp_pos->y) - 1;
+        if (velocity == 0 || track_id >= SEQUENCER_NUM_TRACKS) return ESP_OK;
+
+        ESP_RETURN_ON_ERROR(CALLBACK_INVOKE(&editor->config.callbacks, track_pressed, editor, track_id),
+            TAG, "Failed to invoke track pressed callback");
+        return ESP_OK;
+    }
+
     pattern_t *pattern = editor->pattern;
     if (pattern == NULL) {
         return ESP_OK;
     }
 
-    lpui_position_t *cmp_pos = &editor->cmp.config.pos;
-    lpui_size_t *cmp_size = &editor->cmp.config.size;
-
     // retrieve the step position
     uint8_t x = pos.x - cmp_pos->x;
     uint8_t y = pos.y - cmp_pos->y;
@@ -191,45 +378,184 @@ esp_err_t pattern_editor_key_event(void *context, const lpui_position_t pos, uin
 }
 
 
+esp_err_t pattern_editor_set_track_pattern(pattern_editor_t *editor, int track_id, pattern_t *pattern) {
+    ESP_RETURN_ON_FALSE(track_id >= 0 && track_id < SEQUENCER_NUM_TRACKS, ESP_ERR_INVALID_ARG,
+        TAG, "invalid track %d", track_id);
+
+    // setting the same pattern again means its steps changed, e.g. by a resize
+    editor->patterns[track_id] = pattern;
+    editor->overview_positions[track_id] = pattern != NULL ? pattern->step_position : 0;
+    _pattern_editor_invalidate_cache(editor, track_id);
+
+    if (editor->track_id == track_id) {
+        editor->pattern = pattern;
+        editor->back_buffer_page = -1;
+
+        // the selection and the page may be past the end of the new steps
+        if (pattern != NULL) {
+            uint16_t page_steps = _pattern_editor_page_steps(editor);
+            editor->step_position = pattern->step_position;
+            editor->page = editor->step_position / page_steps;
+            editor->step_offset = editor->page * page_steps;
+        }
+        editor->selected_step = -1;
+    }
+
+    // redraw the track if it is visible
+    if (editor->view == PATTERN_EDITOR_VIEW_OVERVIEW) {
+        _pattern_editor_draw_overview_row(editor, track_id);
+    } else if (editor->track_id == track_id) {
+        _pattern_editor_draw_page(editor);
+    }
+
+    return ESP_OK;
+}
+
 esp_err_t pattern_editor_set_pattern(pattern_editor_t *editor, int track_id, pattern_t *pattern) {
+    ESP_RETURN_ON_FALSE(track_id >= 0 && track_id < SEQUENCER_NUM_TRACKS, ESP_ERR_INVALID_ARG,
+        TAG, "invalid track %d", track_id);
     if (editor->track_id == track_id && editor->pattern == pattern) {
         return ESP_OK;
     }
 
     editor->track_id = track_id;
     editor->pattern = pattern;
+    editor->patterns[track_id] = pattern;
+    editor->overview_positions[track_id] = pattern != NULL ? pattern->step_position : 0;
+
+    // redraw from the cached colors, the commit only sends the leds that differ
+    editor->back_buffer_page = -1;
+    _pattern_editor_draw_page(editor);
 
-    // full redraw
-    return pattern_editor_draw(editor);
+    return ESP_OK;
 }
 
-esp_err_t pattern_editor_update_step_position(pattern_editor_t *editor) {
-    if (editor->pattern == NULL) return ESP_OK;
+esp_err_t pattern_editor_set_view(pattern_editor_t *editor, pattern_editor_view_t view) {
+    ESP_RETURN_ON_FALSE(view < PATTERN_EDITOR_NUM_VIEWS, ESP_ERR_INVALID_ARG,
+        TAG, "invalid view %d", view);
+    if (editor->view == view) return ESP_OK;
+    editor->view = view;
+
+    // catch up with the playheads that were not followed by the previous view
+    if (view == PATTERN_EDITOR_VIEW_OVERVIEW) {
+        for (int i = 0; i < SEQUENCER_NUM_TRACKS; i++) {
+            pattern_t *pattern = editor->patterns[i];
+            editor->overview_positions[i] = pattern != NULL ? pattern->step_position : 0;
+        }
+    } else if (editor->pattern != NULL) {
+        uint16_t page_steps = _pattern_editor_page_steps(editor);
+        editor->step_position = editor->pattern->step_position;
+        editor->page = editor->step_position / page_steps;
+        editor->step_offset = editor->page * page_steps;
+    }
 
-    // get the step position from the active pattern
-    uint16_t step_position = editor->pattern->step_position;
+    // redraw from the cached colors, the commit only sends the leds that differ
+    editor->back_buffer_page = -1;
+    _pattern_editor_draw_page(editor);
+
+    return ESP_OK;
+}
+
+static esp_err_t _pattern_editor_show_step(pattern_editor_t *editor, uint16_t step_position) {
     if (editor->step_position == step_position) return ESP_OK;
 
     // update the step position, but store the previous page and position
     uint8_t prev_page = editor->page;
     uint16_t prev_step_position = editor->step_position;
     editor->step_position = step_position;
-    
+
     // update automatic scrolling
-    if (editor->pattern) {
-        uint8_t page_steps = editor->cmp.config.size.width * editor->cmp.config.size.height;
-        editor->page = editor->pattern->step_position / page_steps;
-        editor->step_offset = editor->page * page_steps;
-    }
+    uint16_t page_steps = _pattern_editor_page_steps(editor);
+    editor->page = step_position / page_steps;
+    editor->step_offset = editor->page * page_steps;
 
-    // if the page changed, redraw the whole pattern.
+    // if the page changed, flip to the prefetched page or redraw the whole pattern.
     // otherwise, only redraw the previous and new step position
     if (editor->page != prev_page) {
-        return pattern_editor_draw(editor);
+        if (editor->back_buffer_page == editor->page && step_position == editor->step_offset) {
+            _pattern_editor_flip(editor);
+        } else {
+            _pattern_editor_draw_page(editor);
+        }
     } else {
-        return pattern_editor_draw_steps(editor, (uint16_t[]) {
-            prev_step_position,
-            editor->step_position
-        }, 2);
+        _pattern_editor_draw_step(editor, prev_step_position);
+        _pattern_editor_draw_step(editor, step_position);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t pattern_editor_update_step_position(pattern_editor_t *editor) {
+    // flip pages exactly when the playhead crosses them
+    return pattern_editor_update_playhead(editor, 0, 0);
+}
+
+static void _pattern_editor_update_overview(pattern_editor_t *editor) {
+    for (int i = 0; i < SEQUENCER_NUM_TRACKS; i++) {
+        pattern_t *pattern = editor->patterns[i];
+        if (pattern == NULL || pattern->step_position == editor->overview_positions[i]) continue;
+
+        // scroll the row or redraw the previous and new step position
+        uint16_t prev_step_position = editor->overview_positions[i];
+        uint16_t prev_offset = _pattern_editor_overview_offset(editor, i);
+        editor->overview_positions[i] = pattern->step_position;
+
+        if (_pattern_editor_overview_offset(editor, i) != prev_offset) {
+            _pattern_editor_draw_overview_row(editor, i);
+        } else {
+            _pattern_editor_draw_overview_step(editor, i, prev_step_position);
+            _pattern_editor_draw_overview_step(editor, i, pattern->step_position);
+        }
+    }
+}
+
+esp_err_t pattern_editor_update_playhead(pattern_editor_t *editor, uint64_t tick_period_us, uint64_t lead_us) {
+    if (editor->view == PATTERN_EDITOR_VIEW_OVERVIEW) {
+        _pattern_editor_update_overview(editor);
+        return ESP_OK;
+    }
+
+    pattern_t *pattern = editor->pattern;
+    if (pattern == NULL) return ESP_OK;
+
+    // get the step position from the active pattern
+    uint16_t step_position = pattern->step_position;
+    uint16_t next_step_position = step_position + 1 < pattern->config.step_length ? step_position + 1 : 0;
+    uint16_t page_steps = _pattern_editor_page_steps(editor);
+
+    // show the next page a little early if the playhead is about to cross into it,
+    // so the burst of leds is out before the step is played
+    uint64_t until_next_step = (uint64_t) (pattern->config.resolution - pattern->substep_position) * tick_period_us;
+    if (lead_us > 0 && next_step_position / page_steps != step_position / page_steps && until_next_step <= lead_us) {
+        step_position = next_step_position;
     }
+
+    ESP_RETURN_ON_ERROR(_pattern_editor_show_step(editor, step_position),
+        TAG, "failed to show step");
+
+    // render the next page while there is nothing else to do
+    _pattern_editor_prefetch(editor);
+
+    return ESP_OK;
+}
+
+esp_err_t pattern_editor_select_step(pattern_editor_t *editor, int step_position) {
+    if (editor->selected_step == step_position) return ESP_OK;
+
+    // redraw the previous and the new selection, if they are visible
+    int prev_selected_step = editor->selected_step;
+    editor->selected_step = step_position;
+
+    uint16_t page_steps = _pattern_editor_page_steps(editor);
+    editor->back_buffer_page = -1;
+    if (editor->view == PATTERN_EDITOR_VIEW_OVERVIEW) return ESP_OK;
+
+    for (int i = 0; i < 2; i++) {
+        int step = i == 0 ? prev_selected_step : step_position;
+        if (step >= editor->step_offset && step < editor->step_offset + page_steps) {
+            _pattern_editor_draw_step(editor, step);
+        }
+    }
+
+    return ESP_OK;
 }
@@ -1,6 +1,7 @@
 #include "lpui_components/piano_editor.h"
 #include <esp_err.h>
-#include <esp_log.h>
+#include <esp_check.h>
+#include <string.h>
 
 
 static const char *TAG = "piano_editor";
@@ -18,49 +19,104 @@ esp_err_t piano_editor_init(piano_editor_t *editor, const piano_editor_config_t
         .context = editor,
         .key_event = piano_editor_key_event
     };
-    lpui_component_init(&editor->cmp, &config->cmp_config, &functions);
+    ESP_RETURN_ON_ERROR(lpui_component_init(&editor->cmp, &config->cmp_config, &functions),
+        TAG, "failed to initialize component");
 
+    memset(editor->pressed_notes, 0, sizeof(editor->pressed_notes));
+
+    return ESP_OK;
+}
+
+static int _piano_editor_get_note(piano_editor_t *editor, lpui_position_t p) {
+    // p is relative to the component, the keys repeat every 8 pads
+    int8_t key = lpui_piano_editor_note_map[p.y % 2][p.x % 8];
+    if (key == -1) return -1;
+
+    int note = editor->config.base_note + (p.y / 2) * 12 + key;
+    return note < 128 ? note : -1;
+}
+
+static bool _piano_editor_is_pressed(piano_editor_t *editor, uint8_t note) {
+    return editor->pressed_notes[note / 32] & (1UL << (note % 32));
+}
+
+esp_err_t piano_editor_get_note(piano_editor_t *editor, lpui_position_t pos, uint8_t *note) {
+    lpui_position_t *cmp_pos = &editor->cmp.config.pos;
+    lpui_size_t *cmp_size = &editor->cmp.config.size;
+
+    // only reads the configuration, so it can be called without holding the ui
+    if (pos.x < cmp_pos->x || pos.x >= cmp_pos->x + cmp_size->width ||
+            pos.y < cmp_pos->y || pos.y >= cmp_pos->y + cmp_size->height) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    int n = _piano_editor_get_note(editor, (lpui_position_t) { pos.x - cmp_pos->x, pos.y - cmp_pos->y });
+    if (n < 0) return ESP_ERR_NOT_FOUND;
+
+    *note = n;
     return ESP_OK;
 }
 
 esp_err_t piano_editor_key_event(void *context, const lpui_position_t pos, uint8_t velocity) {
-    ESP_LOGI(TAG, "piano editor button event at (%d, %d) with velocity %d", pos.x, pos.y, velocity);
+    piano_editor_t *editor = context;
+
+    // gaps between the black keys do nothing
+    uint8_t note;
+    if (piano_editor_get_note(editor, pos, &note) != ESP_OK) return ESP_OK;
+
+    // highlight the key while it is held
+    bool pressed = velocity > 0;
+    if (pressed == _piano_editor_is_pressed(editor, note)) return ESP_OK;
+    editor->pressed_notes[note / 32] ^= 1UL << (note % 32);
+    ESP_RETURN_ON_ERROR(piano_editor_draw_note(editor, note),
+        TAG, "failed to draw note %d", note);
+
+    if (pressed) {
+        ESP_RETURN_ON_ERROR(CALLBACK_INVOKE(&editor->config.callbacks, pressed, editor, note, velocity),
+            TAG, "failed to invoke pressed callback");
+    } else {
+        ESP_RETURN_ON_ERROR(CALLBACK_INVOKE(&editor->config.callbacks, released, editor, note),
+            TAG, "failed to invoke released callback");
+    }
 
     return ESP_OK;
 }
 
-static lpui_color_t piano_editor_get_key_color(piano_editor_t *editor, int8_t key) {
+static lpui_color_t piano_editor_get_key_color(piano_editor_t *editor, int note) {
     // check if key is valid
-    if (key == -1) {
+    if (note == -1) {
         return LPUI_COLOR_BLACK;
     }
 
-    // TODO: different pressed color
-    return LPUI_COLOR_PIANO_RELEASED;
+    return _piano_editor_is_pressed(editor, note) ? LPUI_COLOR_PIANO_PRESSED : LPUI_COLOR_PIANO_RELEASED;
 }
 
-esp_err_t piano_editor_draw(piano_editor_t *editor) {
+static void _piano_editor_draw_keys(piano_editor_t *editor, int note) {
     lpui_t *ui = editor->cmp.ui;
     lpui_position_t *pos = &editor->cmp.config.pos;
     lpui_size_t *size = &editor->cmp.config.size;
 
-    lpui_sysex_reset(ui, LPUI_SYSEX_COMMAND_SET_LEDS);
-
+    // draw all keys or only the pads of one note, the octave key appears twice
     lpui_position_t p;
     for (p.y = 0; p.y < size->height; p.y++) {
         for (p.x = 0; p.x < size->width; p.x++) {
-            uint8_t octave = p.y / 2;
-            uint8_t key = lpui_piano_editor_note_map[p.y % 2][p.x % 8];
-            lpui_color_t color = piano_editor_get_key_color(editor, key);
+            int key_note = _piano_editor_get_note(editor, p);
+            if (note != -1 && key_note != note) continue;
 
-            lpui_sysex_add_led_color(ui, (lpui_position_t) {
+            lpui_set_led(ui, (lpui_position_t) {
                 .x = pos->x + p.x,
                 .y = pos->y + p.y
-            }, color);
+            }, piano_editor_get_key_color(editor, key_note));
         }
     }
+}
 
-    lpui_sysex_commit(ui);
+esp_err_t piano_editor_draw(piano_editor_t *editor) {
+    _piano_editor_draw_keys(editor, -1);
+    return ESP_OK;
+}
 
+esp_err_t piano_editor_draw_note(piano_editor_t *editor, uint8_t note) {
+    _piano_editor_draw_keys(editor, note);
     return ESP_OK;
 }
@@ -0,0 +1,309 @@
+#include "lpui_encoder.h"
+
+#include <string.h>
+#include <esp_check.h>
+
+
+static const char *TAG = "lpui_encoder";
+
+// launchpad palette entries whose color matches the rgb value exactly
+static const struct {
+    uint8_t index;
+    lpui_color_t color;
+} lpui_palette[] = {
+    { 0, LPUI_COLOR(0x00, 0x00, 0x00) },
+    { 3, LPUI_COLOR(0x3f, 0x3f, 0x3f) }
+};
+
+#define LPUI_PALETTE_SIZE (sizeof(lpui_palette) / sizeof(lpui_palette[0]))
+#define LPUI_PALETTE_NONE -1
+
+#define LPUI_GRID_8X8_SIZE 8
+#define LPUI_GRID_8X8_ENTRY_SIZE (1 + LPUI_GRID_8X8_SIZE * LPUI_GRID_8X8_SIZE * 3)
+
+
+typedef struct {
+    bool dirty[LPUI_GRID_SIZE][LPUI_GRID_SIZE];
+    int8_t entries[LPUI_GRID_SIZE][LPUI_GRID_SIZE]; // palette entry of the target color
+} lpui_encoder_state_t;
+
+
+static bool lpui_color_equals(lpui_color_t a, lpui_color_t b) {
+    return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+static int8_t lpui_palette_entry(lpui_color_t color) {
+    for (size_t i = 0; i < LPUI_PALETTE_SIZE; i++) {
+        if (lpui_color_equals(lpui_palette[i].color, color)) return i;
+    }
+    return LPUI_PALETTE_NONE;
+}
+
+bool lpui_palette_find(lpui_color_t color, uint8_t *index) {
+    int8_t entry = lpui_palette_entry(color);
+    if (entry == LPUI_PALETTE_NONE) return false;
+
+    *index = lpui_palette[entry].index;
+    return true;
+}
+
+static size_t lpui_encoder_messages_cost(size_t num_entries, size_t entry_size) {
+    if (num_entries == 0) return 0;
+
+    // entries are split over as many messages as needed
+    size_t per_message = LPUI_SYSEX_PAYLOAD_SIZE / entry_size;
+    size_t num_messages = (num_entries + per_message - 1) / per_message;
+    return num_entries * entry_size + num_messages * LPUI_SYSEX_OVERHEAD;
+}
+
+static size_t lpui_encoder_init_state(lpui_t *ui, lpui_encoder_state_t *state) {
+    lpui_image_t *img = &ui->image;
+    size_t num_dirty = 0;
+
+    for (int x = 0; x < LPUI_GRID_SIZE; x++) {
+        for (int y = 0; y < LPUI_GRID_SIZE; y++) {
+            lpui_color_t color = ui->output.leds[x][y];
+
+            state->entries[x][y] = lpui_palette_entry(color);
+            state->dirty[x][y] = ui->invalidated || ui->stale[x][y] ||
+                !lpui_color_equals(color, img->previous.leds[x][y]);
+            num_dirty += state->dirty[x][y];
+        }
+    }
+
+    return num_dirty;
+}
+
+static esp_err_t lpui_encoder_send(lpui_t *ui, uint8_t command, const uint8_t *entry, size_t length) {
+    // a single entry message
+    ESP_RETURN_ON_ERROR(lpui_sysex_reset(ui, command),
+        TAG, "failed to reset sysex");
+    ESP_RETURN_ON_ERROR(lpui_sysex_add_entry(ui, entry, length),
+        TAG, "failed to add entry");
+    return lpui_sysex_commit(ui);
+}
+
+static bool lpui_encoder_line(lpui_encoder_state_t *state, const lpui_encoder_plan_t *plan,
+        int x, int y, int dx, int dy, int8_t *entry) {
+    // the line has to be a single palette color
+    *entry = state->entries[x][y];
+    if (*entry == LPUI_PALETTE_NONE) return false;
+
+    size_t leds_cost = 0;
+    for (int i = 0; i < LPUI_GRID_SIZE; i++) {
+        int8_t e = state->entries[x + i * dx][y + i * dy];
+        if (e != *entry) return false;
+        if (state->dirty[x + i * dx][y + i * dy]) leds_cost += plan->palette ? 2 : 4;
+    }
+
+    // only worth it if sending the leds one by one is more expensive
+    if (leds_cost <= LPUI_SYSEX_OVERHEAD + 2) return false;
+
+    for (int i = 0; i < LPUI_GRID_SIZE; i++) {
+        state->dirty[x + i * dx][y + i * dy] = false;
+    }
+    return true;
+}
+
+static void lpui_encoder_touch(bool touched[LPUI_GRID_SIZE][LPUI_GRID_SIZE],
+        int x, int y, int width, int height) {
+    for (int i = x; i < x + width; i++) {
+        for (int j = y; j < y + height; j++) {
+            touched[i][j] = true;
+        }
+    }
+}
+
+// touched is only written when sending and records every led a command was sent for
+static esp_err_t lpui_encoder_run(lpui_t *ui, const lpui_encoder_state_t *initial,
+        const lpui_encoder_plan_t *plan, bool send, size_t *cost,
+        bool touched[LPUI_GRID_SIZE][LPUI_GRID_SIZE]) {
+    lpui_image_buffer_t *output = &ui->output;
+    lpui_encoder_state_t state = *initial;
+    size_t num_palette = 0, num_rgb = 0;
+
+    *cost = 0;
+
+    // every led that does not match the fill color has to be sent again
+    if (plan->fill != LPUI_PALETTE_NONE) {
+        for (int x = 0; x < LPUI_GRID_SIZE; x++) {
+            for (int y = 0; y < LPUI_GRID_SIZE; y++) {
+                state.dirty[x][y] = state.entries[x][y] != plan->fill;
+            }
+        }
+
+        *cost += LPUI_SYSEX_OVERHEAD + 1;
+        if (send) {
+            ESP_RETURN_ON_ERROR(lpui_encoder_send(ui, LPUI_SYSEX_COMMAND_SET_LEDS_ALL, &lpui_palette[plan->fill].index, 1),
+                TAG, "failed to send fill");
+            lpui_encoder_touch(touched, 0, 0, LPUI_GRID_SIZE, LPUI_GRID_SIZE);
+        }
+    }
+
+    // uniform rows and columns, one message each
+    if (plan->lines) {
+        int8_t entry;
+        for (int i = 0; i < LPUI_GRID_SIZE; i++) {
+            if (lpui_encoder_line(&state, plan, 0, i, 1, 0, &entry)) {
+                *cost += LPUI_SYSEX_OVERHEAD + 2;
+                if (send) {
+                    const uint8_t row[] = { i, lpui_palette[entry].index };
+                    ESP_RETURN_ON_ERROR(lpui_encoder_send(ui, LPUI_SYSEX_COMMAND_SET_LEDS_ROW, row, sizeof(row)),
+                        TAG, "failed to send row");
+                    lpui_encoder_touch(touched, 0, i, LPUI_GRID_SIZE, 1);
+                }
+            }
+        }
+        for (int i = 0; i < LPUI_GRID_SIZE; i++) {
+            if (lpui_encoder_line(&state, plan, i, 0, 0, 1, &entry)) {
+                *cost += LPUI_SYSEX_OVERHEAD + 2;
+                if (send) {
+                    const uint8_t column[] = { i, lpui_palette[entry].index };
+                    ESP_RETURN_ON_ERROR(lpui_encoder_send(ui, LPUI_SYSEX_COMMAND_SET_LEDS_COLUMN, column, sizeof(column)),
+                        TAG, "failed to send column");
+                    lpui_encoder_touch(touched, i, 0, 1, LPUI_GRID_SIZE);
+                }
+            }
+        }
+    }
+
+    // the inner 8x8 pads as one rgb block, bottom row first. A full 10x10
+    // block does not fit into the sysex buffer
+    if (plan->grid) {
+        uint8_t block[LPUI_GRID_8X8_ENTRY_SIZE], *ptr = block;
+        *ptr++ = LPUI_SYSEX_GRID_8X8;
+
+        for (int y = 1; y <= LPUI_GRID_8X8_SIZE; y++) {
+            for (int x = 1; x <= LPUI_GRID_8X8_SIZE; x++) {
+                lpui_color_t color = output->leds[x][y];
+                *ptr++ = color.red;
+                *ptr++ = color.green;
+                *ptr++ = color.blue;
+                state.dirty[x][y] = false;
+            }
+        }
+
+        *cost += LPUI_SYSEX_OVERHEAD + sizeof(block);
+        if (send) {
+            ESP_RETURN_ON_ERROR(lpui_encoder_send(ui, LPUI_SYSEX_COMMAND_SET_LEDS_GRID, block, sizeof(block)),
+                TAG, "failed to send grid");
+            lpui_encoder_touch(touched, 1, 1, LPUI_GRID_8X8_SIZE, LPUI_GRID_8X8_SIZE);
+        }
+    }
+
+    // the remaining leds one by one
+    for (int x = 0; x < LPUI_GRID_SIZE; x++) {
+        for (int y = 0; y < LPUI_GRID_SIZE; y++) {
+            if (!state.dirty[x][y]) continue;
+            if (plan->palette && state.entries[x][y] != LPUI_PALETTE_NONE) {
+                num_palette++;
+            } else {
+                num_rgb++;
+            }
+        }
+    }
+    *cost += lpui_encoder_messages_cost(num_palette, 2) + lpui_encoder_messages_cost(num_rgb, 4);
+
+    if (send && num_palette > 0) {
+        ESP_RETURN_ON_ERROR(lpui_sysex_reset(ui, LPUI_SYSEX_COMMAND_SET_LEDS_PALETTE),
+            TAG, "failed to reset sysex");
+
+        lpui_position_t pos;
+        for (pos.y = 0; pos.y < LPUI_GRID_SIZE; pos.y++) {
+            for (pos.x = 0; pos.x < LPUI_GRID_SIZE; pos.x++) {
+                int8_t entry = state.entries[pos.x][pos.y];
+                if (!state.dirty[pos.x][pos.y] || entry == LPUI_PALETTE_NONE) continue;
+
+                const uint8_t led[] = { pos.x + pos.y * 10, lpui_palette[entry].index };
+                ESP_RETURN_ON_ERROR(lpui_sysex_add_entry(ui, led, sizeof(led)),
+                    TAG, "failed to add palette led");
+                state.dirty[pos.x][pos.y] = false;
+                touched[pos.x][pos.y] = true;
+            }
+        }
+
+        ESP_RETURN_ON_ERROR(lpui_sysex_commit(ui),
+            TAG, "failed to commit palette leds");
+    }
+
+    if (send && num_rgb > 0) {
+        ESP_RETURN_ON_ERROR(lpui_sysex_reset(ui, LPUI_SYSEX_COMMAND_SET_LEDS),
+            TAG, "failed to reset sysex");
+
+        lpui_position_t pos;
+        for (pos.y = 0; pos.y < LPUI_GRID_SIZE; pos.y++) {
+            for (pos.x = 0; pos.x < LPUI_GRID_SIZE; pos.x++) {
+                if (!state.dirty[pos.x][pos.y]) continue;
+                ESP_RETURN_ON_ERROR(lpui_sysex_add_led_color(ui, pos, output->leds[pos.x][pos.y]),
+                    TAG, "failed to add rgb led");
+                touched[pos.x][pos.y] = true;
+            }
+        }
+
+        ESP_RETURN_ON_ERROR(lpui_sysex_commit(ui),
+            TAG, "failed to commit rgb leds");
+    }
+
+    return ESP_OK;
+}
+
+static void lpui_encoder_choose_plan(lpui_t *ui, const lpui_encoder_state_t *state,
+        lpui_encoder_plan_t *plan, size_t *cost) {
+    *plan = (lpui_encoder_plan_t) LPUI_ENCODER_PLAN_RGB();
+    lpui_encoder_run(ui, state, plan, false, cost, NULL);
+
+    // try every combination of commands, there are only a few
+    for (int8_t fill = LPUI_PALETTE_NONE; fill < (int8_t) LPUI_PALETTE_SIZE; fill++) {
+        for (uint8_t flags = 0; flags < 8; flags++) {
+            const lpui_encoder_plan_t candidate = {
+                .fill = fill,
+                .lines = flags & 1,
+                .grid = flags & 2,
+                .palette = flags & 4
+            };
+
+            size_t candidate_cost;
+            lpui_encoder_run(ui, state, &candidate, false, &candidate_cost, NULL);
+            if (candidate_cost < *cost) {
+                *plan = candidate;
+                *cost = candidate_cost;
+            }
+        }
+    }
+}
+
+esp_err_t lpui_encoder_cost(lpui_t *ui, const lpui_encoder_plan_t *plan, size_t *cost) {
+    lpui_encoder_state_t state;
+    lpui_encoder_init_state(ui, &state);
+
+    return lpui_encoder_run(ui, &state, plan, false, cost, NULL);
+}
+
+esp_err_t lpui_encoder_choose(lpui_t *ui, lpui_encoder_plan_t *plan, size_t *cost) {
+    lpui_encoder_state_t state;
+    lpui_encoder_init_state(ui, &state);
+
+    lpui_encoder_choose_plan(ui, &state, plan, cost);
+    return ESP_OK;
+}
+
+esp_err_t lpui_encode(lpui_t *ui, size_t *num_leds, bool touched[LPUI_GRID_SIZE][LPUI_GRID_SIZE]) {
+    lpui_encoder_state_t state;
+
+    memset(touched, 0, sizeof(bool) * LPUI_GRID_SIZE * LPUI_GRID_SIZE);
+
+    // nothing to send
+    *num_leds = lpui_encoder_init_state(ui, &state);
+    if (*num_leds == 0) return ESP_OK;
+
+    const lpui_encoder_plan_t rgb = LPUI_ENCODER_PLAN_RGB();
+    lpui_encoder_plan_t plan;
+    size_t rgb_cost, cost;
+
+    // the plain rgb cost is only kept for the statistics
+    lpui_encoder_run(ui, &state, &rgb, false, &rgb_cost, NULL);
+    lpui_encoder_choose_plan(ui, &state, &plan, &cost);
+    ui->stats.bytes_rgb += rgb_cost;
+
+    return lpui_encoder_run(ui, &state, &plan, true, &cost, touched);
+}
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <time.h>
+#include "lpui.h"
+#include "lpui_components/button.h"
+#include "lpui_components/pattern_editor.h"
+#include "lpui_components/piano_editor.h"
+
+
+#define BENCH_STEPS 64
+#define BENCH_LOOPS 4
+#define BENCH_SECONDS 10
+
+
+static esp_err_t bench_sysex_ready(void *context, lpui_t *ui, uint8_t *buffer, size_t length) {
+    return ESP_OK;
+}
+
+typedef struct {
+    uint32_t bytes;
+    uint32_t bytes_rgb;
+} bench_session_t;
+
+static void bench_session_start(lpui_t *ui, bench_session_t *session) {
+    session->bytes = ui->stats.bytes;
+    session->bytes_rgb = ui->stats.bytes_rgb;
+}
+
+static void bench_session_end(lpui_t *ui, bench_session_t *session, const char *name) {
+    uint32_t bytes = ui->stats.bytes - session->bytes;
+    uint32_t bytes_rgb = ui->stats.bytes_rgb - session->bytes_rgb;
+    printf("  %-12s %6u bytes rgb, %6u bytes encoded (-%.1f%%)\n", name,
+        (unsigned) bytes_rgb, (unsigned) bytes, 100.0 * (bytes_rgb - bytes) / bytes_rgb);
+}
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_render(lpui_t *ui, pattern_editor_t *editor) {
+    pattern_editor_update_step_position(editor);
+    lpui_commit(ui);
+}
+
+static void bench_render_rate(lpui_t *ui, pattern_editor_t *editor, pattern_t *pattern, uint16_t bpm, uint16_t frame_rate) {
+    uint64_t tick_period = 60000000ULL / (SEQ_PPQN * bpm);
+    uint64_t frame_period = frame_rate ? 1000000ULL / frame_rate : 0;
+    uint64_t next_frame = 0, tick_ns = 0;
+    uint32_t ticks = 0, bytes = ui->stats.bytes;
+
+    // simulated sequencer time in µs, either render on every tick or at the frame rate
+    for (uint64_t t = 0; t < BENCH_SECONDS * 1000000ULL; t += tick_period, ticks++) {
+        pattern->step_position = (ticks / SEQ_TICKS_PER_SIXTEENTH_NOTE) % BENCH_STEPS;
+
+        if (frame_rate == 0) {
+            uint64_t start = bench_now_ns();
+            bench_render(ui, editor);
+            tick_ns += bench_now_ns() - start;
+        }
+
+        while (frame_rate && next_frame <= t) {
+            bench_render(ui, editor);
+            next_frame += frame_period;
+        }
+    }
+
+    bytes = ui->stats.bytes - bytes;
+    printf("  %3u bpm, %-9s tick path %6.1f ns/tick, %6.1f bytes/s\n", bpm,
+        frame_rate ? "60 Hz:" : "per tick:", (double) tick_ns / ticks, (double) bytes / BENCH_SECONDS);
+}
+
+static void bench_selection(lpui_t *ui, pattern_editor_t *editor, bool native_effects) {
+    uint32_t bytes = ui->stats.bytes, messages = ui->stats.messages;
+
+    // a selected step flashing for 10 s of 60 Hz frames, with the playback stopped
+    ui->config.native_effects = native_effects;
+    pattern_editor_select_step(editor, 3);
+    for (int i = 0; i < BENCH_SECONDS * 60; i++) {
+        lpui_animate(ui, i * 1000000LL / 60);
+        lpui_commit(ui);
+    }
+    pattern_editor_select_step(editor, -1);
+    lpui_commit(ui);
+
+    printf("  %-9s %6u bytes, %4u messages, %6.1f bytes/s\n", native_effects ? "native:" : "software:",
+        (unsigned) (ui->stats.bytes - bytes), (unsigned) (ui->stats.messages - messages),
+        (double) (ui->stats.bytes - bytes) / BENCH_SECONDS);
+}
+
+static void bench_view_switch(lpui_t *ui, pattern_editor_t *editor, bool rescan) {
+    uint64_t draw_ns = 0, commit_ns = 0;
+    uint32_t bytes = ui->stats.bytes, switches = 0;
+
+    // cycle through all views, either redrawing from the color cache or rescanning the pattern
+    for (int i = 0; i < BENCH_LOOPS * 256; i++, switches++) {
+        uint64_t start = bench_now_ns();
+        pattern_editor_set_view(editor, (i + 1) % PATTERN_EDITOR_NUM_VIEWS);
+        if (rescan) pattern_editor_draw(editor);
+        uint64_t drawn = bench_now_ns();
+        lpui_commit(ui);
+
+        draw_ns += drawn - start;
+        commit_ns += bench_now_ns() - drawn;
+    }
+    pattern_editor_set_view(editor, PATTERN_EDITOR_VIEW_VELOCITY);
+    lpui_commit(ui);
+
+    printf("  %-9s draw %6.1f ns, commit %6.1f ns, %5.1f bytes per switch\n", rescan ? "rescan:" : "cached:",
+        (double) draw_ns / switches, (double) commit_ns / switches, (double) (ui->stats.bytes - bytes) / switches);
+}
+
+int main() {
+    static lpui_t ui;
+    static pattern_editor_t editor;
+    static piano_editor_t piano;
+    static button_t play_button;
+    static pattern_t pattern;
+
+    // same layout as the launchpad controller
+    const lpui_config_t config = {
+        .callbacks = {
+            .sysex_ready = bench_sysex_ready
+        }
+    };
+    lpui_init(&ui, &config);
+
+    button_init(&play_button, &(button_config_t) {
+        .cmp_config = { .pos = { 0, 2 } },
+        .color = LPUI_COLOR_GREEN,
+        .mode = BUTTON_MODE_TOGGLE
+    });
+    lpui_add_component(&ui, &play_button.cmp);
+    button_draw(&play_button);
+
+    pattern_editor_init(&editor, &(pattern_editor_config_t) {
+        .cmp_config = { .pos = { 1, 5 }, .size = { 8, 4 } }
+    });
+    lpui_add_component(&ui, &editor.cmp);
+
+    piano_editor_init(&piano, &(piano_editor_config_t) {
+        .cmp_config = { .pos = { 1, 1 }, .size = { 8, 4 } }
+    });
+    lpui_add_component(&ui, &piano.cmp);
+    piano_editor_draw(&piano);
+
+    printf("encoder\n");
+    bench_session_t total, session;
+    bench_session_start(&ui, &total);
+    bench_session_start(&ui, &session);
+
+    pattern_init(&pattern, &PATTERN_DEFAULT_CONFIG());
+    pattern_resize(&pattern, BENCH_STEPS);
+    for (int i = 0; i < BENCH_STEPS; i++) {
+        pattern.steps[i].atomic.velocity = (i % 3) ? 100 : 0;
+    }
+    pattern_editor_set_pattern(&editor, 1, &pattern);
+    lpui_commit(&ui);
+    bench_session_end(&ui, &session, "startup:");
+    bench_session_start(&ui, &session);
+
+    // playback: the playhead moves one step per frame, crossing a page every 32 steps
+    uint32_t frames = 0, page_frames = 0;
+    uint32_t legacy_bytes = 0, legacy_page_bytes = 0, bytes = 0, page_bytes = 0;
+    for (int i = 1; i <= BENCH_STEPS * BENCH_LOOPS; i++) {
+        uint32_t drawn = ui.stats.leds_drawn, sent = ui.stats.bytes;
+        uint8_t page = editor.page;
+
+        pattern.step_position = i % BENCH_STEPS;
+        pattern_editor_update_step_position(&editor);
+        lpui_commit(&ui);
+
+        // before the framebuffer every draw call sent its leds in one message
+        drawn = ui.stats.leds_drawn - drawn;
+        sent = ui.stats.bytes - sent;
+        legacy_bytes += drawn > 0 ? 8 + 4 * drawn : 0;
+        bytes += sent;
+        frames++;
+
+        if (editor.page != page) {
+            legacy_page_bytes += 8 + 4 * drawn;
+            page_bytes += sent;
+            page_frames++;
+        }
+    }
+
+    bench_session_end(&ui, &session, "playback:");
+
+    // editing: one step toggled per frame
+    bench_session_start(&ui, &session);
+    for (int i = 0; i < 32; i++) {
+        pattern.steps[i].atomic.velocity = pattern.steps[i].atomic.velocity ? 0 : 100;
+        pattern_editor_draw(&editor);
+        lpui_commit(&ui);
+    }
+    bench_session_end(&ui, &session, "editing:");
+
+    // switching tracks recolors the whole pattern
+    bench_session_start(&ui, &session);
+    for (int i = 0; i < 8; i++) {
+        pattern_editor_set_pattern(&editor, i % 4, &pattern);
+        lpui_commit(&ui);
+    }
+    bench_session_end(&ui, &session, "track switch:");
+
+    // reconnects redraw everything
+    bench_session_start(&ui, &session);
+    for (int i = 0; i < 4; i++) {
+        lpui_invalidate(&ui);
+        lpui_commit(&ui);
+    }
+    bench_session_end(&ui, &session, "reconnect:");
+
+    // switching to an empty screen and back
+    bench_session_start(&ui, &session);
+    for (int i = 0; i < 4; i++) {
+        lpui_image_t saved = ui.image;
+        lpui_position_t pos;
+        for (pos.y = 0; pos.y < LPUI_GRID_SIZE; pos.y++) {
+            for (pos.x = 0; pos.x < LPUI_GRID_SIZE; pos.x++) {
+                lpui_set_led(&ui, pos, LPUI_COLOR_BLACK);
+            }
+        }
+        lpui_commit(&ui);
+
+        ui.image.current = saved.current;
+        lpui_commit(&ui);
+    }
+    bench_session_end(&ui, &session, "screen swap:");
+    bench_session_end(&ui, &total, "total:");
+
+    printf("playback, %u frames (%u page flips)\n", (unsigned) frames, (unsigned) page_frames);
+    printf("  immediate draws: %.1f bytes/frame, %.1f bytes/page flip\n",
+        (double) legacy_bytes / frames, (double) legacy_page_bytes / page_frames);
+    printf("  diffed frames:   %.1f bytes/frame, %.1f bytes/page flip\n",
+        (double) bytes / frames, (double) page_bytes / page_frames);
+
+    // a flashing selection animated by lpui vs. by the device
+    printf("selection flash, %d s\n", BENCH_SECONDS);
+    bench_selection(&ui, &editor, false);
+    bench_selection(&ui, &editor, true);
+
+    // lanes and the overview of all tracks
+    printf("view switch\n");
+    for (int i = 0; i < SEQUENCER_NUM_TRACKS; i++) {
+        pattern_editor_set_track_pattern(&editor, i, &pattern);
+    }
+    bench_view_switch(&ui, &editor, true);
+    bench_view_switch(&ui, &editor, false);
+
+    // rendering from the sequencer tick vs. a frame rate limited render task
+    printf("render rate\n");
+    for (uint16_t bpm = 120; bpm <= 480; bpm *= 2) {
+        bench_render_rate(&ui, &editor, &pattern, bpm, 0);
+        bench_render_rate(&ui, &editor, &pattern, bpm, 60);
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <time.h>
+#include "lpui.h"
+
+
+#define BENCH_COMPONENTS 50
+#define BENCH_EVENTS 1000000
+
+
+static uint32_t bench_hits;
+
+static esp_err_t bench_key_event(void *context, const lpui_position_t pos, uint8_t velocity) {
+    bench_hits++;
+    return ESP_OK;
+}
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool bench_contains_position(const lpui_component_t *cmp, const lpui_position_t pos) {
+    return pos.x >= cmp->config.pos.x &&
+        pos.x < cmp->config.pos.x + cmp->config.size.width &&
+        pos.y >= cmp->config.pos.y &&
+        pos.y < cmp->config.pos.y + cmp->config.size.height;
+}
+
+static esp_err_t bench_midi_recv_linear(lpui_t *ui, const midi_message_t *message) {
+    // the previous dispatch, walking the whole components list
+    lpui_position_t pos = {
+        .x = message->note_on.note % 10,
+        .y = message->note_on.note / 10
+    };
+
+    for (lpui_component_t *cmp = ui->components; cmp != NULL; cmp = cmp->next) {
+        if (!bench_contains_position(cmp, pos)) continue;
+        CALLBACK_INVOKE_REQUIRED(&cmp->functions, key_event, pos, message->note_on.velocity);
+    }
+    return ESP_OK;
+}
+
+static void bench_dispatch(lpui_t *ui, const char *name, esp_err_t (*recv)(lpui_t *, const midi_message_t *)) {
+    midi_message_t msg = { .command = MIDI_COMMAND_NOTE_ON, .note_on = { .velocity = 0x7F } };
+    uint32_t state = 0x12345678;
+
+    bench_hits = 0;
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < BENCH_EVENTS; i++) {
+        // xorshift32 over all pads
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        msg.note_on.note = state % (LPUI_GRID_SIZE * LPUI_GRID_SIZE);
+
+        recv(ui, &msg);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    printf("  %-8s %6.1f ns/event, %u hits\n", name, (double) elapsed / BENCH_EVENTS, bench_hits);
+}
+
+int main() {
+    static lpui_t ui;
+    static lpui_component_t components[BENCH_COMPONENTS];
+
+    const lpui_config_t config = { 0 };
+    lpui_init(&ui, &config);
+
+    const lpui_component_functions_t functions = {
+        .key_event = bench_key_event
+    };
+
+    // 25 2x2 tiles covering the grid on the bottom layer, 25 single pads on top
+    for (int i = 0; i < BENCH_COMPONENTS; i++) {
+        lpui_component_config_t cmp_config;
+        if (i < 25) {
+            cmp_config = (lpui_component_config_t) {
+                .pos = { (i % 5) * 2, (i / 5) * 2 },
+                .size = { 2, 2 },
+                .z = 0
+            };
+        } else {
+            cmp_config = (lpui_component_config_t) {
+                .pos = { ((i - 25) * 7) % 10, ((i - 25) * 3) % 10 },
+                .size = { 1, 1 },
+                .z = 1
+            };
+        }
+        lpui_component_init(&components[i], &cmp_config, &functions);
+        lpui_add_component(&ui, &components[i]);
+    }
+
+    uint64_t start = bench_now_ns();
+    lpui_move_component(&ui, &components[BENCH_COMPONENTS - 1], (lpui_position_t) { 9, 9 }, 1);
+    uint64_t rebuild = bench_now_ns() - start;
+
+    printf("hit testing, %d components\n", BENCH_COMPONENTS);
+    bench_dispatch(&ui, "list:", bench_midi_recv_linear);
+    bench_dispatch(&ui, "hit map:", lpui_midi_recv);
+    printf("  rebuild  %6.1f us\n", (double) rebuild / 1000);
+
+    lpui_free(&ui);
+    return 0;
+}
@@ -0,0 +1,654 @@
+#include "bdd-for-c.h"
+#include "lpui.h"
+#include "lpui_components/pattern_editor.h"
+#include "lpui_components/piano_editor.h"
+
+
+#define MAX_SENT 32
+
+
+static uint8_t sent[MAX_SENT][LPUI_SYSEX_BUFFER_SIZE];
+static size_t sent_lengths[MAX_SENT];
+static int num_sent;
+
+
+static esp_err_t test_sysex_ready(void *context, lpui_t *ui, uint8_t *buffer, size_t length) {
+    if (num_sent < MAX_SENT) {
+        memcpy(sent[num_sent], buffer, length);
+        sent_lengths[num_sent++] = length;
+    }
+    return ESP_OK;
+}
+
+static lpui_component_t *hits[MAX_SENT];
+static int num_hits;
+
+static esp_err_t test_key_event(void *context, const lpui_position_t pos, uint8_t velocity) {
+    if (num_hits < MAX_SENT) hits[num_hits++] = context;
+    return ESP_OK;
+}
+
+static void test_component_init(lpui_component_t *cmp, uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t z) {
+    const lpui_component_config_t config = {
+        .pos = { x, y },
+        .size = { width, height },
+        .z = z
+    };
+    const lpui_component_functions_t functions = {
+        .context = cmp,
+        .key_event = test_key_event
+    };
+    lpui_component_init(cmp, &config, &functions);
+}
+
+static void test_press(lpui_t *ui, uint8_t x, uint8_t y) {
+    const midi_message_t msg = {
+        .command = MIDI_COMMAND_NOTE_ON,
+        .note_on = { .note = x + y * 10, .velocity = 0x7F }
+    };
+    num_hits = 0;
+    lpui_midi_recv(ui, &msg);
+}
+
+static int pressed_track;
+
+static esp_err_t test_track_pressed(void *context, pattern_editor_t *editor, int track_id) {
+    pressed_track = track_id;
+    return ESP_OK;
+}
+
+static int piano_notes[MAX_SENT];
+static int num_piano_notes;
+
+static esp_err_t test_piano_pressed(void *context, piano_editor_t *editor, uint8_t note, uint8_t velocity) {
+    if (num_piano_notes < MAX_SENT) piano_notes[num_piano_notes++] = note;
+    return ESP_OK;
+}
+
+static esp_err_t test_piano_released(void *context, piano_editor_t *editor, uint8_t note) {
+    if (num_piano_notes < MAX_SENT) piano_notes[num_piano_notes++] = -note;
+    return ESP_OK;
+}
+
+static void test_release(lpui_t *ui, uint8_t x, uint8_t y) {
+    const midi_message_t msg = {
+        .command = MIDI_COMMAND_NOTE_OFF,
+        .note_off = { .note = x + y * 10, .velocity = 0 }
+    };
+    lpui_midi_recv(ui, &msg);
+}
+
+static bool color_equals(lpui_color_t a, lpui_color_t b) {
+    return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+static const uint8_t sysex_header[] = { LPUI_SYSEX_HEADER };
+
+static size_t sent_leds(int i) {
+    // header, command and terminator around 4 bytes per led
+    return (sent_lengths[i] - 8) / 4;
+}
+
+
+spec("lpui") {
+    static lpui_t ui;
+
+    before_each() {
+        const lpui_config_t config = {
+            .callbacks = {
+                .sysex_ready = test_sysex_ready
+            }
+        };
+        lpui_init(&ui, &config);
+        num_sent = 0;
+    }
+
+    after_each() {
+        lpui_free(&ui);
+    }
+
+    it("should not send anything without changes") {
+        expect(lpui_commit(&ui)) to_be(ESP_OK);
+        lpui_set_led(&ui, (lpui_position_t) { 3, 4 }, LPUI_COLOR_BLACK);
+        expect(lpui_commit(&ui)) to_be(ESP_OK);
+
+        expect(num_sent) to_be(0);
+    }
+
+    it("should only send changed leds") {
+        lpui_set_led(&ui, (lpui_position_t) { 3, 4 }, LPUI_COLOR_GREEN);
+        lpui_set_led(&ui, (lpui_position_t) { 5, 1 }, LPUI_COLOR_PLAYHEAD);
+        lpui_commit(&ui);
+
+        expect(num_sent) to_be(1);
+        expect(sent_leds(0)) to_be(2);
+        expect(sent[0][6]) to_be(LPUI_SYSEX_COMMAND_SET_LEDS);
+        expect(sent[0][7]) to_be(15);
+        expect(sent[0][11]) to_be(43);
+        expect(sent[0][sent_lengths[0] - 1]) to_be(0xF7);
+
+        // redrawing the same colors does not send again, black is a palette color
+        lpui_set_led(&ui, (lpui_position_t) { 3, 4 }, LPUI_COLOR_GREEN);
+        lpui_set_led(&ui, (lpui_position_t) { 5, 1 }, LPUI_COLOR_BLACK);
+        lpui_commit(&ui);
+
+        expect(num_sent) to_be(2);
+        expect(sent_lengths[1]) to_be(10);
+        expect(sent[1][6]) to_be(LPUI_SYSEX_COMMAND_SET_LEDS_PALETTE);
+        expect(sent[1][7]) to_be(15);
+        expect(sent[1][8]) to_be(0);
+    }
+
+    it("should clear all leds after invalidation") {
+        lpui_invalidate(&ui);
+        lpui_commit(&ui);
+
+        expect(num_sent) to_be(1);
+        expect(sent_lengths[0]) to_be(9);
+        expect(sent[0][6]) to_be(LPUI_SYSEX_COMMAND_SET_LEDS_ALL);
+        expect(sent[0][7]) to_be(0);
+        expect(ui.stats.leds_sent) to_be(LPUI_GRID_SIZE * LPUI_GRID_SIZE);
+    }
+
+    it("should count drawn and sent leds") {
+        lpui_set_led(&ui, (lpui_position_t) { 1, 1 }, LPUI_COLOR_GREEN);
+        lpui_set_led(&ui, (lpui_position_t) { 2, 1 }, LPUI_COLOR_BLACK);
+        lpui_commit(&ui);
+
+        expect(ui.stats.leds_drawn) to_be(2);
+        expect(ui.stats.leds_sent) to_be(1);
+        expect(ui.stats.frames) to_be(1);
+        expect(ui.stats.messages) to_be(1);
+        expect(ui.stats.bytes) to_be(12);
+    }
+
+    describe("sysex writer") {
+        it("should split a 100 led frame into full messages") {
+            bool seen[LPUI_GRID_SIZE * LPUI_GRID_SIZE] = { false };
+            size_t total = 0;
+
+            lpui_sysex_reset(&ui, LPUI_SYSEX_COMMAND_SET_LEDS);
+            for (uint8_t i = 0; i < LPUI_GRID_SIZE * LPUI_GRID_SIZE; i++) {
+                lpui_position_t pos = { i % LPUI_GRID_SIZE, i / LPUI_GRID_SIZE };
+                expect(lpui_sysex_add_led_color(&ui, pos, LPUI_COLOR(i & 0x3F, 1, 2))) to_be(ESP_OK);
+            }
+            expect(lpui_sysex_commit(&ui)) to_be(ESP_OK);
+
+            // 62 leds fit into one message
+            expect(num_sent) to_be(2);
+            expect(sent_leds(0)) to_be(62);
+
+            for (int m = 0; m < num_sent; m++) {
+                check(sent_lengths[m] <= LPUI_SYSEX_BUFFER_SIZE, "message %d is too long", m);
+                check(memcmp(sent[m], sysex_header, sizeof(sysex_header)) == 0, "message %d header", m);
+                check(sent[m][sizeof(sysex_header)] == LPUI_SYSEX_COMMAND_SET_LEDS, "message %d command", m);
+                check(sent[m][sent_lengths[m] - 1] == 0xF7, "message %d terminator", m);
+                check((sent_lengths[m] - 8) % 4 == 0, "message %d splits an led", m);
+
+                // every led exactly once, with its own color
+                for (size_t j = sizeof(sysex_header) + 1; j < sent_lengths[m] - 1; j += 4) {
+                    uint8_t index = sent[m][j];
+                    check(index < LPUI_GRID_SIZE * LPUI_GRID_SIZE && !seen[index], "led %d", index);
+                    check(sent[m][j + 1] == (index & 0x3F), "led %d color", index);
+                    seen[index] = true;
+                    total++;
+                }
+            }
+            expect(total) to_be(LPUI_GRID_SIZE * LPUI_GRID_SIZE);
+        }
+
+        it("should use the whole buffer before splitting") {
+            lpui_sysex_reset(&ui, LPUI_SYSEX_COMMAND_SET_LEDS);
+            for (uint8_t i = 0; i < 62; i++) {
+                lpui_sysex_add_led_color(&ui, (lpui_position_t) { i % 10, i / 10 }, LPUI_COLOR_GREEN);
+            }
+            expect(num_sent) to_be(0);
+
+            expect(lpui_sysex_commit(&ui)) to_be(ESP_OK);
+            expect(num_sent) to_be(1);
+            expect(sent_lengths[0]) to_be(LPUI_SYSEX_BUFFER_SIZE);
+        }
+
+        it("should commit a full frame diff in the minimal number of messages") {
+            lpui_position_t pos;
+            for (pos.y = 0; pos.y < LPUI_GRID_SIZE; pos.y++) {
+                for (pos.x = 0; pos.x < LPUI_GRID_SIZE; pos.x++) {
+                    lpui_set_led(&ui, pos, LPUI_COLOR(pos.x, pos.y, 1));
+                }
+            }
+            expect(lpui_commit(&ui)) to_be(ESP_OK);
+
+            // the inner 8x8 pads as a grid block, the outer ring as rgb leds
+            expect(num_sent) to_be(2);
+            expect(sent[0][6]) to_be(LPUI_SYSEX_COMMAND_SET_LEDS_GRID);
+            expect(sent[1][6]) to_be(LPUI_SYSEX_COMMAND_SET_LEDS);
+            expect(ui.stats.leds_sent) to_be(100);
+            expect(ui.stats.bytes) to_be(8 + 1 + 64 * 3 + 8 + 36 * 4);
+            expect(ui.stats.bytes_rgb) to_be(100 * 4 + 2 * 8);
+        }
+    }
+
+    describe("encoder") {
+        it("should fill uniform rows and columns") {
+            for (uint8_t i = 0; i < LPUI_GRID_SIZE; i++) {
+                lpui_set_led(&ui, (lpui_position_t) { i, 6 }, LPUI_COLOR_PLAYHEAD);
+                lpui_set_led(&ui, (lpui_position_t) { 2, i }, LPUI_COLOR_PLAYHEAD);
+            }
+            lpui_commit(&ui);
+
+            expect(num_sent) to_be(2);
+            expect(sent[0][6]) to_be(LPUI_SYSEX_COMMAND_SET_LEDS_ROW);
+            expect(sent[0][7]) to_be(6);
+            expect(sent[1][6]) to_be(LPUI_SYSEX_COMMAND_SET_LEDS_COLUMN);
+            expect(sent[1][7]) to_be(2);
+            expect(ui.stats.bytes) to_be(20);
+        }
+
+        it("should reproduce the image on the device") {
+            static lpui_color_t device[LPUI_GRID_SIZE][LPUI_GRID_SIZE];
+            const lpui_color_t colors[] = { LPUI_COLOR_BLACK, LPUI_COLOR_PLAYHEAD, LPUI_COLOR_GREEN, LPUI_COLOR(1, 2, 3) };
+            const lpui_color_t palette[] = { [0] = LPUI_COLOR_BLACK, [3] = LPUI_COLOR_PLAYHEAD };
+            uint32_t state = 0x12345678;
+
+            memset(device, 0, sizeof(device));
+            for (int frame = 0; frame < 1000; frame++) {
+                // mostly small changes, sometimes lines or whole screens
+                int changes = (frame % 10 == 0) ? 100 : frame % 7;
+                for (int i = 0; i < changes; i++) {
+                    state ^= state << 13;
+                    state ^= state >> 17;
+                    state ^= state << 5;
+                    lpui_position_t pos = { (state >> 8) % 10, (state >> 16) % 10 };
+                    lpui_color_t color = colors[(frame % 20 == 0) ? 1 : state % 4];
+                    lpui_set_led(&ui, pos, color);
+                }
+
+                uint32_t bytes = ui.stats.bytes, bytes_rgb = ui.stats.bytes_rgb;
+                num_sent = 0;
+                expect(lpui_commit(&ui)) to_be(ESP_OK);
+                check(ui.stats.bytes - bytes <= ui.stats.bytes_rgb - bytes_rgb, "frame %d is larger than rgb", frame);
+
+                // apply the messages like the device would
+                for (int m = 0; m < num_sent; m++) {
+                    uint8_t *data = &sent[m][7], *end = &sent[m][sent_lengths[m] - 1];
+                    switch (sent[m][6]) {
+                        case LPUI_SYSEX_COMMAND_SET_LEDS_PALETTE:
+                            for (; data < end; data += 2) device[data[0] % 10][data[0] / 10] = palette[data[1]];
+                            break;
+                        case LPUI_SYSEX_COMMAND_SET_LEDS:
+                            for (; data < end; data += 4) device[data[0] % 10][data[0] / 10] = LPUI_COLOR(data[1], data[2], data[3]);
+                            break;
+                        case LPUI_SYSEX_COMMAND_SET_LEDS_ROW:
+                            for (int x = 0; x < 10; x++) device[x][data[0]] = palette[data[1]];
+                            break;
+                        case LPUI_SYSEX_COMMAND_SET_LEDS_COLUMN:
+                            for (int y = 0; y < 10; y++) device[data[0]][y] = palette[data[1]];
+                            break;
+                        case LPUI_SYSEX_COMMAND_SET_LEDS_ALL:
+                            for (int x = 0; x < 10; x++) for (int y = 0; y < 10; y++) device[x][y] = palette[data[0]];
+                            break;
+                        case LPUI_SYSEX_COMMAND_SET_LEDS_GRID:
+                            expect(data[0]) to_be(LPUI_SYSEX_GRID_8X8);
+                            data++;
+                            for (int y = 1; y <= 8; y++) for (int x = 1; x <= 8; x++, data += 3) device[x][y] = LPUI_COLOR(data[0], data[1], data[2]);
+                            break;
+                    }
+                }
+
+                check(memcmp(device, ui.image.current.leds, sizeof(device)) == 0, "frame %d differs", frame);
+            }
+        }
+    }
+
+    describe("hit testing") {
+        static lpui_component_t a, b, c;
+
+        before_each() {
+            test_component_init(&a, 0, 0, 4, 4, 0);
+            test_component_init(&b, 2, 2, 4, 4, 1);
+            test_component_init(&c, 3, 3, 1, 1, 0);
+            num_hits = 0;
+        }
+
+        it("should dispatch to the components covering the pad") {
+            lpui_add_component(&ui, &a);
+            lpui_add_component(&ui, &b);
+
+            test_press(&ui, 1, 1);
+            expect(num_hits) to_be(1);
+            expect(hits[0]) to_be(&a);
+
+            test_press(&ui, 5, 5);
+            expect(num_hits) to_be(1);
+            expect(hits[0]) to_be(&b);
+
+            test_press(&ui, 8, 8);
+            expect(num_hits) to_be(0);
+        }
+
+        it("should dispatch overlapping components from the top layer down") {
+            lpui_add_component(&ui, &b);
+            lpui_add_component(&ui, &a);
+            lpui_add_component(&ui, &c);
+
+            test_press(&ui, 3, 3);
+            expect(num_hits) to_be(3);
+            expect(hits[0]) to_be(&b);
+            expect(hits[1]) to_be(&c);
+            expect(hits[2]) to_be(&a);
+        }
+
+        it("should stop at opaque components") {
+            b.config.opaque = true;
+            lpui_add_component(&ui, &a);
+            lpui_add_component(&ui, &b);
+
+            test_press(&ui, 3, 3);
+            expect(num_hits) to_be(1);
+            expect(hits[0]) to_be(&b);
+        }
+
+        it("should follow moved and removed components") {
+            lpui_add_component(&ui, &a);
+            lpui_add_component(&ui, &b);
+
+            expect(lpui_move_component(&ui, &a, (lpui_position_t) { 4, 4 }, 2)) to_be(ESP_OK);
+            test_press(&ui, 0, 0);
+            expect(num_hits) to_be(0);
+            test_press(&ui, 7, 7);
+            expect(num_hits) to_be(1);
+            expect(hits[0]) to_be(&a);
+            test_press(&ui, 5, 5);
+            expect(num_hits) to_be(2);
+            expect(hits[0]) to_be(&a);
+
+            lpui_remove_component(&ui, &a);
+            test_press(&ui, 7, 7);
+            expect(num_hits) to_be(0);
+        }
+
+        it("should clip components to the grid") {
+            test_component_init(&a, 8, 8, 4, 4, 0);
+            expect(lpui_add_component(&ui, &a)) to_be(ESP_OK);
+
+            test_press(&ui, 9, 9);
+            expect(num_hits) to_be(1);
+        }
+
+        it("should reject components that overlap too deeply") {
+            static lpui_component_t stack[LPUI_HIT_DEPTH + 1];
+            for (int i = 0; i < LPUI_HIT_DEPTH; i++) {
+                test_component_init(&stack[i], 0, 0, 1, 1, i);
+                expect(lpui_add_component(&ui, &stack[i])) to_be(ESP_OK);
+            }
+            test_component_init(&stack[LPUI_HIT_DEPTH], 0, 0, 1, 1, 0);
+            expect(lpui_add_component(&ui, &stack[LPUI_HIT_DEPTH])) to_be(ESP_ERR_NO_MEM);
+            expect(stack[LPUI_HIT_DEPTH].ui) to_be(NULL);
+
+            // a failed move keeps the previous placement
+            test_component_init(&a, 6, 6, 1, 1, 0);
+            lpui_add_component(&ui, &a);
+            expect(lpui_move_component(&ui, &a, (lpui_position_t) { 0, 0 }, 9)) to_be(ESP_ERR_NO_MEM);
+            expect(a.config.pos.x) to_be(6);
+            expect(a.config.z) to_be(0);
+            test_press(&ui, 6, 6);
+            expect(num_hits) to_be(1);
+        }
+    }
+
+    describe("effects") {
+        static const lpui_position_t pos = { 3, 3 };
+        static const lpui_effect_t flash = { .type = LPUI_EFFECT_FLASH, .color = LPUI_COLOR_SELECTED };
+
+        it("should let the device animate palette colors") {
+            ui.config.native_effects = true;
+            lpui_set_led(&ui, pos, LPUI_COLOR_GREEN);
+            lpui_set_led_effect(&ui, pos, flash);
+            lpui_commit(&ui);
+
+            expect(num_sent) to_be(2);
+            expect(sent[1][6]) to_be(LPUI_SYSEX_COMMAND_FLASH_LEDS);
+            expect(sent[1][7]) to_be(33);
+            expect(sent[1][8]) to_be(3);
+
+            // nothing to do while the device animates
+            for (int i = 0; i < 60; i++) {
+                lpui_animate(&ui, i * 16667);
+                lpui_commit(&ui);
+            }
+            expect(num_sent) to_be(2);
+
+            // a new static color stops the effect, so it has to be restarted
+            lpui_set_led(&ui, pos, LPUI_COLOR_PLAYHEAD);
+            lpui_commit(&ui);
+            expect(num_sent) to_be(4);
+            expect(sent[3][6]) to_be(LPUI_SYSEX_COMMAND_FLASH_LEDS);
+
+            // stopping the effect resends the unchanged static color
+            lpui_set_led_effect(&ui, pos, (lpui_effect_t) { .type = LPUI_EFFECT_NONE });
+            lpui_commit(&ui);
+            expect(num_sent) to_be(5);
+            expect(sent[4][7]) to_be(33);
+        }
+
+        it("should render other effects into the frame diff") {
+            lpui_set_led(&ui, pos, LPUI_COLOR_GREEN);
+            lpui_set_led_effect(&ui, pos, flash);
+
+            lpui_animate(&ui, 0);
+            lpui_commit(&ui);
+            expect(lpui_get_led(&ui, pos).red) to_be(0);
+            expect(ui.image.previous.leds[3][3].red) to_be(0x3f);
+
+            lpui_animate(&ui, LPUI_EFFECT_PERIOD_US / 2);
+            lpui_commit(&ui);
+            expect(ui.image.previous.leds[3][3].red) to_be(0);
+            expect(num_sent) to_be(2);
+
+            // only changes of the animated color are sent
+            lpui_animate(&ui, LPUI_EFFECT_PERIOD_US / 2 + 16667);
+            lpui_commit(&ui);
+            expect(num_sent) to_be(2);
+        }
+
+        it("should fall back to software for colors outside the palette") {
+            ui.config.native_effects = true;
+            lpui_set_led_effect(&ui, pos, (lpui_effect_t) { .type = LPUI_EFFECT_PULSE, .color = LPUI_COLOR_GREEN });
+
+            int changes = 0;
+            for (int i = 0; i < 30; i++) {
+                uint32_t messages = ui.stats.messages;
+                lpui_animate(&ui, i * 16667);
+                lpui_commit(&ui);
+                changes += ui.stats.messages - messages;
+            }
+
+            // one pulse period, stepping up from black and back down to the lowest level
+            expect(changes) to_be(2 * LPUI_EFFECT_PULSE_LEVELS - 1);
+            for (int i = 0; i < num_sent; i++) {
+                check(sent[i][6] != LPUI_SYSEX_COMMAND_PULSE_LEDS, "message %d is a native pulse", i);
+            }
+        }
+    }
+
+    describe("pattern editor") {
+        static pattern_editor_t editor;
+        static pattern_t patterns[SEQUENCER_NUM_TRACKS];
+
+        before_each() {
+            pattern_editor_init(&editor, &(pattern_editor_config_t) {
+                .callbacks = { .track_pressed = test_track_pressed },
+                .cmp_config = { .pos = { 1, 5 }, .size = { 8, 4 } }
+            });
+            lpui_add_component(&ui, &editor.cmp);
+
+            for (int i = 0; i < SEQUENCER_NUM_TRACKS; i++) {
+                pattern_init(&patterns[i], &PATTERN_DEFAULT_CONFIG());
+                pattern_resize(&patterns[i], 32);
+                for (int j = 0; j < 32; j++) patterns[i].steps[j].atomic.velocity = j % (i + 2) ? 0 : 100;
+                pattern_editor_set_track_pattern(&editor, i, &patterns[i]);
+            }
+            pattern_editor_set_pattern(&editor, 0, &patterns[0]);
+            lpui_commit(&ui);
+            num_sent = 0;
+        }
+
+        it("should switch views without reading the steps again") {
+            // an edit that is not reported keeps the cached color
+            pattern_editor_set_view(&editor, PATTERN_EDITOR_VIEW_GATE);
+            lpui_color_t gate = lpui_get_led(&ui, (lpui_position_t) { 3, 8 });
+            patterns[0].steps[2].gate = 127;
+            pattern_editor_set_view(&editor, PATTERN_EDITOR_VIEW_VELOCITY);
+            pattern_editor_set_view(&editor, PATTERN_EDITOR_VIEW_GATE);
+            check(color_equals(lpui_get_led(&ui, (lpui_position_t) { 3, 8 }), gate));
+
+            // redrawing the edited step updates the cache
+            pattern_editor_draw_steps(&editor, (uint16_t []) { 2 }, 1);
+            check(!color_equals(lpui_get_led(&ui, (lpui_position_t) { 3, 8 }), gate));
+        }
+
+        it("should only send the leds that differ between views") {
+            // the gate lane dims the enabled steps, disabled steps look the same
+            uint32_t leds_sent = ui.stats.leds_sent;
+            pattern_editor_set_view(&editor, PATTERN_EDITOR_VIEW_GATE);
+            lpui_commit(&ui);
+            expect(ui.stats.leds_sent - leds_sent) to_be(15);
+
+            // switching back and forth between tracks ends with an unchanged image
+            pattern_editor_set_view(&editor, PATTERN_EDITOR_VIEW_VELOCITY);
+            lpui_commit(&ui);
+            num_sent = 0;
+            pattern_editor_set_pattern(&editor, 1, &patterns[1]);
+            pattern_editor_set_pattern(&editor, 0, &patterns[0]);
+            lpui_commit(&ui);
+            expect(num_sent) to_be(0);
+        }
+
+        it("should show every track in the overview") {
+            patterns[2].step_position = 11;
+            pattern_editor_set_view(&editor, PATTERN_EDITOR_VIEW_OVERVIEW);
+
+            // one row per track from the top, scrolled to the playhead
+            for (int i = 0; i < SEQUENCER_NUM_TRACKS; i++) {
+                uint8_t y = 8 - i;
+                uint16_t offset = i == 2 ? 8 : 0;
+                for (int x = 0; x < 8; x++) {
+                    lpui_color_t color = lpui_get_led(&ui, (lpui_position_t) { 1 + x, y });
+                    if (offset + x == patterns[i].step_position) {
+                        check(color_equals(color, LPUI_COLOR_PLAYHEAD), "playhead of track %d", i);
+                    } else {
+                        bool enabled = patterns[i].steps[offset + x].atomic.velocity > 0;
+                        check(enabled == (color.red + color.green + color.blue > 0x20), "track %d, step %d", i, x);
+                    }
+                }
+            }
+
+            // the playheads are followed
+            patterns[1].step_position = 1;
+            pattern_editor_update_playhead(&editor, 0, 0);
+            check(color_equals(lpui_get_led(&ui, (lpui_position_t) { 2, 7 }), LPUI_COLOR_PLAYHEAD));
+            check(!color_equals(lpui_get_led(&ui, (lpui_position_t) { 1, 7 }), LPUI_COLOR_PLAYHEAD));
+
+            // a pressed row selects its track
+            pressed_track = -1;
+            test_press(&ui, 4, 6);
+            expect(pressed_track) to_be(2);
+        }
+
+        it("should redraw a track whose pattern is set again") {
+            pattern_editor_set_view(&editor, PATTERN_EDITOR_VIEW_OVERVIEW);
+            lpui_position_t pos = { 4, 7 };
+            lpui_color_t color = lpui_get_led(&ui, pos);
+            check(color.red + color.green + color.blue > 0x20);
+
+            // the steps of track 1 change without an edit being reported, only
+            // setting the pattern again drops the cached colors
+            pattern_resize(&patterns[1], 2);
+            pattern_resize(&patterns[1], 32);
+            pattern_editor_set_track_pattern(&editor, 1, &patterns[1]);
+            color = lpui_get_led(&ui, pos);
+            check(color.red + color.green + color.blue <= 0x20);
+
+            // the same holds for the selected track outside the overview
+            pattern_editor_set_view(&editor, PATTERN_EDITOR_VIEW_VELOCITY);
+            pos = (lpui_position_t) { 3, 8 };
+            color = lpui_get_led(&ui, pos);
+            check(color.red + color.green + color.blue > 0x20);
+            patterns[0].steps[2].atomic.velocity = 0;
+            pattern_editor_set_view(&editor, PATTERN_EDITOR_VIEW_GATE);
+            pattern_editor_set_view(&editor, PATTERN_EDITOR_VIEW_VELOCITY);
+            check(color_equals(lpui_get_led(&ui, pos), color));
+            pattern_editor_set_track_pattern(&editor, 0, &patterns[0]);
+            color = lpui_get_led(&ui, pos);
+            check(color.red + color.green + color.blue <= 0x20);
+        }
+    }
+
+    describe("piano editor") {
+        static piano_editor_t piano;
+
+        before_each() {
+            piano_editor_init(&piano, &(piano_editor_config_t) {
+                .callbacks = { .pressed = test_piano_pressed, .released = test_piano_released },
+                .cmp_config = { .pos = { 1, 1 }, .size = { 8, 4 } },
+                .base_note = PIANO_EDITOR_DEFAULT_BASE_NOTE
+            });
+            lpui_add_component(&ui, &piano.cmp);
+            piano_editor_draw(&piano);
+            lpui_commit(&ui);
+            num_piano_notes = 0;
+        }
+
+        it("should map the pads to two octaves") {
+            uint8_t note;
+            expect(piano_editor_get_note(&piano, (lpui_position_t) { 1, 1 }, &note)) to_be(ESP_OK);
+            expect(note) to_be(PIANO_EDITOR_DEFAULT_BASE_NOTE);
+            expect(piano_editor_get_note(&piano, (lpui_position_t) { 2, 2 }, &note)) to_be(ESP_OK);
+            expect(note) to_be(PIANO_EDITOR_DEFAULT_BASE_NOTE + 1);
+            expect(piano_editor_get_note(&piano, (lpui_position_t) { 8, 3 }, &note)) to_be(ESP_OK);
+            expect(note) to_be(PIANO_EDITOR_DEFAULT_BASE_NOTE + 24);
+
+            // gaps between the black keys and pads outside of the editor
+            expect(piano_editor_get_note(&piano, (lpui_position_t) { 1, 2 }, &note)) to_be(ESP_ERR_NOT_FOUND);
+            expect(piano_editor_get_note(&piano, (lpui_position_t) { 1, 5 }, &note)) to_be(ESP_ERR_NOT_FOUND);
+        }
+
+        it("should highlight pressed keys until they are released") {
+            test_press(&ui, 8, 1);
+            expect(num_piano_notes) to_be(1);
+            expect(piano_notes[0]) to_be(PIANO_EDITOR_DEFAULT_BASE_NOTE + 12);
+
+            // the octave key appears at the end of the first and the start of the second octave
+            check(color_equals(lpui_get_led(&ui, (lpui_position_t) { 8, 1 }), LPUI_COLOR_PIANO_PRESSED));
+            check(color_equals(lpui_get_led(&ui, (lpui_position_t) { 1, 3 }), LPUI_COLOR_PIANO_PRESSED));
+            uint32_t leds_sent = ui.stats.leds_sent;
+            lpui_commit(&ui);
+            expect(ui.stats.leds_sent - leds_sent) to_be(2);
+
+            test_release(&ui, 1, 3);
+            expect(num_piano_notes) to_be(2);
+            expect(piano_notes[1]) to_be(-(PIANO_EDITOR_DEFAULT_BASE_NOTE + 12));
+            check(color_equals(lpui_get_led(&ui, (lpui_position_t) { 8, 1 }), LPUI_COLOR_PIANO_RELEASED));
+
+            // releasing a key that is not held does nothing
+            test_release(&ui, 8, 1);
+            expect(num_piano_notes) to_be(2);
+        }
+    }
+
+    describe("pattern") {
+        it("should quantize to the nearest step") {
+            static pattern_t pattern;
+            pattern_init(&pattern, &PATTERN_DEFAULT_CONFIG());
+
+            pattern_seek(&pattern, 5 * pattern.config.resolution + pattern.config.resolution / 2 - 1);
+            expect(pattern_get_nearest_step(&pattern)) to_be(5);
+            pattern_seek(&pattern, 5 * pattern.config.resolution + pattern.config.resolution / 2);
+            expect(pattern_get_nearest_step(&pattern)) to_be(6);
+
+            // the last step rounds up to the start of the pattern
+            pattern_seek(&pattern, pattern.config.step_length * pattern.config.resolution - 1);
+            expect(pattern_get_nearest_step(&pattern)) to_be(0);
+        }
+    }
+}
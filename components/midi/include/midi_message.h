@@ -4,6 +4,21 @@
 #include "midi_types.h"
 
 
+typedef enum {
+    MIDI_MESSAGE_KIND_INVALID = 0,
+    MIDI_MESSAGE_KIND_BODY,
+    MIDI_MESSAGE_KIND_PITCH_BEND,
+    MIDI_MESSAGE_KIND_TCQF,
+    MIDI_MESSAGE_KIND_SYSEX
+} midi_message_kind_t;
+
+typedef struct {
+    uint8_t length; // required length including the status byte
+    uint8_t channel_mask; // status bits that carry the channel
+    uint8_t kind; // how the message body is stored (midi_message_kind_t)
+} midi_status_t;
+
+
 typedef struct {
     uint8_t command;
     uint8_t channel;
@@ -53,6 +68,13 @@ typedef struct {
 } __attribute__((packed)) midi_message_t;
 
 
+extern const midi_status_t midi_status_table[256];
+
+
+static inline uint8_t midi_message_required_length(uint8_t command) {
+    return midi_status_table[command].length;
+}
+
 esp_err_t midi_message_decode(const uint8_t *data, size_t length, midi_message_t *message);
 
 esp_err_t midi_message_encode(const midi_message_t *message, uint8_t *data, size_t length);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <esp_err.h>
+#include "midi_message.h"
+
+
+typedef struct {
+    midi_message_t message;
+    uint8_t cable;
+    int64_t timestamp;
+} midi_queue_item_t;
+
+// bounded single producer / single consumer ring buffer. Push and pop are lock
+// free, so the producer can run in a usb callback while the consumer drains
+typedef struct {
+    midi_queue_item_t *items;
+    size_t capacity;
+
+    atomic_size_t head;
+    atomic_size_t tail;
+    atomic_uint dropped;
+} midi_queue_t;
+
+
+esp_err_t midi_queue_init(midi_queue_t *queue, size_t capacity);
+void midi_queue_free(midi_queue_t *queue);
+
+bool midi_queue_push(midi_queue_t *queue, const midi_message_t *message, uint8_t cable, int64_t timestamp);
+size_t midi_queue_pop(midi_queue_t *queue, midi_queue_item_t *items, size_t max_items);
+
+size_t midi_queue_size(midi_queue_t *queue);
+uint32_t midi_queue_get_dropped(midi_queue_t *queue);
@@ -20,6 +20,11 @@
 #define MIDI_COMMAND_TUNE_REQUEST 0xF6
 #define MIDI_COMMAND_SYSEX_END 0xF7
 #define MIDI_COMMAND_CLOCK 0xF8
+#define MIDI_COMMAND_START 0xFA
+#define MIDI_COMMAND_CONTINUE 0xFB
+#define MIDI_COMMAND_STOP 0xFC
+
+#define MIDI_CLOCK_PPQN 24
 
 #define MIDI_TCQF_FRAME_LSB 0
 #define MIDI_TCQF_FRAME_MSB 1
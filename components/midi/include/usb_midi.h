@@ -7,6 +7,8 @@
 #include <freertos/semphr.h>
 #include <freertos/queue.h>
 #include "midi_message.h"
+#include "usb_midi_packet.h"
+#include "midi_queue.h"
 #include "usb.h"
 
 
@@ -15,39 +17,16 @@
 #define USB_MIDI_TRANSFER_MAX_SIZE 64
 #define USB_MIDI_SYSEX_BUFFER_SIZE 256
 #define USB_MIDI_PACKET_QUEUE_SIZE 128
-
-#define USB_MIDI_CIN_MISC 0x0
-#define USB_MIDI_CIN_CABLE_EVENT 0x1
-#define USB_MIDI_CIN_SYSCOM_2 0x2
-#define USB_MIDI_CIN_SYSCOM_3 0x3
-#define USB_MIDI_CIN_SYSEX_START_CONT 0x4
-#define USB_MIDI_CIN_SYSEX_END_1_SYSCOM_1 0x5
-#define USB_MIDI_CIN_SYSEX_END_2 0x6
-#define USB_MIDI_CIN_SYSEX_END_3 0x7
-#define USB_MIDI_CIN_NOTE_OFF 0x8
-#define USB_MIDI_CIN_NOTE_ON 0x9
-#define USB_MIDI_CIN_POLY_KEY_PRESSURE 0xA
-#define USB_MIDI_CIN_CONTROL_CHANGE 0xB
-#define USB_MIDI_CIN_PROGRAM_CHANGE 0xC
-#define USB_MIDI_CIN_CHANNEL_PRESSURE 0xD
-#define USB_MIDI_CIN_PITCH_BEND 0xE
-#define USB_MIDI_CIN_BYTE 0xF
+#define USB_MIDI_RECV_QUEUE_SIZE 128 // must be a power of two
+#define USB_MIDI_DISPATCH_BATCH_SIZE 16
 
 #define USB_MIDI_LOCK(usb_midi) xSemaphoreTake((usb_midi)->lock, portMAX_DELAY)
 #define USB_MIDI_UNLOCK(usb_midi) xSemaphoreGive((usb_midi)->lock)
 
 
-typedef uint8_t usb_midi_cin_t;
-
-typedef struct {
-    uint8_t cn_cin;
-    uint8_t data[3];
-} __attribute__((packed)) usb_midi_packet_t;
-
-
 typedef void (*usb_midi_device_connected_callback_t)(const usb_device_desc_t *device_descriptor);
 typedef void (*usb_midi_device_disconnected_callback_t)(const usb_device_desc_t *device_descriptor);
-typedef void (*usb_midi_recv_callback_t)(const midi_message_t *message);
+typedef void (*usb_midi_recv_callback_t)(const midi_message_t *message, uint8_t cable, int64_t timestamp);
 
 typedef struct {
     struct {
@@ -89,6 +68,10 @@ typedef struct {
     usb_midi_port_t out;
     TaskHandle_t transfer_task;
     SemaphoreHandle_t transfer_lock;
+
+    midi_queue_t recv_queue;
+    TaskHandle_t dispatch_task;
+    SemaphoreHandle_t dispatch_lock;
 } usb_midi_t;
 
 
@@ -99,3 +82,5 @@ esp_err_t usb_midi_init(const usb_midi_config_t *config, usb_midi_t *usb_midi);
 esp_err_t usb_midi_send(usb_midi_t *usb_midi, const midi_message_t *message);
 
 esp_err_t usb_midi_send_sysex(usb_midi_t *usb_midi, const uint8_t *data, size_t length);
+
+uint32_t usb_midi_get_dropped_messages(usb_midi_t *usb_midi);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <esp_err.h>
+#include "midi_message.h"
+
+
+#define USB_MIDI_CIN_MISC 0x0
+#define USB_MIDI_CIN_CABLE_EVENT 0x1
+#define USB_MIDI_CIN_SYSCOM_2 0x2
+#define USB_MIDI_CIN_SYSCOM_3 0x3
+#define USB_MIDI_CIN_SYSEX_START_CONT 0x4
+#define USB_MIDI_CIN_SYSEX_END_1_SYSCOM_1 0x5
+#define USB_MIDI_CIN_SYSEX_END_2 0x6
+#define USB_MIDI_CIN_SYSEX_END_3 0x7
+#define USB_MIDI_CIN_NOTE_OFF 0x8
+#define USB_MIDI_CIN_NOTE_ON 0x9
+#define USB_MIDI_CIN_POLY_KEY_PRESSURE 0xA
+#define USB_MIDI_CIN_CONTROL_CHANGE 0xB
+#define USB_MIDI_CIN_PROGRAM_CHANGE 0xC
+#define USB_MIDI_CIN_CHANNEL_PRESSURE 0xD
+#define USB_MIDI_CIN_PITCH_BEND 0xE
+#define USB_MIDI_CIN_BYTE 0xF
+
+
+typedef uint8_t usb_midi_cin_t;
+
+typedef struct {
+    uint8_t cn_cin;
+    uint8_t data[3];
+} __attribute__((packed)) usb_midi_packet_t;
+
+
+// decodes consecutive short message packets into messages (which must fit num_packets entries).
+// Stops at the first sysex or malformed packet and returns the number of consumed packets
+size_t usb_midi_packet_decode_bulk(const usb_midi_packet_t *packets, size_t num_packets,
+    midi_message_t *messages, size_t *num_messages);
@@ -6,76 +6,77 @@
 //static const char *TAG = "midi";
 
 
-const uint8_t midi_channel_voice_message_lengths[7] = {
-    3, 3, 3, 3, 2, 2, 3 // 0x80 - 0xE0
+#define MIDI_STATUS(l, m, k) { .length = (l), .channel_mask = (m), .kind = MIDI_MESSAGE_KIND_ ## k }
+
+// lookup table for all status bytes. Bytes that are not listed (data bytes,
+// undefined system common messages and single EOX bytes) are invalid
+const midi_status_t midi_status_table[256] = {
+    [0x80 ... 0x8F] = MIDI_STATUS(3, 0x0F, BODY), // note off
+    [0x90 ... 0x9F] = MIDI_STATUS(3, 0x0F, BODY), // note on
+    [0xA0 ... 0xAF] = MIDI_STATUS(3, 0x0F, BODY), // poly key pressure
+    [0xB0 ... 0xBF] = MIDI_STATUS(3, 0x0F, BODY), // control change
+    [0xC0 ... 0xCF] = MIDI_STATUS(2, 0x0F, BODY), // program change
+    [0xD0 ... 0xDF] = MIDI_STATUS(2, 0x0F, BODY), // channel pressure
+    [0xE0 ... 0xEF] = MIDI_STATUS(3, 0x0F, PITCH_BEND),
+    [0xF0] = MIDI_STATUS(2, 0x00, SYSEX),
+    [0xF1] = MIDI_STATUS(2, 0x00, TCQF),
+    [0xF2] = MIDI_STATUS(3, 0x00, BODY), // song position
+    [0xF3] = MIDI_STATUS(2, 0x00, BODY), // song select
+    [0xF6] = MIDI_STATUS(1, 0x00, BODY), // tune request
+    [0xF8 ... 0xFF] = MIDI_STATUS(1, 0x00, BODY) // system realtime
 };
 
-const uint8_t midi_system_common_message_lengths[8] = {
-    2, 2, 3, 2, 1, 1, 1, 0 // 0xF0 - 0xF7
+// valid value bits for each tcqf piece
+static const uint8_t midi_tcqf_value_masks[8] = {
+    0x0F, 0x01, 0x0F, 0x03, 0x0F, 0x03, 0x0F, 0x01
 };
 
 
-uint8_t midi_message_required_length(uint8_t command) {
-    if (MIDI_COMMAND_IS_CHANNEL_VOICE(command)) {
-        return midi_channel_voice_message_lengths[(command & 0x70) >> 4];
-    } else if (MIDI_COMMAND_IS_SYSTEM_COMMON(command)) {
-        return midi_system_common_message_lengths[command & 0x07];
-    } else {
-        return 0; // invalid command
-    }
-}
-
 esp_err_t midi_message_decode(const uint8_t *data, size_t length, midi_message_t *message) {
-    uint8_t command, channel, required_length, piece, value, rate;
+    const midi_status_t *status;
+    uint8_t piece, value;
 
     if (length < 1) return ESP_ERR_INVALID_SIZE;
 
-    // validate the command
-    command = data[0];
-    if (!MIDI_COMMAND_IS_VALID(command)) {
+    // validate the command and length
+    status = &midi_status_table[data[0]];
+    if (status->kind == MIDI_MESSAGE_KIND_INVALID) {
         return ESP_ERR_INVALID_ARG;
     }
-
-    // extract the channel
-    if (MIDI_COMMAND_IS_CHANNEL_VOICE(command)) {
-        channel = command & 0x0F;
-        command = command & 0xF0;
-    } else {
-        channel = 0;
-    }
-
-    // validate the length
-    required_length = midi_message_required_length(command);
-    if (length < required_length) {
+    if (length < status->length) {
         return ESP_ERR_INVALID_SIZE;
     }
 
-    // store the command and channel
-    message->command = command;
-    message->channel = channel;
+    // split the status byte into command and channel
+    message->command = data[0] & ~status->channel_mask;
+    message->channel = data[0] & status->channel_mask;
 
     // store the message body
-    switch (command) {
-        case MIDI_COMMAND_TCQF:
+    switch (status->kind) {
+        case MIDI_MESSAGE_KIND_BODY:
+            // store the message body as is, unused bytes are cleared
+            message->body[0] = status->length > 1 ? data[1] : 0;
+            message->body[1] = status->length > 2 ? data[2] : 0;
+            break;
+        case MIDI_MESSAGE_KIND_PITCH_BEND:
+            // align the pitch bend value manually
+            message->pitch_bend.value = data[1] | (data[2] << 7);
+            break;
+        case MIDI_MESSAGE_KIND_TCQF:
             piece = (data[1] >> 4) & 0x07;
             value = data[1] & 0x0F;
-            rate = 0;
 
             // extract the rate
+            message->tcqf.piece = piece;
             if (piece == MIDI_TCQF_RATE_HOUR_MSB) {
-                rate = value >> 1;
-                value = value & 0x01;
+                message->tcqf.value = value & 0x01;
+                message->tcqf.rate = value >> 1;
+            } else {
+                message->tcqf.value = value;
+                message->tcqf.rate = 0;
             }
-
-            message->tcqf.piece = piece;
-            message->tcqf.value = value;
-            message->tcqf.rate = rate;
-            break;
-        case MIDI_COMMAND_PITCH_BEND:
-            // align the pitch bend value manually
-            message->pitch_bend.value = data[1] | (data[2] << 7);
             break;
-        case MIDI_COMMAND_SYSEX:
+        case MIDI_MESSAGE_KIND_SYSEX:
             // validate the EOX byte
             if (data[length - 1] != MIDI_COMMAND_SYSEX_END) return ESP_ERR_INVALID_ARG;
 
@@ -83,75 +84,49 @@ esp_err_t midi_message_decode(const uint8_t *data, size_t length, midi_message_t
             message->sysex.data = data;
             message->sysex.length = length;
             break;
-        case MIDI_COMMAND_SYSEX_END:
-            // single EOX byte is invalid
-            return ESP_ERR_INVALID_ARG;
-        default:
-            // store the message body as is
-            memcpy(message->body, data + 1, required_length - 1);
-            break;
     }
 
     return ESP_OK;
 }
 
 esp_err_t midi_message_encode(const midi_message_t *message, uint8_t *data, size_t length) {
-    uint8_t command, channel, required_length, piece, value;
-
-    command = message->command;
-    channel = message->channel;
+    const midi_status_t *status;
+    uint8_t piece, value;
 
-    // validate the command
-    if (!MIDI_COMMAND_IS_VALID(command)) {
+    // validate the command and length
+    status = &midi_status_table[message->command];
+    if (status->kind == MIDI_MESSAGE_KIND_INVALID) {
         return ESP_ERR_INVALID_ARG;
     }
-
-    // validate the length
-    required_length = midi_message_required_length(command);
-    if (length < required_length) {
+    if (length < status->length) {
         return ESP_ERR_INVALID_SIZE;
     }
 
-    // store the command
-    if (MIDI_COMMAND_IS_CHANNEL_VOICE(command)) {
-        command &= 0xF0;
-        channel &= 0x0F;
-        data[0] = command | channel;
-    } else {
-        data[0] = command;
-    }
+    // merge command and channel (the mask is zero for system messages)
+    data[0] = (message->command & ~status->channel_mask) | (message->channel & status->channel_mask);
 
     // store the message body
-    switch (command) {
-        case MIDI_COMMAND_TCQF:
-            piece = (message->tcqf.piece << 4) & 0x70;
-
-            // mask out the value depending on the piece
-            switch (piece) {
-                case MIDI_TCQF_RATE_HOUR_MSB:
-                    value = (message->tcqf.rate & 0x03) << 1 | (message->tcqf.value & 0x01);
-                    break;
-                case MIDI_TCQF_FRAME_MSB:
-                    value = message->tcqf.value & 0x01;
-                    break;
-                case MIDI_TCQF_SECOND_MSB:
-                case MIDI_TCQF_MINUTE_MSB:
-                    value = message->tcqf.value & 0x03;
-                    break;
-                default:
-                    value = message->tcqf.value & 0x07;
-                    break;
-            }
-
-            data[1] = piece | value;
-
+    switch (status->kind) {
+        case MIDI_MESSAGE_KIND_BODY:
+            // store the message body as is
+            memcpy(data + 1, message->body, status->length - 1);
             break;
-        case MIDI_COMMAND_PITCH_BEND:
+        case MIDI_MESSAGE_KIND_PITCH_BEND:
             // separate the pitch bend value
             data[1] = message->pitch_bend.value & 0x7F;
             data[2] = (message->pitch_bend.value >> 7) & 0x7F;
             break;
-        case MIDI_COMMAND_SYSEX:
+        case MIDI_MESSAGE_KIND_TCQF:
+            // mask out the value depending on the piece
+            piece = message->tcqf.piece & 0x07;
+            value = message->tcqf.value & midi_tcqf_value_masks[piece];
+            if (piece == MIDI_TCQF_RATE_HOUR_MSB) {
+                value |= (message->tcqf.rate & 0x03) << 1;
+            }
+
+            data[1] = piece << 4 | value;
+            break;
+        case MIDI_MESSAGE_KIND_SYSEX:
             // validate the length
             if (length < message->sysex.length) {
                 return ESP_ERR_INVALID_SIZE;
@@ -160,13 +135,6 @@ esp_err_t midi_message_encode(const midi_message_t *message, uint8_t *data, size
             // store the sysex data
             memcpy(data, message->sysex.data, message->sysex.length);
             break;
-        case MIDI_COMMAND_SYSEX_END:
-            // single EOX byte is invalid
-            return ESP_ERR_INVALID_ARG;
-        default:
-            // store the message body as is
-            memcpy(data + 1, message->body, required_length - 1);
-            break;
     }
 
     return ESP_OK;
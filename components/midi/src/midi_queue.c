@@ -0,0 +1,66 @@
+#include "midi_queue.h"
+#include <stdlib.h>
+
+
+esp_err_t midi_queue_init(midi_queue_t *queue, size_t capacity) {
+    // the capacity must be a power of two so that indices can be masked
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) return ESP_ERR_INVALID_ARG;
+
+    queue->items = calloc(capacity, sizeof(midi_queue_item_t));
+    if (queue->items == NULL) return ESP_ERR_NO_MEM;
+
+    queue->capacity = capacity;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->dropped, 0);
+
+    return ESP_OK;
+}
+
+void midi_queue_free(midi_queue_t *queue) {
+    free(queue->items);
+    queue->items = NULL;
+}
+
+bool midi_queue_push(midi_queue_t *queue, const midi_message_t *message, uint8_t cable, int64_t timestamp) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    // drop the message if the queue is full
+    if (head - tail >= queue->capacity) {
+        atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    // store the item, then publish it to the consumer
+    midi_queue_item_t *item = &queue->items[head & (queue->capacity - 1)];
+    item->message = *message;
+    item->cable = cable;
+    item->timestamp = timestamp;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+size_t midi_queue_pop(midi_queue_t *queue, midi_queue_item_t *items, size_t max_items) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    size_t n = head - tail;
+    if (n > max_items) n = max_items;
+
+    // copy the items out before releasing the slots to the producer
+    for (size_t i = 0; i < n; i++) {
+        items[i] = queue->items[(tail + i) & (queue->capacity - 1)];
+    }
+    atomic_store_explicit(&queue->tail, tail + n, memory_order_release);
+
+    return n;
+}
+
+size_t midi_queue_size(midi_queue_t *queue) {
+    return atomic_load(&queue->head) - atomic_load(&queue->tail);
+}
+
+uint32_t midi_queue_get_dropped(midi_queue_t *queue) {
+    return atomic_load(&queue->dropped);
+}
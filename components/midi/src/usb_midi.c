@@ -3,11 +3,13 @@
 #include <esp_err.h>
 #include <esp_check.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <usb/usb_host.h>
 #include <string.h>
 #include "midi.h"
 #include "midi_types.h"
 #include "midi_message.h"
+#include "latency.h"
 
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -19,12 +21,33 @@ static const char *TAG_IN = "usb_midi: data in";
 static const char *TAG_OUT = "usb_midi: data out";
 
 
+static void usb_midi_enqueue(usb_midi_t *usb_midi, const midi_message_t *message, uint8_t cable, int64_t timestamp) {
+    midi_message_t queued = *message;
+
+    // the sysex buffer is reused for the next message, so the dispatch task gets a copy
+    if (message->command == MIDI_COMMAND_SYSEX) {
+        uint8_t *data = malloc(message->sysex.length);
+        if (data == NULL) {
+            ESP_LOGW(TAG_IN, "no memory for sysex message, dropping it");
+            return;
+        }
+
+        memcpy(data, message->sysex.data, message->sysex.length);
+        queued.sysex.data = data;
+    }
+
+    // the dispatch task takes ownership of the sysex copy
+    if (!midi_queue_push(&usb_midi->recv_queue, &queued, cable, timestamp) && message->command == MIDI_COMMAND_SYSEX) {
+        free((void *) queued.sysex.data);
+    }
+}
+
 static void usb_midi_sysex_reset(usb_midi_t *usb_midi) {
     // clear the buffer by resetting the length
     usb_midi->in.sysex_len = 0;
 }
 
-static esp_err_t usb_midi_sysex_parse(usb_midi_t *usb_midi, const uint8_t *data, size_t len) {
+static esp_err_t usb_midi_sysex_parse(usb_midi_t *usb_midi, const uint8_t *data, size_t len, uint8_t cable, int64_t timestamp) {
     midi_message_t message;
     usb_midi_port_t *in = &usb_midi->in;
 
@@ -39,7 +62,7 @@ static esp_err_t usb_midi_sysex_parse(usb_midi_t *usb_midi, const uint8_t *data,
             ESP_RETURN_ON_ERROR(midi_message_decode(in->sysex_buffer, in->sysex_len, &message),
                 TAG, "failed to decode sysex message");
 
-            MIDI_INVOKE_CALLBACK(&usb_midi->config.callbacks, recv, &message);
+            usb_midi_enqueue(usb_midi, &message, cable, timestamp);
             usb_midi_sysex_reset(usb_midi);
         }
     }
@@ -47,9 +70,9 @@ static esp_err_t usb_midi_sysex_parse(usb_midi_t *usb_midi, const uint8_t *data,
     return ESP_OK;
 }
 
-static esp_err_t usb_midi_parse_packet(usb_midi_t *usb_midi, const usb_midi_packet_t *packet) {
+static esp_err_t usb_midi_parse_packet(usb_midi_t *usb_midi, const usb_midi_packet_t *packet, int64_t timestamp) {
     midi_message_t message;
-    uint8_t cin;
+    uint8_t cn, cin;
     const uint8_t *data;
 
     /* printf("raw data in: ");
@@ -57,7 +80,7 @@ static esp_err_t usb_midi_parse_packet(usb_midi_t *usb_midi, const usb_midi_pack
     printf("\n"); */
 
     // get cable number and code index number
-    //cn = packet->cn_cin >> 4;
+    cn = packet->cn_cin >> 4;
     cin = packet->cn_cin & 0x0F;
     data = packet->data;
 
@@ -70,28 +93,28 @@ static esp_err_t usb_midi_parse_packet(usb_midi_t *usb_midi, const usb_midi_pack
         ESP_RETURN_ON_FALSE(cin == message.command >> 4, ESP_ERR_INVALID_ARG,
             TAG, "invalid cin number for short message");
 
-        MIDI_INVOKE_CALLBACK(&usb_midi->config.callbacks, recv, &message);
+        usb_midi_enqueue(usb_midi, &message, cn, timestamp);
         return ESP_OK;
     }
 
     // handle special messages
     switch (cin) {
         case USB_MIDI_CIN_SYSEX_START_CONT:
-            ESP_RETURN_ON_ERROR(usb_midi_sysex_parse(usb_midi, data, 3),
+            ESP_RETURN_ON_ERROR(usb_midi_sysex_parse(usb_midi, data, 3, cn, timestamp),
                 TAG, "failed to parse sysex start packet");
             break;
         case USB_MIDI_CIN_SYSEX_END_1_SYSCOM_1:
-            ESP_RETURN_ON_ERROR(usb_midi_sysex_parse(usb_midi, data, 1),
+            ESP_RETURN_ON_ERROR(usb_midi_sysex_parse(usb_midi, data, 1, cn, timestamp),
                 TAG, "failed to parse sysex end packet");
             usb_midi_sysex_reset(usb_midi);
             break;
         case USB_MIDI_CIN_SYSEX_END_2:
-            ESP_RETURN_ON_ERROR(usb_midi_sysex_parse(usb_midi, data, 2),
+            ESP_RETURN_ON_ERROR(usb_midi_sysex_parse(usb_midi, data, 2, cn, timestamp),
                 TAG, "failed to parse sysex end packet");
             usb_midi_sysex_reset(usb_midi);
             break;
         case USB_MIDI_CIN_SYSEX_END_3:
-            ESP_RETURN_ON_ERROR(usb_midi_sysex_parse(usb_midi, data, 3),
+            ESP_RETURN_ON_ERROR(usb_midi_sysex_parse(usb_midi, data, 3, cn, timestamp),
                  TAG, "failed to parse sysex end packet");
             usb_midi_sysex_reset(usb_midi);
             break;
@@ -105,36 +128,107 @@ static esp_err_t usb_midi_parse_packet(usb_midi_t *usb_midi, const usb_midi_pack
 static void usb_midi_data_in_callback(usb_transfer_t *transfer) {
     esp_err_t ret;
     usb_midi_t *usb_midi = (usb_midi_t *) transfer->context;
-    const usb_midi_packet_t *packet;
-    int i, n;
+    usb_midi_packet_t packets[USB_MIDI_TRANSFER_MAX_SIZE / sizeof(usb_midi_packet_t)];
+    midi_message_t messages[USB_MIDI_TRANSFER_MAX_SIZE / sizeof(usb_midi_packet_t)];
+    size_t i, j, n, num_messages;
+    int64_t timestamp;
 
     //xSemaphoreTake(usb_midi->lock, portMAX_DELAY);
 
+    // all packets of a transfer arrived at the same time
+    timestamp = esp_timer_get_time();
+
     // device is not valid anymore
     ESP_GOTO_ON_FALSE(usb_midi->state == USB_MIDI_CONNECTED, ESP_ERR_INVALID_STATE, exit,
         TAG_IN, "device is not connected anymore");
 
+    // copy the packets out, so the transfer can be resubmitted right away
+    n = transfer->actual_num_bytes / sizeof(usb_midi_packet_t);
+    memcpy(packets, transfer->data_buffer, n * sizeof(usb_midi_packet_t));
+
+    // continue polling
+    ESP_GOTO_ON_ERROR(usb_host_transfer_submit(usb_midi->in.transfer), exit,
+        TAG_IN, "failed to submit transfer");
+    latency_record(LATENCY_USB_IN_RESUBMIT, timestamp);
+
     // validate the size
-    n = transfer->actual_num_bytes / 4;
     ESP_GOTO_ON_FALSE(n > 0, ESP_ERR_INVALID_SIZE, exit,
         TAG_IN, "invalid packet size (%d)", transfer->actual_num_bytes);
 
-    // handle the incoming data in 4 byte packets
-    for (i = 0, packet = (usb_midi_packet_t *) transfer->data_buffer; i < n; i++, packet++) {
-        ESP_GOTO_ON_ERROR(usb_midi_parse_packet(usb_midi, packet), exit,
-            TAG_IN, "failed to parse packet");
-    }
+    // handle the incoming data in 4 byte packets. Messages are only queued here,
+    // the dispatch task invokes the receive callback
+    for (i = 0; i < n;) {
+        // decode all consecutive short messages at once
+        // every short message occupies one packet, so message j came from packet i + j
+        usb_midi_packet_decode_bulk(&packets[i], n - i, messages, &num_messages);
+        for (j = 0; j < num_messages; j++) {
+            usb_midi_enqueue(usb_midi, &messages[j], packets[i + j].cn_cin >> 4, timestamp);
+        }
+        i += num_messages;
 
-    // continue polling
-    ESP_GOTO_ON_ERROR(usb_host_transfer_submit(usb_midi->in.transfer), exit,
-        TAG_IN, "failed to submit transfer");
+        // sysex and malformed packets are handled one by one
+        if (i < n) {
+            ESP_GOTO_ON_ERROR(usb_midi_parse_packet(usb_midi, &packets[i], timestamp), exit,
+                TAG_IN, "failed to parse packet");
+            i++;
+        }
+    }
 
     ret = ESP_OK;
 exit:
+    // wake up the dispatch task, even if only part of the transfer was parsed
+    if (midi_queue_size(&usb_midi->recv_queue) > 0) {
+        xTaskNotifyGive(usb_midi->dispatch_task);
+    }
+
     //xSemaphoreGive(usb_midi->lock);
     return;
 }
 
+static void usb_midi_dispatch_task(void *arg) {
+    usb_midi_t *usb_midi = (usb_midi_t *) arg;
+    midi_queue_item_t items[USB_MIDI_DISPATCH_BATCH_SIZE];
+    size_t i, n;
+
+    while (1) {
+        // wait for the data in callback to queue new messages
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // drain the queue in batches. The disconnect path takes the dispatch lock
+        // before it invokes the disconnected callback, so no message is dispatched
+        // while the receiver is torn down
+        xSemaphoreTake(usb_midi->dispatch_lock, portMAX_DELAY);
+        while ((n = midi_queue_pop(&usb_midi->recv_queue, items, USB_MIDI_DISPATCH_BATCH_SIZE)) > 0) {
+            for (i = 0; i < n; i++) {
+                // messages still queued from a device that is gone are dropped
+                if (usb_midi->state == USB_MIDI_CONNECTED) {
+                    MIDI_INVOKE_CALLBACK(&usb_midi->config.callbacks, recv, &items[i].message, items[i].cable, items[i].timestamp);
+                }
+
+                // release the sysex copy created by usb_midi_enqueue
+                if (items[i].message.command == MIDI_COMMAND_SYSEX) {
+                    free((void *) items[i].message.sysex.data);
+                }
+            }
+        }
+        xSemaphoreGive(usb_midi->dispatch_lock);
+    }
+}
+
+static void usb_midi_dispatch_drain(usb_midi_t *usb_midi) {
+    midi_queue_item_t items[USB_MIDI_DISPATCH_BATCH_SIZE];
+    size_t i, n;
+
+    // drop the messages that were not dispatched yet
+    while ((n = midi_queue_pop(&usb_midi->recv_queue, items, USB_MIDI_DISPATCH_BATCH_SIZE)) > 0) {
+        for (i = 0; i < n; i++) {
+            if (items[i].message.command == MIDI_COMMAND_SYSEX) {
+                free((void *) items[i].message.sysex.data);
+            }
+        }
+    }
+}
+
 static void usb_midi_data_out_callback(usb_transfer_t *transfer) {
     usb_midi_t *usb_midi = (usb_midi_t *) transfer->context;
 
@@ -343,10 +437,15 @@ static esp_err_t usb_midi_close_device(usb_midi_t *usb_midi) {
     ESP_GOTO_ON_FALSE(usb_midi->state == USB_MIDI_CONNECTED, ESP_ERR_INVALID_STATE, exit,
         TAG, "device is not connected");
 
-    // mark as disconnected and invoke the callback
+    // mark as disconnected, wait for the dispatch task to finish its current batch
+    // and drop the rest, then invoke the callback. The receive callback is not
+    // called again until the next device connects
     usb_midi->state = USB_MIDI_DISCONNECTED;
     xSemaphoreGive(usb_midi->lock);
+    xSemaphoreTake(usb_midi->dispatch_lock, portMAX_DELAY);
+    usb_midi_dispatch_drain(usb_midi);
     MIDI_INVOKE_CALLBACK(&usb_midi->config.callbacks, disconnected, usb_midi->device_descriptor);
+    xSemaphoreGive(usb_midi->dispatch_lock);
     xSemaphoreTake(usb_midi->lock, portMAX_DELAY);
 
     // free the ports
@@ -425,6 +524,8 @@ void usb_midi_driver_task(void *arg) {
 }
 
 esp_err_t usb_midi_init(const usb_midi_config_t *config, usb_midi_t *usb_midi) {
+    esp_err_t ret;
+
     memset(usb_midi, 0, sizeof(usb_midi_t));
 
     // store the config and initial state
@@ -432,12 +533,24 @@ esp_err_t usb_midi_init(const usb_midi_config_t *config, usb_midi_t *usb_midi) {
     usb_midi->state = USB_MIDI_DISCONNECTED;
     usb_midi->lock = xSemaphoreCreateMutex();
     usb_midi->transfer_lock = xSemaphoreCreateBinary();
+    usb_midi->dispatch_lock = xSemaphoreCreateMutex();
 
     // link the driver task function and argument, this will be dispatched from the usb interface
     usb_midi->driver_config.task = usb_midi_driver_task;
     usb_midi->driver_config.arg = (void *) usb_midi;
 
-    return ESP_OK;
+    // received messages are handed over to the dispatch task through the receive queue
+    ESP_RETURN_ON_ERROR(midi_queue_init(&usb_midi->recv_queue, USB_MIDI_RECV_QUEUE_SIZE),
+        TAG, "failed to create receive queue");
+    ESP_GOTO_ON_FALSE(xTaskCreatePinnedToCore(usb_midi_dispatch_task, "usb_midi_dispatch", 4096, (void *) usb_midi, 2, &usb_midi->dispatch_task, 0) == pdPASS,
+        ESP_ERR_NO_MEM, exit, TAG, "failed to create dispatch task");
+
+    ret = ESP_OK;
+exit:
+    if (ret != ESP_OK) {
+        midi_queue_free(&usb_midi->recv_queue);
+    }
+    return ret;
 }
 
 static esp_err_t usb_midi_queue_out_packet(usb_midi_t *usb_midi, usb_midi_packet_t *packet) {
@@ -524,3 +637,7 @@ esp_err_t usb_midi_send_sysex(usb_midi_t *usb_midi, const uint8_t *data, size_t
     };
     return usb_midi_send(usb_midi, &message);
 }
+
+uint32_t usb_midi_get_dropped_messages(usb_midi_t *usb_midi) {
+    return midi_queue_get_dropped(&usb_midi->recv_queue);
+}
@@ -0,0 +1,31 @@
+#include "usb_midi_packet.h"
+
+
+// message length for each code index number, zero for sysex and reserved codes
+static const uint8_t usb_midi_cin_lengths[16] = {
+    0, 0, 2, 3, 0, 0, 0, 0, // misc, cable event, syscom, sysex
+    3, 3, 3, 3, 2, 2, 3, 1 // channel voice, single byte
+};
+
+
+size_t usb_midi_packet_decode_bulk(const usb_midi_packet_t *packets, size_t num_packets,
+        midi_message_t *messages, size_t *num_messages) {
+    size_t i, n = 0;
+
+    for (i = 0; i < num_packets; i++) {
+        const uint8_t cin = packets[i].cn_cin & 0x0F;
+        const uint8_t *data = packets[i].data;
+        const uint8_t length = usb_midi_cin_lengths[cin];
+
+        // the cin must agree with the status byte. Channel voice and single byte
+        // packets also carry the command in the cin number
+        if (length == 0 || midi_status_table[data[0]].length != length) break;
+        if (cin >= USB_MIDI_CIN_NOTE_OFF && data[0] >> 4 != cin) break;
+
+        if (midi_message_decode(data, length, &messages[n]) != ESP_OK) break;
+        n++;
+    }
+
+    *num_messages = n;
+    return i;
+}
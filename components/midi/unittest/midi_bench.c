@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <time.h>
+#include "midi_message.h"
+#include "midi_message_reference.h"
+#include "usb_midi_packet.h"
+
+
+#define BENCH_NUM_PACKETS 4096
+#define BENCH_ROUNDS 500
+
+
+static usb_midi_packet_t packets[BENCH_NUM_PACKETS];
+static midi_message_t messages[BENCH_NUM_PACKETS];
+static volatile uint32_t sink;
+
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_report(const char *name, uint64_t elapsed_ns) {
+    printf("%-24s %7.2f ns/message\n", name, (double) elapsed_ns / (BENCH_ROUNDS * BENCH_NUM_PACKETS));
+}
+
+static void bench_setup() {
+    // a typical controller stream: mostly notes and control changes, some clock
+    static const uint8_t statuses[] = { 0x90, 0x80, 0xB0, 0x90, 0xE0, 0xC0, 0x90, 0xB0 };
+    uint32_t x = 0x12345678;
+
+    for (int i = 0; i < BENCH_NUM_PACKETS; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+
+        uint8_t status = statuses[x % sizeof(statuses)] | ((x >> 8) & 0x0F);
+        packets[i].cn_cin = status >> 4;
+        packets[i].data[0] = status;
+        packets[i].data[1] = (x >> 12) & 0x7F;
+        packets[i].data[2] = (x >> 20) & 0x7F;
+    }
+}
+
+int main() {
+    uint64_t start;
+    size_t num_messages;
+    uint8_t data[3];
+
+    bench_setup();
+
+    // decoding
+    start = bench_now_ns();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_NUM_PACKETS; i++) {
+            midi_message_reference_decode(packets[i].data, 3, &messages[i]);
+        }
+        sink += messages[r % BENCH_NUM_PACKETS].body[0];
+    }
+    bench_report("decode (reference)", bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_NUM_PACKETS; i++) {
+            midi_message_decode(packets[i].data, 3, &messages[i]);
+        }
+        sink += messages[r % BENCH_NUM_PACKETS].body[0];
+    }
+    bench_report("decode (table)", bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        usb_midi_packet_decode_bulk(packets, BENCH_NUM_PACKETS, messages, &num_messages);
+        sink += num_messages;
+    }
+    bench_report("decode (bulk)", bench_now_ns() - start);
+
+    // encoding
+    start = bench_now_ns();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_NUM_PACKETS; i++) {
+            midi_message_reference_encode(&messages[i], data, sizeof(data));
+            sink += data[0];
+        }
+    }
+    bench_report("encode (reference)", bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_NUM_PACKETS; i++) {
+            midi_message_encode(&messages[i], data, sizeof(data));
+            sink += data[0];
+        }
+    }
+    bench_report("encode (table)", bench_now_ns() - start);
+
+    return 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "midi_message.h"
+
+
+esp_err_t midi_message_reference_decode(const uint8_t *data, size_t length, midi_message_t *message);
+esp_err_t midi_message_reference_encode(const midi_message_t *message, uint8_t *data, size_t length);
@@ -0,0 +1,122 @@
+#include "bdd-for-c.h"
+#include <pthread.h>
+#include <time.h>
+#include "midi_queue.h"
+
+
+#define FLOOD_MESSAGES 2000000
+#define FLOOD_BATCH_SIZE 16
+
+
+typedef struct {
+    midi_queue_t *queue;
+    uint64_t push_ns;
+    bool done;
+} flood_producer_t;
+
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *flood_producer(void *arg) {
+    flood_producer_t *producer = arg;
+    midi_message_t msg = { .command = MIDI_COMMAND_NOTE_ON };
+
+    // push as fast as possible, the sequence number is stored as the timestamp
+    uint64_t start = now_ns();
+    for (int64_t i = 1; i <= FLOOD_MESSAGES; i++) {
+        msg.note_on.note = i & 0x7F;
+        midi_queue_push(producer->queue, &msg, 0, i);
+    }
+    producer->push_ns = now_ns() - start;
+
+    __atomic_store_n(&producer->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+
+spec("midi queue") {
+    static midi_queue_t queue;
+
+    before_each() {
+        midi_queue_init(&queue, 128);
+    }
+
+    after_each() {
+        midi_queue_free(&queue);
+    }
+
+    it("should reject capacities that are not a power of two") {
+        midi_queue_t other;
+        expect(midi_queue_init(&other, 100)) to_be(ESP_ERR_INVALID_ARG);
+        expect(midi_queue_init(&other, 0)) to_be(ESP_ERR_INVALID_ARG);
+    }
+
+    it("should pop messages in order") {
+        midi_message_t msg = { .command = MIDI_COMMAND_CONTROL_CHANGE };
+        midi_queue_item_t items[8];
+
+        for (int i = 0; i < 5; i++) {
+            msg.control_change.value = i;
+            expect(midi_queue_push(&queue, &msg, i & 0x0F, 1000 + i)) to_be_true();
+        }
+
+        expect(midi_queue_size(&queue)) to_be(5);
+        expect(midi_queue_pop(&queue, items, 3)) to_be(3);
+        expect(midi_queue_pop(&queue, &items[3], 8)) to_be(2);
+        for (int i = 0; i < 5; i++) {
+            expect(items[i].message.control_change.value) to_be(i);
+            expect(items[i].timestamp) to_be(1000 + i);
+            expect(items[i].cable) to_be(i & 0x0F);
+        }
+        expect(midi_queue_size(&queue)) to_be(0);
+    }
+
+    it("should drop messages when full") {
+        midi_message_t msg = { .command = MIDI_COMMAND_CLOCK };
+
+        for (int i = 0; i < 128; i++) {
+            expect(midi_queue_push(&queue, &msg, 0, i)) to_be_true();
+        }
+        expect(midi_queue_push(&queue, &msg, 0, 128)) to_be_false();
+        expect(midi_queue_get_dropped(&queue)) to_be(1);
+    }
+
+    it("should deliver or count every message under a flood") {
+        flood_producer_t producer = { .queue = &queue, .done = false };
+        midi_queue_item_t items[FLOOD_BATCH_SIZE];
+        pthread_t thread;
+        int64_t last = 0;
+        uint32_t received = 0, batches = 0;
+        bool ordered = true;
+
+        pthread_create(&thread, NULL, flood_producer, &producer);
+
+        // drain in batches like the dispatch task does
+        while (true) {
+            bool done = __atomic_load_n(&producer.done, __ATOMIC_ACQUIRE);
+            size_t n = midi_queue_pop(&queue, items, FLOOD_BATCH_SIZE);
+
+            for (size_t i = 0; i < n; i++) {
+                if (items[i].timestamp <= last) ordered = false;
+                if (items[i].message.note_on.note != (items[i].timestamp & 0x7F)) ordered = false;
+                last = items[i].timestamp;
+            }
+            received += n;
+            batches += n > 0;
+
+            if (done && n == 0) break;
+        }
+        pthread_join(thread, NULL);
+
+        uint32_t dropped = midi_queue_get_dropped(&queue);
+        printf("\n    %u messages: %u received in %u batches, %u dropped, %.1f ns/push\n",
+            FLOOD_MESSAGES, received, batches, dropped, (double) producer.push_ns / FLOOD_MESSAGES);
+
+        expect(ordered) to_be_true();
+        expect(received + dropped) to_be(FLOOD_MESSAGES);
+    }
+}
@@ -1,8 +1,200 @@
 #include "bdd-for-c.h"
+#include "midi_message.h"
+#include "midi_message_reference.h"
+#include "usb_midi_packet.h"
 
 
-spec("midi test") {
-    it("should do something") {
-        expect(1) to_be(1);
+#define FUZZ_ITERATIONS 200000
+
+
+static uint32_t fuzz_state = 0x12345678;
+
+static uint32_t fuzz_rand() {
+    // xorshift32, deterministic so failures can be reproduced
+    fuzz_state ^= fuzz_state << 13;
+    fuzz_state ^= fuzz_state >> 17;
+    fuzz_state ^= fuzz_state << 5;
+    return fuzz_state;
+}
+
+static bool midi_message_equals(const midi_message_t *a, const midi_message_t *b) {
+    const midi_status_t *status = &midi_status_table[a->command | a->channel];
+
+    if (a->command != b->command || a->channel != b->channel) return false;
+
+    switch (status->kind) {
+        case MIDI_MESSAGE_KIND_PITCH_BEND:
+            return a->pitch_bend.value == b->pitch_bend.value;
+        case MIDI_MESSAGE_KIND_TCQF:
+            return a->tcqf.piece == b->tcqf.piece && a->tcqf.value == b->tcqf.value && a->tcqf.rate == b->tcqf.rate;
+        case MIDI_MESSAGE_KIND_SYSEX:
+            return a->sysex.data == b->sysex.data && a->sysex.length == b->sysex.length;
+        default:
+            return memcmp(a->body, b->body, status->length - 1) == 0;
+    }
+}
+
+
+spec("midi message") {
+    describe("status table") {
+        it("should match the command validation macros") {
+            for (int s = 0; s < 256; s++) {
+                bool valid = midi_status_table[s].kind != MIDI_MESSAGE_KIND_INVALID;
+                check(valid == (MIDI_COMMAND_IS_VALID(s) && s != MIDI_COMMAND_SYSEX_END), "status %02x", s);
+            }
+        }
+
+        it("should treat system realtime messages as single bytes") {
+            for (int s = 0xF8; s <= 0xFF; s++) {
+                midi_message_t msg;
+                uint8_t data[1] = { s };
+
+                expect(midi_message_decode(data, 1, &msg)) to_be(ESP_OK);
+                expect(msg.command) to_be(s);
+                expect(msg.channel) to_be(0);
+            }
+        }
+    }
+
+    describe("decode") {
+        it("should be equivalent to the reference codec") {
+            uint8_t data[8];
+            midi_message_t expected, actual;
+
+            for (int i = 0; i < FUZZ_ITERATIONS; i++) {
+                size_t length = fuzz_rand() % sizeof(data);
+                for (size_t j = 0; j < sizeof(data); j++) data[j] = fuzz_rand();
+
+                // bias towards valid messages: status byte first, then data bytes
+                if (fuzz_rand() % 4) {
+                    data[0] |= 0x80;
+                    for (size_t j = 1; j < sizeof(data); j++) data[j] &= 0x7F;
+                    if (data[0] == MIDI_COMMAND_SYSEX && length > 1) data[length - 1] = MIDI_COMMAND_SYSEX_END;
+                }
+
+                // the reference codec reads realtime messages with the system common lengths
+                if (length > 0 && data[0] >= 0xF8) continue;
+
+                esp_err_t expected_ret = midi_message_reference_decode(data, length, &expected);
+                esp_err_t actual_ret = midi_message_decode(data, length, &actual);
+
+                check(expected_ret == actual_ret, "return value for %02x (length %zu)", data[0], length);
+                if (expected_ret == ESP_OK) {
+                    check(midi_message_equals(&expected, &actual), "msg for %02x (length %zu)", data[0], length);
+                }
+            }
+        }
+    }
+
+    describe("encode") {
+        it("should be equivalent to the reference codec") {
+            uint8_t expected[4], actual[4];
+            midi_message_t msg;
+
+            for (int i = 0; i < FUZZ_ITERATIONS; i++) {
+                msg.command = fuzz_rand();
+                msg.channel = fuzz_rand();
+                msg.body[0] = fuzz_rand() & 0x7F;
+                msg.body[1] = fuzz_rand() & 0x7F;
+
+                // the reference codec does not encode tcqf pieces and realtime messages correctly
+                if (msg.command == MIDI_COMMAND_TCQF || msg.command >= 0xF8) continue;
+                if (msg.command == MIDI_COMMAND_SYSEX) {
+                    msg.sysex.data = (const uint8_t []) { 0xF0, 0x01, 0xF7 };
+                    msg.sysex.length = 3;
+                }
+
+                size_t length = fuzz_rand() % sizeof(expected);
+                memset(expected, 0, sizeof(expected));
+                memset(actual, 0, sizeof(actual));
+
+                esp_err_t expected_ret = midi_message_reference_encode(&msg, expected, length);
+                esp_err_t actual_ret = midi_message_encode(&msg, actual, length);
+
+                check(expected_ret == actual_ret, "return value for %02x (length %zu)", msg.command, length);
+                if (expected_ret == ESP_OK) {
+                    check(memcmp(expected, actual, length) == 0, "data for %02x (length %zu)", msg.command, length);
+                }
+            }
+        }
+
+        it("should round trip all tcqf pieces") {
+            const uint8_t value_limits[8] = { 16, 2, 16, 4, 16, 4, 16, 2 };
+            uint8_t data[2];
+            midi_message_t msg, decoded;
+
+            msg.command = MIDI_COMMAND_TCQF;
+            msg.channel = 0;
+            for (uint8_t piece = 0; piece < 8; piece++) {
+                for (uint8_t value = 0; value < value_limits[piece]; value++) {
+                    for (uint8_t rate = 0; rate < (piece == MIDI_TCQF_RATE_HOUR_MSB ? 4 : 1); rate++) {
+                        msg.tcqf.piece = piece;
+                        msg.tcqf.value = value;
+                        msg.tcqf.rate = rate;
+
+                        expect(midi_message_encode(&msg, data, 2)) to_be(ESP_OK);
+                        expect(midi_message_decode(data, 2, &decoded)) to_be(ESP_OK);
+                        check(midi_message_equals(&msg, &decoded), "piece %d, value %d, rate %d", piece, value, rate);
+                    }
+                }
+            }
+        }
+    }
+
+    describe("bulk decode") {
+        it("should decode short messages like single packet decoding") {
+            usb_midi_packet_t packets[16];
+            midi_message_t messages[16], expected;
+            size_t num_messages;
+
+            for (int i = 0; i < FUZZ_ITERATIONS / 16; i++) {
+                for (int j = 0; j < 16; j++) {
+                    uint8_t status = 0x80 | (fuzz_rand() % 0x70);
+                    packets[j].cn_cin = status >> 4;
+                    packets[j].data[0] = status;
+                    packets[j].data[1] = fuzz_rand() & 0x7F;
+                    packets[j].data[2] = fuzz_rand() & 0x7F;
+                }
+
+                size_t consumed = usb_midi_packet_decode_bulk(packets, 16, messages, &num_messages);
+                expect(consumed) to_be(16);
+                expect(num_messages) to_be(16);
+
+                for (int j = 0; j < 16; j++) {
+                    expect(midi_message_reference_decode(packets[j].data, 3, &expected)) to_be(ESP_OK);
+                    check(midi_message_equals(&expected, &messages[j]), "packet %d", j);
+                }
+            }
+        }
+
+        it("should stop at sysex packets") {
+            const usb_midi_packet_t packets[] = {
+                { 0x09, { 0x90, 0x3C, 0x7F } },
+                { 0x0F, { 0xF8, 0x00, 0x00 } },
+                { 0x04, { 0xF0, 0x00, 0x20 } },
+                { 0x08, { 0x80, 0x3C, 0x00 } }
+            };
+            midi_message_t messages[4];
+            size_t num_messages;
+
+            expect(usb_midi_packet_decode_bulk(packets, 4, messages, &num_messages)) to_be(2);
+            expect(num_messages) to_be(2);
+            expect(messages[0].command) to_be(MIDI_COMMAND_NOTE_ON);
+            expect(messages[1].command) to_be(MIDI_COMMAND_CLOCK);
+
+            expect(usb_midi_packet_decode_bulk(&packets[3], 1, messages, &num_messages)) to_be(1);
+            expect(messages[0].command) to_be(MIDI_COMMAND_NOTE_OFF);
+        }
+
+        it("should stop at packets whose cin does not match the command") {
+            const usb_midi_packet_t packets[] = {
+                { 0x08, { 0x90, 0x3C, 0x7F } }
+            };
+            midi_message_t messages[1];
+            size_t num_messages;
+
+            expect(usb_midi_packet_decode_bulk(packets, 1, messages, &num_messages)) to_be(0);
+            expect(num_messages) to_be(0);
+        }
     }
 }
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include "modulation_generator.h"
+#include "output.h"
+#include "sequencer.h"
+
+
+#define MODULATION_MAX_GENERATORS 16
+#define MODULATION_DEFAULT_RATE_HZ 1000
+
+#define MODULATION_TRACK_NONE 0xFF
+
+#define MODULATION_DEFAULT_CONFIG(out) ((modulation_config_t) { \
+    .output = (out), \
+    .rate_hz = MODULATION_DEFAULT_RATE_HZ, \
+    .bpm = 120 \
+})
+
+
+typedef struct {
+    output_t *output;
+    uint32_t rate_hz; // control rate, one sample per generator and period
+    uint16_t bpm;
+} modulation_config_t;
+
+// a generator and the analog port it drives
+typedef struct {
+    modulation_generator_config_t generator;
+    output_port_t *port;
+    uint32_t min_mv, max_mv;
+    uint8_t gate_track; // envelopes follow the gate of this sequencer track, MODULATION_TRACK_NONE for none
+} modulation_slot_config_t;
+
+typedef struct {
+    modulation_slot_config_t config;
+    modulation_generator_t generator;
+    int32_t last_sample; // -1 forces the next sample out
+} modulation_slot_t;
+
+typedef struct {
+    modulation_config_t config;
+
+    modulation_slot_t slots[MODULATION_MAX_GENERATORS];
+    uint32_t active_slots;
+    uint8_t block_position; // samples of the current block that went out
+    uint32_t open_tracks; // gates of the sequencer tracks, by track index
+
+    portMUX_TYPE lock;
+    esp_timer_handle_t timer;
+} modulation_t;
+
+
+esp_err_t modulation_init(modulation_t *modulation, const modulation_config_t *config);
+esp_err_t modulation_free(modulation_t *modulation);
+
+esp_err_t modulation_add(modulation_t *modulation, const modulation_slot_config_t *config, uint8_t *id);
+esp_err_t modulation_remove(modulation_t *modulation, uint8_t id);
+
+esp_err_t modulation_gate(modulation_t *modulation, uint8_t id, bool on);
+esp_err_t modulation_set_bpm(modulation_t *modulation, uint16_t bpm);
+
+// renders the next block of all generators when needed, then writes one sample of each
+esp_err_t modulation_tick(modulation_t *modulation);
+
+esp_err_t modulation_sequencer_event(modulation_t *modulation, sequencer_event_t event, sequencer_t *sequencer, void *data);
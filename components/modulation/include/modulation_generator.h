@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// samples rendered per generator at once, gates still act on the next sample
+#define MODULATION_BLOCK_SIZE 16
+
+// waveform tables, interpolated between entries
+#define MODULATION_TABLE_BITS 8
+#define MODULATION_TABLE_SIZE (1 << MODULATION_TABLE_BITS)
+
+// samples are unipolar, 0 .. MODULATION_SAMPLE_MAX
+#define MODULATION_SAMPLE_MAX 0xFFFF
+
+// envelope levels carry extra fractional bits, so long segments still move every sample
+#define MODULATION_LEVEL_FRAC_BITS 8
+#define MODULATION_LEVEL_MAX ((uint32_t) MODULATION_SAMPLE_MAX << MODULATION_LEVEL_FRAC_BITS)
+
+
+typedef enum {
+    MODULATION_ADSR,
+    MODULATION_LFO
+} modulation_generator_type_t;
+
+typedef enum {
+    MODULATION_WAVEFORM_SINE,
+    MODULATION_WAVEFORM_TRIANGLE,
+    MODULATION_WAVEFORM_SAW,
+    MODULATION_WAVEFORM_SQUARE,
+    MODULATION_NUM_WAVEFORMS
+} modulation_waveform_t;
+
+typedef enum {
+    MODULATION_ADSR_IDLE,
+    MODULATION_ADSR_ATTACK,
+    MODULATION_ADSR_DECAY,
+    MODULATION_ADSR_SUSTAIN,
+    MODULATION_ADSR_RELEASE
+} modulation_adsr_stage_t;
+
+typedef struct {
+    modulation_generator_type_t type;
+    union {
+        struct {
+            uint16_t attack_ms, decay_ms, release_ms;
+            uint16_t sustain; // 0 .. MODULATION_SAMPLE_MAX
+        } adsr;
+        struct {
+            modulation_waveform_t waveform;
+            uint16_t period_ticks; // sequencer ticks per cycle, e.g. SEQ_PPQN for a quarter note
+        } lfo;
+    };
+} modulation_generator_config_t;
+
+// an envelope or lfo, rendered a block ahead of the samples going out
+typedef struct {
+    modulation_generator_config_t config;
+
+    // adsr, levels in MODULATION_LEVEL_MAX
+    modulation_adsr_stage_t stage;
+    uint32_t level;
+    uint32_t attack_step, decay_step, release_step, sustain_level;
+
+    // lfo, a full cycle is 2^32
+    uint32_t phase, phase_step;
+
+    uint16_t block[MODULATION_BLOCK_SIZE];
+} modulation_generator_t;
+
+
+// builds the waveform tables, once before rendering any lfo
+void modulation_tables_init();
+
+void modulation_generator_init(modulation_generator_t *generator, const modulation_generator_config_t *config,
+    uint32_t rate_hz, uint16_t bpm);
+void modulation_generator_set_tempo(modulation_generator_t *generator, uint32_t rate_hz, uint16_t bpm);
+
+// aligns the lfo phase to the sequencer playhead
+void modulation_generator_sync(modulation_generator_t *generator, uint32_t playhead);
+
+// starts the attack or release after the first `position` samples of the current block,
+// the ones that went out already. MODULATION_BLOCK_SIZE applies it to the next block
+void modulation_generator_gate(modulation_generator_t *generator, bool on, uint8_t position);
+
+// renders the block from `position` to its end
+void modulation_generator_render(modulation_generator_t *generator, uint8_t position);
@@ -0,0 +1,197 @@
+#include "modulation.h"
+
+#include <esp_check.h>
+#include <freertos/task.h>
+
+
+static const char *TAG = "modulation";
+
+
+static void modulation_timer_callback(void *arg) {
+    modulation_tick(arg);
+}
+
+esp_err_t modulation_init(modulation_t *modulation, const modulation_config_t *config) {
+    ESP_RETURN_ON_FALSE(config->output != NULL, ESP_ERR_INVALID_ARG, TAG, "no output");
+    ESP_RETURN_ON_FALSE(config->rate_hz > 0 && config->rate_hz <= 1000000, ESP_ERR_INVALID_ARG, TAG,
+        "invalid control rate %d", config->rate_hz);
+
+    modulation->config = *config;
+    modulation->active_slots = 0;
+    modulation->open_tracks = 0;
+    modulation->block_position = MODULATION_BLOCK_SIZE;
+    modulation->lock = (portMUX_TYPE) portMUX_INITIALIZER_UNLOCKED;
+
+    modulation_tables_init();
+
+    // render and write at the control rate
+    const esp_timer_create_args_t timer_config = {
+        .name = "modulation",
+        .callback = modulation_timer_callback,
+        .arg = modulation,
+        .skip_unhandled_events = true
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&timer_config, &modulation->timer), TAG,
+        "failed to create timer");
+    ESP_RETURN_ON_ERROR(esp_timer_start_periodic(modulation->timer, 1000000 / config->rate_hz), TAG,
+        "failed to start timer");
+
+    return ESP_OK;
+}
+
+esp_err_t modulation_free(modulation_t *modulation) {
+    esp_timer_stop(modulation->timer);
+    esp_timer_delete(modulation->timer);
+
+    return ESP_OK;
+}
+
+esp_err_t modulation_add(modulation_t *modulation, const modulation_slot_config_t *config, uint8_t *id) {
+    ESP_RETURN_ON_FALSE(config->port != NULL && config->port->config.type == OUTPUT_ANALOG, ESP_ERR_INVALID_ARG, TAG,
+        "generators need an analog port");
+    ESP_RETURN_ON_FALSE(config->min_mv <= config->max_mv, ESP_ERR_INVALID_ARG, TAG,
+        "invalid range %d .. %d mV", config->min_mv, config->max_mv);
+    ESP_RETURN_ON_FALSE(config->generator.type == MODULATION_ADSR || config->generator.lfo.waveform < MODULATION_NUM_WAVEFORMS,
+        ESP_ERR_INVALID_ARG, TAG, "invalid waveform %d", config->generator.lfo.waveform);
+
+    // find a free slot
+    uint8_t i = 0;
+    while (i < MODULATION_MAX_GENERATORS && (modulation->active_slots & (1UL << i))) i++;
+    ESP_RETURN_ON_FALSE(i < MODULATION_MAX_GENERATORS, ESP_ERR_NO_MEM, TAG, "no free generator");
+
+    modulation_slot_t *slot = &modulation->slots[i];
+    slot->config = *config;
+    slot->last_sample = -1;
+    modulation_generator_init(&slot->generator, &config->generator, modulation->config.rate_hz, modulation->config.bpm);
+
+    // joins the other generators right away, its first block was rendered by the init
+    taskENTER_CRITICAL(&modulation->lock);
+    modulation->active_slots |= 1UL << i;
+    taskEXIT_CRITICAL(&modulation->lock);
+
+    *id = i;
+    return ESP_OK;
+}
+
+esp_err_t modulation_remove(modulation_t *modulation, uint8_t id) {
+    ESP_RETURN_ON_FALSE(id < MODULATION_MAX_GENERATORS, ESP_ERR_INVALID_ARG, TAG, "invalid generator %d", id);
+
+    taskENTER_CRITICAL(&modulation->lock);
+    modulation->active_slots &= ~(1UL << id);
+    taskEXIT_CRITICAL(&modulation->lock);
+
+    return ESP_OK;
+}
+
+esp_err_t modulation_gate(modulation_t *modulation, uint8_t id, bool on) {
+    ESP_RETURN_ON_FALSE(id < MODULATION_MAX_GENERATORS, ESP_ERR_INVALID_ARG, TAG, "invalid generator %d", id);
+
+    // re-renders the rest of the block, so the gate is heard with the next sample
+    taskENTER_CRITICAL(&modulation->lock);
+    modulation_generator_gate(&modulation->slots[id].generator, on, modulation->block_position);
+    taskEXIT_CRITICAL(&modulation->lock);
+
+    return ESP_OK;
+}
+
+esp_err_t modulation_set_bpm(modulation_t *modulation, uint16_t bpm) {
+    taskENTER_CRITICAL(&modulation->lock);
+    modulation->config.bpm = bpm;
+    for (uint32_t mask = modulation->active_slots; mask; mask &= mask - 1) {
+        modulation_slot_t *slot = &modulation->slots[__builtin_ctz(mask)];
+        modulation_generator_set_tempo(&slot->generator, modulation->config.rate_hz, bpm);
+    }
+    taskEXIT_CRITICAL(&modulation->lock);
+
+    return ESP_OK;
+}
+
+esp_err_t modulation_tick(modulation_t *modulation) {
+    uint16_t samples[MODULATION_MAX_GENERATORS];
+
+    taskENTER_CRITICAL(&modulation->lock);
+    uint32_t active = modulation->active_slots;
+
+    // one block of all generators in one pass, the cost grows linearly with the active generators
+    if (modulation->block_position == MODULATION_BLOCK_SIZE) {
+        for (uint32_t mask = active; mask; mask &= mask - 1) {
+            modulation_generator_render(&modulation->slots[__builtin_ctz(mask)].generator, 0);
+        }
+        modulation->block_position = 0;
+    }
+
+    for (uint32_t mask = active; mask; mask &= mask - 1) {
+        uint8_t i = __builtin_ctz(mask);
+        samples[i] = modulation->slots[i].generator.block[modulation->block_position];
+    }
+    modulation->block_position++;
+    taskEXIT_CRITICAL(&modulation->lock);
+
+    // all generators change their ports together, unchanged samples are not written again
+    output_transaction_t tx;
+    output_transaction_begin(modulation->config.output, &tx);
+    for (uint32_t mask = active; mask; mask &= mask - 1) {
+        uint8_t i = __builtin_ctz(mask);
+        modulation_slot_t *slot = &modulation->slots[i];
+        if (samples[i] == slot->last_sample) continue;
+        slot->last_sample = samples[i];
+
+        uint32_t range_mv = slot->config.max_mv - slot->config.min_mv;
+        uint32_t value_mv = slot->config.min_mv + range_mv * samples[i] / MODULATION_SAMPLE_MAX;
+        ESP_RETURN_ON_ERROR(output_transaction_port_set_voltage(&tx, slot->config.port, value_mv), TAG,
+            "failed to stage generator %d", i);
+    }
+
+    return output_transaction_commit(&tx);
+}
+
+esp_err_t modulation_sequencer_event(modulation_t *modulation, sequencer_event_t event, sequencer_t *sequencer, void *data) {
+    switch (event) {
+        case SEQUENCER_CLOCK:
+            // follow tempo changes of the sequencer
+            if (sequencer->config.bpm != modulation->config.bpm) {
+                ESP_RETURN_ON_ERROR(modulation_set_bpm(modulation, sequencer->config.bpm), TAG,
+                    "failed to follow tempo");
+            }
+            break;
+        case SEQUENCER_PLAY:
+        case SEQUENCER_SEEK:;
+            // lfos restart in phase with the playhead
+            uint32_t playhead = event == SEQUENCER_SEEK ? *(uint32_t *) data : sequencer->playhead;
+            taskENTER_CRITICAL(&modulation->lock);
+            for (uint32_t mask = modulation->active_slots; mask; mask &= mask - 1) {
+                modulation_generator_sync(&modulation->slots[__builtin_ctz(mask)].generator, playhead);
+            }
+            taskEXIT_CRITICAL(&modulation->lock);
+            break;
+        case SEQUENCER_TRACK_EVENT:;
+            // envelopes follow the gate of their track: a velocity opens it, velocity 0 closes it,
+            // and a new note while it is open retriggers them. Notes are only sent with a velocity
+            sequencer_track_event_t *track_event = (sequencer_track_event_t *) data;
+            uint8_t track_index = track_event->track - sequencer->tracks;
+            uint32_t track_bit = 1UL << track_index;
+            bool open;
+
+            if (track_event->event == TRACK_VELOCITY_CHANGE) {
+                open = *(uint8_t *) track_event->data > 0;
+                if (open == !!(modulation->open_tracks & track_bit)) break;
+                modulation->open_tracks ^= track_bit;
+            } else if (track_event->event == TRACK_NOTE_CHANGE && (modulation->open_tracks & track_bit)) {
+                open = true;
+            } else {
+                break;
+            }
+
+            for (uint32_t mask = modulation->active_slots; mask; mask &= mask - 1) {
+                uint8_t i = __builtin_ctz(mask);
+                if (modulation->slots[i].config.gate_track != track_index) continue;
+                ESP_RETURN_ON_ERROR(modulation_gate(modulation, i, open), TAG,
+                    "failed to gate generator %d", i);
+            }
+            break;
+        default:
+            break;
+    }
+
+    return ESP_OK;
+}
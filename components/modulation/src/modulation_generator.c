@@ -0,0 +1,159 @@
+#include "modulation_generator.h"
+#include "sequencer_config.h"
+
+
+// first quarter of a sine cycle, 32767 * sin(i * pi / 128)
+static const int16_t quarter_sine[MODULATION_TABLE_SIZE / 4 + 1] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602,
+    6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+    23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+    27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+    32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+    32767
+};
+
+// one more entry than the table size, so interpolation never wraps
+static uint16_t tables[MODULATION_NUM_WAVEFORMS][MODULATION_TABLE_SIZE + 1];
+
+
+void modulation_tables_init() {
+    const uint32_t half = MODULATION_TABLE_SIZE / 2, quarter = MODULATION_TABLE_SIZE / 4;
+
+    for (uint32_t i = 0; i <= MODULATION_TABLE_SIZE; i++) {
+        uint32_t j = i % MODULATION_TABLE_SIZE;
+
+        // mirror the quarter wave, then shift it above zero
+        int32_t sine = j <= quarter ? quarter_sine[j] :
+            j <= half ? quarter_sine[half - j] :
+            j <= half + quarter ? -quarter_sine[j - half] : -quarter_sine[MODULATION_TABLE_SIZE - j];
+        tables[MODULATION_WAVEFORM_SINE][i] = 32768 + sine;
+
+        uint32_t triangle = j < half ? j * MODULATION_SAMPLE_MAX / half : (MODULATION_TABLE_SIZE - j) * MODULATION_SAMPLE_MAX / half;
+        tables[MODULATION_WAVEFORM_TRIANGLE][i] = triangle;
+        tables[MODULATION_WAVEFORM_SAW][i] = i < MODULATION_TABLE_SIZE ? i * MODULATION_SAMPLE_MAX / (MODULATION_TABLE_SIZE - 1) : 0;
+        tables[MODULATION_WAVEFORM_SQUARE][i] = j < half ? MODULATION_SAMPLE_MAX : 0;
+    }
+}
+
+static uint32_t modulation_segment_step(uint32_t distance, uint16_t time_ms, uint32_t rate_hz) {
+    // level change per sample to cover the distance in the given time, at least one sample
+    uint32_t samples = (uint32_t) time_ms * rate_hz / 1000;
+    return samples > 0 ? distance / samples : distance;
+}
+
+void modulation_generator_init(modulation_generator_t *generator, const modulation_generator_config_t *config,
+        uint32_t rate_hz, uint16_t bpm) {
+    generator->config = *config;
+    generator->stage = MODULATION_ADSR_IDLE;
+    generator->level = 0;
+    generator->phase = 0;
+
+    modulation_generator_set_tempo(generator, rate_hz, bpm);
+    modulation_generator_render(generator, 0);
+}
+
+void modulation_generator_set_tempo(modulation_generator_t *generator, uint32_t rate_hz, uint16_t bpm) {
+    if (generator->config.type == MODULATION_ADSR) {
+        // decay and release times are given for the full range, like most analog envelopes
+        generator->sustain_level = (uint32_t) generator->config.adsr.sustain << MODULATION_LEVEL_FRAC_BITS;
+        generator->attack_step = modulation_segment_step(MODULATION_LEVEL_MAX, generator->config.adsr.attack_ms, rate_hz);
+        generator->decay_step = modulation_segment_step(MODULATION_LEVEL_MAX, generator->config.adsr.decay_ms, rate_hz);
+        generator->release_step = modulation_segment_step(MODULATION_LEVEL_MAX, generator->config.adsr.release_ms, rate_hz);
+    } else {
+        // cycles per sample: bpm / 60 * SEQ_PPQN / period_ticks / rate_hz
+        uint64_t denominator = 60ULL * generator->config.lfo.period_ticks * rate_hz;
+        generator->phase_step = denominator ? ((uint64_t) bpm * SEQ_PPQN << 32) / denominator : 0;
+    }
+}
+
+void modulation_generator_sync(modulation_generator_t *generator, uint32_t playhead) {
+    uint16_t period = generator->config.lfo.period_ticks;
+    if (generator->config.type != MODULATION_LFO || period == 0) return;
+
+    generator->phase = ((uint64_t) (playhead % period) << 32) / period;
+}
+
+void modulation_generator_gate(modulation_generator_t *generator, bool on, uint8_t position) {
+    if (generator->config.type != MODULATION_ADSR) return;
+
+    // continue from the level that is going out, so retriggers do not click
+    if (position > 0 && position < MODULATION_BLOCK_SIZE) {
+        generator->level = (uint32_t) generator->block[position - 1] << MODULATION_LEVEL_FRAC_BITS;
+    }
+
+    if (on) {
+        generator->stage = MODULATION_ADSR_ATTACK;
+    } else if (generator->stage != MODULATION_ADSR_IDLE) {
+        generator->stage = MODULATION_ADSR_RELEASE;
+    }
+
+    if (position < MODULATION_BLOCK_SIZE) modulation_generator_render(generator, position);
+}
+
+static void modulation_adsr_render(modulation_generator_t *generator, uint8_t position) {
+    uint32_t level = generator->level;
+    modulation_adsr_stage_t stage = generator->stage;
+
+    for (uint8_t i = position; i < MODULATION_BLOCK_SIZE; i++) {
+        switch (stage) {
+            case MODULATION_ADSR_ATTACK:
+                level += generator->attack_step;
+                if (level >= MODULATION_LEVEL_MAX) {
+                    level = MODULATION_LEVEL_MAX;
+                    stage = MODULATION_ADSR_DECAY;
+                }
+                break;
+            case MODULATION_ADSR_DECAY:
+                if (level > generator->sustain_level + generator->decay_step) {
+                    level -= generator->decay_step;
+                } else {
+                    level = generator->sustain_level;
+                    stage = MODULATION_ADSR_SUSTAIN;
+                }
+                break;
+            case MODULATION_ADSR_RELEASE:
+                if (level > generator->release_step) {
+                    level -= generator->release_step;
+                } else {
+                    level = 0;
+                    stage = MODULATION_ADSR_IDLE;
+                }
+                break;
+            default:
+                break;
+        }
+
+        generator->block[i] = level >> MODULATION_LEVEL_FRAC_BITS;
+    }
+
+    generator->level = level;
+    generator->stage = stage;
+}
+
+static void modulation_lfo_render(modulation_generator_t *generator, uint8_t position) {
+    const uint16_t *table = tables[generator->config.lfo.waveform];
+    uint32_t phase = generator->phase;
+
+    for (uint8_t i = position; i < MODULATION_BLOCK_SIZE; i++) {
+        // table index from the top bits, the next 8 bits interpolate to the following entry
+        uint32_t index = phase >> (32 - MODULATION_TABLE_BITS);
+        int32_t fraction = (phase >> (32 - MODULATION_TABLE_BITS - 8)) & 0xFF;
+        int32_t a = table[index], b = table[index + 1];
+
+        generator->block[i] = a + (((b - a) * fraction) >> 8);
+        phase += generator->phase_step;
+    }
+
+    generator->phase = phase;
+}
+
+void modulation_generator_render(modulation_generator_t *generator, uint8_t position) {
+    if (generator->config.type == MODULATION_ADSR) {
+        modulation_adsr_render(generator, position);
+    } else {
+        modulation_lfo_render(generator, position);
+    }
+}
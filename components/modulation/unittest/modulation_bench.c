@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <time.h>
+#include "modulation_generator.h"
+#include "sequencer_config.h"
+
+
+#define BENCH_RATE_HZ 1000
+#define BENCH_BLOCKS 200000
+#define BENCH_MAX_GENERATORS 16
+
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_run(const char *name, uint8_t num_generators, bool adsr, bool lfo) {
+    static modulation_generator_t generators[BENCH_MAX_GENERATORS];
+    const modulation_generator_config_t adsr_config = {
+        .type = MODULATION_ADSR,
+        .adsr = { .attack_ms = 10, .decay_ms = 200, .release_ms = 300, .sustain = MODULATION_SAMPLE_MAX / 2 }
+    };
+
+    // mixed generators alternate, envelopes are gated every 16th note
+    for (uint8_t i = 0; i < num_generators; i++) {
+        bool is_adsr = adsr && (!lfo || i % 2 == 0);
+        const modulation_generator_config_t lfo_config = {
+            .type = MODULATION_LFO,
+            .lfo = { .waveform = i % MODULATION_NUM_WAVEFORMS, .period_ticks = SEQ_PPQN * (i + 1) }
+        };
+        modulation_generator_init(&generators[i], is_adsr ? &adsr_config : &lfo_config, BENCH_RATE_HZ, 120);
+    }
+
+    uint32_t checksum = 0;
+    uint64_t start = bench_now_ns();
+    for (uint32_t block = 0; block < BENCH_BLOCKS; block++) {
+        if (block % 8 == 0) {
+            for (uint8_t i = 0; i < num_generators; i++) modulation_generator_gate(&generators[i], block % 16 == 0, MODULATION_BLOCK_SIZE);
+        }
+        for (uint8_t i = 0; i < num_generators; i++) {
+            modulation_generator_render(&generators[i], 0);
+            checksum += generators[i].block[block % MODULATION_BLOCK_SIZE];
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    uint64_t samples = (uint64_t) BENCH_BLOCKS * MODULATION_BLOCK_SIZE * num_generators;
+    printf("  %-6s %2u generators: %5.2f ns/sample, %6.1f M samples/s, %6.1f ns per %d sample block of all (%08x)\n",
+        name, num_generators, (double) elapsed / samples, samples * 1000.0 / elapsed,
+        (double) elapsed / BENCH_BLOCKS, MODULATION_BLOCK_SIZE, (unsigned) checksum);
+}
+
+int main() {
+    modulation_tables_init();
+
+    printf("modulation, %d blocks of %d samples\n", BENCH_BLOCKS, MODULATION_BLOCK_SIZE);
+    for (uint8_t n = 1; n <= BENCH_MAX_GENERATORS; n *= 2) bench_run("adsr", n, true, false);
+    for (uint8_t n = 1; n <= BENCH_MAX_GENERATORS; n *= 2) bench_run("lfo", n, false, true);
+    for (uint8_t n = 1; n <= BENCH_MAX_GENERATORS; n *= 2) bench_run("mixed", n, true, true);
+
+    return 0;
+}
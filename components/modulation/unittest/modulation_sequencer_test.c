@@ -0,0 +1,156 @@
+#include "bdd-for-c.h"
+#include "modulation.h"
+#include "output_sim.h"
+#include "sequencer_config.h"
+
+
+#define PIN_ENVELOPE 2
+#define PIN_FREE 3
+
+#define TICKS_PER_STEP SEQ_TICKS_PER_SIXTEENTH_NOTE
+#define SAMPLES_PER_TICK 10 // 1 kHz control rate, 120 bpm
+
+
+static const output_port_config_t port_configs[] = {
+    { .type = OUTPUT_ANALOG, .pin = PIN_ENVELOPE, .vmax_mv = 5000 },
+    { .type = OUTPUT_ANALOG, .pin = PIN_FREE, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 4, .vmax_mv = 5000 }
+};
+
+static const modulation_generator_config_t adsr_config = {
+    .type = MODULATION_ADSR,
+    .adsr = { .attack_ms = 50, .decay_ms = 50, .release_ms = 50, .sustain = MODULATION_SAMPLE_MAX / 2 }
+};
+
+static output_t output;
+static sequencer_t sequencer;
+static modulation_t modulation;
+
+
+// the timers are not started on the host, the tests tick the sequencer and the generators
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    return ESP_OK;
+}
+
+// wired like main does it
+static esp_err_t sequencer_event(void *context, sequencer_event_t event, sequencer_t *sequencer, void *data) {
+    return modulation_sequencer_event(&modulation, event, sequencer, data);
+}
+
+static void set_step(uint8_t track, uint16_t step, uint8_t note, uint8_t velocity, uint8_t gate) {
+    pattern_t *pattern = sequencer_get_active_pattern(&sequencer, track);
+    pattern->steps[step] = (pattern_step_t) {
+        .atomic = { .note = note, .velocity = velocity },
+        .gate = gate,
+        .probability = 127
+    };
+}
+
+// sequencer ticks, each followed by the control rate samples until the next one
+static void play_ticks(int num_ticks) {
+    for (int i = 0; i < num_ticks; i++) {
+        sequencer_tick_external(&sequencer);
+        for (int j = 0; j < SAMPLES_PER_TICK; j++) modulation_tick(&modulation);
+    }
+}
+
+static uint32_t port_mv(uint8_t row) {
+    return output_port_get(&output, 0, row)->value_mv;
+}
+
+
+spec("modulation") {
+    static uint8_t envelope;
+
+    before_each() {
+        output_sim_reset();
+        output_init(&output, &(output_config_t) {
+            .num_columns = 1, .num_rows = 3, .port_configs = port_configs, .backend = &output_sim_backend
+        });
+
+        sequencer_init(&sequencer, &(sequencer_config_t) { .callbacks = { .event = sequencer_event }, .bpm = 120 });
+        sequencer_set_clock_source(&sequencer, SEQUENCER_CLOCK_EXTERNAL);
+
+        modulation_init(&modulation, &MODULATION_DEFAULT_CONFIG(&output));
+        modulation_add(&modulation, &(modulation_slot_config_t) {
+            .generator = adsr_config,
+            .port = output_port_get(&output, 0, 0),
+            .min_mv = 0, .max_mv = 5000,
+            .gate_track = 0
+        }, &envelope);
+        sequencer_play(&sequencer);
+    }
+
+    after_each() {
+        modulation_free(&modulation);
+    }
+
+    it("should open envelopes with a step and close them on the rest after it") {
+        set_step(0, 0, 60, 100, 127);
+
+        // a tenth of the attack per tick, then the sustain level
+        play_ticks(1);
+        check(port_mv(0) >= 900 && port_mv(0) <= 1100, "%u mV", (unsigned) port_mv(0));
+        play_ticks(TICKS_PER_STEP - 1);
+        check(port_mv(0) >= 2450 && port_mv(0) <= 2550, "%u mV", (unsigned) port_mv(0));
+
+        // the second step is a rest, velocity 0 closes the gate
+        play_ticks(1);
+        check(port_mv(0) >= 1400 && port_mv(0) <= 1600, "%u mV", (unsigned) port_mv(0));
+        play_ticks(TICKS_PER_STEP - 1);
+        expect(port_mv(0)) to_be(0);
+    }
+
+    it("should close envelopes at the end of the step gate") {
+        set_step(0, 0, 60, 100, 64);
+
+        play_ticks(TICKS_PER_STEP / 2);
+        check(port_mv(0) > 2500, "%u mV", (unsigned) port_mv(0));
+        play_ticks(TICKS_PER_STEP / 2);
+        expect(port_mv(0)) to_be(0);
+    }
+
+    it("should retrigger on a new note, but not on a new velocity") {
+        set_step(0, 0, 60, 100, 127);
+        set_step(0, 1, 62, 100, 127);
+        set_step(0, 2, 62, 64, 127);
+
+        play_ticks(TICKS_PER_STEP);
+        uint32_t sustain_mv = port_mv(0);
+        play_ticks(1);
+        check(port_mv(0) > sustain_mv + 900, "%u mV", (unsigned) port_mv(0));
+
+        play_ticks(TICKS_PER_STEP);
+        expect(port_mv(0)) to_be(sustain_mv);
+        play_ticks(TICKS_PER_STEP - 1);
+        expect(port_mv(0)) to_be(sustain_mv);
+    }
+
+    it("should only follow the steps of its track") {
+        uint8_t free_envelope;
+        expect(modulation_add(&modulation, &(modulation_slot_config_t) {
+            .generator = adsr_config,
+            .port = output_port_get(&output, 0, 1),
+            .min_mv = 0, .max_mv = 5000,
+            .gate_track = MODULATION_TRACK_NONE
+        }, &free_envelope)) to_be(ESP_OK);
+        set_step(1, 0, 60, 100, 127);
+
+        play_ticks(TICKS_PER_STEP);
+        expect(port_mv(0)) to_be(0);
+        expect(port_mv(1)) to_be(0);
+    }
+
+    it("should reject generators on digital ports") {
+        uint8_t id;
+        expect(modulation_add(&modulation, &(modulation_slot_config_t) {
+            .generator = adsr_config,
+            .port = output_port_get(&output, 0, 2),
+            .max_mv = 5000
+        }, &id)) to_be(ESP_ERR_INVALID_ARG);
+    }
+}
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include "bdd-for-c.h"
+#include "modulation_generator.h"
+#include "sequencer_config.h"
+
+
+#define RATE_HZ 1000
+#define BPM 120
+
+
+// renders whole blocks and collects the samples, like the control rate timer
+static size_t render(modulation_generator_t *generator, uint16_t *samples, size_t num_samples) {
+    size_t n = 0;
+    while (n < num_samples) {
+        modulation_generator_render(generator, 0);
+        for (uint8_t i = 0; i < MODULATION_BLOCK_SIZE && n < num_samples; i++) samples[n++] = generator->block[i];
+    }
+    return n;
+}
+
+static size_t first_sample_at(const uint16_t *samples, size_t from, size_t num_samples, uint16_t value) {
+    for (size_t i = from; i < num_samples; i++) {
+        if (samples[i] == value) return i;
+    }
+    return num_samples;
+}
+
+
+spec("modulation generator") {
+    static modulation_generator_t generator;
+    static uint16_t samples[4000];
+
+    before() {
+        modulation_tables_init();
+    }
+
+    describe("adsr") {
+        const modulation_generator_config_t adsr_config = {
+            .type = MODULATION_ADSR,
+            .adsr = { .attack_ms = 100, .decay_ms = 400, .release_ms = 800, .sustain = MODULATION_SAMPLE_MAX / 2 }
+        };
+
+        it("should stay closed until the gate opens") {
+            modulation_generator_init(&generator, &adsr_config, RATE_HZ, BPM);
+            render(&generator, samples, 100);
+            for (int i = 0; i < 100; i++) check(samples[i] == 0, "sample %d", i);
+        }
+
+        it("should run attack, decay and sustain in their times") {
+            modulation_generator_init(&generator, &adsr_config, RATE_HZ, BPM);
+            modulation_generator_gate(&generator, true, MODULATION_BLOCK_SIZE);
+            render(&generator, samples, 1000);
+
+            // the peak after the attack time, the decay covers half the range in half its time
+            size_t peak = first_sample_at(samples, 0, 1000, MODULATION_SAMPLE_MAX);
+            check(peak >= 98 && peak <= 100, "peak at %zu", peak);
+            size_t sustain = first_sample_at(samples, peak, 1000, MODULATION_SAMPLE_MAX / 2);
+            check(sustain - peak >= 198 && sustain - peak <= 201, "sustain after %zu", sustain - peak);
+
+            for (size_t i = 1; i <= peak; i++) check(samples[i] > samples[i - 1], "attack sample %zu", i);
+            for (size_t i = peak + 1; i <= sustain; i++) check(samples[i] < samples[i - 1], "decay sample %zu", i);
+            for (size_t i = sustain; i < 1000; i++) check(samples[i] == MODULATION_SAMPLE_MAX / 2, "sustain sample %zu", i);
+        }
+
+        it("should release to zero and close") {
+            modulation_generator_init(&generator, &adsr_config, RATE_HZ, BPM);
+            modulation_generator_gate(&generator, true, MODULATION_BLOCK_SIZE);
+            render(&generator, samples, 1000);
+            modulation_generator_gate(&generator, false, MODULATION_BLOCK_SIZE);
+            render(&generator, samples, 1000);
+
+            // half the range in half the release time
+            size_t closed = first_sample_at(samples, 0, 1000, 0);
+            check(closed >= 398 && closed <= 401, "closed after %zu", closed);
+            expect(generator.stage) to_be(MODULATION_ADSR_IDLE);
+        }
+
+        it("should act on the next sample within a block") {
+            modulation_generator_init(&generator, &adsr_config, RATE_HZ, BPM);
+            modulation_generator_gate(&generator, true, MODULATION_BLOCK_SIZE);
+            render(&generator, samples, 1000);
+
+            // five samples of the block went out already
+            modulation_generator_render(&generator, 0);
+            uint16_t block[MODULATION_BLOCK_SIZE];
+            memcpy(block, generator.block, sizeof(block));
+            modulation_generator_gate(&generator, false, 5);
+
+            for (int i = 0; i < 5; i++) expect(generator.block[i]) to_be(block[i]);
+            for (int i = 5; i < MODULATION_BLOCK_SIZE; i++) check(generator.block[i] < generator.block[i - 1], "sample %d", i);
+        }
+
+        it("should retrigger from the current level without a jump") {
+            modulation_generator_init(&generator, &adsr_config, RATE_HZ, BPM);
+            modulation_generator_gate(&generator, true, MODULATION_BLOCK_SIZE);
+            render(&generator, samples, 1000);
+            modulation_generator_gate(&generator, false, MODULATION_BLOCK_SIZE);
+            render(&generator, samples, 96);
+
+            uint16_t level = samples[95];
+            modulation_generator_gate(&generator, true, MODULATION_BLOCK_SIZE);
+            render(&generator, samples, 1);
+            check(samples[0] > level && samples[0] - level <= MODULATION_SAMPLE_MAX / 100 + 1);
+        }
+    }
+
+    describe("lfo") {
+        it("should follow the tempo") {
+            // a quarter note at 120 bpm is 500 ms
+            const modulation_generator_config_t lfo_config = {
+                .type = MODULATION_LFO,
+                .lfo = { .waveform = MODULATION_WAVEFORM_SAW, .period_ticks = SEQ_TICKS_PER_QUARTER_NOTE }
+            };
+            modulation_generator_init(&generator, &lfo_config, RATE_HZ, BPM);
+            modulation_generator_sync(&generator, 0);
+            render(&generator, samples, 2000);
+
+            // the saw wraps once per cycle, the interpolated drop starts within the last table entry
+            int wraps = 0;
+            for (int i = 2; i < 1900; i++) {
+                if (samples[i] < samples[i - 1] && samples[i - 1] >= samples[i - 2]) {
+                    check((i + 1) % 500 <= 2, "wrap at %d", i);
+                    wraps++;
+                }
+            }
+            expect(wraps) to_be(3);
+
+            // twice the tempo, twice the cycles
+            modulation_generator_set_tempo(&generator, RATE_HZ, 2 * BPM);
+            modulation_generator_sync(&generator, 0);
+            render(&generator, samples, 2000);
+            wraps = 0;
+            for (int i = 2; i < 1900; i++) wraps += samples[i] < samples[i - 1] && samples[i - 1] >= samples[i - 2];
+            expect(wraps) to_be(7);
+        }
+
+        it("should render the waveform tables") {
+            const struct {
+                modulation_waveform_t waveform;
+                uint16_t expected[4]; // at 0, 1/4, 1/2 and 3/4 of the cycle
+            } cases[] = {
+                { MODULATION_WAVEFORM_SINE, { 32768, 65535, 32768, 1 } },
+                { MODULATION_WAVEFORM_TRIANGLE, { 0, 32767, 65535, 32767 } },
+                { MODULATION_WAVEFORM_SAW, { 0, 16448, 32896, 49344 } },
+                { MODULATION_WAVEFORM_SQUARE, { 65535, 65535, 0, 0 } }
+            };
+
+            for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+                const modulation_generator_config_t lfo_config = {
+                    .type = MODULATION_LFO,
+                    .lfo = { .waveform = cases[c].waveform, .period_ticks = SEQ_PPQN }
+                };
+                modulation_generator_init(&generator, &lfo_config, RATE_HZ, BPM);
+
+                for (int q = 0; q < 4; q++) {
+                    modulation_generator_sync(&generator, q * SEQ_PPQN / 4);
+                    modulation_generator_render(&generator, 0);
+                    check(abs(generator.block[0] - cases[c].expected[q]) <= 1,
+                        "waveform %d at %d/4: %d", cases[c].waveform, q, generator.block[0]);
+                }
+            }
+        }
+
+        it("should interpolate between table entries") {
+            const modulation_generator_config_t lfo_config = {
+                .type = MODULATION_LFO,
+                .lfo = { .waveform = MODULATION_WAVEFORM_SINE, .period_ticks = SEQ_TICKS_PER_BAR * 4 }
+            };
+            modulation_generator_init(&generator, &lfo_config, RATE_HZ, BPM);
+            render(&generator, samples, 4000);
+
+            // a slow sine moves by small steps, the table alone would stay put for 31 samples
+            for (int i = 1; i < 4000; i++) check(abs(samples[i] - samples[i - 1]) <= 60, "sample %d", i);
+            int unchanged = 0;
+            for (int i = 1; i < 4000; i++) unchanged += samples[i] == samples[i - 1];
+            check(unchanged < 400, "%d unchanged samples", unchanged);
+        }
+    }
+}
@@ -2,18 +2,43 @@
 
 #include <esp_err.h>
 #include <driver/ledc.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "output_pulse.h"
+#include "callback.h"
 
 
 #define OUTPUT_PWM_DUTY_RESOLUTION LEDC_TIMER_10_BIT // -> PWM freq = 20kHz
 #define OUTPUT_PWM_DUTY_MAX ((1U << OUTPUT_PWM_DUTY_RESOLUTION) - 1)
 #define OUTPUT_PWM_FREQUENCY (5000 * (1U << (12 - OUTPUT_PWM_DUTY_RESOLUTION)))
+#define OUTPUT_PWM_PERIOD_US (1000000 / OUTPUT_PWM_FREQUENCY)
 
 #define OUTPUT_MAX_ANALOG_PORTS LEDC_CHANNEL_MAX
 #define OUTPUT_MAX_PORTS GPIO_NUM_MAX
 
+#define OUTPUT_TRANSACTION_MAX_PORTS 16
+
+// note to duty tables hold fractions of a duty step, 1/64 step is below 0.1 cent
+#define OUTPUT_DUTY_FRAC_BITS 6
+#define OUTPUT_NUM_NOTES 128
+#define OUTPUT_CALIBRATION_MAX_POINTS 9
+#define OUTPUT_CALIBRATION_NVS_NAMESPACE "output_cal"
+
+// glide ramps run with extra fractional bits, so slow glides still move every update
+#define OUTPUT_RAMP_FRAC_BITS 8
+#define OUTPUT_GLIDE_COEFFICIENT_ONE (1 << 16)
+
 #define OUTPUT_NOTE_TO_VOLTAGE(note) ((note) * 1000 / 12)
 #define OUTPUT_VELOCITY_TO_VOLTAGE(velocity) ((velocity) * 5000 / 127)
 
+// rows of a note column, a grid with fewer rows leaves out the last ones
+#define OUTPUT_ROW_PITCH 0
+#define OUTPUT_ROW_VELOCITY 1
+#define OUTPUT_ROW_GATE 2
+#define OUTPUT_ROW_TRIGGER 3
+#define OUTPUT_TRIGGER_US 5000
+
 //#define OUTPUT_ANALOG_MILLIVOLTS 4840 // 5.5V = 3.3V * 1.67 gain
 
 
@@ -22,24 +47,86 @@ typedef enum {
     OUTPUT_ANALOG
 } output_type_t;
 
+typedef enum {
+    OUTPUT_GLIDE_LINEAR,
+    OUTPUT_GLIDE_EXPONENTIAL // covers 98% of the distance in the glide time, then settles
+} output_glide_curve_t;
+
 typedef struct {
     output_type_t type;
     gpio_num_t pin;
     uint32_t vmax_mv;
+    bool dither; // sigma-delta modulate the fractional duty, for pitch ports
 } output_port_config_t;
 
+// measured output voltage at a few duty cycles, both ascending. Voltages in
+// between are interpolated linearly, which corrects gain, offset and bow
+typedef struct {
+    uint8_t num_points;
+    struct {
+        uint16_t duty;
+        uint32_t uv;
+    } points[OUTPUT_CALIBRATION_MAX_POINTS];
+} output_calibration_t;
+
 typedef struct {
     output_port_config_t config;
     uint8_t index, row, column;
 
     ledc_channel_t analog_channel;
     uint32_t value_mv;
+
+    output_calibration_t calibration;
+    uint16_t note_duties[OUTPUT_NUM_NOTES]; // 1V/octave, in 1 / 2^OUTPUT_DUTY_FRAC_BITS duty steps
+
+    uint32_t duty; // fractional, as last committed
+    uint32_t dither_error; // sigma-delta accumulator
+    uint32_t hardware_duty; // as last written to the ledc channel
+
+    uint32_t glide_time_us;
+    output_glide_curve_t glide_curve;
+    uint32_t glide_coefficient; // exponential, part of the distance per update in 1 / OUTPUT_GLIDE_COEFFICIENT_ONE
+    int32_t ramp_value, ramp_target, ramp_increment; // fractional duty << OUTPUT_RAMP_FRAC_BITS
+    uint32_t ramp_steps;
 } output_port_t;
 
+// the hardware behind the ports. Duties of several ports are set first and then
+// latched back to back, digital levels change together with one write. Latched duties
+// take effect at the end of the pwm period, wait_latch returns once they did.
+// write_levels is called from the pulse timer interrupt as well, it must not block
+CALLBACK_DECLARE(output_backend_init, esp_err_t);
+CALLBACK_DECLARE(output_backend_setup_port, esp_err_t,
+    output_port_t *port);
+CALLBACK_DECLARE(output_backend_teardown_port, esp_err_t,
+    output_port_t *port);
+CALLBACK_DECLARE(output_backend_set_duty, esp_err_t,
+    output_port_t *port, uint32_t duty);
+CALLBACK_DECLARE(output_backend_update_duty, esp_err_t,
+    output_port_t *port);
+CALLBACK_DECLARE(output_backend_wait_latch, esp_err_t);
+CALLBACK_DECLARE(output_backend_write_levels, esp_err_t,
+    uint64_t set_mask, uint64_t clear_mask);
+
+typedef struct {
+    void *context;
+    CALLBACK_TYPE(output_backend_init) init;
+    CALLBACK_TYPE(output_backend_setup_port) setup_port;
+    CALLBACK_TYPE(output_backend_teardown_port) teardown_port;
+    CALLBACK_TYPE(output_backend_set_duty) set_duty;
+    CALLBACK_TYPE(output_backend_update_duty) update_duty;
+    CALLBACK_TYPE(output_backend_wait_latch) wait_latch;
+    CALLBACK_TYPE(output_backend_write_levels) write_levels;
+} output_backend_t;
+
+// ledc pwm channels and gpio pins of the target
+extern const output_backend_t output_backend_ledc;
+
 typedef struct {
     uint8_t num_columns;
     uint8_t num_rows;
-    const output_port_config_t *port_configs;
+    const output_port_config_t *port_configs; // row by row, num_columns ports each
+    uint32_t update_interval_us; // of glides and dithering, 0 disables glides
+    const output_backend_t *backend;
 } output_config_t;
 
 typedef struct {
@@ -49,8 +136,35 @@ typedef struct {
     output_port_t *ports;
 
     int8_t claimed_analog_channels[OUTPUT_MAX_ANALOG_PORTS];
+
+    // the duty state of the ports and the backend writes, shared by commits and output_update
+    SemaphoreHandle_t write_lock;
+
+    // ports visited by output_update, by port index. Idle ports are skipped
+    portMUX_TYPE lock;
+    uint64_t ramping_ports, dithering_ports;
+    esp_timer_handle_t update_timer;
+
+    // edges of digital ports, executed by a hardware timer at their esp_timer time
+    output_pulse_queue_t pulses;
+    int64_t pulse_time_offset_us; // esp_timer time at timer count 0
+    bool pulse_timer_ready;
 } output_t;
 
+// port values that are staged and then applied together, e.g. pitch and gate
+// of a note. Lives on the stack of the caller, so concurrent callers do not share it
+typedef struct {
+    output_t *output;
+
+    uint8_t num_ports;
+    struct {
+        output_port_t *port;
+        uint32_t value_mv;
+        uint32_t duty; // fractional, see OUTPUT_DUTY_FRAC_BITS
+        uint32_t pulse_us; // digital ports: high for this long from the commit on, 0 for a level
+    } staged[OUTPUT_TRANSACTION_MAX_PORTS];
+} output_transaction_t;
+
 
 esp_err_t output_init(output_t *output, const output_config_t *config);
 
@@ -58,5 +172,42 @@ output_port_t *output_port_get(output_t *output, uint8_t column, uint8_t row);
 esp_err_t output_port_set_type(output_t *output, output_port_t *port, output_type_t type);
 esp_err_t output_port_set_voltage(output_t *output, output_port_t *port, uint32_t value_mv);
 
+esp_err_t output_port_set_calibration(output_t *output, output_port_t *port, const output_calibration_t *calibration);
+uint32_t output_port_voltage_to_duty(output_port_t *port, uint32_t value_uv);
+
+esp_err_t output_port_set_dither(output_t *output, output_port_t *port, bool dither);
+uint32_t output_port_dither_step(output_port_t *port);
+esp_err_t output_port_set_glide(output_t *output, output_port_t *port, uint32_t time_us, output_glide_curve_t curve);
+esp_err_t output_update(output_t *output);
+
+// sets and clears digital pins of the target with one register write per gpio bank each
+void output_gpio_write(uint64_t set_mask, uint64_t clear_mask);
+
+esp_err_t output_pulse_init(output_t *output);
+esp_err_t output_port_schedule_edge(output_t *output, output_port_t *port, int64_t time_us, bool level);
+esp_err_t output_port_pulse(output_t *output, output_port_t *port, int64_t time_us, uint32_t length_us);
+esp_err_t output_pulse(output_t *output, uint8_t column, uint8_t row, int64_t time_us, uint32_t length_us);
+// drops the pending edges of the pins, used by commits that write their levels
+void output_pulse_cancel(output_t *output, uint64_t pin_mask);
+
+// calibrations are flashed with the nvs partition, one output_calibration_t blob per port
+// with the key "cal<port index>" in the OUTPUT_CALIBRATION_NVS_NAMESPACE namespace
+esp_err_t output_calibration_load(output_t *output);
+
 esp_err_t output_set_type(output_t *output, uint8_t column, uint8_t row, output_type_t type);
 esp_err_t output_set_voltage(output_t *output, uint8_t column, uint8_t row, uint32_t value_mv);
+esp_err_t output_set_glide(output_t *output, uint8_t column, uint8_t row, uint32_t time_us, output_glide_curve_t curve);
+
+esp_err_t output_transaction_begin(output_t *output, output_transaction_t *tx);
+esp_err_t output_transaction_port_set_voltage(output_transaction_t *tx, output_port_t *port, uint32_t value_mv);
+esp_err_t output_transaction_set_voltage(output_transaction_t *tx, uint8_t column, uint8_t row, uint32_t value_mv);
+esp_err_t output_transaction_port_set_note(output_transaction_t *tx, output_port_t *port, uint8_t note);
+esp_err_t output_transaction_set_note(output_transaction_t *tx, uint8_t column, uint8_t row, uint8_t note);
+// triggers: the digital port goes high with the commit and low again after length_us, at least
+// OUTPUT_PULSE_MIN_WIDTH_US. Needs output_pulse_init
+esp_err_t output_transaction_port_pulse(output_transaction_t *tx, output_port_t *port, uint32_t length_us);
+esp_err_t output_transaction_pulse(output_transaction_t *tx, uint8_t column, uint8_t row, uint32_t length_us);
+// a note on a column: pitch, velocity, gate and a trigger on note on. Velocity 0 releases
+// the note and keeps the pitch. The trigger needs a digital port and output_pulse_init
+esp_err_t output_transaction_set_column_note(output_transaction_t *tx, uint8_t column, uint8_t note, uint8_t velocity);
+esp_err_t output_transaction_commit(output_transaction_t *tx);
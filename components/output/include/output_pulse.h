@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define OUTPUT_PULSE_MAX_EDGES 32
+#define OUTPUT_PULSE_NONE INT64_MAX
+
+// the hardware timer is not armed closer than this to its current count
+#define OUTPUT_PULSE_MIN_LEAD_US 5
+// a pin does not change again within this after a write, even if its next edge is overdue
+#define OUTPUT_PULSE_MIN_WIDTH_US 20
+
+
+// a level change of one or more digital pins
+typedef struct {
+    int64_t time_us;
+    uint64_t pin_mask;
+    bool level;
+} output_pulse_edge_t;
+
+// pending edges, sorted latest first so the next edge is taken off the end.
+// Edges with the same time keep their order
+typedef struct {
+    output_pulse_edge_t edges[OUTPUT_PULSE_MAX_EDGES];
+    uint8_t num_edges;
+
+    // the last write taken off the queue
+    int64_t written_us;
+    uint64_t written_mask;
+} output_pulse_queue_t;
+
+
+void output_pulse_queue_init(output_pulse_queue_t *queue);
+
+// returns false if the queue is full
+bool output_pulse_queue_push(output_pulse_queue_t *queue, const output_pulse_edge_t *edge);
+
+// drops the pending edges of the pins, edges of other pins stay
+void output_pulse_queue_remove(output_pulse_queue_t *queue, uint64_t pin_mask);
+
+// time of the next edge, or OUTPUT_PULSE_NONE
+int64_t output_pulse_queue_next(const output_pulse_queue_t *queue);
+
+// time to fire the timer at for the next edge, or OUTPUT_PULSE_NONE. At least OUTPUT_PULSE_MIN_LEAD_US
+// after `now_us`, and OUTPUT_PULSE_MIN_WIDTH_US after the last write if the edge changes one of its pins
+int64_t output_pulse_queue_alarm(const output_pulse_queue_t *queue, int64_t now_us);
+
+// takes the edges due at `now_us` off the queue and merges them into one write of the
+// set and clear masks. Returns false if no edge is due. A pin changing twice stops the
+// batch, the second change goes into the next write so short pulses are not lost. The timer
+// takes one batch per interrupt, see output_pulse_queue_alarm
+bool output_pulse_queue_pop_due(output_pulse_queue_t *queue, int64_t now_us, uint64_t *set_mask, uint64_t *clear_mask);
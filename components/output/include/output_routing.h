@@ -0,0 +1,75 @@
+#pragma once
+
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "output.h"
+
+
+#define OUTPUT_ROUTING_MAX_TRACKS 8
+#define OUTPUT_ROUTING_MAX_ROUTES 16
+#define OUTPUT_ROUTING_NUM_DRUMS 16 // bits of a drum mask
+
+
+// the voices of a track that can drive a port
+typedef enum {
+    OUTPUT_VOICE_PITCH,
+    OUTPUT_VOICE_VELOCITY,
+    OUTPUT_VOICE_GATE, // high while the velocity is above zero
+    OUTPUT_VOICE_DRUM, // high while a bit of the drum mask is set
+    OUTPUT_NUM_VOICES
+} output_voice_t;
+
+typedef struct {
+    uint8_t track;
+    output_voice_t voice;
+    uint8_t drum; // bit of the drum mask, for drum voices
+    uint8_t column, row;
+    // gate and drum voices on digital ports: a trigger of this length at each rise and at each new
+    // note of an open gate, on the pulse timer. 0 follows the level
+    uint32_t pulse_us;
+} output_route_t;
+
+// routes compiled for dispatch: sorted by track and voice, the ports of a track voice
+// are routes[first[track][voice]] up to the first route of the next track voice
+typedef struct {
+    uint8_t num_routes;
+    struct {
+        output_port_t *port;
+        output_voice_t voice;
+        uint8_t drum;
+        uint32_t pulse_us;
+    } routes[OUTPUT_ROUTING_MAX_ROUTES];
+    uint8_t first[OUTPUT_ROUTING_MAX_TRACKS * OUTPUT_NUM_VOICES + 1];
+} output_routing_table_t;
+
+typedef struct {
+    output_t *output;
+
+    SemaphoreHandle_t lock; // routes change from other tasks than the track events
+    output_routing_table_t table;
+    output_routing_table_t pending; // set, but not applied yet
+    bool has_pending;
+
+    // last state of each track, newly routed ports start from it
+    uint8_t notes[OUTPUT_ROUTING_MAX_TRACKS];
+    uint8_t velocities[OUTPUT_ROUTING_MAX_TRACKS];
+    uint16_t drum_masks[OUTPUT_ROUTING_MAX_TRACKS];
+} output_routing_t;
+
+
+esp_err_t output_routing_init(output_routing_t *routing, output_t *output);
+
+// replaces all routes from any task. The new routes are validated right away and take
+// effect with the next output_routing_apply_pending
+esp_err_t output_routing_set_routes(output_routing_t *routing, const output_route_t *routes, uint8_t num_routes);
+
+// swaps in the routes set since the last call, from the task owning the transaction, e.g. at the
+// start of a sequencer tick. Ports that keep their route are not touched, all others are staged
+// with their new voice, or 0V if they are no longer routed
+esp_err_t output_routing_apply_pending(output_routing_t *routing, output_transaction_t *tx);
+
+// stage the ports of a track voice into a transaction of the caller
+esp_err_t output_routing_set_note(output_routing_t *routing, output_transaction_t *tx, uint8_t track, uint8_t note);
+esp_err_t output_routing_set_velocity(output_routing_t *routing, output_transaction_t *tx, uint8_t track, uint8_t velocity);
+esp_err_t output_routing_set_drum_mask(output_routing_t *routing, output_transaction_t *tx, uint8_t track, uint16_t drum_mask);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+#include "output.h"
+
+
+#define OUTPUT_TIMELINE_NO_PORT 0xFF
+
+
+// one port change, 8 bytes so long captures fit in memory
+typedef struct {
+    uint32_t time_us;
+    uint8_t port; // index
+    uint8_t reserved;
+    uint16_t value; // duty of analog ports, level of digital ports
+} output_timeline_record_t;
+
+// an output backend that records every port change instead of driving pins, e.g. to
+// measure sequencer to cv timing on the host. Use &timeline->backend as output backend
+typedef struct {
+    output_backend_t backend;
+    int64_t now_us; // time of the next port changes, advanced by the caller and by waits for a duty latch
+
+    output_timeline_record_t *records; // sorted by time
+    size_t max_records;
+    size_t num_records;
+    size_t num_dropped;
+
+    uint8_t pin_ports[64]; // port index of each pin, for digital writes
+    uint16_t channel_duties[OUTPUT_MAX_ANALOG_PORTS]; // set, but not latched yet
+    uint16_t port_values[OUTPUT_MAX_PORTS]; // as last recorded, rewrites of the same value are skipped
+} output_timeline_t;
+
+
+esp_err_t output_timeline_init(output_timeline_t *timeline, output_timeline_record_t *records, size_t max_records);
+void output_timeline_clear(output_timeline_t *timeline);
+
+// port voltage of a record, analog duties are mapped through the port calibration
+uint32_t output_timeline_record_voltage(const output_timeline_record_t *record, const output_t *output);
+
+esp_err_t output_timeline_export_csv(const output_timeline_t *timeline, const output_t *output, FILE *file);
+esp_err_t output_timeline_export_vcd(const output_timeline_t *timeline, const output_t *output, FILE *file);
@@ -1,8 +1,7 @@
 #include "output.h"
 
 #include <esp_check.h>
-#include <driver/gpio.h>
-#include <driver/ledc.h>
+#include <freertos/task.h>
 
 
 static const char *TAG = "output";
@@ -44,80 +43,40 @@ static esp_err_t output_port_analog_channel_release(output_t *output, output_por
     return ESP_OK;
 }
 
-static esp_err_t output_port_setup_digital(output_t *output, output_port_t *port) {
-    // setup gpio pin
-    port->analog_channel = -1;
-    gpio_config_t digital_config = {
-        .pin_bit_mask = 1ULL << port->config.pin,
-        .mode = GPIO_MODE_OUTPUT,
-        .pull_up_en = GPIO_PULLUP_DISABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE
-    };
-    ESP_RETURN_ON_ERROR(gpio_config(&digital_config), TAG,
-        "failed to configure digital port %d on pin %d", port->index, port->config.pin);
-    
-    return ESP_OK;
-}
-
-static esp_err_t output_port_setup_analog(output_t *output, output_port_t *port) {
-    // claim a free analog channel
-    ESP_RETURN_ON_ERROR(output_port_analog_channel_claim(output, port), TAG,
-        "failed to claim analog channel for port %d", port->index);
-
-    // setup ledc pwm channel
-    ledc_channel_config_t analog_config = {
-        .gpio_num = port->config.pin,
-        .speed_mode = LEDC_LOW_SPEED_MODE,
-        .channel = port->analog_channel,
-        .intr_type = LEDC_INTR_DISABLE,
-        .timer_sel = LEDC_TIMER_0,
-        .duty = 0,
-        .hpoint = 0
-    };
-    ESP_RETURN_ON_ERROR(ledc_channel_config(&analog_config), TAG,
-        "failed to configure analog port %d on pin %d, channel %d",
-        port->index, port->config.pin, port->analog_channel);
-    
-    return ESP_OK;
-}
-
 static esp_err_t output_port_setup(output_t *output, output_port_t *port) {
-    if (port->config.type == OUTPUT_DIGITAL) {
-        return output_port_setup_digital(output, port);
-    } else {
-        return output_port_setup_analog(output, port);
+    // analog ports claim a free pwm channel first
+    port->analog_channel = -1;
+    if (port->config.type == OUTPUT_ANALOG) {
+        ESP_RETURN_ON_ERROR(output_port_analog_channel_claim(output, port), TAG,
+            "failed to claim analog channel for port %d", port->index);
     }
-}
 
-static esp_err_t output_port_teardown_digital(output_t *output, output_port_t *port) {
-    // nothing to do
+    ESP_RETURN_ON_ERROR(CALLBACK_INVOKE(output->config.backend, setup_port, port), TAG,
+        "failed to setup port %d on pin %d", port->index, port->config.pin);
+
     return ESP_OK;
 }
 
-static esp_err_t output_port_teardown_analog(output_t *output, output_port_t *port) {
-    // release the analog channel
-    ESP_RETURN_ON_ERROR(output_port_analog_channel_release(output, port), TAG,
-        "failed to release analog channel for port %d", port->index);
+static esp_err_t output_port_teardown(output_t *output, output_port_t *port) {
+    ESP_RETURN_ON_ERROR(CALLBACK_INVOKE(output->config.backend, teardown_port, port), TAG,
+        "failed to stop port %d on pin %d", port->index, port->config.pin);
 
-    // stop the ledc pwm channel
-    ESP_RETURN_ON_ERROR(ledc_stop(LEDC_LOW_SPEED_MODE, port->analog_channel, 0), TAG,
-        "failed to stop analog port %d on pin %d, channel %d",
-        port->index, port->config.pin, port->analog_channel);
+    // and give the pwm channel back
+    if (port->config.type == OUTPUT_ANALOG) {
+        ESP_RETURN_ON_ERROR(output_port_analog_channel_release(output, port), TAG,
+            "failed to release analog channel for port %d", port->index);
+    }
 
     return ESP_OK;
 }
 
-static esp_err_t output_port_teardown(output_t *output, output_port_t *port) {
-    if (port->config.type == OUTPUT_DIGITAL) {
-        return output_port_teardown_digital(output, port);
-    } else {
-        return output_port_teardown_analog(output, port);
-    }
+static void output_update_timer_callback(void *arg) {
+    output_update(arg);
 }
 
 esp_err_t output_init(output_t *output, const output_config_t *config) {
     // store the config
+    ESP_RETURN_ON_FALSE(config->backend, ESP_ERR_INVALID_ARG, TAG, "no output backend");
     output->config = *config;
 
     // store the total number of ports
@@ -130,17 +89,17 @@ esp_err_t output_init(output_t *output, const output_config_t *config) {
     for (int i = 0; i < OUTPUT_MAX_ANALOG_PORTS; i++) {
         output->claimed_analog_channels[i] = -1;
     }
+
+    output->lock = (portMUX_TYPE) portMUX_INITIALIZER_UNLOCKED;
+    output->write_lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(output->write_lock, ESP_ERR_NO_MEM, TAG, "failed to create write lock");
+    output->ramping_ports = 0;
+    output->dithering_ports = 0;
+    output->pulse_timer_ready = false;
     
-    // setup the pwm timer for the analog ports
-    ledc_timer_config_t timer_config = {
-        .speed_mode = LEDC_LOW_SPEED_MODE,
-        .timer_num = LEDC_TIMER_0,
-        .duty_resolution = OUTPUT_PWM_DUTY_RESOLUTION,
-        .freq_hz = OUTPUT_PWM_FREQUENCY,
-        .clk_cfg = LEDC_USE_APB_CLK
-    };
-    ESP_RETURN_ON_ERROR(ledc_timer_config(&timer_config), TAG,
-        "failed to configure pwm timer");
+    // setup the backend, e.g. the pwm timer of the analog ports
+    ESP_RETURN_ON_ERROR(CALLBACK_INVOKE(output->config.backend, init), TAG,
+        "failed to setup output backend");
 
     // setup all ports
     output->ports = malloc(output->num_ports * sizeof(output_port_t));
@@ -149,7 +108,8 @@ esp_err_t output_init(output_t *output, const output_config_t *config) {
 
     for (uint8_t x = 0; x < output->config.num_columns; x++) {
         for (uint8_t y = 0; y < output->config.num_rows; y++) {
-            uint8_t i = x * output->config.num_rows + y;
+            // row by row, like output_port_get
+            uint8_t i = y * output->config.num_columns + x;
             output_port_t *port = &output->ports[i];
             port->config = config->port_configs[i];
             port->index = i;
@@ -158,17 +118,46 @@ esp_err_t output_init(output_t *output, const output_config_t *config) {
 
             port->analog_channel = -1;
             port->value_mv = 0;
-
-            // setup the port (configures the gpio and ledc channels)
+            port->duty = 0;
+            port->dither_error = 0;
+            port->hardware_duty = 0;
+            port->glide_time_us = 0;
+            port->glide_curve = OUTPUT_GLIDE_LINEAR;
+
+            // ideal linear response until a measured calibration is loaded
+            const output_calibration_t linear = {
+                .num_points = 2,
+                .points = { { 0, 0 }, { OUTPUT_PWM_DUTY_MAX, port->config.vmax_mv * 1000 } }
+            };
+            ESP_RETURN_ON_ERROR(output_port_set_calibration(output, port, &linear), TAG,
+                "failed to set default calibration for port %d", i);
+
+            // setup the port (configures the pin in the backend)
             ESP_RETURN_ON_ERROR(output_port_setup(output, port), TAG,
                 "failed to setup port %d", i);
             
             // set initial voltage level
             ESP_RETURN_ON_ERROR(output_port_set_voltage(output, port, port->value_mv), TAG,
                 "failed to set initial voltage level for port %d", i);
+            output_port_set_dither(output, port, port->config.dither);
         }
     }
 
+    // glide and dither in the background
+    output->update_timer = NULL;
+    if (config->update_interval_us > 0) {
+        const esp_timer_create_args_t timer_config = {
+            .name = "output_update",
+            .callback = output_update_timer_callback,
+            .arg = output,
+            .skip_unhandled_events = true
+        };
+        ESP_RETURN_ON_ERROR(esp_timer_create(&timer_config, &output->update_timer), TAG,
+            "failed to create update timer");
+        ESP_RETURN_ON_ERROR(esp_timer_start_periodic(output->update_timer, config->update_interval_us), TAG,
+            "failed to start update timer");
+    }
+
     return ESP_OK;
 }
 
@@ -186,12 +175,22 @@ esp_err_t output_port_set_type(output_t *output, output_port_t *port, output_typ
     // if the type is the same, do nothing
     if (port->config.type == type) return ESP_OK;
 
-    // teardown, re-type, setup
-    ESP_RETURN_ON_ERROR(output_port_teardown(output, port), TAG,
+    esp_err_t ret = ESP_OK;
+
+    // teardown, re-type, setup. output_update must not write the port in between, nor glide it on
+    xSemaphoreTake(output->write_lock, portMAX_DELAY);
+    taskENTER_CRITICAL(&output->lock);
+    output->ramping_ports &= ~(1ULL << port->index);
+    taskEXIT_CRITICAL(&output->lock);
+    ESP_GOTO_ON_ERROR(output_port_teardown(output, port), exit, TAG,
         "failed to teardown port %d", port->index);
     port->config.type = type;
-    ESP_RETURN_ON_ERROR(output_port_setup(output, port), TAG,
+    ESP_GOTO_ON_ERROR(output_port_setup(output, port), exit, TAG,
         "failed to setup port %d", port->index);
+    output_port_set_dither(output, port, port->config.dither);
+exit:
+    xSemaphoreGive(output->write_lock);
+    ESP_RETURN_ON_ERROR(ret, TAG, "failed to change the type of port %d", port->index);
 
     // set the output voltage
     output_port_set_voltage(output, port, port->value_mv);
@@ -199,57 +198,211 @@ esp_err_t output_port_set_type(output_t *output, output_port_t *port, output_typ
     return ESP_OK;
 }
 
-static esp_err_t output_port_set_voltage_digital(output_t *output, output_port_t *port, uint32_t value_mv) {
-    // set the gpio level
-    uint32_t level = value_mv > 0;
-    ESP_LOGD(TAG, "port %d (pin %d, digital) => %dmV",
-        port->index, port->config.pin, level);
-    ESP_RETURN_ON_ERROR(gpio_set_level(port->config.pin, level), TAG,
-        "failed to set digital port %d to %d", port->index, value_mv);
+static uint32_t output_port_clamp(output_port_t *port, uint32_t value_mv) {
+    return value_mv > port->config.vmax_mv ? port->config.vmax_mv : value_mv;
+}
+
+static uint32_t output_duty_round(uint32_t duty) {
+    // round the fractional duty to the hardware resolution
+    duty = (duty + (1 << (OUTPUT_DUTY_FRAC_BITS - 1))) >> OUTPUT_DUTY_FRAC_BITS;
+    return duty > OUTPUT_PWM_DUTY_MAX ? OUTPUT_PWM_DUTY_MAX : duty;
+}
+
+uint32_t output_port_voltage_to_duty(output_port_t *port, uint32_t value_uv) {
+    const output_calibration_t *cal = &port->calibration;
+
+    // clamp to the calibrated range
+    if (value_uv <= cal->points[0].uv) return cal->points[0].duty << OUTPUT_DUTY_FRAC_BITS;
+    if (value_uv >= cal->points[cal->num_points - 1].uv) {
+        return cal->points[cal->num_points - 1].duty << OUTPUT_DUTY_FRAC_BITS;
+    }
+
+    // find the segment and interpolate the inverse response linearly
+    uint8_t i = 1;
+    while (value_uv > cal->points[i].uv) i++;
+
+    uint32_t duty0 = cal->points[i - 1].duty, duty1 = cal->points[i].duty;
+    uint32_t uv0 = cal->points[i - 1].uv, uv1 = cal->points[i].uv;
+    uint64_t offset = ((uint64_t) (value_uv - uv0) * (duty1 - duty0) << OUTPUT_DUTY_FRAC_BITS) + (uv1 - uv0) / 2;
+
+    return (duty0 << OUTPUT_DUTY_FRAC_BITS) + (uint32_t) (offset / (uv1 - uv0));
+}
+
+esp_err_t output_port_set_calibration(output_t *output, output_port_t *port, const output_calibration_t *calibration) {
+    ESP_RETURN_ON_FALSE(calibration->num_points >= 2 && calibration->num_points <= OUTPUT_CALIBRATION_MAX_POINTS,
+        ESP_ERR_INVALID_ARG, TAG, "invalid number of calibration points %d", calibration->num_points);
+
+    for (uint8_t i = 0; i < calibration->num_points; i++) {
+        ESP_RETURN_ON_FALSE(calibration->points[i].duty <= OUTPUT_PWM_DUTY_MAX, ESP_ERR_INVALID_ARG, TAG,
+            "calibration point %d is out of range", i);
+        ESP_RETURN_ON_FALSE(i == 0 || (calibration->points[i].duty > calibration->points[i - 1].duty &&
+            calibration->points[i].uv > calibration->points[i - 1].uv), ESP_ERR_INVALID_ARG, TAG,
+            "calibration point %d is not ascending", i);
+    }
+
+    port->calibration = *calibration;
+
+    // rebuild the note table, so the hot path is a single lookup
+    for (uint8_t note = 0; note < OUTPUT_NUM_NOTES; note++) {
+        uint32_t value_uv = ((uint32_t) note * 1000000 + 6) / 12;
+        port->note_duties[note] = output_port_voltage_to_duty(port, value_uv);
+    }
+
+    // a running port moves to its voltage under the new calibration right away
+    if (port->config.type == OUTPUT_ANALOG && port->analog_channel != -1) {
+        ESP_RETURN_ON_ERROR(output_port_set_voltage(output, port, port->value_mv), TAG,
+            "failed to apply the calibration of port %d", port->index);
+    }
 
-    port->value_mv = value_mv;
     return ESP_OK;
 }
 
-static esp_err_t output_port_set_voltage_analog(output_t *output, output_port_t *port, uint32_t value_mv) {
-    ledc_channel_t channel = port->analog_channel;
+uint32_t output_port_dither_step(output_port_t *port) {
+    const uint32_t frac_mask = (1 << OUTPUT_DUTY_FRAC_BITS) - 1;
 
-    // scale the voltage to duty cycle resolution
-    uint32_t duty = value_mv * OUTPUT_PWM_DUTY_MAX / port->config.vmax_mv;
+    // first order sigma-delta: carry the fraction over until it adds up to a whole step,
+    // so the mean duty matches the fractional duty and the error is pushed to high frequencies
+    uint32_t sum = port->dither_error + (port->duty & frac_mask);
+    port->dither_error = sum & frac_mask;
 
-    // upper clamping
-    if (duty > OUTPUT_PWM_DUTY_MAX) {
-        duty = OUTPUT_PWM_DUTY_MAX;
+    uint32_t duty = (port->duty >> OUTPUT_DUTY_FRAC_BITS) + (sum >> OUTPUT_DUTY_FRAC_BITS);
+    return duty > OUTPUT_PWM_DUTY_MAX ? OUTPUT_PWM_DUTY_MAX : duty;
+}
+
+esp_err_t output_port_set_dither(output_t *output, output_port_t *port, bool dither) {
+    port->config.dither = dither;
+
+    taskENTER_CRITICAL(&output->lock);
+    if (dither && port->config.type == OUTPUT_ANALOG) {
+        output->dithering_ports |= 1ULL << port->index;
+    } else {
+        output->dithering_ports &= ~(1ULL << port->index);
     }
+    taskEXIT_CRITICAL(&output->lock);
 
-    // update the duty cycle
-    ESP_LOGD(TAG, "port %d (pin %d, analog chan %d) => %dmV",
-        port->index, port->config.pin, channel, value_mv);
-    ESP_RETURN_ON_ERROR(ledc_set_duty(LEDC_LOW_SPEED_MODE, channel, duty), TAG,
-        "failed to set analog port %d (channel %d) to %d mV (%d%% duty)",
-        port->index, channel, value_mv, duty * 100 / OUTPUT_PWM_DUTY_MAX);
-    ESP_RETURN_ON_ERROR(ledc_update_duty(LEDC_LOW_SPEED_MODE, channel), TAG,
-        "failed to update analog port %d", port->index);
-    
     return ESP_OK;
 }
 
-esp_err_t output_port_set_voltage(output_t *output, output_port_t *port, uint32_t value_mv) {
-    // clamp the value
-    if (value_mv > port->config.vmax_mv) {
-        value_mv = port->config.vmax_mv;
+esp_err_t output_port_set_glide(output_t *output, output_port_t *port, uint32_t time_us, output_glide_curve_t curve) {
+    ESP_RETURN_ON_FALSE(curve == OUTPUT_GLIDE_LINEAR || curve == OUTPUT_GLIDE_EXPONENTIAL, ESP_ERR_INVALID_ARG, TAG,
+        "invalid glide curve %d", curve);
+
+    // four time constants within the glide time: 1 - e^(-x), as x - x^2 / 2 + x^3 / 6 in fixed point
+    uint32_t coefficient = OUTPUT_GLIDE_COEFFICIENT_ONE;
+    uint32_t steps = output->config.update_interval_us ? time_us / output->config.update_interval_us : 0;
+    if (steps > 4) {
+        uint64_t x = 4ULL * OUTPUT_GLIDE_COEFFICIENT_ONE / steps;
+        uint64_t x2 = x * x / OUTPUT_GLIDE_COEFFICIENT_ONE, x3 = x2 * x / OUTPUT_GLIDE_COEFFICIENT_ONE;
+        coefficient = x - x2 / 2 + x3 / 6;
     }
 
-    #ifdef CONFIG_OUTPUT_DUMP_VOLTAGES
-        printf("OUTPUT %d = %dmV", port->index, value_mv);
-    #endif
+    taskENTER_CRITICAL(&output->lock);
+    port->glide_time_us = time_us;
+    port->glide_curve = curve;
+    port->glide_coefficient = coefficient;
+    taskEXIT_CRITICAL(&output->lock);
 
-    // set the voltage level
-    if (port->config.type == OUTPUT_DIGITAL) {
-        return output_port_set_voltage_digital(output, port, value_mv);
-    } else {
-        return output_port_set_voltage_analog(output, port, value_mv);
+    return ESP_OK;
+}
+
+static bool output_port_glides(output_t *output, output_port_t *port) {
+    return port->config.type == OUTPUT_ANALOG && output->config.update_interval_us > 0 &&
+        port->glide_time_us >= output->config.update_interval_us;
+}
+
+static void output_port_start_ramp(output_t *output, output_port_t *port, uint32_t duty) {
+    uint32_t steps = port->glide_time_us / output->config.update_interval_us;
+
+    taskENTER_CRITICAL(&output->lock);
+    // a new target glides on from wherever the port is, even in the middle of a ramp
+    if (!(output->ramping_ports & (1ULL << port->index))) {
+        port->ramp_value = port->duty << OUTPUT_RAMP_FRAC_BITS;
     }
+    port->ramp_target = duty << OUTPUT_RAMP_FRAC_BITS;
+    port->ramp_increment = (port->ramp_target - port->ramp_value) / (int32_t) steps;
+    port->ramp_steps = steps;
+    output->ramping_ports |= 1ULL << port->index;
+    taskEXIT_CRITICAL(&output->lock);
+}
+
+static void output_port_stop_ramp(output_t *output, output_port_t *port) {
+    taskENTER_CRITICAL(&output->lock);
+    output->ramping_ports &= ~(1ULL << port->index);
+    taskEXIT_CRITICAL(&output->lock);
+}
+
+static bool output_port_ramp_step(output_port_t *port) {
+    if (port->glide_curve == OUTPUT_GLIDE_LINEAR) {
+        // the last step lands on the target, whatever the increment rounded away
+        if (--port->ramp_steps == 0) {
+            port->ramp_value = port->ramp_target;
+            return true;
+        }
+        port->ramp_value += port->ramp_increment;
+        return false;
+    }
+
+    // exponential: a fixed part of the remaining distance, until that is below one ramp unit
+    int32_t step = (int64_t) (port->ramp_target - port->ramp_value) * port->glide_coefficient / OUTPUT_GLIDE_COEFFICIENT_ONE;
+    if (step == 0) {
+        port->ramp_value = port->ramp_target;
+        return true;
+    }
+    port->ramp_value += step;
+    return false;
+}
+
+esp_err_t output_update(output_t *output) {
+    output_port_t *changed[OUTPUT_MAX_ANALOG_PORTS];
+    uint8_t num_changed = 0;
+    esp_err_t ret = ESP_OK;
+
+    // a commit in between would mix its duties with these, or be overwritten by a stale one
+    xSemaphoreTake(output->write_lock, portMAX_DELAY);
+
+    // advance all ramps in one pass
+    taskENTER_CRITICAL(&output->lock);
+    uint64_t ports = output->ramping_ports;
+    for (uint64_t mask = ports; mask; mask &= mask - 1) {
+        output_port_t *port = &output->ports[__builtin_ctzll(mask)];
+        if (output_port_ramp_step(port)) output->ramping_ports &= ~(1ULL << port->index);
+        port->duty = (port->ramp_value + (1 << (OUTPUT_RAMP_FRAC_BITS - 1))) >> OUTPUT_RAMP_FRAC_BITS;
+    }
+    ports |= output->dithering_ports;
+    taskEXIT_CRITICAL(&output->lock);
+
+    // write the duties that changed, whole duties and runs of the same step cost no driver calls
+    for (uint64_t mask = ports; mask; mask &= mask - 1) {
+        output_port_t *port = &output->ports[__builtin_ctzll(mask)];
+
+        uint32_t duty = port->config.dither ? output_port_dither_step(port) : output_duty_round(port->duty);
+        if (duty == port->hardware_duty) continue;
+
+        ESP_GOTO_ON_ERROR(CALLBACK_INVOKE(output->config.backend, set_duty, port, duty), exit, TAG,
+            "failed to update analog port %d", port->index);
+        port->hardware_duty = duty;
+        changed[num_changed++] = port;
+    }
+
+    // and latch them back to back, like a transaction
+    for (uint8_t i = 0; i < num_changed; i++) {
+        ESP_GOTO_ON_ERROR(CALLBACK_INVOKE(output->config.backend, update_duty, changed[i]), exit, TAG,
+            "failed to latch analog port %d", changed[i]->index);
+    }
+
+exit:
+    xSemaphoreGive(output->write_lock);
+    return ret;
+}
+
+esp_err_t output_port_set_voltage(output_t *output, output_port_t *port, uint32_t value_mv) {
+    output_transaction_t tx;
+
+    // a transaction of a single port
+    output_transaction_begin(output, &tx);
+    ESP_RETURN_ON_ERROR(output_transaction_port_set_voltage(&tx, port, value_mv), TAG,
+        "failed to stage port %d", port->index);
+    return output_transaction_commit(&tx);
 }
 
 esp_err_t output_set_type(output_t *output, uint8_t column, uint8_t row, output_type_t type) {
@@ -266,3 +419,212 @@ esp_err_t output_set_voltage(output_t *output, uint8_t column, uint8_t row, uint
 
     return output_port_set_voltage(output, port, value_mv);
 }
+
+esp_err_t output_set_glide(output_t *output, uint8_t column, uint8_t row, uint32_t time_us, output_glide_curve_t curve) {
+    output_port_t *port = output_port_get(output, column, row);
+    if (!port) return ESP_ERR_INVALID_ARG;
+
+    return output_port_set_glide(output, port, time_us, curve);
+}
+
+esp_err_t output_transaction_begin(output_t *output, output_transaction_t *tx) {
+    tx->output = output;
+    tx->num_ports = 0;
+
+    return ESP_OK;
+}
+
+static esp_err_t output_transaction_stage(output_transaction_t *tx, output_port_t *port, uint32_t value_mv, uint32_t duty,
+        uint32_t pulse_us) {
+    // a port staged twice keeps the last value
+    uint8_t i = 0;
+    while (i < tx->num_ports && tx->staged[i].port != port) i++;
+
+    if (i == tx->num_ports) {
+        ESP_RETURN_ON_FALSE(tx->num_ports < OUTPUT_TRANSACTION_MAX_PORTS, ESP_ERR_NO_MEM, TAG,
+            "too many ports in transaction");
+        tx->staged[i].port = port;
+        tx->num_ports++;
+    }
+
+    tx->staged[i].value_mv = value_mv;
+    tx->staged[i].duty = duty;
+    tx->staged[i].pulse_us = pulse_us;
+
+    return ESP_OK;
+}
+
+esp_err_t output_transaction_port_set_voltage(output_transaction_t *tx, output_port_t *port, uint32_t value_mv) {
+    value_mv = output_port_clamp(port, value_mv);
+    return output_transaction_stage(tx, port, value_mv, output_port_voltage_to_duty(port, value_mv * 1000), 0);
+}
+
+esp_err_t output_transaction_set_voltage(output_transaction_t *tx, uint8_t column, uint8_t row, uint32_t value_mv) {
+    output_port_t *port = output_port_get(tx->output, column, row);
+    if (!port) return ESP_ERR_INVALID_ARG;
+
+    return output_transaction_port_set_voltage(tx, port, value_mv);
+}
+
+esp_err_t output_transaction_port_set_note(output_transaction_t *tx, output_port_t *port, uint8_t note) {
+    ESP_RETURN_ON_FALSE(note < OUTPUT_NUM_NOTES, ESP_ERR_INVALID_ARG, TAG, "invalid note %d", note);
+
+    uint32_t value_mv = output_port_clamp(port, OUTPUT_NOTE_TO_VOLTAGE(note));
+    return output_transaction_stage(tx, port, value_mv, port->note_duties[note], 0);
+}
+
+esp_err_t output_transaction_set_note(output_transaction_t *tx, uint8_t column, uint8_t row, uint8_t note) {
+    output_port_t *port = output_port_get(tx->output, column, row);
+    if (!port) return ESP_ERR_INVALID_ARG;
+
+    return output_transaction_port_set_note(tx, port, note);
+}
+
+esp_err_t output_transaction_port_pulse(output_transaction_t *tx, output_port_t *port, uint32_t length_us) {
+    ESP_RETURN_ON_FALSE(tx->output->pulse_timer_ready, ESP_ERR_INVALID_STATE, TAG, "pulse timer not running");
+    ESP_RETURN_ON_FALSE(port->config.type == OUTPUT_DIGITAL, ESP_ERR_INVALID_ARG, TAG,
+        "port %d is not digital", port->index);
+
+    if (length_us < OUTPUT_PULSE_MIN_WIDTH_US) length_us = OUTPUT_PULSE_MIN_WIDTH_US;
+    return output_transaction_stage(tx, port, port->config.vmax_mv, 0, length_us);
+}
+
+esp_err_t output_transaction_pulse(output_transaction_t *tx, uint8_t column, uint8_t row, uint32_t length_us) {
+    output_port_t *port = output_port_get(tx->output, column, row);
+    if (!port) return ESP_ERR_INVALID_ARG;
+
+    return output_transaction_port_pulse(tx, port, length_us);
+}
+
+esp_err_t output_transaction_set_column_note(output_transaction_t *tx, uint8_t column, uint8_t note, uint8_t velocity) {
+    output_t *output = tx->output;
+    ESP_RETURN_ON_FALSE(column < output->config.num_columns, ESP_ERR_INVALID_ARG, TAG, "invalid column %d", column);
+    uint8_t num_rows = output->config.num_rows;
+
+    if (velocity > 0 && num_rows > OUTPUT_ROW_PITCH) {
+        ESP_RETURN_ON_ERROR(output_transaction_set_note(tx, column, OUTPUT_ROW_PITCH, note), TAG,
+            "failed to stage pitch of column %d", column);
+    }
+    if (num_rows > OUTPUT_ROW_VELOCITY) {
+        ESP_RETURN_ON_ERROR(output_transaction_set_voltage(tx, column, OUTPUT_ROW_VELOCITY, OUTPUT_VELOCITY_TO_VOLTAGE(velocity)),
+            TAG, "failed to stage velocity of column %d", column);
+    }
+    if (num_rows > OUTPUT_ROW_GATE) {
+        output_port_t *gate = output_port_get(output, column, OUTPUT_ROW_GATE);
+        ESP_RETURN_ON_ERROR(output_transaction_port_set_voltage(tx, gate, velocity > 0 ? gate->config.vmax_mv : 0),
+            TAG, "failed to stage gate of column %d", column);
+    }
+
+    // triggers end on their own
+    if (velocity > 0 && num_rows > OUTPUT_ROW_TRIGGER && output->pulse_timer_ready) {
+        output_port_t *trigger = output_port_get(output, column, OUTPUT_ROW_TRIGGER);
+        if (trigger->config.type == OUTPUT_DIGITAL) {
+            ESP_RETURN_ON_ERROR(output_transaction_port_pulse(tx, trigger, OUTPUT_TRIGGER_US),
+                TAG, "failed to stage trigger of column %d", column);
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t output_transaction_commit(output_transaction_t *tx) {
+    uint32_t hardware_duties[OUTPUT_TRANSACTION_MAX_PORTS];
+    uint64_t set_mask = 0, clear_mask = 0;
+    bool latched = false, pulses = false;
+    esp_err_t ret = ESP_OK;
+
+    // output_update leaves the ports alone until all of them are written
+    xSemaphoreTake(tx->output->write_lock, portMAX_DELAY);
+
+    // write all duty registers first. Nothing changes at the outputs yet
+    for (uint8_t i = 0; i < tx->num_ports; i++) {
+        output_port_t *port = tx->staged[i].port;
+        hardware_duties[i] = port->hardware_duty;
+
+        #ifdef CONFIG_OUTPUT_DUMP_VOLTAGES
+            printf("OUTPUT %d = %dmV", port->index, tx->staged[i].value_mv);
+        #endif
+
+        if (port->config.type != OUTPUT_ANALOG) continue;
+
+        // gliding ports are moved by output_update from here on
+        if (output_port_glides(tx->output, port)) {
+            output_port_start_ramp(tx->output, port, tx->staged[i].duty);
+            continue;
+        }
+        output_port_stop_ramp(tx->output, port);
+
+        // dithered ports start the modulation
+        port->duty = tx->staged[i].duty;
+        uint32_t duty = port->config.dither ? output_port_dither_step(port) : output_duty_round(port->duty);
+        ESP_LOGD(TAG, "port %d (pin %d, analog chan %d) => %dmV",
+            port->index, port->config.pin, port->analog_channel, tx->staged[i].value_mv);
+        ESP_GOTO_ON_ERROR(CALLBACK_INVOKE(tx->output->config.backend, set_duty, port, duty), exit, TAG,
+            "failed to set analog port %d (channel %d) to %d mV (%d%% duty)",
+            port->index, port->analog_channel, tx->staged[i].value_mv, duty * 100 / OUTPUT_PWM_DUTY_MAX);
+        port->hardware_duty = duty;
+    }
+
+    // latch the new duties back to back, they take effect at the end of the current pwm period
+    for (uint8_t i = 0; i < tx->num_ports; i++) {
+        output_port_t *port = tx->staged[i].port;
+        if (port->config.type != OUTPUT_ANALOG) continue;
+
+        // the value of a gliding port is its target
+        port->value_mv = tx->staged[i].value_mv;
+        if (output_port_glides(tx->output, port)) continue;
+
+        ESP_GOTO_ON_ERROR(CALLBACK_INVOKE(tx->output->config.backend, update_duty, port), exit, TAG,
+            "failed to update analog port %d", port->index);
+        latched |= hardware_duties[i] != port->hardware_duty;
+    }
+
+    // digital ports (e.g. gates) follow last, so they never change before the new duties are in effect.
+    // All of them change with one set and one clear write, e.g. the 16 triggers of a drum step
+    for (uint8_t i = 0; i < tx->num_ports; i++) {
+        output_port_t *port = tx->staged[i].port;
+        if (port->config.type != OUTPUT_DIGITAL) continue;
+
+        // pulses rise with the levels and rest low, their ends are on the pulse timer
+        uint32_t level = tx->staged[i].value_mv > 0;
+        ESP_LOGD(TAG, "port %d (pin %d, digital) => %dmV",
+            port->index, port->config.pin, level);
+        pulses |= tx->staged[i].pulse_us > 0;
+        if (level) {
+            set_mask |= 1ULL << port->config.pin;
+        } else {
+            clear_mask |= 1ULL << port->config.pin;
+        }
+        port->value_mv = tx->staged[i].pulse_us ? 0 : tx->staged[i].value_mv;
+    }
+    if (set_mask || clear_mask) {
+        // the written levels replace pending edges of their pins, e.g. the end of an earlier pulse
+        output_pulse_cancel(tx->output, set_mask | clear_mask);
+        if (latched) {
+            ESP_GOTO_ON_ERROR(CALLBACK_INVOKE(tx->output->config.backend, wait_latch), exit, TAG,
+                "failed to wait for the duty latch");
+        }
+        ESP_GOTO_ON_ERROR(CALLBACK_INVOKE(tx->output->config.backend, write_levels, set_mask, clear_mask), exit, TAG,
+            "failed to set digital ports");
+    }
+    if (pulses) {
+        int64_t now_us = esp_timer_get_time();
+        for (uint8_t i = 0; i < tx->num_ports; i++) {
+            output_port_t *port = tx->staged[i].port;
+            if (tx->staged[i].pulse_us == 0) continue;
+
+            esp_err_t err = output_port_schedule_edge(tx->output, port, now_us + tx->staged[i].pulse_us, false);
+            if (err != ESP_OK) {
+                // a pulse without its end would be a stuck gate, end it right away instead
+                CALLBACK_INVOKE(tx->output->config.backend, write_levels, 0, 1ULL << port->config.pin);
+            }
+            ESP_GOTO_ON_ERROR(err, exit, TAG, "failed to schedule the end of the pulse of port %d", port->index);
+        }
+    }
+
+    tx->num_ports = 0;
+
+exit:
+    xSemaphoreGive(tx->output->write_lock);
+    return ret;
+}
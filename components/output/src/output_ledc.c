@@ -0,0 +1,114 @@
+#include "output.h"
+
+#include <esp_check.h>
+#include <driver/gpio.h>
+#include <driver/ledc.h>
+#include <esp_rom_sys.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+
+
+static const char *TAG = "output_ledc";
+
+// esp_timer time of the pwm timer start. Both clocks derive from the same crystal,
+// so the pwm period boundaries stay at fixed offsets from it
+static int64_t output_ledc_start_us;
+
+
+void output_gpio_write(uint64_t set_mask, uint64_t clear_mask) {
+    // the set and clear registers only touch the pins of the mask, no read-modify-write
+    if ((uint32_t) set_mask) REG_WRITE(GPIO_OUT_W1TS_REG, (uint32_t) set_mask);
+    if (set_mask >> 32) REG_WRITE(GPIO_OUT1_W1TS_REG, (uint32_t) (set_mask >> 32));
+    if ((uint32_t) clear_mask) REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t) clear_mask);
+    if (clear_mask >> 32) REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t) (clear_mask >> 32));
+}
+
+static esp_err_t output_ledc_init(void *context) {
+    // setup the pwm timer for the analog ports
+    ledc_timer_config_t timer_config = {
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .timer_num = LEDC_TIMER_0,
+        .duty_resolution = OUTPUT_PWM_DUTY_RESOLUTION,
+        .freq_hz = OUTPUT_PWM_FREQUENCY,
+        .clk_cfg = LEDC_USE_APB_CLK
+    };
+    ESP_RETURN_ON_ERROR(ledc_timer_config(&timer_config), TAG,
+        "failed to configure pwm timer");
+    output_ledc_start_us = esp_timer_get_time();
+
+    return ESP_OK;
+}
+
+static esp_err_t output_ledc_setup_port(void *context, output_port_t *port) {
+    if (port->config.type == OUTPUT_DIGITAL) {
+        // setup gpio pin
+        gpio_config_t digital_config = {
+            .pin_bit_mask = 1ULL << port->config.pin,
+            .mode = GPIO_MODE_OUTPUT,
+            .pull_up_en = GPIO_PULLUP_DISABLE,
+            .pull_down_en = GPIO_PULLDOWN_DISABLE,
+            .intr_type = GPIO_INTR_DISABLE
+        };
+        ESP_RETURN_ON_ERROR(gpio_config(&digital_config), TAG,
+            "failed to configure digital port %d on pin %d", port->index, port->config.pin);
+    } else {
+        // setup ledc pwm channel
+        ledc_channel_config_t analog_config = {
+            .gpio_num = port->config.pin,
+            .speed_mode = LEDC_LOW_SPEED_MODE,
+            .channel = port->analog_channel,
+            .intr_type = LEDC_INTR_DISABLE,
+            .timer_sel = LEDC_TIMER_0,
+            .duty = 0,
+            .hpoint = 0
+        };
+        ESP_RETURN_ON_ERROR(ledc_channel_config(&analog_config), TAG,
+            "failed to configure analog port %d on pin %d, channel %d",
+            port->index, port->config.pin, port->analog_channel);
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t output_ledc_teardown_port(void *context, output_port_t *port) {
+    // digital ports need nothing, analog ports stop the ledc pwm channel
+    if (port->config.type == OUTPUT_DIGITAL) return ESP_OK;
+
+    ESP_RETURN_ON_ERROR(ledc_stop(LEDC_LOW_SPEED_MODE, port->analog_channel, 0), TAG,
+        "failed to stop analog port %d on pin %d, channel %d",
+        port->index, port->config.pin, port->analog_channel);
+
+    return ESP_OK;
+}
+
+static esp_err_t output_ledc_set_duty(void *context, output_port_t *port, uint32_t duty) {
+    return ledc_set_duty(LEDC_LOW_SPEED_MODE, port->analog_channel, duty);
+}
+
+static esp_err_t output_ledc_update_duty(void *context, output_port_t *port) {
+    return ledc_update_duty(LEDC_LOW_SPEED_MODE, port->analog_channel);
+}
+
+static esp_err_t output_ledc_wait_latch(void *context) {
+    // latched duties take effect when the pwm timer overflows, one microsecond of margin
+    // covers the time between the timer start and reading the esp_timer
+    uint32_t elapsed_us = (esp_timer_get_time() - output_ledc_start_us) % OUTPUT_PWM_PERIOD_US;
+    esp_rom_delay_us(OUTPUT_PWM_PERIOD_US - elapsed_us + 1);
+    return ESP_OK;
+}
+
+static esp_err_t output_ledc_write_levels(void *context, uint64_t set_mask, uint64_t clear_mask) {
+    output_gpio_write(set_mask, clear_mask);
+    return ESP_OK;
+}
+
+const output_backend_t output_backend_ledc = {
+    .context = NULL,
+    .init = output_ledc_init,
+    .setup_port = output_ledc_setup_port,
+    .teardown_port = output_ledc_teardown_port,
+    .set_duty = output_ledc_set_duty,
+    .update_duty = output_ledc_update_duty,
+    .wait_latch = output_ledc_wait_latch,
+    .write_levels = output_ledc_write_levels
+};
@@ -0,0 +1,39 @@
+#include "output.h"
+
+#include <stdio.h>
+#include <esp_check.h>
+#include <nvs.h>
+
+
+static const char *TAG = "output_nvs";
+
+
+esp_err_t output_calibration_load(output_t *output) {
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(OUTPUT_CALIBRATION_NVS_NAMESPACE, NVS_READONLY, &handle);
+
+    // nothing was ever calibrated, keep the defaults
+    if (ret == ESP_ERR_NVS_NOT_FOUND) return ESP_OK;
+    ESP_RETURN_ON_ERROR(ret, TAG, "failed to open calibration namespace");
+
+    for (uint8_t i = 0; i < output->num_ports; i++) {
+        output_port_t *port = &output->ports[i];
+        output_calibration_t calibration;
+        size_t length = sizeof(calibration);
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        snprintf(key, sizeof(key), "cal%d", port->index);
+
+        ret = nvs_get_blob(handle, key, &calibration, &length);
+        if (ret == ESP_ERR_NVS_NOT_FOUND) continue;
+        if (ret == ESP_OK && length != sizeof(calibration)) ret = ESP_ERR_INVALID_SIZE;
+
+        // a broken entry only costs this port its calibration
+        if (ret == ESP_OK) ret = output_port_set_calibration(output, port, &calibration);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "ignoring calibration of port %d: %s", port->index, esp_err_to_name(ret));
+        }
+    }
+
+    nvs_close(handle);
+    return ESP_OK;
+}
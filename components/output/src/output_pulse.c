@@ -0,0 +1,75 @@
+#include "output_pulse.h"
+
+#include <string.h>
+
+
+void output_pulse_queue_init(output_pulse_queue_t *queue) {
+    queue->num_edges = 0;
+    queue->written_us = 0;
+    queue->written_mask = 0;
+}
+
+bool output_pulse_queue_push(output_pulse_queue_t *queue, const output_pulse_edge_t *edge) {
+    if (queue->num_edges == OUTPUT_PULSE_MAX_EDGES) return false;
+
+    // behind all later edges, in front of earlier and equal ones
+    uint8_t i = 0;
+    while (i < queue->num_edges && queue->edges[i].time_us > edge->time_us) i++;
+
+    memmove(&queue->edges[i + 1], &queue->edges[i], (queue->num_edges - i) * sizeof(output_pulse_edge_t));
+    queue->edges[i] = *edge;
+    queue->num_edges++;
+
+    return true;
+}
+
+void output_pulse_queue_remove(output_pulse_queue_t *queue, uint64_t pin_mask) {
+    // edges of several pins only lose the removed ones, the order stays
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < queue->num_edges; i++) {
+        output_pulse_edge_t edge = queue->edges[i];
+        edge.pin_mask &= ~pin_mask;
+        if (edge.pin_mask) queue->edges[n++] = edge;
+    }
+    queue->num_edges = n;
+}
+
+int64_t output_pulse_queue_next(const output_pulse_queue_t *queue) {
+    return queue->num_edges ? queue->edges[queue->num_edges - 1].time_us : OUTPUT_PULSE_NONE;
+}
+
+int64_t output_pulse_queue_alarm(const output_pulse_queue_t *queue, int64_t now_us) {
+    if (queue->num_edges == 0) return OUTPUT_PULSE_NONE;
+    const output_pulse_edge_t *edge = &queue->edges[queue->num_edges - 1];
+
+    // edges that are (almost) due fire right away, the second change of a pin not before the minimum width
+    int64_t earliest = now_us + OUTPUT_PULSE_MIN_LEAD_US;
+    if ((edge->pin_mask & queue->written_mask) && earliest < queue->written_us + OUTPUT_PULSE_MIN_WIDTH_US) {
+        earliest = queue->written_us + OUTPUT_PULSE_MIN_WIDTH_US;
+    }
+
+    return edge->time_us > earliest ? edge->time_us : earliest;
+}
+
+bool output_pulse_queue_pop_due(output_pulse_queue_t *queue, int64_t now_us, uint64_t *set_mask, uint64_t *clear_mask) {
+    *set_mask = 0;
+    *clear_mask = 0;
+
+    while (queue->num_edges > 0) {
+        const output_pulse_edge_t *edge = &queue->edges[queue->num_edges - 1];
+        if (edge->time_us > now_us) break;
+        if ((*set_mask | *clear_mask) & edge->pin_mask) break;
+
+        if (edge->level) {
+            *set_mask |= edge->pin_mask;
+        } else {
+            *clear_mask |= edge->pin_mask;
+        }
+        queue->num_edges--;
+    }
+
+    if (!(*set_mask || *clear_mask)) return false;
+    queue->written_us = now_us;
+    queue->written_mask = *set_mask | *clear_mask;
+    return true;
+}
@@ -0,0 +1,119 @@
+#include "output.h"
+
+#include <esp_check.h>
+#include <driver/timer.h>
+#include <soc/soc.h>
+#include <freertos/task.h>
+
+
+#define OUTPUT_PULSE_TIMER_GROUP TIMER_GROUP_0
+#define OUTPUT_PULSE_TIMER TIMER_0
+#define OUTPUT_PULSE_TIMER_DIVIDER (APB_CLK_FREQ / 1000000) // counts microseconds
+
+
+static const char *TAG = "output_pulse";
+
+
+static void output_pulse_arm(output_t *output, uint64_t count) {
+    int64_t alarm = output_pulse_queue_alarm(&output->pulses, count + output->pulse_time_offset_us);
+    if (alarm == OUTPUT_PULSE_NONE) return;
+
+    timer_group_set_alarm_value_in_isr(OUTPUT_PULSE_TIMER_GROUP, OUTPUT_PULSE_TIMER, alarm - output->pulse_time_offset_us);
+    timer_group_enable_alarm_in_isr(OUTPUT_PULSE_TIMER_GROUP, OUTPUT_PULSE_TIMER);
+}
+
+static bool output_pulse_timer_callback(void *arg) {
+    output_t *output = (output_t *) arg;
+    uint64_t set_mask, clear_mask;
+
+    portENTER_CRITICAL_ISR(&output->lock);
+    uint64_t count = timer_group_get_counter_value_in_isr(OUTPUT_PULSE_TIMER_GROUP, OUTPUT_PULSE_TIMER);
+    // one write per interrupt, the next change of a written pin waits for the minimum pulse width
+    if (output_pulse_queue_pop_due(&output->pulses, count + output->pulse_time_offset_us, &set_mask, &clear_mask)) {
+        // through the backend like every other level change, so a timeline records the pulses too
+        CALLBACK_INVOKE(output->config.backend, write_levels, set_mask, clear_mask);
+    }
+    output_pulse_arm(output, count);
+    portEXIT_CRITICAL_ISR(&output->lock);
+
+    return false;
+}
+
+esp_err_t output_pulse_init(output_t *output) {
+    output_pulse_queue_init(&output->pulses);
+
+    const timer_config_t timer_config = {
+        .divider = OUTPUT_PULSE_TIMER_DIVIDER,
+        .counter_dir = TIMER_COUNT_UP,
+        .counter_en = TIMER_PAUSE,
+        .alarm_en = TIMER_ALARM_DIS,
+        .auto_reload = TIMER_AUTORELOAD_DIS,
+        .intr_type = TIMER_INTR_LEVEL
+    };
+    ESP_RETURN_ON_ERROR(timer_init(OUTPUT_PULSE_TIMER_GROUP, OUTPUT_PULSE_TIMER, &timer_config), TAG,
+        "failed to configure pulse timer");
+    ESP_RETURN_ON_ERROR(timer_set_counter_value(OUTPUT_PULSE_TIMER_GROUP, OUTPUT_PULSE_TIMER, 0), TAG,
+        "failed to reset pulse timer");
+    ESP_RETURN_ON_ERROR(timer_isr_callback_add(OUTPUT_PULSE_TIMER_GROUP, OUTPUT_PULSE_TIMER,
+            output_pulse_timer_callback, output, 0), TAG,
+        "failed to add pulse timer interrupt");
+
+    // both clocks derive from the same crystal, a fixed offset maps esp_timer times to counts
+    output->pulse_time_offset_us = esp_timer_get_time();
+    ESP_RETURN_ON_ERROR(timer_start(OUTPUT_PULSE_TIMER_GROUP, OUTPUT_PULSE_TIMER), TAG,
+        "failed to start pulse timer");
+
+    output->pulse_timer_ready = true;
+    return ESP_OK;
+}
+
+static esp_err_t output_pulse_schedule(output_t *output, output_port_t *port, const output_pulse_edge_t *edges, uint8_t num_edges) {
+    ESP_RETURN_ON_FALSE(output->pulse_timer_ready, ESP_ERR_INVALID_STATE, TAG, "pulse timer not running");
+    ESP_RETURN_ON_FALSE(port->config.type == OUTPUT_DIGITAL, ESP_ERR_INVALID_ARG, TAG,
+        "port %d is not digital", port->index);
+
+    // all edges or none, so a pulse never misses its falling edge
+    taskENTER_CRITICAL(&output->lock);
+    bool queued = output->pulses.num_edges + num_edges <= OUTPUT_PULSE_MAX_EDGES;
+    if (queued) {
+        for (uint8_t i = 0; i < num_edges; i++) output_pulse_queue_push(&output->pulses, &edges[i]);
+        output_pulse_arm(output, timer_group_get_counter_value_in_isr(OUTPUT_PULSE_TIMER_GROUP, OUTPUT_PULSE_TIMER));
+    }
+    taskEXIT_CRITICAL(&output->lock);
+
+    ESP_RETURN_ON_FALSE(queued, ESP_ERR_NO_MEM, TAG, "pulse queue is full");
+    return ESP_OK;
+}
+
+esp_err_t output_port_schedule_edge(output_t *output, output_port_t *port, int64_t time_us, bool level) {
+    const output_pulse_edge_t edge = {
+        .time_us = time_us,
+        .pin_mask = 1ULL << port->config.pin,
+        .level = level
+    };
+    return output_pulse_schedule(output, port, &edge, 1);
+}
+
+esp_err_t output_port_pulse(output_t *output, output_port_t *port, int64_t time_us, uint32_t length_us) {
+    const output_pulse_edge_t edges[] = {
+        { .time_us = time_us, .pin_mask = 1ULL << port->config.pin, .level = true },
+        { .time_us = time_us + length_us, .pin_mask = 1ULL << port->config.pin, .level = false }
+    };
+    return output_pulse_schedule(output, port, edges, 2);
+}
+
+esp_err_t output_pulse(output_t *output, uint8_t column, uint8_t row, int64_t time_us, uint32_t length_us) {
+    output_port_t *port = output_port_get(output, column, row);
+    if (!port) return ESP_ERR_INVALID_ARG;
+
+    return output_port_pulse(output, port, time_us, length_us);
+}
+
+void output_pulse_cancel(output_t *output, uint64_t pin_mask) {
+    if (!output->pulse_timer_ready) return;
+
+    // an alarm armed for a dropped edge fires without a write and arms the next one
+    taskENTER_CRITICAL(&output->lock);
+    output_pulse_queue_remove(&output->pulses, pin_mask);
+    taskEXIT_CRITICAL(&output->lock);
+}
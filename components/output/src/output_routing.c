@@ -0,0 +1,238 @@
+#include "output_routing.h"
+
+#include <string.h>
+#include <esp_check.h>
+
+
+#define OUTPUT_ROUTING_NO_ROUTE 0xFF
+
+
+static const char *TAG = "output_routing";
+
+
+esp_err_t output_routing_init(output_routing_t *routing, output_t *output) {
+    routing->output = output;
+    routing->lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(routing->lock, ESP_ERR_NO_MEM, TAG, "failed to create lock");
+
+    memset(&routing->table, 0, sizeof(routing->table));
+    routing->has_pending = false;
+    memset(routing->notes, 0, sizeof(routing->notes));
+    memset(routing->velocities, 0, sizeof(routing->velocities));
+    memset(routing->drum_masks, 0, sizeof(routing->drum_masks));
+
+    return ESP_OK;
+}
+
+static esp_err_t output_routing_compile(output_routing_t *routing, const output_route_t *routes, uint8_t num_routes,
+        output_routing_table_t *table) {
+    ESP_RETURN_ON_FALSE(num_routes <= OUTPUT_ROUTING_MAX_ROUTES, ESP_ERR_INVALID_ARG, TAG,
+        "too many routes (%d)", num_routes);
+
+    // validate, and count the routes of each track voice
+    uint8_t counts[OUTPUT_ROUTING_MAX_TRACKS * OUTPUT_NUM_VOICES] = { 0 };
+    uint64_t routed_ports = 0;
+    for (uint8_t i = 0; i < num_routes; i++) {
+        const output_route_t *route = &routes[i];
+        ESP_RETURN_ON_FALSE(route->track < OUTPUT_ROUTING_MAX_TRACKS && route->voice < OUTPUT_NUM_VOICES, ESP_ERR_INVALID_ARG,
+            TAG, "invalid route %d", i);
+        ESP_RETURN_ON_FALSE(route->voice != OUTPUT_VOICE_DRUM || route->drum < OUTPUT_ROUTING_NUM_DRUMS, ESP_ERR_INVALID_ARG,
+            TAG, "invalid drum %d of route %d", route->drum, i);
+
+        output_port_t *port = output_port_get(routing->output, route->column, route->row);
+        ESP_RETURN_ON_FALSE(port, ESP_ERR_INVALID_ARG, TAG, "invalid port of route %d", i);
+        ESP_RETURN_ON_FALSE(!(routed_ports & (1ULL << port->index)), ESP_ERR_INVALID_ARG, TAG,
+            "port %d is routed twice", port->index);
+        ESP_RETURN_ON_FALSE(port->config.type == OUTPUT_ANALOG || route->voice >= OUTPUT_VOICE_GATE, ESP_ERR_INVALID_ARG,
+            TAG, "digital port %d can only carry gates", port->index);
+        ESP_RETURN_ON_FALSE(route->pulse_us == 0 || (port->config.type == OUTPUT_DIGITAL && route->voice >= OUTPUT_VOICE_GATE),
+            ESP_ERR_INVALID_ARG, TAG, "triggers of route %d need a digital gate port", i);
+
+        routed_ports |= 1ULL << port->index;
+        counts[route->track * OUTPUT_NUM_VOICES + route->voice]++;
+    }
+
+    // counting sort by track voice, the order of routes within one is kept
+    uint8_t next[OUTPUT_ROUTING_MAX_TRACKS * OUTPUT_NUM_VOICES];
+    table->first[0] = 0;
+    for (uint8_t i = 0; i < OUTPUT_ROUTING_MAX_TRACKS * OUTPUT_NUM_VOICES; i++) {
+        next[i] = table->first[i];
+        table->first[i + 1] = table->first[i] + counts[i];
+    }
+
+    for (uint8_t i = 0; i < num_routes; i++) {
+        const output_route_t *route = &routes[i];
+        uint8_t j = next[route->track * OUTPUT_NUM_VOICES + route->voice]++;
+        table->routes[j].port = output_port_get(routing->output, route->column, route->row);
+        table->routes[j].voice = route->voice;
+        table->routes[j].drum = route->drum;
+        table->routes[j].pulse_us = route->pulse_us;
+    }
+    table->num_routes = num_routes;
+
+    return ESP_OK;
+}
+
+// route index of each port in a table, by port index
+static void output_routing_port_routes(const output_routing_table_t *table, uint8_t *port_routes, uint8_t *route_tracks) {
+    memset(port_routes, OUTPUT_ROUTING_NO_ROUTE, OUTPUT_MAX_PORTS);
+
+    uint8_t track_voice = 0;
+    for (uint8_t i = 0; i < table->num_routes; i++) {
+        while (table->first[track_voice + 1] <= i) track_voice++;
+        port_routes[table->routes[i].port->index] = i;
+        route_tracks[i] = track_voice / OUTPUT_NUM_VOICES;
+    }
+}
+
+static esp_err_t output_routing_stage_gate(output_transaction_t *tx, output_port_t *port, uint32_t pulse_us, bool level) {
+    // triggers fire when the gate opens and end on their own
+    if (pulse_us) return level ? output_transaction_port_pulse(tx, port, pulse_us) : ESP_OK;
+    return output_transaction_port_set_voltage(tx, port, level ? port->config.vmax_mv : 0);
+}
+
+static esp_err_t output_routing_stage(output_routing_t *routing, output_transaction_t *tx,
+        const output_routing_table_t *table, uint8_t route, uint8_t track) {
+    output_port_t *port = table->routes[route].port;
+    uint32_t pulse_us = table->routes[route].pulse_us;
+
+    switch (table->routes[route].voice) {
+        case OUTPUT_VOICE_PITCH:
+            return output_transaction_port_set_note(tx, port, routing->notes[track]);
+        case OUTPUT_VOICE_VELOCITY:
+            return output_transaction_port_set_voltage(tx, port, OUTPUT_VELOCITY_TO_VOLTAGE(routing->velocities[track]));
+        case OUTPUT_VOICE_GATE:
+            return output_routing_stage_gate(tx, port, pulse_us, routing->velocities[track] > 0);
+        case OUTPUT_VOICE_DRUM:
+            return output_routing_stage_gate(tx, port, pulse_us,
+                routing->drum_masks[track] & (1U << table->routes[route].drum));
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+}
+
+esp_err_t output_routing_set_routes(output_routing_t *routing, const output_route_t *routes, uint8_t num_routes) {
+    output_routing_table_t table;
+
+    ESP_RETURN_ON_ERROR(output_routing_compile(routing, routes, num_routes, &table), TAG, "failed to compile routes");
+
+    // a table set twice before the next tick only applies the last one
+    xSemaphoreTake(routing->lock, portMAX_DELAY);
+    routing->pending = table;
+    routing->has_pending = true;
+    xSemaphoreGive(routing->lock);
+
+    return ESP_OK;
+}
+
+esp_err_t output_routing_apply_pending(output_routing_t *routing, output_transaction_t *tx) {
+    uint8_t old_port_routes[OUTPUT_MAX_PORTS], new_port_routes[OUTPUT_MAX_PORTS];
+    uint8_t old_route_tracks[OUTPUT_ROUTING_MAX_ROUTES], new_route_tracks[OUTPUT_ROUTING_MAX_ROUTES];
+    output_t *output = routing->output;
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(routing->lock, portMAX_DELAY);
+    if (!routing->has_pending) {
+        xSemaphoreGive(routing->lock);
+        return ESP_OK;
+    }
+
+    // the new ports start from the current track state, staged together with the swap
+    const output_routing_table_t *table = &routing->pending;
+    output_routing_port_routes(table, new_port_routes, new_route_tracks);
+    output_routing_port_routes(&routing->table, old_port_routes, old_route_tracks);
+    for (uint8_t i = 0; i < output->num_ports && ret == ESP_OK; i++) {
+        uint8_t old_route = old_port_routes[i], new_route = new_port_routes[i];
+        if (old_route == OUTPUT_ROUTING_NO_ROUTE && new_route == OUTPUT_ROUTING_NO_ROUTE) continue;
+
+        // rerouted triggers rest low until their next rise
+        if (new_route == OUTPUT_ROUTING_NO_ROUTE) {
+            ret = output_transaction_port_set_voltage(tx, &output->ports[i], 0);
+        } else if (old_route == OUTPUT_ROUTING_NO_ROUTE
+                || old_route_tracks[old_route] != new_route_tracks[new_route]
+                || routing->table.routes[old_route].voice != table->routes[new_route].voice
+                || routing->table.routes[old_route].drum != table->routes[new_route].drum
+                || routing->table.routes[old_route].pulse_us != table->routes[new_route].pulse_us) {
+            ret = table->routes[new_route].pulse_us
+                ? output_transaction_port_set_voltage(tx, &output->ports[i], 0)
+                : output_routing_stage(routing, tx, table, new_route, new_route_tracks[new_route]);
+        }
+    }
+    if (ret == ESP_OK) {
+        routing->table = *table;
+        routing->has_pending = false;
+    }
+    xSemaphoreGive(routing->lock);
+
+    ESP_RETURN_ON_ERROR(ret, TAG, "failed to stage rerouted ports");
+    return ESP_OK;
+}
+
+static esp_err_t output_routing_dispatch(output_routing_t *routing, output_transaction_t *tx, uint8_t track,
+        output_voice_t voice, uint16_t drum_changes) {
+    const output_routing_table_t *table = &routing->table;
+    uint8_t track_voice = track * OUTPUT_NUM_VOICES + voice;
+    esp_err_t ret = ESP_OK;
+
+    for (uint8_t i = table->first[track_voice]; i < table->first[track_voice + 1] && ret == ESP_OK; i++) {
+        if (voice == OUTPUT_VOICE_DRUM && !(drum_changes & (1U << table->routes[i].drum))) continue;
+        ret = output_routing_stage(routing, tx, table, i, track);
+    }
+
+    return ret;
+}
+
+static esp_err_t output_routing_retrigger(output_routing_t *routing, output_transaction_t *tx, uint8_t track) {
+    const output_routing_table_t *table = &routing->table;
+    uint8_t track_voice = track * OUTPUT_NUM_VOICES + OUTPUT_VOICE_GATE;
+    esp_err_t ret = ESP_OK;
+
+    for (uint8_t i = table->first[track_voice]; i < table->first[track_voice + 1] && ret == ESP_OK; i++) {
+        if (table->routes[i].pulse_us) ret = output_transaction_port_pulse(tx, table->routes[i].port, table->routes[i].pulse_us);
+    }
+
+    return ret;
+}
+
+esp_err_t output_routing_set_note(output_routing_t *routing, output_transaction_t *tx, uint8_t track, uint8_t note) {
+    ESP_RETURN_ON_FALSE(track < OUTPUT_ROUTING_MAX_TRACKS, ESP_ERR_INVALID_ARG, TAG, "invalid track %d", track);
+
+    // a new note of an open gate fires its triggers again, level gates stay high
+    xSemaphoreTake(routing->lock, portMAX_DELAY);
+    bool retrigger = routing->notes[track] != note && routing->velocities[track] > 0;
+    routing->notes[track] = note;
+    esp_err_t ret = output_routing_dispatch(routing, tx, track, OUTPUT_VOICE_PITCH, 0);
+    if (ret == ESP_OK && retrigger) ret = output_routing_retrigger(routing, tx, track);
+    xSemaphoreGive(routing->lock);
+
+    ESP_RETURN_ON_ERROR(ret, TAG, "failed to stage pitch of track %d", track);
+    return ESP_OK;
+}
+
+esp_err_t output_routing_set_velocity(output_routing_t *routing, output_transaction_t *tx, uint8_t track, uint8_t velocity) {
+    ESP_RETURN_ON_FALSE(track < OUTPUT_ROUTING_MAX_TRACKS, ESP_ERR_INVALID_ARG, TAG, "invalid track %d", track);
+
+    xSemaphoreTake(routing->lock, portMAX_DELAY);
+    bool gate_changes = (routing->velocities[track] > 0) != (velocity > 0);
+    routing->velocities[track] = velocity;
+    esp_err_t ret = output_routing_dispatch(routing, tx, track, OUTPUT_VOICE_VELOCITY, 0);
+    if (ret == ESP_OK && gate_changes) ret = output_routing_dispatch(routing, tx, track, OUTPUT_VOICE_GATE, 0);
+    xSemaphoreGive(routing->lock);
+
+    ESP_RETURN_ON_ERROR(ret, TAG, "failed to stage velocity of track %d", track);
+    return ESP_OK;
+}
+
+esp_err_t output_routing_set_drum_mask(output_routing_t *routing, output_transaction_t *tx, uint8_t track, uint16_t drum_mask) {
+    ESP_RETURN_ON_FALSE(track < OUTPUT_ROUTING_MAX_TRACKS, ESP_ERR_INVALID_ARG, TAG, "invalid track %d", track);
+
+    // only drums that change are staged
+    xSemaphoreTake(routing->lock, portMAX_DELAY);
+    uint16_t drum_changes = routing->drum_masks[track] ^ drum_mask;
+    routing->drum_masks[track] = drum_mask;
+    esp_err_t ret = drum_changes ? output_routing_dispatch(routing, tx, track, OUTPUT_VOICE_DRUM, drum_changes) : ESP_OK;
+    xSemaphoreGive(routing->lock);
+
+    ESP_RETURN_ON_ERROR(ret, TAG, "failed to stage drums of track %d", track);
+    return ESP_OK;
+}
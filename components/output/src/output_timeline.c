@@ -0,0 +1,188 @@
+#include "output_timeline.h"
+
+#include <string.h>
+#include <esp_check.h>
+
+
+#define OUTPUT_TIMELINE_VCD_ID(port) ((char) ('!' + (port)))
+
+
+static const char *TAG = "output_timeline";
+
+
+static void output_timeline_record(output_timeline_t *timeline, int64_t time_us, uint8_t port, uint16_t value) {
+    if (timeline->port_values[port] == value) return;
+    timeline->port_values[port] = value;
+
+    if (timeline->num_records == timeline->max_records) {
+        timeline->num_dropped++;
+        return;
+    }
+
+    // latched duties lie up to one pwm period ahead, so the records are nearly sorted
+    size_t i = timeline->num_records++;
+    while (i > 0 && timeline->records[i - 1].time_us > (uint32_t) time_us) {
+        timeline->records[i] = timeline->records[i - 1];
+        i--;
+    }
+    timeline->records[i] = (output_timeline_record_t) {
+        .time_us = time_us,
+        .port = port,
+        .value = value
+    };
+}
+
+static esp_err_t output_timeline_setup_port(void *context, output_port_t *port) {
+    output_timeline_t *timeline = (output_timeline_t *) context;
+
+    // ports start at 0V
+    timeline->port_values[port->index] = 0;
+    if (port->config.type == OUTPUT_ANALOG) {
+        timeline->channel_duties[port->analog_channel] = 0;
+    } else {
+        timeline->pin_ports[port->config.pin] = port->index;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t output_timeline_teardown_port(void *context, output_port_t *port) {
+    output_timeline_t *timeline = (output_timeline_t *) context;
+
+    if (port->config.type == OUTPUT_DIGITAL) timeline->pin_ports[port->config.pin] = OUTPUT_TIMELINE_NO_PORT;
+
+    return ESP_OK;
+}
+
+static esp_err_t output_timeline_set_duty(void *context, output_port_t *port, uint32_t duty) {
+    output_timeline_t *timeline = (output_timeline_t *) context;
+
+    timeline->channel_duties[port->analog_channel] = duty;
+
+    return ESP_OK;
+}
+
+static esp_err_t output_timeline_update_duty(void *context, output_port_t *port) {
+    output_timeline_t *timeline = (output_timeline_t *) context;
+
+    // like the ledc, a latched duty is used from the next pwm period on
+    int64_t time_us = (timeline->now_us / OUTPUT_PWM_PERIOD_US + 1) * OUTPUT_PWM_PERIOD_US;
+    output_timeline_record(timeline, time_us, port->index, timeline->channel_duties[port->analog_channel]);
+
+    return ESP_OK;
+}
+
+static esp_err_t output_timeline_wait_latch(void *context) {
+    output_timeline_t *timeline = (output_timeline_t *) context;
+
+    // the duties latched at now_us take effect at the next period boundary
+    timeline->now_us = (timeline->now_us / OUTPUT_PWM_PERIOD_US + 1) * OUTPUT_PWM_PERIOD_US;
+
+    return ESP_OK;
+}
+
+static esp_err_t output_timeline_write_levels(void *context, uint64_t set_mask, uint64_t clear_mask) {
+    output_timeline_t *timeline = (output_timeline_t *) context;
+
+    for (uint64_t mask = set_mask | clear_mask; mask; mask &= mask - 1) {
+        uint8_t pin = __builtin_ctzll(mask);
+        ESP_RETURN_ON_FALSE(timeline->pin_ports[pin] != OUTPUT_TIMELINE_NO_PORT, ESP_ERR_INVALID_ARG, TAG,
+            "pin %d is not a digital port", pin);
+        output_timeline_record(timeline, timeline->now_us, timeline->pin_ports[pin], (set_mask >> pin) & 1);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t output_timeline_init(output_timeline_t *timeline, output_timeline_record_t *records, size_t max_records) {
+    ESP_RETURN_ON_FALSE(records && max_records > 0, ESP_ERR_INVALID_ARG, TAG, "no record buffer");
+
+    timeline->backend = (output_backend_t) {
+        .context = timeline,
+        .setup_port = output_timeline_setup_port,
+        .teardown_port = output_timeline_teardown_port,
+        .set_duty = output_timeline_set_duty,
+        .update_duty = output_timeline_update_duty,
+        .wait_latch = output_timeline_wait_latch,
+        .write_levels = output_timeline_write_levels
+    };
+    timeline->records = records;
+    timeline->max_records = max_records;
+    memset(timeline->pin_ports, OUTPUT_TIMELINE_NO_PORT, sizeof(timeline->pin_ports));
+    memset(timeline->channel_duties, 0, sizeof(timeline->channel_duties));
+    output_timeline_clear(timeline);
+
+    return ESP_OK;
+}
+
+void output_timeline_clear(output_timeline_t *timeline) {
+    timeline->now_us = 0;
+    timeline->num_records = 0;
+    timeline->num_dropped = 0;
+}
+
+uint32_t output_timeline_record_voltage(const output_timeline_record_t *record, const output_t *output) {
+    const output_port_t *port = &output->ports[record->port];
+    if (port->config.type == OUTPUT_DIGITAL) return record->value ? port->config.vmax_mv : 0;
+
+    // interpolate between the calibration points around the duty
+    const output_calibration_t *calibration = &port->calibration;
+    uint8_t i = 1;
+    while (i < calibration->num_points - 1 && calibration->points[i].duty < record->value) i++;
+
+    int64_t duty0 = calibration->points[i - 1].duty, duty1 = calibration->points[i].duty;
+    int64_t uv0 = calibration->points[i - 1].uv, uv1 = calibration->points[i].uv;
+    int64_t uv = uv0 + (uv1 - uv0) * ((int64_t) record->value - duty0) / (duty1 - duty0);
+
+    return uv > 0 ? (uv + 500) / 1000 : 0;
+}
+
+esp_err_t output_timeline_export_csv(const output_timeline_t *timeline, const output_t *output, FILE *file) {
+    fprintf(file, "time_us,port,column,row,value,voltage_mv\n");
+    for (size_t i = 0; i < timeline->num_records; i++) {
+        const output_timeline_record_t *record = &timeline->records[i];
+        const output_port_t *port = &output->ports[record->port];
+        fprintf(file, "%u,%u,%u,%u,%u,%u\n", (unsigned) record->time_us, record->port, port->column, port->row,
+            record->value, (unsigned) output_timeline_record_voltage(record, output));
+    }
+
+    ESP_RETURN_ON_FALSE(!ferror(file), ESP_FAIL, TAG, "failed to write csv");
+    return ESP_OK;
+}
+
+esp_err_t output_timeline_export_vcd(const output_timeline_t *timeline, const output_t *output, FILE *file) {
+    // analog ports as voltages in millivolts, digital ports as single wires
+    fprintf(file, "$timescale 1us $end\n$scope module output $end\n");
+    for (uint8_t i = 0; i < output->num_ports; i++) {
+        const output_port_t *port = &output->ports[i];
+        fprintf(file, "$var %s %s %c port_%u_%u $end\n", port->config.type == OUTPUT_ANALOG ? "real" : "wire",
+            port->config.type == OUTPUT_ANALOG ? "64" : "1", OUTPUT_TIMELINE_VCD_ID(i), port->column, port->row);
+    }
+    fprintf(file, "$upscope $end\n$enddefinitions $end\n");
+
+    // all ports start at 0V
+    fprintf(file, "#0\n$dumpvars\n");
+    for (uint8_t i = 0; i < output->num_ports; i++) {
+        fprintf(file, output->ports[i].config.type == OUTPUT_ANALOG ? "r0 %c\n" : "0%c\n", OUTPUT_TIMELINE_VCD_ID(i));
+    }
+    fprintf(file, "$end\n");
+
+    int64_t time_us = 0;
+    for (size_t i = 0; i < timeline->num_records; i++) {
+        const output_timeline_record_t *record = &timeline->records[i];
+        if (record->time_us != time_us) {
+            time_us = record->time_us;
+            fprintf(file, "#%u\n", (unsigned) record->time_us);
+        }
+
+        if (output->ports[record->port].config.type == OUTPUT_ANALOG) {
+            fprintf(file, "r%u %c\n", (unsigned) output_timeline_record_voltage(record, output),
+                OUTPUT_TIMELINE_VCD_ID(record->port));
+        } else {
+            fprintf(file, "%u%c\n", record->value, OUTPUT_TIMELINE_VCD_ID(record->port));
+        }
+    }
+
+    ESP_RETURN_ON_FALSE(!ferror(file), ESP_FAIL, TAG, "failed to write vcd");
+    return ESP_OK;
+}
@@ -0,0 +1,339 @@
+#include "bdd-for-c.h"
+#include "output_pulse.h"
+#include "output_sim.h"
+
+
+#define MAX_WRITES 64
+#define NUM_PORTS 4
+
+// triggers and gates, on the pulse timer
+static const output_port_config_t port_configs[NUM_PORTS] = {
+    { .type = OUTPUT_DIGITAL, .pin = 4, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 5, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 6, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 7, .vmax_mv = 5000 }
+};
+
+
+// a gpio register write of the timer interrupt
+typedef struct {
+    int64_t time_us;
+    uint64_t set_mask, clear_mask;
+} pulse_write_t;
+
+static pulse_write_t writes[MAX_WRITES];
+static int num_writes;
+
+static uint32_t latency_state = 0x2468ACE1;
+
+static uint32_t latency_rand() {
+    latency_state ^= latency_state << 13;
+    latency_state ^= latency_state >> 17;
+    latency_state ^= latency_state << 5;
+    return latency_state;
+}
+
+// stands in for the hardware timer: fires at each alarm plus the interrupt latency
+// and writes one batch of due edges per interrupt, like the interrupt does
+static void run_timer(output_pulse_queue_t *queue, uint32_t max_latency_us) {
+    uint64_t set_mask, clear_mask;
+    int64_t now_us = 0, alarm;
+
+    num_writes = 0;
+    while ((alarm = output_pulse_queue_alarm(queue, now_us)) != OUTPUT_PULSE_NONE) {
+        now_us = alarm + (max_latency_us ? latency_rand() % (max_latency_us + 1) : 0);
+        if (output_pulse_queue_pop_due(queue, now_us, &set_mask, &clear_mask)) {
+            writes[num_writes++] = (pulse_write_t) { now_us, set_mask, clear_mask };
+        }
+    }
+}
+
+static void push_pulse(output_pulse_queue_t *queue, uint8_t pin, int64_t time_us, uint32_t length_us) {
+    const output_pulse_edge_t rise = { time_us, 1ULL << pin, true };
+    const output_pulse_edge_t fall = { time_us + length_us, 1ULL << pin, false };
+    output_pulse_queue_push(queue, &rise);
+    output_pulse_queue_push(queue, &fall);
+}
+
+// time of the first write that sets or clears the pin, or -1
+static int64_t write_time(uint8_t pin, bool level) {
+    for (int i = 0; i < num_writes; i++) {
+        if ((level ? writes[i].set_mask : writes[i].clear_mask) & (1ULL << pin)) return writes[i].time_us;
+    }
+    return -1;
+}
+
+// time of the first simulated level change of the pin after the given one, or -1
+static int64_t sim_level_ns(int pin, uint32_t level, int64_t after_ns) {
+    for (size_t i = 0; i < output_sim.num_events; i++) {
+        const output_sim_event_t *event = &output_sim.events[i];
+        if (event->pin == pin && event->value == level && event->time_ns > after_ns) return event->time_ns;
+    }
+    return -1;
+}
+
+static size_t sim_num_changes(int pin) {
+    size_t n = 0;
+    for (size_t i = 0; i < output_sim.num_events; i++) n += output_sim.events[i].pin == pin;
+    return n;
+}
+
+
+spec("output pulse") {
+    static output_pulse_queue_t queue;
+    static output_t output;
+
+    before_each() {
+        output_pulse_queue_init(&queue);
+
+        output_sim_reset();
+        output_init(&output, &(output_config_t) {
+            .num_columns = 1, .num_rows = NUM_PORTS, .port_configs = port_configs, .backend = &output_sim_backend
+        });
+        output_pulse_init(&output);
+        output_sim_advance(1000000);
+
+        // only the changes after the port setup
+        output_sim.num_events = 0;
+        output_sim.num_gpio_writes = 0;
+    }
+
+    it("should write each edge at its time") {
+        // gates and triggers from 1 to 10 ms, started out of order
+        for (uint8_t pin = 1; pin <= 10; pin++) {
+            push_pulse(&queue, pin, 1000 + (pin * 7919) % 10000, pin * 1000);
+        }
+        run_timer(&queue, 0);
+
+        expect(num_writes) to_be(20);
+        for (int i = 1; i < num_writes; i++) check(writes[i].time_us > writes[i - 1].time_us, "write %d", i);
+        for (uint8_t pin = 1; pin <= 10; pin++) {
+            int64_t start_us = 1000 + (pin * 7919) % 10000;
+            expect(write_time(pin, true)) to_be(start_us);
+            expect(write_time(pin, false)) to_be(start_us + pin * 1000);
+        }
+    }
+
+    it("should keep pulse lengths with interrupt latency") {
+        for (uint8_t pin = 1; pin <= 10; pin++) {
+            push_pulse(&queue, pin, 1000 + pin * 613, pin * 1000);
+        }
+        run_timer(&queue, 20);
+
+        for (uint8_t pin = 1; pin <= 10; pin++) {
+            int64_t start_us = write_time(pin, true);
+            int64_t length_us = write_time(pin, false) - start_us;
+            check(start_us >= 1000 + pin * 613 && start_us <= 1000 + pin * 613 + 20, "pin %d start", pin);
+            check(length_us >= pin * 1000 - 20 && length_us <= pin * 1000 + 20, "pin %d length", pin);
+        }
+    }
+
+    it("should merge edges due at the same instant into one write") {
+        // eight triggers of a drum step, each with its own length
+        for (uint8_t pin = 0; pin < 8; pin++) push_pulse(&queue, pin, 5000, 1000 + pin * 250);
+        // and a gate ending right when they start
+        push_pulse(&queue, 40, 2000, 3000);
+        run_timer(&queue, 0);
+
+        expect(num_writes) to_be(10);
+        expect(writes[1].time_us) to_be(5000);
+        expect(writes[1].set_mask) to_be(0xFF);
+        expect(writes[1].clear_mask) to_be(1ULL << 40);
+    }
+
+    it("should merge edges that became due while the interrupt was late") {
+        push_pulse(&queue, 1, 1000, 5000);
+        push_pulse(&queue, 2, 1003, 5000);
+        push_pulse(&queue, 3, 1010, 5000);
+        run_timer(&queue, 0);
+        expect(num_writes) to_be(6);
+
+        output_pulse_queue_init(&queue);
+        push_pulse(&queue, 1, 1000, 5000);
+        push_pulse(&queue, 2, 1003, 5000);
+        push_pulse(&queue, 3, 1010, 5000);
+
+        uint64_t set_mask, clear_mask;
+        expect(output_pulse_queue_pop_due(&queue, 1010, &set_mask, &clear_mask)) to_be(true);
+        expect(set_mask) to_be(0x0E);
+        expect(clear_mask) to_be(0);
+        expect(output_pulse_queue_next(&queue)) to_be(6000);
+    }
+
+    it("should not lose pulses shorter than the interrupt latency") {
+        push_pulse(&queue, 3, 1000, 1);
+        run_timer(&queue, 0);
+        expect(num_writes) to_be(2);
+
+        // both edges are due at the same time, the pin still goes high and then low
+        push_pulse(&queue, 3, 1000, 1);
+        uint64_t set_mask, clear_mask;
+        expect(output_pulse_queue_pop_due(&queue, 1050, &set_mask, &clear_mask)) to_be(true);
+        expect(set_mask) to_be(1ULL << 3);
+        expect(clear_mask) to_be(0);
+        expect(output_pulse_queue_pop_due(&queue, 1050, &set_mask, &clear_mask)) to_be(true);
+        expect(set_mask) to_be(0);
+        expect(clear_mask) to_be(1ULL << 3);
+        expect(output_pulse_queue_pop_due(&queue, 1050, &set_mask, &clear_mask)) to_be(false);
+    }
+
+    it("should keep the order of edges at the same time") {
+        // a retrigger: the running gate closes and opens again at the next step
+        push_pulse(&queue, 4, 1000, 2000);
+        push_pulse(&queue, 4, 3000, 2000);
+        run_timer(&queue, 0);
+
+        expect(num_writes) to_be(4);
+        expect(writes[1].time_us) to_be(3000);
+        expect(writes[1].clear_mask) to_be(1ULL << 4);
+        // the pin stays low for the minimum width
+        expect(writes[2].time_us) to_be(3000 + OUTPUT_PULSE_MIN_WIDTH_US);
+        expect(writes[2].set_mask) to_be(1ULL << 4);
+    }
+
+    it("should hold overdue changes of a pin apart by the minimum width") {
+        uint64_t set_mask, clear_mask;
+        push_pulse(&queue, 3, 1000, 1);
+        const output_pulse_edge_t other = { 1000, 1ULL << 5, true };
+        output_pulse_queue_push(&queue, &other);
+
+        // the interrupt was late, the rise goes out with the other pin
+        expect(output_pulse_queue_pop_due(&queue, 1050, &set_mask, &clear_mask)) to_be(true);
+        expect(set_mask) to_be((1ULL << 3) | (1ULL << 5));
+        expect(output_pulse_queue_alarm(&queue, 1050)) to_be(1050 + OUTPUT_PULSE_MIN_WIDTH_US);
+
+        // edges of other pins only keep the lead
+        output_pulse_queue_remove(&queue, 1ULL << 3);
+        const output_pulse_edge_t late = { 1000, 1ULL << 6, true };
+        output_pulse_queue_push(&queue, &late);
+        expect(output_pulse_queue_alarm(&queue, 1050)) to_be(1050 + OUTPUT_PULSE_MIN_LEAD_US);
+    }
+
+    it("should drop the pending edges of removed pins only") {
+        const output_pulse_edge_t both = { 1000, (1ULL << 1) | (1ULL << 2), true };
+        output_pulse_queue_push(&queue, &both);
+        push_pulse(&queue, 1, 2000, 100);
+        push_pulse(&queue, 3, 1500, 100);
+
+        output_pulse_queue_remove(&queue, 1ULL << 1);
+        run_timer(&queue, 0);
+
+        expect(num_writes) to_be(3);
+        expect(writes[0].set_mask) to_be(1ULL << 2);
+        expect(write_time(1, true)) to_be(-1);
+        expect(write_time(1, false)) to_be(-1);
+        expect(write_time(3, false)) to_be(1600);
+    }
+
+    it("should not write if nothing is due") {
+        uint64_t set_mask, clear_mask;
+        expect(output_pulse_queue_next(&queue)) to_be(OUTPUT_PULSE_NONE);
+        expect(output_pulse_queue_pop_due(&queue, 1000, &set_mask, &clear_mask)) to_be(false);
+
+        push_pulse(&queue, 1, 2000, 100);
+        expect(output_pulse_queue_pop_due(&queue, 1999, &set_mask, &clear_mask)) to_be(false);
+        expect(output_pulse_queue_next(&queue)) to_be(2000);
+    }
+
+    it("should reject edges if the queue is full") {
+        const output_pulse_edge_t edge = { 1000, 1, true };
+        for (int i = 0; i < OUTPUT_PULSE_MAX_EDGES; i++) expect(output_pulse_queue_push(&queue, &edge)) to_be(true);
+        expect(output_pulse_queue_push(&queue, &edge)) to_be(false);
+        expect(queue.num_edges) to_be(OUTPUT_PULSE_MAX_EDGES);
+    }
+
+    it("should fire the pulse timer at each edge of the ports") {
+        int64_t start_us = esp_timer_get_time();
+        for (uint8_t row = 0; row < NUM_PORTS; row++) {
+            expect(output_pulse(&output, 0, row, start_us + 1000 + row * 300, 500 + row * 1000)) to_be(ESP_OK);
+        }
+        output_sim_run_timer((start_us + 10000) * 1000, 20000);
+
+        expect(output_sim.timer.num_interrupts) to_be(2 * NUM_PORTS);
+        for (uint8_t row = 0; row < NUM_PORTS; row++) {
+            int pin = port_configs[row].pin;
+            int64_t rise_ns = sim_level_ns(pin, 1, 0);
+            int64_t length_ns = sim_level_ns(pin, 0, rise_ns) - rise_ns;
+            check(rise_ns >= (start_us + 1000 + row * 300) * 1000 && rise_ns <= (start_us + 1000 + row * 300 + 21) * 1000,
+                "pin %d rise at %lld ns", pin, (long long) rise_ns);
+            check(length_ns >= (500 + row * 1000 - 21) * 1000 && length_ns <= (500 + row * 1000 + 21) * 1000,
+                "pin %d length %lld ns", pin, (long long) length_ns);
+        }
+    }
+
+    it("should keep the minimum width if the interrupt is late") {
+        int64_t start_us = esp_timer_get_time();
+        expect(output_pulse(&output, 0, 0, start_us + 1000, 1)) to_be(ESP_OK);
+        output_sim_run_timer((start_us + 2000) * 1000, 50000);
+
+        int64_t rise_ns = sim_level_ns(4, 1, 0);
+        int64_t length_ns = sim_level_ns(4, 0, rise_ns) - rise_ns;
+        check(length_ns >= OUTPUT_PULSE_MIN_WIDTH_US * 1000, "length %lld ns", (long long) length_ns);
+        expect(output_sim.timer.num_interrupts) to_be(2);
+    }
+
+    it("should start transaction pulses with the commit and end them on the timer") {
+        output_transaction_t tx;
+        output_transaction_begin(&output, &tx);
+        expect(output_transaction_pulse(&tx, 0, 0, 1000)) to_be(ESP_OK);
+        expect(output_transaction_set_voltage(&tx, 0, 1, 5000)) to_be(ESP_OK);
+        int64_t commit_ns = output_sim.now_ns;
+        expect(output_transaction_commit(&tx)) to_be(ESP_OK);
+
+        // both rise with one write, the gate stays
+        expect(output_sim.num_gpio_writes) to_be(1);
+        expect(sim_level_ns(4, 1, 0)) to_be(commit_ns);
+        expect(sim_level_ns(5, 1, 0)) to_be(commit_ns);
+        expect(output_port_get(&output, 0, 0)->value_mv) to_be(0);
+
+        output_sim_run_timer(commit_ns + 5000000, 10000);
+        int64_t length_ns = sim_level_ns(4, 0, 0) - commit_ns;
+        check(length_ns >= 1000000 && length_ns <= 1011000, "length %lld ns", (long long) length_ns);
+        expect(sim_level_ns(5, 0, 0)) to_be(-1);
+    }
+
+    it("should restart a running pulse when it is triggered again") {
+        output_transaction_t tx;
+        output_transaction_begin(&output, &tx);
+        output_transaction_pulse(&tx, 0, 0, 1000);
+        expect(output_transaction_commit(&tx)) to_be(ESP_OK);
+
+        output_sim_run_timer(output_sim.now_ns + 600000, 0);
+        int64_t retrigger_ns = output_sim.now_ns;
+        output_transaction_pulse(&tx, 0, 0, 1000);
+        expect(output_transaction_commit(&tx)) to_be(ESP_OK);
+        output_sim_run_timer(output_sim.now_ns + 5000000, 0);
+
+        // the end of the first pulse is dropped
+        expect(sim_num_changes(4)) to_be(3);
+        int64_t length_ns = sim_level_ns(4, 0, 0) - retrigger_ns;
+        check(length_ns >= 999000 && length_ns <= 1001000, "length %lld ns", (long long) length_ns);
+    }
+
+    it("should end a pulse right away if the queue is full") {
+        int64_t start_us = esp_timer_get_time();
+        for (int i = 0; i < OUTPUT_PULSE_MAX_EDGES / 2; i++) {
+            expect(output_pulse(&output, 0, 1, start_us + 1000 + i * 100, 50)) to_be(ESP_OK);
+        }
+
+        output_transaction_t tx;
+        output_transaction_begin(&output, &tx);
+        output_transaction_pulse(&tx, 0, 0, 1000);
+        expect(output_transaction_commit(&tx)) to_be(ESP_ERR_NO_MEM);
+        expect(sim_num_changes(4)) to_be(2);
+    }
+
+    it("should reject pulses without the pulse timer or on analog ports") {
+        static const output_port_config_t analog_config = { .type = OUTPUT_ANALOG, .pin = 2, .vmax_mv = 5000 };
+        output_t analog_output;
+        output_init(&analog_output, &(output_config_t) {
+            .num_columns = 1, .num_rows = 1, .port_configs = &analog_config, .backend = &output_sim_backend
+        });
+
+        output_transaction_t tx;
+        output_transaction_begin(&analog_output, &tx);
+        expect(output_transaction_pulse(&tx, 0, 0, 1000)) to_be(ESP_ERR_INVALID_STATE);
+        analog_output.pulse_timer_ready = true;
+        expect(output_transaction_pulse(&tx, 0, 0, 1000)) to_be(ESP_ERR_INVALID_ARG);
+    }
+}
@@ -0,0 +1,365 @@
+#include "bdd-for-c.h"
+#include "output_routing.h"
+#include "output_sim.h"
+
+
+#define NUM_TRACKS 4
+
+// one column per track: pitch, velocity and gate
+static const output_port_config_t port_configs[] = {
+    { .type = OUTPUT_ANALOG, .pin = 1, .vmax_mv = 5000 },
+    { .type = OUTPUT_ANALOG, .pin = 2, .vmax_mv = 5000 },
+    { .type = OUTPUT_ANALOG, .pin = 3, .vmax_mv = 5000 },
+    { .type = OUTPUT_ANALOG, .pin = 4, .vmax_mv = 5000 },
+    { .type = OUTPUT_ANALOG, .pin = 5, .vmax_mv = 5000 },
+    { .type = OUTPUT_ANALOG, .pin = 6, .vmax_mv = 5000 },
+    { .type = OUTPUT_ANALOG, .pin = 7, .vmax_mv = 5000 },
+    { .type = OUTPUT_ANALOG, .pin = 8, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 9, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 10, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 11, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 12, .vmax_mv = 5000 }
+};
+
+static const output_route_t track_routes[] = {
+    { .track = 0, .voice = OUTPUT_VOICE_PITCH, .column = 0, .row = 0 },
+    { .track = 0, .voice = OUTPUT_VOICE_VELOCITY, .column = 0, .row = 1 },
+    { .track = 0, .voice = OUTPUT_VOICE_GATE, .column = 0, .row = 2 },
+    { .track = 1, .voice = OUTPUT_VOICE_PITCH, .column = 1, .row = 0 },
+    { .track = 1, .voice = OUTPUT_VOICE_VELOCITY, .column = 1, .row = 1 },
+    { .track = 1, .voice = OUTPUT_VOICE_GATE, .column = 1, .row = 2 },
+    { .track = 2, .voice = OUTPUT_VOICE_PITCH, .column = 2, .row = 0 },
+    { .track = 2, .voice = OUTPUT_VOICE_VELOCITY, .column = 2, .row = 1 },
+    { .track = 2, .voice = OUTPUT_VOICE_GATE, .column = 2, .row = 2 },
+    { .track = 3, .voice = OUTPUT_VOICE_PITCH, .column = 3, .row = 0 },
+    { .track = 3, .voice = OUTPUT_VOICE_VELOCITY, .column = 3, .row = 1 },
+    { .track = 3, .voice = OUTPUT_VOICE_GATE, .column = 3, .row = 2 }
+};
+
+#define NUM_TRACK_ROUTES (sizeof(track_routes) / sizeof(track_routes[0]))
+
+// a drum track on a bank of 16 trigger outputs
+#define NUM_DRUMS 16
+#define DRUM_PIN(drum) (1 + (drum))
+
+static output_port_config_t drum_port_configs[NUM_DRUMS];
+static output_route_t drum_routes[NUM_DRUMS];
+
+
+static size_t count_events(size_t first_event, int pin) {
+    size_t count = 0;
+    for (size_t i = first_event; i < output_sim.num_events; i++) {
+        if (output_sim.events[i].pin == pin) count++;
+    }
+    return count;
+}
+
+// drum pins that changed since the given event, as set and clear masks
+static void drum_edges(size_t first_event, uint16_t *rising, uint16_t *falling) {
+    *rising = *falling = 0;
+    for (size_t i = first_event; i < output_sim.num_events; i++) {
+        uint16_t bit = 1U << (output_sim.events[i].pin - DRUM_PIN(0));
+        if (output_sim.events[i].value) {
+            *rising |= bit;
+        } else {
+            *falling |= bit;
+        }
+    }
+}
+
+// replaces the routes right away, like a tick without track events
+static esp_err_t set_routes(output_routing_t *routing, const output_route_t *routes, uint8_t num_routes) {
+    output_transaction_t tx;
+    esp_err_t ret = output_routing_set_routes(routing, routes, num_routes);
+    if (ret != ESP_OK) return ret;
+
+    output_transaction_begin(routing->output, &tx);
+    ret = output_routing_apply_pending(routing, &tx);
+    if (ret == ESP_OK) ret = output_transaction_commit(&tx);
+    return ret;
+}
+
+static void play_drums(output_routing_t *routing, uint16_t drum_mask) {
+    output_transaction_t tx;
+    output_transaction_begin(routing->output, &tx);
+    output_routing_set_drum_mask(routing, &tx, 0, drum_mask);
+    output_transaction_commit(&tx);
+}
+
+static void play(output_routing_t *routing, uint8_t track, uint8_t note, uint8_t velocity) {
+    output_transaction_t tx;
+    output_transaction_begin(routing->output, &tx);
+    output_routing_set_note(routing, &tx, track, note);
+    output_routing_set_velocity(routing, &tx, track, velocity);
+    output_transaction_commit(&tx);
+}
+
+
+spec("output routing") {
+    static output_t output;
+    static output_routing_t routing;
+
+    before_each() {
+        output_sim_reset();
+
+        const output_config_t config = {
+            .num_columns = NUM_TRACKS,
+            .num_rows = 3,
+            .port_configs = port_configs,
+            .backend = &output_sim_backend
+        };
+        output_init(&output, &config);
+        output_routing_init(&routing, &output);
+        set_routes(&routing, track_routes, NUM_TRACK_ROUTES);
+
+        output_sim_advance(10 * OUTPUT_SIM_PWM_PERIOD_NS + 37000);
+        output_sim.num_events = 0;
+    }
+
+    it("should drive the ports of each track") {
+        for (uint8_t track = 0; track < NUM_TRACKS; track++) play(&routing, track, 24 + track * 12, 32 + track * 16);
+
+        for (uint8_t track = 0; track < NUM_TRACKS; track++) {
+            expect(output_port_get(&output, track, 0)->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(24 + track * 12));
+            expect(output_port_get(&output, track, 1)->value_mv) to_be(OUTPUT_VELOCITY_TO_VOLTAGE(32 + track * 16));
+            expect(output_port_get(&output, track, 2)->value_mv) to_be(5000);
+        }
+
+        play(&routing, 2, 36, 0);
+        expect(output_port_get(&output, 2, 1)->value_mv) to_be(0);
+        expect(output_port_get(&output, 2, 2)->value_mv) to_be(0);
+        expect(output_port_get(&output, 1, 2)->value_mv) to_be(5000);
+    }
+
+    it("should stage only the ports of the changed track voice") {
+        output_transaction_t tx;
+        output_transaction_begin(&output, &tx);
+
+        expect(output_routing_set_note(&routing, &tx, 1, 40)) to_be(ESP_OK);
+        expect(tx.num_ports) to_be(1);
+        expect(tx.staged[0].port) to_be(output_port_get(&output, 1, 0));
+
+        // the gate opens with the first velocity, then only the velocity changes
+        expect(output_routing_set_velocity(&routing, &tx, 1, 100)) to_be(ESP_OK);
+        expect(tx.num_ports) to_be(3);
+        output_transaction_commit(&tx);
+
+        expect(output_routing_set_velocity(&routing, &tx, 1, 90)) to_be(ESP_OK);
+        expect(tx.num_ports) to_be(1);
+        expect(tx.staged[0].port) to_be(output_port_get(&output, 1, 1));
+    }
+
+    it("should ignore tracks without routes") {
+        output_transaction_t tx;
+        output_transaction_begin(&output, &tx);
+        expect(output_routing_set_note(&routing, &tx, 5, 40)) to_be(ESP_OK);
+        expect(output_routing_set_velocity(&routing, &tx, 5, 100)) to_be(ESP_OK);
+        expect(tx.num_ports) to_be(0);
+        expect(output_routing_set_note(&routing, &tx, OUTPUT_ROUTING_MAX_TRACKS, 40)) to_be(ESP_ERR_INVALID_ARG);
+    }
+
+    it("should change routes without glitches") {
+        for (uint8_t track = 0; track < NUM_TRACKS; track++) play(&routing, track, 24 + track * 12, 127);
+        size_t first = output_sim.num_events;
+
+        // tracks 0 and 1 swap their pitch ports, track 3 gives up its velocity port
+        output_route_t routes[NUM_TRACK_ROUTES];
+        memcpy(routes, track_routes, sizeof(routes));
+        routes[0].column = 1;
+        routes[3].column = 0;
+        expect(set_routes(&routing, routes, NUM_TRACK_ROUTES - 2)) to_be(ESP_OK);
+
+        // the swapped ports move straight to their new pitch, in one pwm period
+        expect(count_events(first, 1)) to_be(1);
+        expect(output_port_get(&output, 0, 0)->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(36));
+        expect(output_port_get(&output, 1, 0)->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(24));
+        expect(count_events(first, 2)) to_be(1);
+        check(output_sim_spread_ns(first) <= OUTPUT_SIM_PWM_PERIOD_NS);
+
+        // the unrouted ports close, all others are left alone
+        expect(output_port_get(&output, 3, 1)->value_mv) to_be(0);
+        expect(output_port_get(&output, 3, 2)->value_mv) to_be(0);
+        expect(output_sim.num_events - first) to_be(4);
+
+        // events follow the new routes
+        play(&routing, 0, 60, 127);
+        expect(output_port_get(&output, 1, 0)->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(60));
+        expect(output_port_get(&output, 0, 0)->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(36));
+    }
+
+    it("should apply routes set during a tick with the next one") {
+        play(&routing, 1, 36, 127);
+
+        // tracks 0 and 1 swap their pitch ports while a tick of track 0 is staged
+        output_transaction_t tx;
+        output_transaction_begin(&output, &tx);
+        expect(output_routing_apply_pending(&routing, &tx)) to_be(ESP_OK);
+        output_routing_set_note(&routing, &tx, 0, 60);
+
+        output_route_t routes[NUM_TRACK_ROUTES];
+        memcpy(routes, track_routes, sizeof(routes));
+        routes[0].column = 1;
+        routes[3].column = 0;
+        expect(output_routing_set_routes(&routing, routes, NUM_TRACK_ROUTES)) to_be(ESP_OK);
+
+        output_routing_set_velocity(&routing, &tx, 0, 127);
+        expect(output_transaction_commit(&tx)) to_be(ESP_OK);
+
+        // the whole tick still follows the old routes
+        expect(output_port_get(&output, 0, 0)->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(60));
+        expect(output_port_get(&output, 1, 0)->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(36));
+        expect(output_port_get(&output, 0, 2)->value_mv) to_be(5000);
+
+        // the next tick swaps them, before any track event
+        output_transaction_begin(&output, &tx);
+        expect(output_routing_apply_pending(&routing, &tx)) to_be(ESP_OK);
+        expect(tx.num_ports) to_be(2);
+        expect(output_transaction_commit(&tx)) to_be(ESP_OK);
+        expect(output_port_get(&output, 0, 0)->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(36));
+        expect(output_port_get(&output, 1, 0)->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(60));
+
+        // and only once
+        output_transaction_begin(&output, &tx);
+        expect(output_routing_apply_pending(&routing, &tx)) to_be(ESP_OK);
+        expect(tx.num_ports) to_be(0);
+    }
+
+    it("should not touch any port if the routes do not change") {
+        play(&routing, 0, 48, 127);
+        size_t first = output_sim.num_events;
+
+        expect(set_routes(&routing, track_routes, NUM_TRACK_ROUTES)) to_be(ESP_OK);
+        expect(output_sim.num_events) to_be(first);
+    }
+
+    it("should gate ports from the drum mask") {
+        const output_route_t drum_routes[] = {
+            { .track = 2, .voice = OUTPUT_VOICE_DRUM, .drum = 0, .column = 0, .row = 2 },
+            { .track = 2, .voice = OUTPUT_VOICE_DRUM, .drum = 3, .column = 1, .row = 2 },
+            { .track = 2, .voice = OUTPUT_VOICE_DRUM, .drum = 7, .column = 2, .row = 2 }
+        };
+        expect(set_routes(&routing, drum_routes, 3)) to_be(ESP_OK);
+
+        output_transaction_t tx;
+        output_transaction_begin(&output, &tx);
+        expect(output_routing_set_drum_mask(&routing, &tx, 2, 0x0009)) to_be(ESP_OK);
+        expect(tx.num_ports) to_be(2);
+        output_transaction_commit(&tx);
+        expect(output_port_get(&output, 0, 2)->value_mv) to_be(5000);
+        expect(output_port_get(&output, 1, 2)->value_mv) to_be(5000);
+        expect(output_port_get(&output, 2, 2)->value_mv) to_be(0);
+
+        // only drum 0 changes
+        expect(output_routing_set_drum_mask(&routing, &tx, 2, 0x0008)) to_be(ESP_OK);
+        expect(tx.num_ports) to_be(1);
+        expect(tx.staged[0].port) to_be(output_port_get(&output, 0, 2));
+    }
+
+    it("should write the edges of a drum step with one register pair") {
+        for (uint8_t drum = 0; drum < NUM_DRUMS; drum++) {
+            drum_port_configs[drum] = (output_port_config_t) { .type = OUTPUT_DIGITAL, .pin = DRUM_PIN(drum), .vmax_mv = 5000 };
+            drum_routes[drum] = (output_route_t) { .track = 0, .voice = OUTPUT_VOICE_DRUM, .drum = drum, .column = drum, .row = 0 };
+        }
+        const output_config_t config = {
+            .num_columns = NUM_DRUMS,
+            .num_rows = 1,
+            .port_configs = drum_port_configs,
+            .backend = &output_sim_backend
+        };
+        output_init(&output, &config);
+        output_routing_init(&routing, &output);
+        expect(set_routes(&routing, drum_routes, NUM_DRUMS)) to_be(ESP_OK);
+
+        // each step only writes the drums whose bit changed, all in the same cycle
+        const uint16_t steps[] = { 0xFFFF, 0x00F0, 0x0F0F, 0x0F0F, 0x8001, 0x0000 };
+        uint16_t previous = 0, rising, falling;
+        for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+            size_t first = output_sim.num_events = 0;
+            output_sim.num_gpio_writes = 0;
+
+            play_drums(&routing, steps[i]);
+            drum_edges(first, &rising, &falling);
+
+            expect(rising) to_be(steps[i] & ~previous);
+            expect(falling) to_be(previous & ~steps[i]);
+            expect(output_sim.num_gpio_writes) to_be(steps[i] != previous ? 1 : 0);
+            expect(output_sim_spread_ns(first)) to_be(0);
+            previous = steps[i];
+        }
+    }
+
+    it("should fire triggers when the gate opens and on each new note") {
+        output_route_t routes[NUM_TRACK_ROUTES];
+        memcpy(routes, track_routes, sizeof(routes));
+        routes[2].pulse_us = 2000;
+        output_pulse_init(&output);
+        expect(set_routes(&routing, routes, NUM_TRACK_ROUTES)) to_be(ESP_OK);
+        size_t first = output_sim.num_events;
+
+        // the trigger ends on the pulse timer, its port rests low
+        play(&routing, 0, 60, 100);
+        expect(count_events(first, 9)) to_be(1);
+        expect(output_port_get(&output, 0, 2)->value_mv) to_be(0);
+        output_sim_run_timer(output_sim.now_ns + 5000000, 0);
+        expect(count_events(first, 9)) to_be(2);
+
+        // a new note fires again, a new velocity does not
+        play(&routing, 0, 62, 100);
+        output_sim_run_timer(output_sim.now_ns + 5000000, 0);
+        expect(count_events(first, 9)) to_be(4);
+        play(&routing, 0, 62, 64);
+        play(&routing, 0, 62, 0);
+        output_sim_run_timer(output_sim.now_ns + 5000000, 0);
+        expect(count_events(first, 9)) to_be(4);
+
+        // level gates of the other tracks stay
+        play(&routing, 1, 60, 100);
+        output_sim_run_timer(output_sim.now_ns + 5000000, 0);
+        expect(output_port_get(&output, 1, 2)->value_mv) to_be(5000);
+    }
+
+    it("should fire drum triggers for the rising bits only") {
+        const output_route_t drum_routes[] = {
+            { .track = 0, .voice = OUTPUT_VOICE_DRUM, .drum = 0, .column = 0, .row = 2, .pulse_us = 1000 },
+            { .track = 0, .voice = OUTPUT_VOICE_DRUM, .drum = 3, .column = 1, .row = 2, .pulse_us = 1000 }
+        };
+        output_pulse_init(&output);
+        expect(set_routes(&routing, drum_routes, 2)) to_be(ESP_OK);
+        size_t first = output_sim.num_events;
+
+        play_drums(&routing, 0x0009);
+        play_drums(&routing, 0x0008);
+        output_sim_run_timer(output_sim.now_ns + 5000000, 0);
+        expect(count_events(first, 9)) to_be(2);
+        expect(count_events(first, 10)) to_be(2);
+
+        play_drums(&routing, 0x0009);
+        output_sim_run_timer(output_sim.now_ns + 5000000, 0);
+        expect(count_events(first, 9)) to_be(4);
+        expect(count_events(first, 10)) to_be(2);
+    }
+
+    it("should reject invalid routes and keep the previous ones") {
+        output_route_t routes[2] = {
+            { .track = 0, .voice = OUTPUT_VOICE_PITCH, .column = 0, .row = 0 },
+            { .track = 1, .voice = OUTPUT_VOICE_PITCH, .column = 0, .row = 0 }
+        };
+        expect(set_routes(&routing, routes, 2)) to_be(ESP_ERR_INVALID_ARG);
+
+        routes[1] = (output_route_t) { .track = 1, .voice = OUTPUT_VOICE_PITCH, .column = 1, .row = 2 };
+        expect(set_routes(&routing, routes, 2)) to_be(ESP_ERR_INVALID_ARG);
+
+        routes[1] = (output_route_t) { .track = OUTPUT_ROUTING_MAX_TRACKS, .voice = OUTPUT_VOICE_GATE, .column = 1, .row = 2 };
+        expect(set_routes(&routing, routes, 2)) to_be(ESP_ERR_INVALID_ARG);
+
+        routes[1] = (output_route_t) { .track = 1, .voice = OUTPUT_VOICE_DRUM, .drum = OUTPUT_ROUTING_NUM_DRUMS, .column = 1, .row = 2 };
+        expect(set_routes(&routing, routes, 2)) to_be(ESP_ERR_INVALID_ARG);
+
+        // triggers only on digital gate ports
+        routes[1] = (output_route_t) { .track = 1, .voice = OUTPUT_VOICE_GATE, .column = 1, .row = 1, .pulse_us = 1000 };
+        expect(set_routes(&routing, routes, 2)) to_be(ESP_ERR_INVALID_ARG);
+
+        play(&routing, 3, 50, 127);
+        expect(output_port_get(&output, 3, 0)->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(50));
+    }
+}
@@ -0,0 +1,170 @@
+#include "output_sim.h"
+#include <string.h>
+#include <freertos/semphr.h>
+
+
+output_sim_t output_sim;
+
+
+void output_sim_reset() {
+    memset(&output_sim, 0, sizeof(output_sim));
+}
+
+void output_sim_advance(int64_t ns) {
+    output_sim.now_ns += ns;
+}
+
+static uint32_t output_sim_latency_state = 0x2468ACE1;
+
+static uint32_t output_sim_latency_rand() {
+    output_sim_latency_state ^= output_sim_latency_state << 13;
+    output_sim_latency_state ^= output_sim_latency_state >> 17;
+    output_sim_latency_state ^= output_sim_latency_state << 5;
+    return output_sim_latency_state;
+}
+
+void output_sim_run_timer(int64_t until_ns, int64_t max_latency_ns) {
+    output_sim_timer_t *timer = &output_sim.timer;
+
+    // the alarm is disabled when it fires, the interrupt arms the next one
+    while (timer->running && timer->alarm_enabled && timer->start_ns + (int64_t) timer->alarm * 1000 <= until_ns) {
+        int64_t fire_ns = timer->start_ns + (int64_t) timer->alarm * 1000;
+        if (max_latency_ns) fire_ns += output_sim_latency_rand() % (max_latency_ns + 1);
+        if (fire_ns > output_sim.now_ns) output_sim.now_ns = fire_ns;
+
+        timer->alarm_enabled = false;
+        timer->num_interrupts++;
+        timer->isr(timer->arg);
+    }
+
+    if (output_sim.now_ns < until_ns) output_sim.now_ns = until_ns;
+}
+
+static void output_sim_record(int64_t time_ns, int pin, uint32_t value) {
+    if (output_sim.num_events < OUTPUT_SIM_MAX_EVENTS) {
+        output_sim.events[output_sim.num_events++] = (output_sim_event_t) {
+            .time_ns = time_ns,
+            .pin = pin,
+            .value = value
+        };
+    }
+}
+
+int64_t output_sim_spread_ns(size_t first_event) {
+    int64_t min = INT64_MAX, max = INT64_MIN;
+
+    for (size_t i = first_event; i < output_sim.num_events; i++) {
+        if (output_sim.events[i].time_ns < min) min = output_sim.events[i].time_ns;
+        if (output_sim.events[i].time_ns > max) max = output_sim.events[i].time_ns;
+    }
+
+    return max >= min ? max - min : 0;
+}
+
+
+static esp_err_t output_sim_setup_port(void *context, output_port_t *port) {
+    if (port->config.type == OUTPUT_ANALOG) {
+        output_sim.channel_pins[port->analog_channel] = port->config.pin;
+        output_sim.channel_duties[port->analog_channel] = 0;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t output_sim_set_duty(void *context, output_port_t *port, uint32_t duty) {
+    output_sim.channel_duties[port->analog_channel] = duty;
+    output_sim.now_ns += OUTPUT_SIM_SET_DUTY_NS;
+    return ESP_OK;
+}
+
+static esp_err_t output_sim_update_duty(void *context, output_port_t *port) {
+    // the new duty is used from the next pwm period on
+    int64_t period = OUTPUT_SIM_PWM_PERIOD_NS;
+    int64_t latch_ns = (output_sim.now_ns / period + 1) * period;
+    output_sim_record(latch_ns, port->config.pin, output_sim.channel_duties[port->analog_channel]);
+    if (latch_ns > output_sim.latch_ns) output_sim.latch_ns = latch_ns;
+
+    output_sim.now_ns += OUTPUT_SIM_UPDATE_DUTY_NS;
+    return ESP_OK;
+}
+
+static esp_err_t output_sim_wait_latch(void *context) {
+    if (output_sim.now_ns < output_sim.latch_ns) output_sim.now_ns = output_sim.latch_ns;
+    return ESP_OK;
+}
+
+static esp_err_t output_sim_write_levels(void *context, uint64_t set_mask, uint64_t clear_mask) {
+    // all pins of the write change at once
+    for (int pin = 0; pin < 64; pin++) {
+        if ((set_mask | clear_mask) & (1ULL << pin)) output_sim_record(output_sim.now_ns, pin, (set_mask >> pin) & 1);
+    }
+    output_sim.num_gpio_writes++;
+    output_sim.now_ns += OUTPUT_SIM_SET_LEVEL_NS;
+    return ESP_OK;
+}
+
+const output_backend_t output_sim_backend = {
+    .setup_port = output_sim_setup_port,
+    .set_duty = output_sim_set_duty,
+    .update_duty = output_sim_update_duty,
+    .wait_latch = output_sim_wait_latch,
+    .write_levels = output_sim_write_levels
+};
+
+int64_t esp_timer_get_time(void) {
+    return output_sim.now_ns / 1000;
+}
+
+esp_err_t timer_init(timer_group_t group, timer_idx_t timer, const timer_config_t *config) {
+    return ESP_OK;
+}
+
+esp_err_t timer_set_counter_value(timer_group_t group, timer_idx_t timer, uint64_t value) {
+    output_sim.timer.start_ns = output_sim.now_ns - (int64_t) value * 1000;
+    return ESP_OK;
+}
+
+esp_err_t timer_isr_callback_add(timer_group_t group, timer_idx_t timer, timer_isr_t isr, void *arg, int flags) {
+    output_sim.timer.isr = isr;
+    output_sim.timer.arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t timer_start(timer_group_t group, timer_idx_t timer) {
+    output_sim.timer.running = true;
+    return ESP_OK;
+}
+
+uint64_t timer_group_get_counter_value_in_isr(timer_group_t group, timer_idx_t timer) {
+    return (output_sim.now_ns - output_sim.timer.start_ns) / 1000;
+}
+
+void timer_group_set_alarm_value_in_isr(timer_group_t group, timer_idx_t timer, uint64_t alarm) {
+    output_sim.timer.alarm = alarm;
+}
+
+void timer_group_enable_alarm_in_isr(timer_group_t group, timer_idx_t timer) {
+    output_sim.timer.alarm_enabled = true;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+    // the update timer is driven by calling output_update directly
+    *handle = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t handle, uint64_t period_us) {
+    return ESP_OK;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    static int lock;
+    return (SemaphoreHandle_t) &lock;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t lock, TickType_t timeout) {
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t lock) {
+    return pdTRUE;
+}
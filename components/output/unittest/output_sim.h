@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <driver/timer.h>
+#include "output.h"
+
+
+#define OUTPUT_SIM_MAX_EVENTS 64
+#define OUTPUT_SIM_PWM_PERIOD_NS (1000000000LL / OUTPUT_PWM_FREQUENCY)
+
+// cpu time spent in the driver calls, the outputs do not wait for them
+#define OUTPUT_SIM_SET_DUTY_NS 2000
+#define OUTPUT_SIM_UPDATE_DUTY_NS 1500
+#define OUTPUT_SIM_SET_LEVEL_NS 300
+
+
+// a change of an output pin, duty for pwm pins and level for digital pins
+typedef struct {
+    int64_t time_ns;
+    int pin;
+    uint32_t value;
+} output_sim_event_t;
+
+// the pulse timer of the timer group, counting microseconds of the simulated time
+typedef struct {
+    timer_isr_t isr;
+    void *arg;
+    bool running;
+    int64_t start_ns; // simulated time at count 0
+    bool alarm_enabled;
+    uint64_t alarm;
+    uint32_t num_interrupts;
+} output_sim_timer_t;
+
+typedef struct {
+    int64_t now_ns;
+
+    int channel_pins[LEDC_CHANNEL_MAX];
+    uint32_t channel_duties[LEDC_CHANNEL_MAX]; // written, but not latched yet
+    int64_t latch_ns; // when the last latched duty takes effect
+
+    output_sim_event_t events[OUTPUT_SIM_MAX_EVENTS];
+    size_t num_events;
+    size_t num_gpio_writes; // set and clear register pairs
+
+    output_sim_timer_t timer;
+} output_sim_t;
+
+
+// simulated ledc and gpio backend. A latched duty takes effect at the end of the
+// current pwm period, like the ledc peripheral, gpio levels change immediately
+extern output_sim_t output_sim;
+extern const output_backend_t output_sim_backend;
+
+void output_sim_reset();
+void output_sim_advance(int64_t ns);
+
+// advances to `until_ns`, firing the pulse timer interrupt at each alarm on the way, up to
+// `max_latency_ns` late. esp_timer_get_time follows the simulated time
+void output_sim_run_timer(int64_t until_ns, int64_t max_latency_ns);
+
+// time between the first and the last pin change since the given event
+int64_t output_sim_spread_ns(size_t first_event);
@@ -0,0 +1,506 @@
+#include <math.h>
+#include "bdd-for-c.h"
+#include "output.h"
+#include "output_sim.h"
+
+
+#define PIN_PITCH 2
+#define PIN_VELOCITY 3
+#define PIN_GATE 4
+#define PIN_MOD 5
+
+#define UPDATE_INTERVAL_US 100
+#define GLIDE_TIME_US 10000
+#define GLIDE_STEPS (GLIDE_TIME_US / UPDATE_INTERVAL_US)
+
+
+static const output_port_config_t port_configs[] = {
+    { .type = OUTPUT_ANALOG, .pin = PIN_PITCH, .vmax_mv = 5000 },
+    { .type = OUTPUT_ANALOG, .pin = PIN_VELOCITY, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = PIN_GATE, .vmax_mv = 5000 },
+    { .type = OUTPUT_ANALOG, .pin = PIN_MOD, .vmax_mv = 5000 }
+};
+
+// a measured dac: offset, gain error and a bow from the output filter load
+#define DAC_OFFSET_MV 4.0
+#define DAC_GAIN 0.985
+#define DAC_BOW 0.02
+
+static double dac_output_mv(double duty) {
+    double x = duty / OUTPUT_PWM_DUTY_MAX;
+    return DAC_OFFSET_MV + 5000.0 * DAC_GAIN * x * (1.0 + DAC_BOW * (1.0 - x));
+}
+
+static void dac_calibrate(output_calibration_t *calibration, uint8_t num_points) {
+    calibration->num_points = num_points;
+    for (uint8_t i = 0; i < num_points; i++) {
+        uint16_t duty = i * OUTPUT_PWM_DUTY_MAX / (num_points - 1);
+        calibration->points[i].duty = duty;
+        calibration->points[i].uv = lround(dac_output_mv(duty) * 1000.0);
+    }
+}
+
+// worst pitch error over all notes the dac can reach, at the fractional duty
+static double dac_max_error_cents(output_port_t *port) {
+    double max_error = 0;
+    for (uint8_t note = 0; note < OUTPUT_NUM_NOTES; note++) {
+        double target_mv = note * 1000.0 / 12;
+        if (target_mv < DAC_OFFSET_MV || target_mv > dac_output_mv(OUTPUT_PWM_DUTY_MAX)) continue;
+
+        double duty = (double) port->note_duties[note] / (1 << OUTPUT_DUTY_FRAC_BITS);
+        double error = fabs(dac_output_mv(duty) - target_mv) * 1200.0 / 1000.0;
+        if (error > max_error) max_error = error;
+    }
+    return max_error;
+}
+
+// rc output filter of a pitch output, fed with the mean voltage of each dither interval
+#define FILTER_TAU_US 2000.0
+
+// worst pitch error of the filtered output over all notes, after the filter settled
+static double filtered_max_error_cents(output_t *output, output_port_t *port) {
+    const double alpha = 1.0 - exp(-UPDATE_INTERVAL_US / FILTER_TAU_US);
+    double max_error = 0;
+
+    for (uint8_t note = 0; note < 60; note++) {
+        output_transaction_t tx;
+        output_transaction_begin(output, &tx);
+        output_transaction_port_set_note(&tx, port, note);
+        output_transaction_commit(&tx);
+
+        double target_mv = note * 1000.0 / 12, filtered_mv = target_mv;
+        for (int step = 0; step < 300; step++) {
+            double duty = output_sim.channel_duties[port->analog_channel];
+            filtered_mv += (duty * 5000.0 / OUTPUT_PWM_DUTY_MAX - filtered_mv) * alpha;
+            output_update(output);
+
+            double error = fabs(filtered_mv - target_mv) * 1200.0 / 1000.0;
+            if (step >= 100 && error > max_error) max_error = error;
+        }
+    }
+    return max_error;
+}
+
+static void set_voltage_now(output_t *output, output_port_t *port, uint32_t value_mv) {
+    output_transaction_t tx;
+    output_transaction_begin(output, &tx);
+    output_transaction_port_set_voltage(&tx, port, value_mv);
+    output_transaction_commit(&tx);
+}
+
+static uint32_t round_duty(uint32_t duty) {
+    return (duty + (1 << (OUTPUT_DUTY_FRAC_BITS - 1))) >> OUTPUT_DUTY_FRAC_BITS;
+}
+
+static bool is_ramping(output_t *output, output_port_t *port) {
+    return output->ramping_ports & (1ULL << port->index);
+}
+
+static const output_sim_event_t *find_event(size_t first_event, int pin) {
+    for (size_t i = first_event; i < output_sim.num_events; i++) {
+        if (output_sim.events[i].pin == pin) return &output_sim.events[i];
+    }
+    return NULL;
+}
+
+
+spec("output") {
+    static output_t output;
+
+    before_each() {
+        output_sim_reset();
+
+        // one column of pitch, velocity, gate and modulation
+        const output_config_t config = {
+            .num_columns = 1,
+            .num_rows = 4,
+            .port_configs = port_configs,
+            .backend = &output_sim_backend,
+            .update_interval_us = UPDATE_INTERVAL_US
+        };
+        output_init(&output, &config);
+
+        // start at an arbitrary point of the pwm period
+        output_sim_advance(10 * OUTPUT_SIM_PWM_PERIOD_NS + 37000);
+        output_sim.num_events = 0;
+    }
+
+    describe("transaction") {
+        it("should play a note on the rows of a column") {
+            output_transaction_t tx;
+            output_transaction_begin(&output, &tx);
+            expect(output_transaction_set_column_note(&tx, 0, 60, 127)) to_be(ESP_OK);
+            expect(output_transaction_commit(&tx)) to_be(ESP_OK);
+
+            // the modulation row is analog, it gets no trigger
+            expect(output_port_get(&output, 0, OUTPUT_ROW_PITCH)->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(60));
+            expect(output_port_get(&output, 0, OUTPUT_ROW_VELOCITY)->value_mv) to_be(5000);
+            expect(output_port_get(&output, 0, OUTPUT_ROW_GATE)->value_mv) to_be(5000);
+            expect(output_port_get(&output, 0, OUTPUT_ROW_TRIGGER)->value_mv) to_be(0);
+
+            // a release keeps the pitch
+            output_transaction_begin(&output, &tx);
+            expect(output_transaction_set_column_note(&tx, 0, 60, 0)) to_be(ESP_OK);
+            expect(output_transaction_commit(&tx)) to_be(ESP_OK);
+            expect(output_port_get(&output, 0, OUTPUT_ROW_PITCH)->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(60));
+            expect(output_port_get(&output, 0, OUTPUT_ROW_VELOCITY)->value_mv) to_be(0);
+            expect(output_port_get(&output, 0, OUTPUT_ROW_GATE)->value_mv) to_be(0);
+
+            expect(output_transaction_set_column_note(&tx, 1, 60, 127)) to_be(ESP_ERR_INVALID_ARG);
+        }
+
+        it("should not change any port before the commit") {
+            output_transaction_t tx;
+            output_transaction_begin(&output, &tx);
+            expect(output_transaction_set_voltage(&tx, 0, 0, 1000)) to_be(ESP_OK);
+            expect(output_transaction_set_voltage(&tx, 0, 2, 5000)) to_be(ESP_OK);
+
+            expect(output_sim.num_events) to_be(0);
+            expect(output_transaction_commit(&tx)) to_be(ESP_OK);
+            expect(output_sim.num_events) to_be(2);
+            expect(output_port_get(&output, 0, 0)->value_mv) to_be(1000);
+            expect(output_port_get(&output, 0, 2)->value_mv) to_be(5000);
+        }
+
+        it("should change all ports within one pwm period") {
+            // every start phase within the period, with all ports of the column
+            for (int64_t phase = 0; phase < OUTPUT_SIM_PWM_PERIOD_NS; phase += 1000) {
+                output_sim.now_ns = 100 * OUTPUT_SIM_PWM_PERIOD_NS + phase;
+                size_t first = output_sim.num_events = 0;
+
+                output_transaction_t tx;
+                output_transaction_begin(&output, &tx);
+                for (uint8_t row = 0; row < 4; row++) {
+                    output_transaction_set_voltage(&tx, 0, row, 1000 + phase / 100 + row);
+                }
+                output_transaction_commit(&tx);
+
+                // updates that straddle the end of a period latch one period apart at most
+                expect(output_sim.num_events) to_be(4);
+                check(output_sim_spread_ns(first) <= OUTPUT_SIM_PWM_PERIOD_NS, "phase %lld ns", (long long) phase);
+            }
+        }
+
+        it("should set digital gates once the pitch duty is in effect") {
+            // every start phase within the period, the gate is staged first
+            for (int64_t phase = 0; phase < OUTPUT_SIM_PWM_PERIOD_NS; phase += 1000) {
+                output_sim.now_ns = 100 * OUTPUT_SIM_PWM_PERIOD_NS + phase;
+                output_sim.num_events = 0;
+
+                output_transaction_t tx;
+                output_transaction_begin(&output, &tx);
+                output_transaction_set_voltage(&tx, 0, 2, phase % 2000 ? 0 : 5000);
+                output_transaction_set_voltage(&tx, 0, 0, 1000 + phase / 100);
+                output_transaction_commit(&tx);
+
+                const output_sim_event_t *pitch = find_event(0, PIN_PITCH), *gate = find_event(0, PIN_GATE);
+                check(pitch && gate, "phase %lld ns", (long long) phase);
+                check(gate->time_ns >= pitch->time_ns, "phase %lld ns", (long long) phase);
+                check(gate->time_ns - pitch->time_ns < OUTPUT_SIM_UPDATE_DUTY_NS, "phase %lld ns", (long long) phase);
+            }
+        }
+
+        it("should not wait for a duty that did not change") {
+            set_voltage_now(&output, output_port_get(&output, 0, 0), 2000);
+            int64_t start_ns = output_sim.now_ns;
+
+            output_transaction_t tx;
+            output_transaction_begin(&output, &tx);
+            output_transaction_set_voltage(&tx, 0, 0, 2000);
+            output_transaction_set_voltage(&tx, 0, 2, 5000);
+            output_transaction_commit(&tx);
+            check(find_event(0, PIN_GATE)->time_ns - start_ns < OUTPUT_SIM_PWM_PERIOD_NS / 2);
+        }
+
+        it("should keep the last value of a port staged twice") {
+            output_transaction_t tx;
+            output_transaction_begin(&output, &tx);
+            output_transaction_set_voltage(&tx, 0, 0, 1000);
+            output_transaction_set_voltage(&tx, 0, 0, 2500);
+            output_transaction_commit(&tx);
+
+            expect(output_sim.num_events) to_be(1);
+            expect(output_sim.events[0].value) to_be((2500 * OUTPUT_PWM_DUTY_MAX + 2500) / 5000);
+        }
+
+        it("should reject invalid and too many ports") {
+            output_transaction_t tx;
+            output_transaction_begin(&output, &tx);
+            expect(output_transaction_set_voltage(&tx, 1, 0, 1000)) to_be(ESP_ERR_INVALID_ARG);
+
+            static output_port_t ports[OUTPUT_TRANSACTION_MAX_PORTS + 1];
+            for (int i = 0; i < OUTPUT_TRANSACTION_MAX_PORTS; i++) {
+                expect(output_transaction_port_set_voltage(&tx, &ports[i], 0)) to_be(ESP_OK);
+            }
+            expect(output_transaction_port_set_voltage(&tx, &ports[OUTPUT_TRANSACTION_MAX_PORTS], 0)) to_be(ESP_ERR_NO_MEM);
+        }
+
+        it("should line up better than separate port updates") {
+            // separate updates with some work in between, e.g. routing the next track event
+            output_set_voltage(&output, 0, 0, 2000);
+            output_sim_advance(2 * OUTPUT_SIM_PWM_PERIOD_NS);
+            output_set_voltage(&output, 0, 1, 4000);
+            check(output_sim_spread_ns(0) > OUTPUT_SIM_PWM_PERIOD_NS);
+        }
+    }
+
+    describe("calibration") {
+        it("should keep every note within one cent") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+            output_calibration_t calibration;
+            dac_calibrate(&calibration, OUTPUT_CALIBRATION_MAX_POINTS);
+
+            // the ideal linear response is off by several cents
+            check(dac_max_error_cents(port) > 1.0);
+
+            expect(output_port_set_calibration(&output, port, &calibration)) to_be(ESP_OK);
+            double error = dac_max_error_cents(port);
+            check(error < 1.0, "max error %.3f cents", error);
+        }
+
+        it("should round the note duty to the hardware resolution") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+            output_calibration_t calibration;
+            dac_calibrate(&calibration, OUTPUT_CALIBRATION_MAX_POINTS);
+            output_port_set_calibration(&output, port, &calibration);
+
+            for (uint8_t note = 1; note < 48; note++) {
+                output_transaction_t tx;
+                output_sim.num_events = 0;
+                output_transaction_begin(&output, &tx);
+                expect(output_transaction_set_note(&tx, 0, 0, note)) to_be(ESP_OK);
+                output_transaction_commit(&tx);
+
+                int32_t fraction = (int32_t) (output_sim.events[0].value << OUTPUT_DUTY_FRAC_BITS) - port->note_duties[note];
+                check(abs(fraction) <= 1 << (OUTPUT_DUTY_FRAC_BITS - 1), "note %d", note);
+                expect(port->value_mv) to_be(OUTPUT_NOTE_TO_VOLTAGE(note));
+            }
+        }
+
+        it("should apply to voltages as well") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+            output_calibration_t calibration;
+            dac_calibrate(&calibration, OUTPUT_CALIBRATION_MAX_POINTS);
+            output_port_set_calibration(&output, port, &calibration);
+
+            // whole volts match the note table
+            for (uint8_t octave = 1; octave < 5; octave++) {
+                check(output_port_voltage_to_duty(port, octave * 1000000) == port->note_duties[octave * 12],
+                    "octave %d", octave);
+            }
+        }
+
+        it("should move a running port to its calibrated voltage") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+            set_voltage_now(&output, port, 3000);
+            output_sim.num_events = 0;
+
+            output_calibration_t calibration;
+            dac_calibrate(&calibration, OUTPUT_CALIBRATION_MAX_POINTS);
+            expect(output_port_set_calibration(&output, port, &calibration)) to_be(ESP_OK);
+
+            expect(output_sim.num_events) to_be(1);
+            expect(output_sim.events[0].value) to_be(round_duty(output_port_voltage_to_duty(port, 3000000)));
+            expect(port->value_mv) to_be(3000);
+        }
+
+        it("should reject invalid calibrations") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+            output_calibration_t calibration;
+            uint16_t note_duty = port->note_duties[60];
+
+            dac_calibrate(&calibration, 2);
+            calibration.num_points = 1;
+            expect(output_port_set_calibration(&output, port, &calibration)) to_be(ESP_ERR_INVALID_ARG);
+
+            dac_calibrate(&calibration, 3);
+            calibration.points[2].uv = calibration.points[1].uv;
+            expect(output_port_set_calibration(&output, port, &calibration)) to_be(ESP_ERR_INVALID_ARG);
+
+            // the previous calibration stays in place
+            expect(port->note_duties[60]) to_be(note_duty);
+        }
+    }
+
+    describe("dither") {
+        it("should resolve the mean voltage to at least 14 bits") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+            output_port_set_dither(&output, port, true);
+
+            for (uint32_t value_mv = 0; value_mv <= 5000; value_mv += 7) {
+                output_transaction_t tx;
+                output_transaction_begin(&output, &tx);
+                output_transaction_port_set_voltage(&tx, port, value_mv);
+                output_transaction_commit(&tx);
+
+                // the sequence repeats at most every 2^OUTPUT_DUTY_FRAC_BITS steps
+                uint32_t sum = 0;
+                for (int step = 0; step < 1 << OUTPUT_DUTY_FRAC_BITS; step++) {
+                    output_update(&output);
+                    sum += output_sim.channel_duties[port->analog_channel];
+                }
+
+                double mean_mv = (double) sum / (1 << OUTPUT_DUTY_FRAC_BITS) * 5000.0 / OUTPUT_PWM_DUTY_MAX;
+                check(fabs(mean_mv - value_mv) < 5000.0 / (1 << 14), "%d mV, mean %.3f mV", value_mv, mean_mv);
+            }
+        }
+
+        it("should keep filtered notes within one cent") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+
+            // the plain 10 bit duty is off by up to half a step, about 3 cents
+            check(filtered_max_error_cents(&output, port) > 1.0);
+
+            output_port_set_dither(&output, port, true);
+            double error = filtered_max_error_cents(&output, port);
+            check(error < 1.0, "max error %.3f cents", error);
+        }
+
+        it("should not call the driver for whole duties") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+            output_port_set_dither(&output, port, true);
+            // full scale is a whole duty
+            output_set_voltage(&output, 0, 0, 5000);
+            output_sim.num_events = 0;
+
+            for (int step = 0; step < 64; step++) output_update(&output);
+            expect(output_sim.num_events) to_be(0);
+        }
+
+        it("should leave ports without dithering alone") {
+            output_set_voltage(&output, 0, 1, 1234);
+            output_sim.num_events = 0;
+
+            for (int step = 0; step < 64; step++) output_update(&output);
+            expect(output_sim.num_events) to_be(0);
+        }
+    }
+
+    describe("glide") {
+        it("should ramp linearly to the target in the glide time") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+            set_voltage_now(&output, port, 1000);
+            uint32_t start = port->duty;
+
+            expect(output_port_set_glide(&output, port, GLIDE_TIME_US, OUTPUT_GLIDE_LINEAR)) to_be(ESP_OK);
+            output_sim.num_events = 0;
+            set_voltage_now(&output, port, 3000);
+            uint32_t target = output_port_voltage_to_duty(port, 3000000);
+
+            // nothing moves before the first update
+            expect(output_sim.num_events) to_be(0);
+            expect(port->value_mv) to_be(3000);
+
+            for (int step = 1; step <= GLIDE_STEPS; step++) {
+                uint32_t previous = port->duty;
+                output_update(&output);
+
+                uint32_t expected = start + (uint64_t) (target - start) * step / GLIDE_STEPS;
+                check(port->duty >= previous, "step %d", step);
+                check(abs((int32_t) port->duty - (int32_t) expected) <= 1, "step %d: %d, expected %d", step, port->duty, expected);
+                check(is_ramping(&output, port) == (step < GLIDE_STEPS), "step %d", step);
+            }
+
+            expect(port->duty) to_be(target);
+            expect(port->hardware_duty) to_be((target + 32) >> OUTPUT_DUTY_FRAC_BITS);
+        }
+
+        it("should ramp exponentially and settle on the target") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+            set_voltage_now(&output, port, 4000);
+            output_port_set_glide(&output, port, GLIDE_TIME_US, OUTPUT_GLIDE_EXPONENTIAL);
+            set_voltage_now(&output, port, 1000);
+
+            uint32_t start = output_port_voltage_to_duty(port, 4000000);
+            uint32_t target = output_port_voltage_to_duty(port, 1000000);
+            uint32_t previous = port->duty;
+            int steps = 0;
+            while (is_ramping(&output, port) && steps < 100 * GLIDE_STEPS) {
+                output_update(&output);
+                steps++;
+
+                check(port->duty <= previous, "step %d", steps);
+                previous = port->duty;
+
+                // four time constants: 98% of the way after the glide time
+                if (steps == GLIDE_STEPS) {
+                    uint32_t remaining = port->duty - target;
+                    check(remaining * 100 < (start - target) * 2, "remaining %d of %d", remaining, start - target);
+                    check(remaining * 100 > (start - target) * 1, "remaining %d of %d", remaining, start - target);
+                }
+            }
+
+            expect(is_ramping(&output, port)) to_be(false);
+            expect(port->duty) to_be(target);
+        }
+
+        it("should glide on from the middle of a ramp") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+            output_port_set_glide(&output, port, GLIDE_TIME_US, OUTPUT_GLIDE_LINEAR);
+            set_voltage_now(&output, port, 4000);
+            for (int step = 0; step < GLIDE_STEPS / 2; step++) output_update(&output);
+
+            // turning back does not jump, and takes the full glide time from there
+            uint32_t middle = port->duty;
+            set_voltage_now(&output, port, 0);
+            output_update(&output);
+            check(middle - port->duty < middle / GLIDE_STEPS + 2);
+
+            for (int step = 1; step < GLIDE_STEPS; step++) output_update(&output);
+            expect(is_ramping(&output, port)) to_be(false);
+            expect(port->duty) to_be(0);
+        }
+
+        it("should latch all ramping ports together") {
+            for (uint8_t row = 0; row < 4; row++) {
+                output_set_glide(&output, 0, row, GLIDE_TIME_US, OUTPUT_GLIDE_LINEAR);
+            }
+
+            output_transaction_t tx;
+            output_transaction_begin(&output, &tx);
+            for (uint8_t row = 0; row < 4; row++) output_transaction_set_voltage(&tx, 0, row, 5000);
+            output_transaction_commit(&tx);
+
+            // the gate is digital, it does not glide
+            expect(output_sim.num_events) to_be(1);
+            expect(output_sim.events[0].pin) to_be(PIN_GATE);
+
+            for (int step = 0; step < GLIDE_STEPS; step++) {
+                output_sim.num_events = 0;
+                output_update(&output);
+
+                expect(output_sim.num_events) to_be(3);
+                check(output_sim_spread_ns(0) <= OUTPUT_SIM_PWM_PERIOD_NS, "step %d", step);
+            }
+        }
+
+        it("should stop gliding a port that changes its type") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+            output_port_set_glide(&output, port, GLIDE_TIME_US, OUTPUT_GLIDE_LINEAR);
+            set_voltage_now(&output, port, 4000);
+            output_update(&output);
+            expect(is_ramping(&output, port)) to_be(true);
+
+            // the ramp would otherwise write the duty of a released pwm channel
+            expect(output_port_set_type(&output, port, OUTPUT_DIGITAL)) to_be(ESP_OK);
+            expect(is_ramping(&output, port)) to_be(false);
+            output_sim.num_events = 0;
+            output_update(&output);
+            expect(output_sim.num_events) to_be(0);
+        }
+
+        it("should jump without glide time or update timer") {
+            output_port_t *port = output_port_get(&output, 0, 0);
+            output_port_set_glide(&output, port, UPDATE_INTERVAL_US - 1, OUTPUT_GLIDE_LINEAR);
+            set_voltage_now(&output, port, 2000);
+            expect(is_ramping(&output, port)) to_be(false);
+            expect(port->duty) to_be(output_port_voltage_to_duty(port, 2000000));
+
+            output.config.update_interval_us = 0;
+            output_port_set_glide(&output, port, GLIDE_TIME_US, OUTPUT_GLIDE_LINEAR);
+            set_voltage_now(&output, port, 3000);
+            expect(is_ramping(&output, port)) to_be(false);
+            expect(port->duty) to_be(output_port_voltage_to_duty(port, 3000000));
+        }
+    }
+}
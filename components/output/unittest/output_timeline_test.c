@@ -0,0 +1,170 @@
+#include <string.h>
+#include "bdd-for-c.h"
+#include "output_routing.h"
+#include "output_timeline.h"
+
+
+#define MAX_RECORDS 256
+#define STEP_US 125000 // sixteenth notes at 120 bpm
+
+static const output_port_config_t port_configs[] = {
+    { .type = OUTPUT_ANALOG, .pin = 2, .vmax_mv = 5000 },
+    { .type = OUTPUT_ANALOG, .pin = 3, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 4, .vmax_mv = 5000 }
+};
+
+static const output_route_t routes[] = {
+    { .track = 0, .voice = OUTPUT_VOICE_PITCH, .column = 0, .row = 0 },
+    { .track = 0, .voice = OUTPUT_VOICE_VELOCITY, .column = 0, .row = 1 },
+    { .track = 0, .voice = OUTPUT_VOICE_GATE, .column = 0, .row = 2 }
+};
+
+static output_timeline_record_t records[MAX_RECORDS];
+
+
+static void set_voltages(output_t *output, uint32_t pitch_mv, uint32_t gate_mv) {
+    output_transaction_t tx;
+    output_transaction_begin(output, &tx);
+    output_transaction_set_voltage(&tx, 0, 0, pitch_mv);
+    output_transaction_set_voltage(&tx, 0, 2, gate_mv);
+    output_transaction_commit(&tx);
+}
+
+// exports into a string, the caller frees it
+static char *export(output_timeline_t *timeline, output_t *output, bool vcd) {
+    char *text;
+    size_t length;
+    FILE *file = open_memstream(&text, &length);
+    esp_err_t ret = vcd ? output_timeline_export_vcd(timeline, output, file) : output_timeline_export_csv(timeline, output, file);
+    fclose(file);
+    return ret == ESP_OK ? text : NULL;
+}
+
+
+spec("output timeline") {
+    static output_t output;
+    static output_timeline_t timeline;
+
+    before_each() {
+        output_timeline_init(&timeline, records, MAX_RECORDS);
+
+        const output_config_t config = {
+            .num_columns = 1,
+            .num_rows = 3,
+            .port_configs = port_configs,
+            .backend = &timeline.backend
+        };
+        output_init(&output, &config);
+        output_timeline_clear(&timeline);
+    }
+
+    it("should record port changes in time order") {
+        timeline.now_us = 1234;
+        set_voltages(&output, 1000, 5000);
+
+        // the duty changes at the end of the pwm period, the gate waits for it
+        expect(timeline.num_records) to_be(2);
+        expect(records[0].time_us) to_be(1250);
+        expect(records[0].port) to_be(0);
+        expect(output_timeline_record_voltage(&records[0], &output)) to_be(1002); // 10 bit duty step
+        expect(records[1].time_us) to_be(1250);
+        expect(records[1].port) to_be(2);
+        expect(records[1].value) to_be(1);
+    }
+
+    it("should map duties through the port calibration") {
+        const output_calibration_t calibration = {
+            .num_points = 3,
+            .points = { { 0, 10000 }, { 512, 2400000 }, { OUTPUT_PWM_DUTY_MAX, 4900000 } }
+        };
+        output_port_set_calibration(&output, &output.ports[0], &calibration);
+
+        for (uint32_t mv = 100; mv <= 4800; mv += 100) {
+            output_timeline_clear(&timeline);
+            set_voltages(&output, mv, 0);
+
+            // within half a duty step of 10 bit
+            int32_t error = (int32_t) output_timeline_record_voltage(&records[timeline.num_records - 1], &output) - mv;
+            check(error >= -3 && error <= 3, "%u mV", mv);
+        }
+    }
+
+    it("should export csv") {
+        timeline.now_us = 100;
+        set_voltages(&output, 2500, 5000);
+        timeline.now_us = 60000;
+        set_voltages(&output, 2500, 0);
+
+        char *csv = export(&timeline, &output, false);
+        check(csv != NULL);
+        expect(csv) to_be("time_us,port,column,row,value,voltage_mv\n"
+            "150,0,0,0,512,2502\n"
+            "150,2,0,2,1,5000\n"
+            "60000,2,0,2,0,0\n");
+        free(csv);
+    }
+
+    it("should export vcd") {
+        timeline.now_us = 100;
+        set_voltages(&output, 2500, 5000);
+
+        char *vcd = export(&timeline, &output, true);
+        check(vcd != NULL);
+        check(strstr(vcd, "$timescale 1us $end\n") != NULL);
+        check(strstr(vcd, "$var real 64 ! port_0_0 $end\n") != NULL);
+        check(strstr(vcd, "$var wire 1 # port_0_2 $end\n") != NULL);
+        check(strstr(vcd, "$enddefinitions $end\n#0\n$dumpvars\nr0 !\nr0 \"\n0#\n$end\n") != NULL);
+        check(strstr(vcd, "#150\nr2502 !\n1#\n") != NULL);
+        free(vcd);
+    }
+
+    it("should skip rewrites of the same value") {
+        set_voltages(&output, 2500, 5000);
+        timeline.now_us = 1000;
+        set_voltages(&output, 2500, 5000);
+        expect(timeline.num_records) to_be(2);
+    }
+
+    it("should count records that do not fit") {
+        for (int i = 0; i < MAX_RECORDS / 2 + 1; i++) {
+            timeline.now_us = i * 1000;
+            set_voltages(&output, 1000 + i * 10, i % 2 ? 5000 : 0);
+        }
+        expect(timeline.num_records) to_be(MAX_RECORDS);
+        // the first gate stays low, so one record is missing
+        expect(timeline.num_dropped) to_be(1);
+    }
+
+    it("should capture routed track steps at the step time") {
+        output_routing_t routing;
+        output_transaction_t tx;
+        output_routing_init(&routing, &output);
+        output_routing_set_routes(&routing, routes, 3);
+        output_transaction_begin(&output, &tx);
+        output_routing_apply_pending(&routing, &tx);
+        output_transaction_commit(&tx);
+        output_timeline_clear(&timeline);
+
+        // a step of the sequencer: note and velocity, committed together
+        const uint8_t notes[] = { 36, 38, 0, 43, 45, 0, 48, 36 };
+        const uint8_t velocities[] = { 127, 64, 0, 100, 127, 0, 90, 127 };
+        for (int step = 0; step < 8; step++) {
+            timeline.now_us = step * STEP_US + 17;
+            output_transaction_begin(&output, &tx);
+            output_routing_set_note(&routing, &tx, 0, notes[step]);
+            output_routing_set_velocity(&routing, &tx, 0, velocities[step]);
+            output_transaction_commit(&tx);
+        }
+
+        // every change lands within one pwm period after its step, the pitch never after the gate opens
+        int64_t gate_on_us = -1;
+        for (size_t i = 0; i < timeline.num_records; i++) {
+            int64_t step_us = (records[i].time_us / STEP_US) * STEP_US + 17;
+            check(records[i].time_us >= step_us && records[i].time_us - step_us <= OUTPUT_PWM_PERIOD_US, "record %zu", i);
+            if (records[i].port == 2 && records[i].value) gate_on_us = records[i].time_us;
+        }
+        // the gate opens once the pitch of the step is in effect, at the end of the pwm period
+        expect(gate_on_us) to_be(6 * STEP_US + OUTPUT_PWM_PERIOD_US);
+        expect(timeline.num_dropped) to_be(0);
+    }
+}
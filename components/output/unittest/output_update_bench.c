@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <time.h>
+#include "output.h"
+#include "output_sim.h"
+
+
+#define BENCH_STEPS 1000000
+#define BENCH_NOTES 61
+#define BENCH_INTERVAL_US 100
+#define BENCH_GLIDE_PORTS 16
+#define BENCH_GLIDE_TIME_US 50000
+
+
+static const output_port_config_t dither_port_configs[] = {
+    { .type = OUTPUT_ANALOG, .pin = 2, .vmax_mv = 5000, .dither = true }
+};
+
+// the ledc peripheral has 8 channels, 16 analog ports take two output units
+#define BENCH_GLIDE_PORT(gpio) { .type = OUTPUT_ANALOG, .pin = (gpio), .vmax_mv = 5000 }
+static const output_port_config_t glide_port_configs[] = {
+    BENCH_GLIDE_PORT(1), BENCH_GLIDE_PORT(2), BENCH_GLIDE_PORT(3), BENCH_GLIDE_PORT(4),
+    BENCH_GLIDE_PORT(5), BENCH_GLIDE_PORT(6), BENCH_GLIDE_PORT(7), BENCH_GLIDE_PORT(8)
+};
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double bench_cpu_percent(uint32_t interval_us, double calls_per_update) {
+    // modelled ledc driver cost of a duty update, the esp_timer dispatch of each
+    // interval comes on top, once for all ports
+    double update_ns = OUTPUT_SIM_SET_DUTY_NS + OUTPUT_SIM_UPDATE_DUTY_NS;
+    return 1000000.0 / interval_us * calls_per_update * update_ns / 1e7;
+}
+
+static void bench_dither() {
+    static output_t output;
+    output_sim_reset();
+    output_init(&output, &(output_config_t) { .num_columns = 1, .num_rows = 1, .port_configs = dither_port_configs,
+        .backend = &output_sim_backend });
+    output_port_t *port = &output.ports[0];
+
+    // driver calls per update, averaged over the notes of five octaves
+    uint64_t driver_calls = 0, steps = 0, worst_calls = 0;
+    uint64_t elapsed_ns = 0;
+    for (uint8_t note = 0; note < BENCH_NOTES; note++) {
+        output_transaction_t tx;
+        output_transaction_begin(&output, &tx);
+        output_transaction_port_set_note(&tx, port, note);
+        output_transaction_commit(&tx);
+
+        output_sim.num_events = 0;
+        uint64_t calls = 0;
+        uint64_t start = bench_now_ns();
+        for (int step = 0; step < BENCH_STEPS / BENCH_NOTES; step++) {
+            output_update(&output);
+
+            // count the latched updates without filling the event buffer
+            calls += output_sim.num_events;
+            output_sim.num_events = 0;
+        }
+        elapsed_ns += bench_now_ns() - start;
+
+        driver_calls += calls;
+        steps += BENCH_STEPS / BENCH_NOTES;
+        if (calls > worst_calls) worst_calls = calls;
+    }
+
+    double update_ratio = (double) driver_calls / steps;
+    double worst_ratio = (double) worst_calls / (BENCH_STEPS / BENCH_NOTES);
+
+    printf("dither, %d notes, %d updates\n", BENCH_NOTES, BENCH_STEPS);
+    printf("  host update %.1f ns (incl. sim driver), duty changes on %.1f%% of the updates (worst note %.1f%%)\n",
+        (double) elapsed_ns / steps, update_ratio * 100, worst_ratio * 100);
+    for (uint32_t interval_us = 50; interval_us <= 400; interval_us *= 2) {
+        printf("  %3u us interval: %5.2f%% cpu per port avg, %5.2f%% worst note\n",
+            (unsigned) interval_us, bench_cpu_percent(interval_us, update_ratio), bench_cpu_percent(interval_us, worst_ratio));
+    }
+}
+
+static void bench_glide(output_glide_curve_t curve, const char *name) {
+    static output_t outputs[BENCH_GLIDE_PORTS / 8];
+    const uint8_t num_outputs = BENCH_GLIDE_PORTS / 8;
+    output_sim_reset();
+
+    for (uint8_t i = 0; i < num_outputs; i++) {
+        output_init(&outputs[i], &(output_config_t) {
+            .num_columns = 1, .num_rows = 8, .port_configs = glide_port_configs,
+            .update_interval_us = BENCH_INTERVAL_US,
+            .backend = &output_sim_backend
+        });
+        for (uint8_t row = 0; row < 8; row++) output_set_glide(&outputs[i], 0, row, BENCH_GLIDE_TIME_US, curve);
+    }
+
+    // all ports glide all the time, up and down over the full range
+    uint64_t driver_calls = 0, elapsed_ns = 0;
+    for (int step = 0; step < BENCH_STEPS / 10; step++) {
+        for (uint8_t i = 0; i < num_outputs; i++) {
+            if (outputs[i].ramping_ports) continue;
+            for (uint8_t row = 0; row < 8; row++) {
+                output_port_t *port = output_port_get(&outputs[i], 0, row);
+                output_port_set_voltage(&outputs[i], port, port->value_mv ? 0 : 5000);
+            }
+        }
+
+        output_sim.num_events = 0;
+        uint64_t start = bench_now_ns();
+        for (uint8_t i = 0; i < num_outputs; i++) output_update(&outputs[i]);
+        elapsed_ns += bench_now_ns() - start;
+        driver_calls += output_sim.num_events;
+    }
+
+    double calls_per_update = (double) driver_calls / (BENCH_STEPS / 10);
+    printf("glide %s, %d ports, %d ms full range, %d us interval\n",
+        name, BENCH_GLIDE_PORTS, BENCH_GLIDE_TIME_US / 1000, BENCH_INTERVAL_US);
+    printf("  host update %.1f ns for all ports (incl. sim driver), %.1f duty changes per update, %5.2f%% cpu\n",
+        (double) elapsed_ns / (BENCH_STEPS / 10), calls_per_update, bench_cpu_percent(BENCH_INTERVAL_US, calls_per_update));
+}
+
+int main() {
+    bench_dither();
+    bench_glide(OUTPUT_GLIDE_LINEAR, "linear");
+    bench_glide(OUTPUT_GLIDE_EXPONENTIAL, "exponential");
+
+    return 0;
+}
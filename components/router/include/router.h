@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <esp_err.h>
+#include "midi_message.h"
+#include "callback.h"
+
+
+#define ROUTER_MAX_ROUTES 32
+#define ROUTER_MAX_ENTRIES 2048 // compiled (source, channel, route) entries
+#define ROUTER_MAX_SOURCE_INDEX 16 // usb cables, din ports or sequencer tracks per source type
+
+#define ROUTER_INDEX_ANY 0xFF
+
+// channel slots 0 - 15 are the midi channels, slot 16 carries all system messages
+#define ROUTER_CHANNEL_SLOTS 17
+#define ROUTER_CHANNEL_SYSTEM 16
+#define ROUTER_CHANNEL_MASK_SYSTEM (1UL << ROUTER_CHANNEL_SYSTEM)
+#define ROUTER_CHANNEL_MASK_ALL ((1UL << ROUTER_CHANNEL_SLOTS) - 1)
+
+#define ROUTER_KEEP_CHANNEL -1
+
+// how long a route change waits for messages still routed through the old table
+#define ROUTER_QUIESCE_TIMEOUT_MS 100
+
+#define ROUTER_SOURCE(t, i) ((router_source_t) { .type = ROUTER_SOURCE_ ## t, .index = (i) })
+#define ROUTER_SINK(t, i) ((router_sink_t) { .type = ROUTER_SINK_ ## t, .index = (i) })
+
+#define ROUTER_DEFAULT_ROUTE(src, dst) ((router_route_t) { \
+    .source = src, \
+    .sink = dst, \
+    .channel_mask = ROUTER_CHANNEL_MASK_ALL, \
+    .channel = ROUTER_KEEP_CHANNEL, \
+    .transpose = 0, \
+    .velocity_curve = ROUTER_VELOCITY_LINEAR, \
+    .velocity = 0 \
+})
+
+
+typedef enum {
+    ROUTER_SOURCE_USB,
+    ROUTER_SOURCE_DIN,
+    ROUTER_SOURCE_TRACK,
+    ROUTER_NUM_SOURCE_TYPES
+} router_source_type_t;
+
+typedef struct {
+    router_source_type_t type;
+    uint8_t index;
+} router_source_t;
+
+typedef enum {
+    ROUTER_SINK_CONTROLLER,
+    ROUTER_SINK_CV,
+    ROUTER_SINK_MIDI_OUT,
+    ROUTER_SINK_CLOCK,
+    ROUTER_NUM_SINK_TYPES
+} router_sink_type_t;
+
+typedef struct {
+    router_sink_type_t type;
+    uint8_t index;
+} router_sink_t;
+
+typedef enum {
+    ROUTER_VELOCITY_LINEAR,
+    ROUTER_VELOCITY_SOFT,
+    ROUTER_VELOCITY_HARD,
+    ROUTER_VELOCITY_FIXED,
+    ROUTER_NUM_VELOCITY_CURVES
+} router_velocity_curve_t;
+
+typedef struct {
+    router_source_t source;
+    router_sink_t sink;
+
+    uint32_t channel_mask; // bit n lets channel n pass, see ROUTER_CHANNEL_MASK_SYSTEM
+    int8_t channel; // output channel or ROUTER_KEEP_CHANNEL
+    int8_t transpose;
+    router_velocity_curve_t velocity_curve;
+    uint8_t velocity; // fixed velocity for ROUTER_VELOCITY_FIXED
+} router_route_t;
+
+
+typedef struct router_t router_t;
+CALLBACK_DECLARE(router_sink, esp_err_t,
+    router_sink_t sink, const midi_message_t *message, int64_t timestamp);
+
+typedef struct {
+    struct {
+        void *context;
+        CALLBACK_TYPE(router_sink) sink;
+    } callbacks;
+} router_config_t;
+
+// flat lookup table, compiled from the route list. The routes for a source and
+// channel slot are indices[offsets[slot]] up to (excluding) indices[offsets[slot + 1]]
+typedef struct {
+    router_route_t routes[ROUTER_MAX_ROUTES];
+    uint16_t offsets[ROUTER_NUM_SOURCE_TYPES * ROUTER_MAX_SOURCE_INDEX * ROUTER_CHANNEL_SLOTS + 1];
+    uint8_t indices[ROUTER_MAX_ENTRIES];
+} router_table_t;
+
+struct router_t {
+    router_config_t config;
+
+    router_route_t routes[ROUTER_MAX_ROUTES];
+    uint8_t num_routes;
+
+    // route changes are compiled into the inactive table, which is then swapped in.
+    // A table is only rebuilt once no router_route call is walking it anymore
+    router_table_t tables[2];
+    _Atomic(router_table_t *) table;
+    atomic_uint readers[2];
+
+    uint8_t velocity_curves[ROUTER_NUM_VELOCITY_CURVES][128];
+};
+
+
+esp_err_t router_init(router_t *router, const router_config_t *config);
+
+esp_err_t router_add_route(router_t *router, const router_route_t *route);
+esp_err_t router_remove_route(router_t *router, uint8_t index);
+esp_err_t router_clear(router_t *router);
+
+esp_err_t router_route(router_t *router, router_source_t source, const midi_message_t *message, int64_t timestamp);
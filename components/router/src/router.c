@@ -0,0 +1,206 @@
+#include "router.h"
+#include <string.h>
+#include <esp_check.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+
+static const char *TAG = "router";
+
+
+static inline size_t router_slot(router_source_type_t type, uint8_t index, uint8_t channel) {
+    return (type * ROUTER_MAX_SOURCE_INDEX + index) * ROUTER_CHANNEL_SLOTS + channel;
+}
+
+static bool router_route_matches(const router_route_t *route, router_source_type_t type, uint8_t index, uint8_t channel) {
+    return route->source.type == type &&
+        (route->source.index == ROUTER_INDEX_ANY || route->source.index == index) &&
+        (route->channel_mask & (1UL << channel));
+}
+
+static void router_init_velocity_curves(router_t *router) {
+    for (int v = 0; v < 128; v++) {
+        router->velocity_curves[ROUTER_VELOCITY_LINEAR][v] = v;
+        router->velocity_curves[ROUTER_VELOCITY_SOFT][v] = 127 - (127 - v) * (127 - v) / 127;
+        router->velocity_curves[ROUTER_VELOCITY_HARD][v] = v == 0 ? 0 : 1 + (v * v - 1) / 127;
+        router->velocity_curves[ROUTER_VELOCITY_FIXED][v] = v; // replaced by the route velocity
+    }
+}
+
+static esp_err_t router_compile(router_t *router) {
+    // always build into the table that is currently not in use
+    router_table_t *active = atomic_load(&router->table);
+    router_table_t *table = active == &router->tables[0] ? &router->tables[1] : &router->tables[0];
+    atomic_uint *readers = &router->readers[table - router->tables];
+    size_t slot = 0, n = 0;
+
+    // messages routed before the last swap may still be walking this table
+    for (TickType_t waited = 0; atomic_load(readers) > 0; waited++) {
+        ESP_RETURN_ON_FALSE(waited < pdMS_TO_TICKS(ROUTER_QUIESCE_TIMEOUT_MS), ESP_ERR_TIMEOUT,
+            TAG, "routing table still in use");
+        vTaskDelay(1);
+    }
+
+    memcpy(table->routes, router->routes, router->num_routes * sizeof(router_route_t));
+
+    // list the matching routes for every source and channel slot
+    for (int type = 0; type < ROUTER_NUM_SOURCE_TYPES; type++) {
+        for (int index = 0; index < ROUTER_MAX_SOURCE_INDEX; index++) {
+            for (int channel = 0; channel < ROUTER_CHANNEL_SLOTS; channel++, slot++) {
+                table->offsets[slot] = n;
+
+                for (int i = 0; i < router->num_routes; i++) {
+                    if (!router_route_matches(&router->routes[i], type, index, channel)) continue;
+
+                    ESP_RETURN_ON_FALSE(n < ROUTER_MAX_ENTRIES, ESP_ERR_NO_MEM,
+                        TAG, "too many route entries");
+                    table->indices[n++] = i;
+                }
+            }
+        }
+    }
+    table->offsets[slot] = n;
+
+    // publish the new table
+    atomic_store(&router->table, table);
+
+    return ESP_OK;
+}
+
+esp_err_t router_init(router_t *router, const router_config_t *config) {
+    router->config = *config;
+    router->num_routes = 0;
+
+    router_init_velocity_curves(router);
+
+    // start with an empty table
+    atomic_init(&router->table, &router->tables[0]);
+    atomic_init(&router->readers[0], 0);
+    atomic_init(&router->readers[1], 0);
+    return router_compile(router);
+}
+
+esp_err_t router_add_route(router_t *router, const router_route_t *route) {
+    ESP_RETURN_ON_FALSE(router->num_routes < ROUTER_MAX_ROUTES, ESP_ERR_NO_MEM,
+        TAG, "too many routes");
+    ESP_RETURN_ON_FALSE(route->source.type < ROUTER_NUM_SOURCE_TYPES, ESP_ERR_INVALID_ARG,
+        TAG, "invalid source type %d", route->source.type);
+    ESP_RETURN_ON_FALSE(route->source.index < ROUTER_MAX_SOURCE_INDEX || route->source.index == ROUTER_INDEX_ANY, ESP_ERR_INVALID_ARG,
+        TAG, "invalid source index %d", route->source.index);
+    ESP_RETURN_ON_FALSE(route->sink.type < ROUTER_NUM_SINK_TYPES, ESP_ERR_INVALID_ARG,
+        TAG, "invalid sink type %d", route->sink.type);
+    ESP_RETURN_ON_FALSE((route->channel >= 0 && route->channel < 16) || route->channel == ROUTER_KEEP_CHANNEL, ESP_ERR_INVALID_ARG,
+        TAG, "invalid channel %d", route->channel);
+    ESP_RETURN_ON_FALSE(route->velocity_curve < ROUTER_NUM_VELOCITY_CURVES, ESP_ERR_INVALID_ARG,
+        TAG, "invalid velocity curve %d", route->velocity_curve);
+
+    router->routes[router->num_routes++] = *route;
+
+    // undo the change if it does not fit into the table
+    esp_err_t ret = router_compile(router);
+    if (ret != ESP_OK) router->num_routes--;
+
+    return ret;
+}
+
+esp_err_t router_remove_route(router_t *router, uint8_t index) {
+    ESP_RETURN_ON_FALSE(index < router->num_routes, ESP_ERR_INVALID_ARG,
+        TAG, "invalid route %d", index);
+
+    router_route_t removed = router->routes[index];
+
+    // close the gap, route indices after the removed one move down
+    memmove(&router->routes[index], &router->routes[index + 1],
+        (router->num_routes - index - 1) * sizeof(router_route_t));
+    router->num_routes--;
+
+    // undo the change if the table could not be rebuilt
+    esp_err_t ret = router_compile(router);
+    if (ret != ESP_OK) {
+        memmove(&router->routes[index + 1], &router->routes[index],
+            (router->num_routes - index) * sizeof(router_route_t));
+        router->routes[index] = removed;
+        router->num_routes++;
+    }
+
+    return ret;
+}
+
+esp_err_t router_clear(router_t *router) {
+    uint8_t num_routes = router->num_routes;
+
+    // undo the change if the table could not be rebuilt
+    router->num_routes = 0;
+    esp_err_t ret = router_compile(router);
+    if (ret != ESP_OK) router->num_routes = num_routes;
+
+    return ret;
+}
+
+static const router_table_t *router_table_acquire(router_t *router, atomic_uint **readers) {
+    router_table_t *table;
+
+    // announce the reader, then make sure the table was not swapped out meanwhile.
+    // Otherwise the writer may already be rebuilding it
+    while (1) {
+        table = atomic_load(&router->table);
+        *readers = &router->readers[table - router->tables];
+        atomic_fetch_add(*readers, 1);
+        if (atomic_load(&router->table) == table) return table;
+        atomic_fetch_sub(*readers, 1);
+    }
+}
+
+esp_err_t router_route(router_t *router, router_source_t source, const midi_message_t *message, int64_t timestamp) {
+    const router_table_t *table;
+    atomic_uint *readers;
+    esp_err_t ret = ESP_OK;
+    midi_message_t routed;
+    int note;
+
+    if (source.type >= ROUTER_NUM_SOURCE_TYPES || source.index >= ROUTER_MAX_SOURCE_INDEX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    table = router_table_acquire(router, &readers);
+
+    // system messages are routed through their own channel slot
+    uint8_t channel = MIDI_COMMAND_IS_CHANNEL_VOICE(message->command) ? message->channel : ROUTER_CHANNEL_SYSTEM;
+    size_t slot = router_slot(source.type, source.index, channel);
+
+    for (uint16_t i = table->offsets[slot]; i < table->offsets[slot + 1]; i++) {
+        const router_route_t *route = &table->routes[table->indices[i]];
+        routed = *message;
+
+        switch (routed.command) {
+            case MIDI_COMMAND_NOTE_ON:
+                // velocity 0 keeps its note off meaning
+                if (routed.note_on.velocity > 0) {
+                    routed.note_on.velocity = route->velocity_curve == ROUTER_VELOCITY_FIXED
+                        ? route->velocity
+                        : router->velocity_curves[route->velocity_curve][routed.note_on.velocity];
+                }
+                // fall through
+            case MIDI_COMMAND_NOTE_OFF:
+            case MIDI_COMMAND_POLY_KEY_PRESSURE:
+                // skip notes that are transposed out of range
+                note = routed.note_on.note + route->transpose;
+                if (note < 0 || note > 127) continue;
+                routed.note_on.note = note;
+                break;
+            default:
+                break;
+        }
+
+        if (channel != ROUTER_CHANNEL_SYSTEM && route->channel != ROUTER_KEEP_CHANNEL) {
+            routed.channel = route->channel;
+        }
+
+        // deliver to all sinks, even if one of them fails
+        esp_err_t err = CALLBACK_INVOKE(&router->config.callbacks, sink, route->sink, &routed, timestamp);
+        if (err != ESP_OK) ret = err;
+    }
+
+    atomic_fetch_sub(readers, 1);
+    return ret;
+}
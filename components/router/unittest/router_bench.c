@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <time.h>
+#include "router.h"
+#include <freertos/task.h>
+
+
+#define BENCH_ROUTES 32
+#define BENCH_MESSAGES 4000000
+
+
+static volatile uint32_t delivered;
+
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    // routes are only changed while no message is routed
+}
+
+static esp_err_t bench_sink(void *context, router_sink_t sink, const midi_message_t *message, int64_t timestamp) {
+    delivered += message->note_on.velocity;
+    return ESP_OK;
+}
+
+int main() {
+    static router_t router;
+    const router_config_t config = {
+        .callbacks = {
+            .sink = bench_sink
+        }
+    };
+    router_init(&router, &config);
+
+    // 32 routes: every usb cable 0 - 3 channel goes to its own sink with different transforms,
+    // plus some track routes that never match usb input
+    for (int i = 0; i < BENCH_ROUTES; i++) {
+        router_route_t route = ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, i % 4), ROUTER_SINK(CV, i % 16));
+        if (i >= 24) route.source = ROUTER_SOURCE(TRACK, i % 4);
+        route.channel_mask = 1UL << (i % 16);
+        route.transpose = (i % 5) - 2;
+        route.velocity_curve = i % ROUTER_NUM_VELOCITY_CURVES;
+        route.velocity = 100;
+        if (router_add_route(&router, &route) != ESP_OK) {
+            printf("failed to add route %d\n", i);
+            return 1;
+        }
+    }
+
+    uint32_t x = 0x12345678;
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < BENCH_MESSAGES; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+
+        midi_message_t message = {
+            .command = MIDI_COMMAND_NOTE_ON,
+            .channel = x & 0x0F,
+            .note_on = { .note = (x >> 8) & 0x7F, .velocity = (x >> 16) & 0x7F }
+        };
+        router_route(&router, ROUTER_SOURCE(USB, (x >> 24) & 0x03), &message, 0);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    printf("%d routes: %.2f ns/message\n", BENCH_ROUTES, (double) elapsed / BENCH_MESSAGES);
+    return 0;
+}
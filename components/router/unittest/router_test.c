@@ -0,0 +1,237 @@
+#include "bdd-for-c.h"
+#include "router.h"
+#include <freertos/task.h>
+
+
+#define MAX_RECEIVED 16
+
+
+typedef struct {
+    router_sink_t sink;
+    midi_message_t message;
+} received_t;
+
+static received_t received[MAX_RECEIVED];
+static int num_received;
+
+// route changed by the sink while a message is routed
+static router_t *reroute_router;
+static esp_err_t reroute_results[2];
+static int num_delays;
+
+
+void vTaskDelay(TickType_t ticks) {
+    num_delays++;
+}
+
+static esp_err_t test_sink(void *context, router_sink_t sink, const midi_message_t *message, int64_t timestamp) {
+    if (num_received < MAX_RECEIVED) {
+        received[num_received++] = (received_t) { .sink = sink, .message = *message };
+    }
+
+    // the second change would rebuild the table this message is routed through
+    if (reroute_router != NULL) {
+        router_t *router = reroute_router;
+        reroute_router = NULL;
+        reroute_results[0] = router_add_route(router, &ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(CV, 1)));
+        reroute_results[1] = router_add_route(router, &ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(CV, 2)));
+    }
+    return ESP_OK;
+}
+
+static midi_message_t note_on(uint8_t channel, uint8_t note, uint8_t velocity) {
+    return (midi_message_t) {
+        .command = MIDI_COMMAND_NOTE_ON,
+        .channel = channel,
+        .note_on = { .note = note, .velocity = velocity }
+    };
+}
+
+
+spec("router") {
+    static router_t router;
+
+    before_each() {
+        const router_config_t config = {
+            .callbacks = {
+                .sink = test_sink
+            }
+        };
+        router_init(&router, &config);
+        num_received = 0;
+        num_delays = 0;
+    }
+
+    it("should not deliver messages without routes") {
+        midi_message_t msg = note_on(0, 60, 100);
+        expect(router_route(&router, ROUTER_SOURCE(USB, 0), &msg, 0)) to_be(ESP_OK);
+        expect(num_received) to_be(0);
+    }
+
+    it("should filter by source and channel") {
+        router_route_t route = ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 1), ROUTER_SINK(CV, 2));
+        route.channel_mask = 1 << 3;
+        router_add_route(&router, &route);
+
+        midi_message_t msg = note_on(3, 60, 100);
+        router_route(&router, ROUTER_SOURCE(USB, 0), &msg, 0);
+        router_route(&router, ROUTER_SOURCE(DIN, 1), &msg, 0);
+        expect(num_received) to_be(0);
+
+        msg.channel = 4;
+        router_route(&router, ROUTER_SOURCE(USB, 1), &msg, 0);
+        expect(num_received) to_be(0);
+
+        msg.channel = 3;
+        router_route(&router, ROUTER_SOURCE(USB, 1), &msg, 0);
+        expect(num_received) to_be(1);
+        expect(received[0].sink.type) to_be(ROUTER_SINK_CV);
+        expect(received[0].sink.index) to_be(2);
+    }
+
+    it("should route system messages through the system channel slot") {
+        router_route_t route = ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(MIDI_OUT, 0));
+        route.channel_mask = ROUTER_CHANNEL_MASK_SYSTEM;
+        router_add_route(&router, &route);
+
+        midi_message_t clock = { .command = MIDI_COMMAND_CLOCK };
+        midi_message_t msg = note_on(0, 60, 100);
+        router_route(&router, ROUTER_SOURCE(USB, 0), &clock, 0);
+        router_route(&router, ROUTER_SOURCE(USB, 0), &msg, 0);
+
+        expect(num_received) to_be(1);
+        expect(received[0].message.command) to_be(MIDI_COMMAND_CLOCK);
+    }
+
+    it("should match any source index") {
+        router_route_t route = ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(TRACK, ROUTER_INDEX_ANY), ROUTER_SINK(MIDI_OUT, 0));
+        router_add_route(&router, &route);
+
+        midi_message_t msg = note_on(0, 60, 100);
+        for (int i = 0; i < ROUTER_MAX_SOURCE_INDEX; i++) {
+            router_route(&router, ROUTER_SOURCE(TRACK, i), &msg, 0);
+        }
+        expect(num_received) to_be(ROUTER_MAX_SOURCE_INDEX);
+    }
+
+    it("should transpose notes and drop them when out of range") {
+        router_route_t route = ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(CV, 0));
+        route.transpose = 12;
+        router_add_route(&router, &route);
+
+        midi_message_t msg = note_on(0, 60, 100);
+        router_route(&router, ROUTER_SOURCE(USB, 0), &msg, 0);
+        msg.note_on.note = 120;
+        router_route(&router, ROUTER_SOURCE(USB, 0), &msg, 0);
+
+        expect(num_received) to_be(1);
+        expect(received[0].message.note_on.note) to_be(72);
+        expect(received[0].message.note_on.velocity) to_be(100);
+    }
+
+    it("should apply velocity curves but keep note offs") {
+        router_route_t route = ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(CV, 0));
+        route.velocity_curve = ROUTER_VELOCITY_FIXED;
+        route.velocity = 90;
+        router_add_route(&router, &route);
+        route.velocity_curve = ROUTER_VELOCITY_HARD;
+        router_add_route(&router, &route);
+
+        midi_message_t msg = note_on(0, 60, 64);
+        router_route(&router, ROUTER_SOURCE(USB, 0), &msg, 0);
+        msg.note_on.velocity = 0;
+        router_route(&router, ROUTER_SOURCE(USB, 0), &msg, 0);
+
+        expect(num_received) to_be(4);
+        expect(received[0].message.note_on.velocity) to_be(90);
+        expect(received[1].message.note_on.velocity) to_be_less_than(64);
+        expect(received[2].message.note_on.velocity) to_be(0);
+        expect(received[3].message.note_on.velocity) to_be(0);
+    }
+
+    it("should remap the output channel") {
+        router_route_t route = ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(MIDI_OUT, 0));
+        route.channel = 9;
+        router_add_route(&router, &route);
+
+        midi_message_t msg = note_on(2, 36, 127);
+        router_route(&router, ROUTER_SOURCE(USB, 0), &msg, 0);
+
+        expect(num_received) to_be(1);
+        expect(received[0].message.channel) to_be(9);
+    }
+
+    it("should merge several sources into one sink") {
+        router_add_route(&router, &ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(CV, 0)));
+        router_add_route(&router, &ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(TRACK, 1), ROUTER_SINK(CV, 0)));
+
+        midi_message_t msg = note_on(0, 60, 100);
+        router_route(&router, ROUTER_SOURCE(USB, 0), &msg, 0);
+        router_route(&router, ROUTER_SOURCE(TRACK, 1), &msg, 0);
+
+        expect(num_received) to_be(2);
+    }
+
+    it("should update the table when routes are removed") {
+        router_add_route(&router, &ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(CV, 0)));
+        router_add_route(&router, &ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(CV, 1)));
+        expect(router_remove_route(&router, 0)) to_be(ESP_OK);
+
+        midi_message_t msg = note_on(0, 60, 100);
+        router_route(&router, ROUTER_SOURCE(USB, 0), &msg, 0);
+
+        expect(num_received) to_be(1);
+        expect(received[0].sink.index) to_be(1);
+    }
+
+    it("should reject invalid sinks and channels") {
+        router_route_t route = ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(CV, 0));
+        route.sink.type = ROUTER_NUM_SINK_TYPES;
+        expect(router_add_route(&router, &route)) to_be(ESP_ERR_INVALID_ARG);
+
+        route = ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(CV, 0));
+        route.channel = 16;
+        expect(router_add_route(&router, &route)) to_be(ESP_ERR_INVALID_ARG);
+        route.channel = -2;
+        expect(router_add_route(&router, &route)) to_be(ESP_ERR_INVALID_ARG);
+
+        route.channel = 15;
+        expect(router_add_route(&router, &route)) to_be(ESP_OK);
+        expect(router.num_routes) to_be(1);
+    }
+
+    it("should not rebuild a table while a message is routed through it") {
+        router_add_route(&router, &ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(CV, 0)));
+
+        midi_message_t msg = note_on(0, 60, 100);
+        reroute_router = &router;
+        expect(router_route(&router, ROUTER_SOURCE(USB, 0), &msg, 0)) to_be(ESP_OK);
+
+        // the first change goes to the idle table, the second one times out
+        expect(reroute_results[0]) to_be(ESP_OK);
+        expect(reroute_results[1]) to_be(ESP_ERR_TIMEOUT);
+        expect(num_delays) to_be(ROUTER_QUIESCE_TIMEOUT_MS);
+        expect(router.num_routes) to_be(2);
+        expect(num_received) to_be(1);
+
+        // once the message is through, the table can be rebuilt again
+        num_received = 0;
+        router_route(&router, ROUTER_SOURCE(USB, 0), &msg, 0);
+        expect(num_received) to_be(2);
+        expect(received[1].sink.index) to_be(1);
+        expect(router_add_route(&router, &ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, 0), ROUTER_SINK(CV, 2)))) to_be(ESP_OK);
+    }
+
+    it("should reject routes that do not fit") {
+        router_route_t route = ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, ROUTER_INDEX_ANY), ROUTER_SINK(CV, 0));
+        esp_err_t ret = ESP_OK;
+
+        // every route expands to 16 sources with 17 channel slots each
+        for (int i = 0; i < ROUTER_MAX_ROUTES && ret == ESP_OK; i++) {
+            ret = router_add_route(&router, &route);
+        }
+
+        expect(ret) to_be(ESP_ERR_NO_MEM);
+        expect(router.num_routes) to_be(ROUTER_MAX_ENTRIES / (ROUTER_MAX_SOURCE_INDEX * ROUTER_CHANNEL_SLOTS));
+    }
+}
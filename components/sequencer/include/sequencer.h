@@ -14,6 +14,7 @@
 
 
 typedef enum {
+    SEQUENCER_CLOCK,
     SEQUENCER_TICK,
     SEQUENCER_PLAY,
     SEQUENCER_PAUSE,
@@ -21,6 +22,11 @@ typedef enum {
     SEQUENCER_TRACK_EVENT
 } sequencer_event_t;
 
+typedef enum {
+    SEQUENCER_CLOCK_INTERNAL,
+    SEQUENCER_CLOCK_EXTERNAL
+} sequencer_clock_source_t;
+
 typedef struct {
     track_t *track;
     track_event_t event;
@@ -47,6 +53,7 @@ struct sequencer_t {
     track_t tracks[SEQUENCER_NUM_TRACKS];
     uint32_t playhead;
     bool playing;
+    sequencer_clock_source_t clock_source;
 };
 
 
@@ -57,5 +64,7 @@ esp_err_t sequencer_play(sequencer_t *sequencer);
 esp_err_t sequencer_pause(sequencer_t *sequencer);
 
 esp_err_t sequencer_set_bpm(sequencer_t *sequencer, uint16_t bpm);
+esp_err_t sequencer_set_clock_source(sequencer_t *sequencer, sequencer_clock_source_t clock_source);
+esp_err_t sequencer_tick_external(sequencer_t *sequencer);
 uint64_t sequencer_get_tick_period_us(sequencer_t *sequencer);
 pattern_t *sequencer_get_active_pattern(sequencer_t *sequencer, int track_id);
@@ -9,7 +9,10 @@
 
 typedef enum {
     TRACK_NOTE_CHANGE,
-    TRACK_VELOCITY_CHANGE
+    TRACK_VELOCITY_CHANGE,
+    TRACK_DRUM_MASK_CHANGE,
+    TRACK_PATTERN_CHANGE, // data is the new active pattern, or NULL
+    TRACK_PATTERN_RESIZE // data is the resized pattern
 } track_event_t;
 
 typedef struct track_t track_t;
@@ -42,3 +45,4 @@ esp_err_t track_tick(track_t *track, uint32_t playhead);
 
 esp_err_t track_set_active_pattern(track_t *track, int pattern_id);
 pattern_t *track_get_active_pattern(track_t *track);
+esp_err_t track_resize_pattern(track_t *track, int pattern_id, uint16_t step_length);
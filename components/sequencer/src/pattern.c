@@ -127,6 +127,14 @@ pattern_step_t *pattern_get_next_step(pattern_t *pattern) {
     return &pattern->steps[position];
 }
 
+uint16_t pattern_get_nearest_step(pattern_t *pattern) {
+    // substep_position ticks of the current step have passed, round to the closer step
+    if (pattern->substep_position * 2 < pattern->config.resolution) return pattern->step_position;
+
+    if (pattern->step_position == pattern->config.step_length - 1) return 0;
+    return pattern->step_position + 1;
+}
+
 inline uint32_t pattern_step_to_ticks(pattern_t *pattern, uint16_t step) {
     return step * pattern->config.resolution;
 }
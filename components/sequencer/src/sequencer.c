@@ -9,6 +9,14 @@ static const char *TAG = "sequencer";
 static esp_err_t sequencer_tick(sequencer_t *sequencer) {
     esp_err_t ret;
 
+    // the clock event comes before any track work, so anything timed by it
+    // (e.g. midi clock output) does not jitter with the track load
+    ret = CALLBACK_INVOKE(&sequencer->config.callbacks, event,
+        SEQUENCER_CLOCK,
+        sequencer,
+        &sequencer->playhead);
+    ESP_RETURN_ON_ERROR(ret, TAG, "failed to invoke clock callback");
+
     // update each track
     for (int i = 0; i < SEQUENCER_NUM_TRACKS; i++) {
         ret = track_tick(&sequencer->tracks[i], sequencer->playhead);
@@ -58,6 +66,8 @@ esp_err_t sequencer_init(sequencer_t *sequencer, const sequencer_config_t *confi
 
     sequencer->config = *config;
     sequencer->playhead = 0;
+    sequencer->playing = false;
+    sequencer->clock_source = SEQUENCER_CLOCK_INTERNAL;
 
     // initialize all tracks.
     const track_config_t track_config = {
@@ -109,8 +119,11 @@ esp_err_t sequencer_play(sequencer_t *sequencer) {
 
     if (sequencer->playing) return ESP_OK;
 
-    ret = esp_timer_start_periodic(sequencer->timer, sequencer_get_tick_period_us(sequencer));
-    ESP_RETURN_ON_ERROR(ret, TAG, "failed to start timer");
+    // with an external clock the ticks are driven by sequencer_tick_external
+    if (sequencer->clock_source == SEQUENCER_CLOCK_INTERNAL) {
+        ret = esp_timer_start_periodic(sequencer->timer, sequencer_get_tick_period_us(sequencer));
+        ESP_RETURN_ON_ERROR(ret, TAG, "failed to start timer");
+    }
     sequencer->playing = true;
 
     ret = CALLBACK_INVOKE(&sequencer->config.callbacks, event,
@@ -127,8 +140,10 @@ esp_err_t sequencer_pause(sequencer_t *sequencer) {
 
     if (!sequencer->playing) return ESP_OK;
 
-    ret = esp_timer_stop(sequencer->timer);
-    ESP_RETURN_ON_ERROR(ret, TAG, "failed to stop timer");
+    if (sequencer->clock_source == SEQUENCER_CLOCK_INTERNAL) {
+        ret = esp_timer_stop(sequencer->timer);
+        ESP_RETURN_ON_ERROR(ret, TAG, "failed to stop timer");
+    }
     sequencer->playing = false;
 
     ret = CALLBACK_INVOKE(&sequencer->config.callbacks, event,
@@ -146,7 +161,7 @@ esp_err_t sequencer_set_bpm(sequencer_t *sequencer, uint16_t bpm) {
     sequencer->config.bpm = bpm;
 
     // restart the timer
-    if (sequencer->playing) {
+    if (sequencer->playing && sequencer->clock_source == SEQUENCER_CLOCK_INTERNAL) {
         ret = esp_timer_stop(sequencer->timer);
         ESP_RETURN_ON_ERROR(ret, TAG, "failed to stop timer");
 
@@ -157,6 +172,36 @@ esp_err_t sequencer_set_bpm(sequencer_t *sequencer, uint16_t bpm) {
     return ESP_OK;
 }
 
+esp_err_t sequencer_set_clock_source(sequencer_t *sequencer, sequencer_clock_source_t clock_source) {
+    esp_err_t ret;
+
+    if (sequencer->clock_source == clock_source) return ESP_OK;
+    sequencer->clock_source = clock_source;
+
+    // hand the running playback over to the new clock
+    if (sequencer->playing) {
+        if (clock_source == SEQUENCER_CLOCK_EXTERNAL) {
+            ret = esp_timer_stop(sequencer->timer);
+            ESP_RETURN_ON_ERROR(ret, TAG, "failed to stop timer");
+        } else {
+            ret = esp_timer_start_periodic(sequencer->timer, sequencer_get_tick_period_us(sequencer));
+            ESP_RETURN_ON_ERROR(ret, TAG, "failed to start timer");
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t sequencer_tick_external(sequencer_t *sequencer) {
+    ESP_RETURN_ON_FALSE(sequencer->clock_source == SEQUENCER_CLOCK_EXTERNAL, ESP_ERR_INVALID_STATE,
+        TAG, "sequencer is not externally clocked");
+
+    // ticks that arrive while paused are dropped
+    if (!sequencer->playing) return ESP_OK;
+
+    return sequencer_tick(sequencer);
+}
+
 uint64_t sequencer_get_tick_period_us(sequencer_t *sequencer) {
     return (60000000 / (SEQ_PPQN * sequencer->config.bpm));
 }
@@ -41,6 +41,18 @@ esp_err_t track_tick(track_t *track, uint32_t playhead) {
     // update the pattern's state
     ESP_RETURN_ON_ERROR(pattern_tick(pattern), TAG, "failed to update pattern");
 
+    // drum steps hold one trigger per bit instead of a note
+    if (pattern->config.type == PATTERN_TYPE_DRUM) {
+        if (track->active_step.drum_mask != pattern->state.drum_mask) {
+            ret = CALLBACK_INVOKE(&track->config.callbacks, event,
+                TRACK_DRUM_MASK_CHANGE, track, &pattern->state.drum_mask);
+            ESP_RETURN_ON_ERROR(ret, TAG, "failed to invoke drum mask change callback");
+        }
+
+        track->active_step = pattern->state;
+        return ESP_OK;
+    }
+
     // update the note only if it's actually audible (velocity > 0)
     if (track->active_step.note != pattern->state.note && pattern->state.velocity > 0) {
         ret = CALLBACK_INVOKE(&track->config.callbacks, event,
@@ -78,6 +90,10 @@ esp_err_t track_set_active_pattern(track_t *track, int pattern_id) {
     // set the pattern id
     track->active_pattern = pattern_id;
 
+    ESP_RETURN_ON_ERROR(CALLBACK_INVOKE(&track->config.callbacks, event,
+            TRACK_PATTERN_CHANGE, track, track_get_active_pattern(track)),
+        TAG, "failed to invoke pattern change callback");
+
     return ESP_OK;
 }
 
@@ -86,3 +102,19 @@ pattern_t *track_get_active_pattern(track_t *track) {
 
     return &track->patterns[track->active_pattern];
 }
+
+esp_err_t track_resize_pattern(track_t *track, int pattern_id, uint16_t step_length) {
+    ESP_RETURN_ON_FALSE(pattern_id >= 0 && pattern_id < TRACK_MAX_PATTERNS, ESP_ERR_INVALID_ARG,
+        TAG, "invalid pattern id %d", pattern_id);
+
+    // the steps may move, so listeners holding on to them are told
+    pattern_t *pattern = &track->patterns[pattern_id];
+    ESP_RETURN_ON_ERROR(pattern_resize(pattern, step_length),
+        TAG, "failed to resize pattern %d", pattern_id);
+
+    ESP_RETURN_ON_ERROR(CALLBACK_INVOKE(&track->config.callbacks, event,
+            TRACK_PATTERN_RESIZE, track, pattern),
+        TAG, "failed to invoke pattern resize callback");
+
+    return ESP_OK;
+}
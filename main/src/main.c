@@ -1,13 +1,20 @@
+#include <string.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <esp_log.h>
 #include <esp_check.h>
+#include <nvs_flash.h>
 
 #include <usb.h>
 #include <usb_midi.h>
 #include <store.h>
 #include <output.h>
+#include <output_routing.h>
+#include <modulation.h>
 #include <sequencer.h>
+#include <latency.h>
+#include <router.h>
+#include <midi_clock.h>
 
 #include <controller.h>
 #include <controllers/launchpad.h>
@@ -17,13 +24,50 @@
 static const char *TAG = "espseq";
 
 
-#define OUTPUT_COLUMNS 1
-#define OUTPUT_ROWS 2
+// one column per sequencer track on GPIO1...16, see connections.txt
+#define OUTPUT_COLUMNS SEQUENCER_NUM_TRACKS
+#define OUTPUT_ROWS 4 // pitch, velocity, gate and trigger
 
 
+// row by row, the pitch and velocity rows take the 8 pwm channels
 static const output_port_config_t output_port_configs[] = {
-    { .type = OUTPUT_ANALOG, .pin = 2, .vmax_mv = 5000 /* 4840 */ },
-    { .type = OUTPUT_ANALOG, .pin = 3, .vmax_mv = 4840 },
+    { .type = OUTPUT_ANALOG, .pin = 1, .vmax_mv = 5000, .dither = true },
+    { .type = OUTPUT_ANALOG, .pin = 2, .vmax_mv = 5000, .dither = true },
+    { .type = OUTPUT_ANALOG, .pin = 3, .vmax_mv = 5000, .dither = true },
+    { .type = OUTPUT_ANALOG, .pin = 4, .vmax_mv = 5000, .dither = true },
+    { .type = OUTPUT_ANALOG, .pin = 5, .vmax_mv = 4840 },
+    { .type = OUTPUT_ANALOG, .pin = 6, .vmax_mv = 4840 },
+    { .type = OUTPUT_ANALOG, .pin = 7, .vmax_mv = 4840 },
+    { .type = OUTPUT_ANALOG, .pin = 8, .vmax_mv = 4840 },
+    { .type = OUTPUT_DIGITAL, .pin = 9, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 10, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 11, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 12, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 13, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 14, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 15, .vmax_mv = 5000 },
+    { .type = OUTPUT_DIGITAL, .pin = 16, .vmax_mv = 5000 },
+};
+
+// the velocity port carries the envelope of the track if enabled
+#ifdef CONFIG_ESPSEQ_VELOCITY_ENVELOPE
+    #define OUTPUT_VELOCITY_ROUTE(t)
+#else
+    #define OUTPUT_VELOCITY_ROUTE(t) { .track = (t), .voice = OUTPUT_VOICE_VELOCITY, .column = (t), .row = OUTPUT_ROW_VELOCITY },
+#endif
+
+#define OUTPUT_TRACK_ROUTES(t) \
+    { .track = (t), .voice = OUTPUT_VOICE_PITCH, .column = (t), .row = OUTPUT_ROW_PITCH }, \
+    OUTPUT_VELOCITY_ROUTE(t) \
+    { .track = (t), .voice = OUTPUT_VOICE_GATE, .column = (t), .row = OUTPUT_ROW_GATE }, \
+    { .track = (t), .voice = OUTPUT_VOICE_GATE, .column = (t), .row = OUTPUT_ROW_TRIGGER, .pulse_us = OUTPUT_TRIGGER_US }
+
+// track voices on the output ports
+static const output_route_t output_routes[] = {
+    OUTPUT_TRACK_ROUTES(0),
+    OUTPUT_TRACK_ROUTES(1),
+    OUTPUT_TRACK_ROUTES(2),
+    OUTPUT_TRACK_ROUTES(3)
 };
 
 static const controller_class_t *controller_classes[] = {
@@ -122,30 +166,105 @@ uint16_t bpm = 30;*/
 
 static usb_midi_t usb_midi;
 static output_t output;
+static output_routing_t output_routing;
 static sequencer_t sequencer;
+static router_t router;
+static midi_clock_t midi_clock;
+static modulation_t modulation;
 
 static controller_t *controller = NULL;
 
+// notes currently sounding per sequencer track and cv column (0xFF = none)
+static uint8_t track_notes[SEQUENCER_NUM_TRACKS];
+static uint8_t track_velocities[SEQUENCER_NUM_TRACKS];
+static uint8_t track_sounding_notes[SEQUENCER_NUM_TRACKS];
+static uint8_t cv_notes[OUTPUT_COLUMNS];
+
+// outputs changed by the tracks during a tick, applied together at the end of it
+static output_transaction_t tick_outputs;
+
+
+static esp_err_t track_route_update(uint8_t track_index) {
+    midi_message_t message = { .command = MIDI_COMMAND_NOTE_OFF, .channel = 0 };
+    uint8_t note = track_velocities[track_index] > 0 ? track_notes[track_index] : 0xFF;
+    uint8_t sounding_note = track_sounding_notes[track_index];
+
+    if (note == sounding_note) return ESP_OK;
+    track_sounding_notes[track_index] = note;
+
+    // release the previous note before the next one starts
+    if (sounding_note != 0xFF) {
+        message.note_off.note = sounding_note;
+        message.note_off.velocity = 0;
+        ESP_RETURN_ON_ERROR(router_route(&router, ROUTER_SOURCE(TRACK, track_index), &message, 0),
+            TAG, "failed to route track note off");
+    }
+
+    if (note != 0xFF) {
+        message.command = MIDI_COMMAND_NOTE_ON;
+        message.note_on.note = note;
+        message.note_on.velocity = track_velocities[track_index];
+        ESP_RETURN_ON_ERROR(router_route(&router, ROUTER_SOURCE(TRACK, track_index), &message, 0),
+            TAG, "failed to route track note on");
+    }
+
+    return ESP_OK;
+}
+
 
 esp_err_t sequencer_event_callback(void *context, sequencer_event_t event, sequencer_t *sequencer, void *data) {
     esp_err_t ret;
-    
+
+    // clock and transport go out first
+    ret = midi_clock_sequencer_event(&midi_clock, event, sequencer, data);
+    ESP_RETURN_ON_ERROR(ret, TAG, "failed to forward sequencer event to midi clock");
+
+    // envelopes and lfos follow the notes and the tempo
+    ret = modulation_sequencer_event(&modulation, event, sequencer, data);
+    ESP_RETURN_ON_ERROR(ret, TAG, "failed to forward sequencer event to modulation");
+
     // set the output voltage based on note and velocity events
     switch (event) {
+        case SEQUENCER_CLOCK:
+            // routes changed since the last tick switch before the tracks stage into it
+            output_transaction_begin(&output, &tick_outputs);
+            ret = output_routing_apply_pending(&output_routing, &tick_outputs);
+            ESP_RETURN_ON_ERROR(ret, TAG, "failed to apply output routes");
+            break;
+        case SEQUENCER_TICK:
+            // pitch and velocity of all tracks change at the same instant
+            ret = output_transaction_commit(&tick_outputs);
+            ESP_RETURN_ON_ERROR(ret, TAG, "failed to commit track outputs");
+            break;
         case SEQUENCER_TRACK_EVENT:;
             sequencer_track_event_t *track_event = (sequencer_track_event_t *) data;
+            uint8_t track_index = track_event->track - sequencer->tracks;
             switch (track_event->event) {
                 case TRACK_NOTE_CHANGE:;
                     uint8_t note = *(uint8_t *) track_event->data;
-                    ret = output_set_voltage(&output, 0, 0, OUTPUT_NOTE_TO_VOLTAGE(note));
-                    ESP_RETURN_ON_ERROR(ret, TAG, "failed to set output voltage");
+                    track_notes[track_index] = note;
+                    ret = output_routing_set_note(&output_routing, &tick_outputs, track_index, note);
+                    ESP_RETURN_ON_ERROR(ret, TAG, "failed to stage output voltage");
                     break;
                 case TRACK_VELOCITY_CHANGE:;
                     uint8_t velocity = *(uint8_t *) track_event->data;
-                    ret = output_set_voltage(&output, 0, 1, OUTPUT_VELOCITY_TO_VOLTAGE(velocity));
-                    ESP_RETURN_ON_ERROR(ret, TAG, "failed to set output voltage");
+                    track_velocities[track_index] = velocity;
+                    ret = output_routing_set_velocity(&output_routing, &tick_outputs, track_index, velocity);
+                    ESP_RETURN_ON_ERROR(ret, TAG, "failed to stage output voltage");
+                    break;
+                case TRACK_DRUM_MASK_CHANGE:;
+                    // all drum gates of the step change with one register write
+                    uint16_t drum_mask = *(uint16_t *) track_event->data;
+                    ret = output_routing_set_drum_mask(&output_routing, &tick_outputs, track_index, drum_mask);
+                    ESP_RETURN_ON_ERROR(ret, TAG, "failed to stage drum outputs");
+                    break;
+                default:
                     break;
             }
+
+            // sequencer track --> router
+            ESP_RETURN_ON_ERROR(track_route_update(track_index),
+                TAG, "failed to route track event");
             break;
         default:
             break;
@@ -198,16 +317,113 @@ void usb_midi_disconnected_callback(const usb_device_desc_t *desc) {
     controller = NULL;
 }
 
-void usb_midi_recv_callback(const midi_message_t *message) {
-    // usb midi --> controller
-    if (controller != NULL) {
-        controller_midi_recv(controller, message);
+void usb_midi_recv_callback(const midi_message_t *message, uint8_t cable, int64_t timestamp) {
+    // usb midi --> router
+    router_route(&router, ROUTER_SOURCE(USB, cable), message, timestamp);
+}
+
+static esp_err_t router_cv_sink(uint8_t column, const midi_message_t *message) {
+    if (column >= OUTPUT_COLUMNS) return ESP_ERR_INVALID_ARG;
+
+    // pitch, velocity and gate of a note change together
+    output_transaction_t tx;
+    output_transaction_begin(&output, &tx);
+
+    switch (message->command) {
+        case MIDI_COMMAND_NOTE_ON:
+            if (message->note_on.velocity > 0) {
+                cv_notes[column] = message->note_on.note;
+                ESP_RETURN_ON_ERROR(output_transaction_set_column_note(&tx, column, message->note_on.note, message->note_on.velocity),
+                    TAG, "failed to stage note");
+                break;
+            }
+            // fall through, note on with zero velocity is a note off
+        case MIDI_COMMAND_NOTE_OFF:
+            // only the last note played closes the gate
+            if (cv_notes[column] == message->note_off.note) {
+                cv_notes[column] = 0xFF;
+                ESP_RETURN_ON_ERROR(output_transaction_set_column_note(&tx, column, message->note_off.note, 0),
+                    TAG, "failed to stage note release");
+            }
+            break;
+        default:
+            break;
     }
+
+    return output_transaction_commit(&tx);
 }
 
+esp_err_t router_sink_callback(void *context, router_sink_t sink, const midi_message_t *message, int64_t timestamp) {
+    switch (sink.type) {
+        case ROUTER_SINK_CONTROLLER:
+            // router --> controller
+            if (controller != NULL) {
+                controller_midi_recv(controller, message, timestamp);
+            }
+            break;
+        case ROUTER_SINK_CV:
+            // router --> analog outputs
+            ESP_RETURN_ON_ERROR(router_cv_sink(sink.index, message),
+                TAG, "failed to update cv column %d", sink.index);
+            break;
+        case ROUTER_SINK_MIDI_OUT:
+            // router --> usb midi
+            #ifdef CONFIG_ESPSEQ_USB_MIDI_ENABLE
+                ESP_RETURN_ON_ERROR(usb_midi_send(&usb_midi, message),
+                    TAG, "failed to send midi message");
+            #endif
+            break;
+        case ROUTER_SINK_CLOCK:
+            // router --> midi clock slave
+            ESP_RETURN_ON_ERROR(midi_clock_recv(&midi_clock, message, timestamp),
+                TAG, "failed to handle clock message");
+            break;
+        default:
+            break;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t midi_clock_send_callback(void *context, const midi_message_t *message) {
+    // send midi clock if the usb peripheral is available
+    #ifdef CONFIG_ESPSEQ_USB_MIDI_ENABLE
+        ESP_RETURN_ON_ERROR(usb_midi_send(&usb_midi, message),
+            TAG, "failed to send midi clock");
+    #endif
+
+    return ESP_OK;
+}
+
+#ifdef CONFIG_ESPSEQ_DUMP_LATENCY
+static void latency_dump_task(void *arg) {
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_ESPSEQ_DUMP_LATENCY_INTERVAL_MS));
+        latency_dump();
+
+        #ifdef CONFIG_ESPSEQ_USB_MIDI_ENABLE
+            printf("USB MIDI dropped messages: %u\n", (unsigned) usb_midi_get_dropped_messages(&usb_midi));
+        #endif
+    }
+}
+#endif
+
 void app_main(void) {
     ESP_LOGI(TAG, "ESP MIDI v2.0");
 
+    // setup the midi router, by default all usb input goes to the controller
+    const router_config_t router_config = {
+        .callbacks = {
+            .sink = router_sink_callback
+        }
+    };
+    ESP_ERROR_CHECK(router_init(&router, &router_config));
+    ESP_ERROR_CHECK(router_add_route(&router,
+        &ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, ROUTER_INDEX_ANY), ROUTER_SINK(CONTROLLER, 0))));
+
+    memset(track_sounding_notes, 0xFF, sizeof(track_sounding_notes));
+    memset(cv_notes, 0xFF, sizeof(cv_notes));
+
     // setup the file store
     //ESP_ERROR_CHECK(store_init());
 
@@ -224,6 +440,14 @@ void app_main(void) {
         ESP_ERROR_CHECK(usb_init(&usb_midi.driver_config));
     #endif
 
+    // setup the non-volatile storage, holding e.g. the output calibration
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+
     // setup the output unit
     uint8_t num_port_configs = sizeof(output_port_configs) / sizeof(output_port_configs[0]);
     uint8_t num_ports = OUTPUT_COLUMNS * OUTPUT_ROWS;
@@ -236,9 +460,51 @@ void app_main(void) {
     const output_config_t output_config = {
         .num_columns = OUTPUT_COLUMNS,
         .num_rows = OUTPUT_ROWS,
-        .port_configs = output_port_configs
+        .port_configs = output_port_configs,
+        .update_interval_us = CONFIG_OUTPUT_UPDATE_INTERVAL_US,
+        .backend = &output_backend_ledc
     };
     ESP_ERROR_CHECK(output_init(&output, &output_config));
+    ESP_ERROR_CHECK(output_calibration_load(&output));
+    ESP_ERROR_CHECK(output_pulse_init(&output));
+    for (uint8_t column = 0; column < OUTPUT_COLUMNS; column++) {
+        #ifdef CONFIG_ESPSEQ_PITCH_GLIDE_EXPONENTIAL
+            ESP_ERROR_CHECK(output_set_glide(&output, column, OUTPUT_ROW_PITCH, CONFIG_ESPSEQ_PITCH_GLIDE_MS * 1000,
+                OUTPUT_GLIDE_EXPONENTIAL));
+        #else
+            ESP_ERROR_CHECK(output_set_glide(&output, column, OUTPUT_ROW_PITCH, CONFIG_ESPSEQ_PITCH_GLIDE_MS * 1000,
+                OUTPUT_GLIDE_LINEAR));
+        #endif
+    }
+
+    // route the track voices to the output ports, applied before the sequencer ticks
+    ESP_ERROR_CHECK(output_routing_init(&output_routing, &output));
+    ESP_ERROR_CHECK(output_routing_set_routes(&output_routing, output_routes,
+        sizeof(output_routes) / sizeof(output_routes[0])));
+    ESP_ERROR_CHECK(output_transaction_begin(&output, &tick_outputs));
+    ESP_ERROR_CHECK(output_routing_apply_pending(&output_routing, &tick_outputs));
+    ESP_ERROR_CHECK(output_transaction_commit(&tick_outputs));
+
+    // setup the modulation generators, rendered to the analog outputs
+    modulation_config_t modulation_config = MODULATION_DEFAULT_CONFIG(&output);
+    modulation_config.bpm = bpm;
+    ESP_ERROR_CHECK(modulation_init(&modulation, &modulation_config));
+    #ifdef CONFIG_ESPSEQ_VELOCITY_ENVELOPE
+        for (uint8_t track = 0; track < SEQUENCER_NUM_TRACKS; track++) {
+            uint8_t envelope_id;
+            const modulation_slot_config_t envelope_config = {
+                .generator = {
+                    .type = MODULATION_ADSR,
+                    .adsr = { .attack_ms = 5, .decay_ms = 300, .release_ms = 400, .sustain = MODULATION_SAMPLE_MAX / 2 }
+                },
+                .port = output_port_get(&output, track, OUTPUT_ROW_VELOCITY),
+                .min_mv = 0,
+                .max_mv = 5000,
+                .gate_track = track
+            };
+            ESP_ERROR_CHECK(modulation_add(&modulation, &envelope_config, &envelope_id));
+        }
+    #endif
     
     // setup the sequencer
     const sequencer_config_t sequencer_config = {
@@ -249,6 +515,29 @@ void app_main(void) {
     };
     ESP_ERROR_CHECK(sequencer_init(&sequencer, &sequencer_config));
 
+    // setup midi clock output or sync to the received clock
+    const midi_clock_config_t midi_clock_config = {
+        .callbacks = {
+            .send = midi_clock_send_callback
+        },
+        .sequencer = &sequencer,
+        #if defined(CONFIG_ESPSEQ_MIDI_CLOCK_MASTER)
+            .mode = MIDI_CLOCK_MASTER
+        #elif defined(CONFIG_ESPSEQ_MIDI_CLOCK_SLAVE)
+            .mode = MIDI_CLOCK_SLAVE
+        #else
+            .mode = MIDI_CLOCK_OFF
+        #endif
+    };
+    ESP_ERROR_CHECK(midi_clock_init(&midi_clock, &midi_clock_config));
+
+    // received clock and transport messages drive the sequencer
+    #ifdef CONFIG_ESPSEQ_MIDI_CLOCK_SLAVE
+        router_route_t clock_route = ROUTER_DEFAULT_ROUTE(ROUTER_SOURCE(USB, ROUTER_INDEX_ANY), ROUTER_SINK(CLOCK, 0));
+        clock_route.channel_mask = ROUTER_CHANNEL_MASK_SYSTEM;
+        ESP_ERROR_CHECK(router_add_route(&router, &clock_route));
+    #endif
+
     // setup a test sequence
     track_t *track = &sequencer.tracks[0];
     //ESP_ERROR_CHECK(track_set_active_pattern(track, 0));
@@ -256,7 +545,7 @@ void app_main(void) {
     pattern_t *pattern = track_get_active_pattern(track);
 
     uint16_t testseq_length = sizeof(testseq_notes) / sizeof(testseq_notes[0]);
-    ESP_ERROR_CHECK(pattern_resize(pattern, testseq_length));
+    ESP_ERROR_CHECK(track_resize_pattern(track, track->active_pattern, testseq_length));
 
     for (int i = 0; i < pattern->config.step_length; i++) {
         pattern_step_t *step = &pattern->steps[i];
@@ -282,6 +571,11 @@ void app_main(void) {
         }
     #endif
 
+    // periodically print the input latency histograms
+    #ifdef CONFIG_ESPSEQ_DUMP_LATENCY
+        xTaskCreate(latency_dump_task, "latency_dump", 2048, NULL, 1, NULL);
+    #endif
+
     // start the sequencer
     //ESP_ERROR_CHECK(sequencer_play(&sequencer));
 
@@ -0,0 +1,10 @@
+#pragma once
+
+// host stand-in for the esp-idf gpio driver types
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+
+#define GPIO_NUM_MAX 47
@@ -0,0 +1,15 @@
+#pragma once
+
+// host stand-in for the esp-idf ledc driver types, the tests drive the
+// outputs through their own backend
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+typedef int ledc_channel_t;
+typedef int ledc_mode_t;
+
+#define LEDC_CHANNEL_MAX 8
+#define LEDC_LOW_SPEED_MODE 0
+#define LEDC_TIMER_10_BIT 10
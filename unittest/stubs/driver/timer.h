@@ -0,0 +1,35 @@
+#pragma once
+
+// host stand-in for the esp-idf timer group driver, the tests simulate the
+// pulse timer in output_sim
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef enum { TIMER_GROUP_0, TIMER_GROUP_1 } timer_group_t;
+typedef enum { TIMER_0, TIMER_1 } timer_idx_t;
+typedef enum { TIMER_COUNT_DOWN, TIMER_COUNT_UP } timer_count_dir_t;
+typedef enum { TIMER_PAUSE, TIMER_START } timer_start_t;
+typedef enum { TIMER_ALARM_DIS, TIMER_ALARM_EN } timer_alarm_t;
+typedef enum { TIMER_AUTORELOAD_DIS, TIMER_AUTORELOAD_EN } timer_autoreload_t;
+typedef enum { TIMER_INTR_LEVEL } timer_intr_mode_t;
+
+typedef struct {
+    timer_alarm_t alarm_en;
+    timer_start_t counter_en;
+    timer_intr_mode_t intr_type;
+    timer_count_dir_t counter_dir;
+    timer_autoreload_t auto_reload;
+    uint32_t divider;
+} timer_config_t;
+
+typedef bool (*timer_isr_t)(void *arg);
+
+esp_err_t timer_init(timer_group_t group, timer_idx_t timer, const timer_config_t *config);
+esp_err_t timer_set_counter_value(timer_group_t group, timer_idx_t timer, uint64_t value);
+esp_err_t timer_isr_callback_add(timer_group_t group, timer_idx_t timer, timer_isr_t isr, void *arg, int flags);
+esp_err_t timer_start(timer_group_t group, timer_idx_t timer);
+uint64_t timer_group_get_counter_value_in_isr(timer_group_t group, timer_idx_t timer);
+void timer_group_set_alarm_value_in_isr(timer_group_t group, timer_idx_t timer, uint64_t alarm);
+void timer_group_enable_alarm_in_isr(timer_group_t group, timer_idx_t timer);
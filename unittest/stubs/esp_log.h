@@ -0,0 +1,9 @@
+#pragma once
+
+// host stand-in that drops esp-idf log output
+
+#define ESP_LOGE(tag, fmt, ...) ((void) (tag))
+#define ESP_LOGW(tag, fmt, ...) ((void) (tag))
+#define ESP_LOGI(tag, fmt, ...) ((void) (tag))
+#define ESP_LOGD(tag, fmt, ...) ((void) (tag))
+#define ESP_LOGV(tag, fmt, ...) ((void) (tag))
@@ -0,0 +1,5 @@
+#pragma once
+
+// host stand-in for the soc constants the components use
+
+#define APB_CLK_FREQ 80000000